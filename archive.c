@@ -0,0 +1,190 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef SODA_ZSTD
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "panic.h"
+
+/* code */
+
+static void validateArchive(Archive *archive, const char *path) {
+	/* Panics if the mapped file isn't an archive this build can read */
+	if (archive->size < sizeof(ArchiveHeader))
+		Panic("OpenArchive: %s is too small to be an archive\n", path);
+
+	const ArchiveHeader *header = archive->header;
+
+	if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0)
+		Panic("OpenArchive: %s is not an archive\n", path);
+
+	if (header->version != ARCHIVE_VERSION)
+		Panic("OpenArchive: %s has version %u, expected %u\n", path, header->version, ARCHIVE_VERSION);
+
+	size_t index_end = sizeof(ArchiveHeader) + (size_t) header->count * sizeof(ArchiveEntry);
+	if (index_end > archive->size)
+		Panic("OpenArchive: %s has a truncated index\n", path);
+
+	uint32_t i;
+	for (i = 0; i < header->count; i++) {
+		const ArchiveEntry *entry = &archive->entries[i];
+
+		/* offset is checked first so size - offset can't wrap */
+		bool outside = entry->offset > archive->size || entry->stored > archive->size - entry->offset;
+
+		if (entry->offset < index_end || entry->offset % ARCHIVE_ALIGNMENT || outside)
+			Panic("OpenArchive: %s has an out of bounds blob '%.*s'\n", path, ARCHIVE_NAME_SIZE, entry->name);
+
+		if (entry->compression == ARCHIVE_STORED && entry->stored == entry->size) continue;
+
+#ifdef SODA_ZSTD
+		if (entry->compression == ARCHIVE_ZSTD) continue;
+#else
+		if (entry->compression == ARCHIVE_ZSTD)
+			Panic("OpenArchive: %s has compressed blobs, this build was made without ZSTD=1\n", path);
+#endif
+
+		Panic("OpenArchive: %s has an unreadable blob '%.*s'\n", path, ARCHIVE_NAME_SIZE, entry->name);
+	}
+}
+
+static void adviseRange(const void *data, size_t size, int advice) {
+	/* Gives the kernel advice about the pages holding size bytes at data. It's
+	only advice, so failures are ignored */
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) data & ~(page - 1);
+	uintptr_t end = (uintptr_t) data + size;
+
+	if (size) madvise((void *) start, end - start, advice);
+}
+
+Archive OpenArchive(const char *path) {
+	/* Maps the archive at path into memory, blobs are read from the mapping so
+	there are no per-blob opens or copies */
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) Panic("OpenArchive: unable to open %s\n", path);
+
+	struct stat status;
+	if (fstat(fd, &status) != 0) Panic("OpenArchive: unable to stat %s\n", path);
+
+	void *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) Panic("OpenArchive: unable to mmap %s\n", path);
+
+	Archive archive = {
+		.data = data,
+		.size = status.st_size,
+		.header = data,
+		.entries = (const ArchiveEntry *) ((const char *) data + sizeof(ArchiveHeader)),
+	};
+
+	/* The index is read up front in one go rather than faulted a page at a
+	time as the search walks it */
+	if (archive.size >= sizeof(ArchiveHeader)) {
+		size_t index_size = sizeof(ArchiveHeader) + (size_t) archive.header->count * sizeof(ArchiveEntry);
+		adviseRange(data, (index_size < archive.size) ? index_size : archive.size, MADV_WILLNEED);
+	}
+
+	validateArchive(&archive, path);
+
+	archive.decompressed = calloc(archive.header->count + 1, sizeof(void *));
+	if (!archive.decompressed) Panic("OpenArchive: unable to allocate %s's index\n", path);
+
+	return archive;
+}
+
+void CloseArchive(Archive *archive) {
+	/* Unmaps the archive, any ArchiveBlobs from it are no longer valid */
+	if (archive->decompressed) {
+		uint32_t i;
+		for (i = 0; i < archive->header->count; i++) free(archive->decompressed[i]);
+
+		free(archive->decompressed);
+	}
+
+	if (archive->data) munmap(archive->data, archive->size);
+
+	*archive = (Archive) {};
+}
+
+static int compareEntryName(const void *name, const void *entry) {
+	/* bsearch comparator for a name and an ArchiveEntry */
+	return strncmp(name, ((const ArchiveEntry *) entry)->name, ARCHIVE_NAME_SIZE);
+}
+
+const ArchiveEntry *FindArchiveEntry(Archive *archive, const char *name) {
+	/* Returns the entry of the blob called name, or NULL */
+	return bsearch(name, archive->entries, archive->header->count, sizeof(ArchiveEntry), compareEntryName);
+}
+
+ArchiveBlob FindArchiveBlob(Archive *archive, const char *name) {
+	/* Returns the blob called name. Stored blobs are viewed in the mapping,
+	compressed ones are decompressed the first time they're found and kept
+	until the archive is closed */
+	const ArchiveEntry *entry = FindArchiveEntry(archive, name);
+
+	if (!entry) return (ArchiveBlob) {};
+
+	if (entry->compression == ARCHIVE_STORED) {
+		return (ArchiveBlob) {
+			.data = (const char *) archive->data + entry->offset,
+			.size = entry->size,
+		};
+	}
+
+	void **slot = &archive->decompressed[entry - archive->entries];
+	void *contents = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+	/* The shader reloader finds blobs on its own thread, so racing finds each
+	decompress and the first to publish its copy wins */
+	if (!contents) {
+		void *copy = malloc(entry->size);
+		if (!copy) Panic("FindArchiveBlob: unable to allocate %llu bytes for '%s'\n", (unsigned long long) entry->size, name);
+
+		ReadArchiveEntry(archive, entry, copy);
+
+		if (__atomic_compare_exchange_n(slot, &contents, copy, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) contents = copy;
+		else free(copy);
+	}
+
+	return (ArchiveBlob) {
+		.data = contents,
+		.size = entry->size,
+	};
+}
+
+void PrefetchArchiveEntry(Archive *archive, const ArchiveEntry *entry) {
+	/* Starts reading the blob of entry in the background. Prefetching a batch
+	of blobs before reading any lets the kernel order and merge their reads,
+	which matters most on spinning disks and network mounts */
+	adviseRange((const char *) archive->data + entry->offset, entry->stored, MADV_WILLNEED);
+}
+
+void ReadArchiveEntry(Archive *archive, const ArchiveEntry *entry, void *destination) {
+	/* Writes the entry->size bytes of the blob of entry to destination, which
+	may be mapped device memory. The blob is read straight from the mapping */
+	const void *source = (const char *) archive->data + entry->offset;
+
+	if (entry->compression == ARCHIVE_STORED) {
+		memcpy(destination, source, entry->size);
+		return;
+	}
+
+#ifdef SODA_ZSTD
+	size_t size = ZSTD_decompress(destination, entry->size, source, entry->stored);
+
+	if (ZSTD_isError(size) || size != entry->size)
+		Panic("ReadArchiveEntry: unable to decompress '%.*s'\n", ARCHIVE_NAME_SIZE, entry->name);
+#else
+	Panic("ReadArchiveEntry: '%.*s' is compressed, this build was made without ZSTD=1\n", ARCHIVE_NAME_SIZE, entry->name);
+#endif
+}
@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "panic.h"
+
+/* constants */
+
+#define NO_FIT UINT32_MAX
+
+/* code */
+
+Atlas CreateAtlas(uint32_t size) {
+	/* Returns an Atlas without pages, they're added as rectangles are packed */
+	return (Atlas) {
+		.size = size,
+	};
+}
+
+void DestroyAtlas(Atlas *atlas) {
+	/* Frees the skylines of every page */
+	uint32_t i;
+	for (i = 0; i < atlas->count; i++)
+		free(atlas->pages[i].nodes);
+
+	free(atlas->pages);
+	*atlas = (Atlas) {};
+}
+
+static void addPage(Atlas *atlas) {
+	/* Adds an empty page whose skyline is the bottom edge */
+	if (atlas->count == atlas->capacity) {
+		uint32_t capacity = (atlas->capacity) ? atlas->capacity * 2 : 4;
+
+		AtlasPage *pages = realloc(atlas->pages, capacity * sizeof(AtlasPage));
+		if (!pages) Panic("addPage: unable to allocate %u AtlasPages\n", capacity);
+
+		atlas->pages = pages;
+		atlas->capacity = capacity;
+	}
+
+	/* An insert briefly holds one node more than the columns of the page */
+	AtlasPage *page = &atlas->pages[atlas->count++];
+	page->nodes = malloc((atlas->size + 1) * sizeof(AtlasNode));
+	if (!page->nodes) Panic("addPage: unable to allocate a skyline of %u\n", atlas->size);
+
+	page->count = 1;
+	page->nodes[0] = (AtlasNode) {.x = 0, .y = 0, .width = atlas->size};
+}
+
+static uint32_t fitSkyline(Atlas *atlas, AtlasPage *page, uint32_t index, uint32_t width, uint32_t height) {
+	/* Returns the lowest y that a rectangle whose left edge is at node index
+	can rest on, or NO_FIT if it would leave the page */
+	uint32_t x = page->nodes[index].x;
+	if (x + width > atlas->size) return NO_FIT;
+
+	uint32_t y = 0, remaining = width;
+	while (remaining > 0) {
+		AtlasNode *node = &page->nodes[index++];
+		if (node->y > y) y = node->y;
+		if (y + height > atlas->size) return NO_FIT;
+
+		if (node->width >= remaining) break;
+		remaining -= node->width;
+	}
+
+	return y;
+}
+
+static void raiseSkyline(AtlasPage *page, uint32_t index, AtlasNode node) {
+	/* Inserts node at index, then trims the nodes it covers and merges
+	neighbours of the same height */
+	memmove(&page->nodes[index + 1], &page->nodes[index], (page->count - index) * sizeof(AtlasNode));
+	page->nodes[index] = node;
+	page->count++;
+
+	uint32_t i = index + 1;
+	while (i < page->count) {
+		AtlasNode *previous = &page->nodes[i - 1], *current = &page->nodes[i];
+		uint32_t end = previous->x + previous->width;
+
+		if (current->x >= end) break;
+
+		uint32_t overlap = end - current->x;
+		if (current->width > overlap) {
+			current->x += overlap;
+			current->width -= overlap;
+			break;
+		}
+
+		memmove(current, current + 1, (page->count - i - 1) * sizeof(AtlasNode));
+		page->count--;
+	}
+
+	i = 0;
+	while (i + 1 < page->count) {
+		AtlasNode *current = &page->nodes[i], *next = &page->nodes[i + 1];
+
+		if (current->y != next->y) {
+			i++;
+			continue;
+		}
+
+		current->width += next->width;
+		memmove(next, next + 1, (page->count - i - 2) * sizeof(AtlasNode));
+		page->count--;
+	}
+}
+
+static bool packPage(Atlas *atlas, uint32_t p, uint32_t width, uint32_t height, AtlasRect *rect) {
+	/* Places the rectangle where its top edge is lowest, preferring the
+	narrowest node so wide gaps are kept for wide rectangles */
+	AtlasPage *page = &atlas->pages[p];
+
+	uint32_t best = NO_FIT, best_top = NO_FIT, best_width = NO_FIT, best_y = 0;
+
+	uint32_t i;
+	for (i = 0; i < page->count; i++) {
+		uint32_t y = fitSkyline(atlas, page, i, width, height);
+		if (y == NO_FIT) continue;
+
+		uint32_t top = y + height;
+		if (top < best_top || (top == best_top && page->nodes[i].width < best_width)) {
+			best = i;
+			best_top = top;
+			best_width = page->nodes[i].width;
+			best_y = y;
+		}
+	}
+
+	if (best == NO_FIT) return false;
+
+	*rect = (AtlasRect) {
+		.page = p,
+		.x = page->nodes[best].x,
+		.y = best_y,
+		.width = width,
+		.height = height,
+	};
+
+	raiseSkyline(page, best, (AtlasNode) {.x = rect->x, .y = best_top, .width = width});
+	return true;
+}
+
+bool PackAtlas(Atlas *atlas, uint32_t width, uint32_t height, AtlasRect *rect) {
+	/* Packs a rectangle into the first page with room for it, adding a page
+	if none has. Returns false if the rectangle is empty or larger than a
+	page */
+	if (!width || !height || width > atlas->size || height > atlas->size)
+		return false;
+
+	uint32_t i;
+	for (i = 0; i < atlas->count; i++)
+		if (packPage(atlas, i, width, height, rect)) return true;
+
+	addPage(atlas);
+	return packPage(atlas, atlas->count - 1, width, height, rect);
+}
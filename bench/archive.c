@@ -0,0 +1,213 @@
+/* bench-archive stages blobs from archives into a staging buffer with
+StageArchiveBlobs. It writes FILES source files of awkward sizes, half of them
+compressible, and packs them with pack, which SODA_PACK names if it isn't
+./pack. Staged bytes are checked against the files before timing. Builds made
+with ZSTD=1 also pack and check them with -z:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-archive
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "bench.h"
+#include "buffers.h"
+#include "panic.h"
+#include "renderer.h"
+
+/* constants */
+
+#define FILES 8
+#define PATH_SIZE 256
+
+/* Sizes are off the page and staging alignments so the padding is checked */
+static const size_t FILE_SIZES[FILES] = {0, 1, 15, 4097, 65536, (1 << 20) + 3, (3 << 20) + 5, 4 << 20};
+
+/* types */
+
+typedef struct {
+	/* Source is the generated files and their contents */
+	char directory[PATH_SIZE];
+	char paths[FILES][PATH_SIZE];
+	const char *names[FILES];
+	void *contents[FILES];
+} Source;
+
+typedef struct {
+	/* Stage is an archive staged by a benchmark and the staging it made */
+	RendererDevice *device;
+	Archive archive;
+	const char *const *names;
+	VkDeviceSize offsets[FILES];
+	Buffer staging;
+} Stage;
+
+/* code */
+
+static void fillFile(void *data, size_t size, uint32_t index) {
+	/* Fills even files with slowly changing bytes zstd can compress and odd
+	files with xorshift noise it can't */
+	uint8_t *bytes = data;
+	uint32_t state = 0x5eed + index;
+
+	size_t i;
+	for (i = 0; i < size; i++) {
+		if (index % 2 == 0) {
+			bytes[i] = (uint8_t) (i / 64 + i % 7);
+			continue;
+		}
+
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		bytes[i] = (uint8_t) (state >> 11);
+	}
+}
+
+static void createSource(Source *source) {
+	/* Writes the source files to a new temporary directory, names point into
+	source's paths so it's filled in place */
+	*source = (Source) {};
+	strcpy(source->directory, "/tmp/soda-bench-archive-XXXXXX");
+
+	if (!mkdtemp(source->directory)) Panic("bench-archive: unable to create a temporary directory\n");
+
+	uint32_t i;
+	for (i = 0; i < FILES; i++) {
+		snprintf(source->paths[i], PATH_SIZE, "%s/blob%u.bin", source->directory, i);
+		source->names[i] = strrchr(source->paths[i], '/') + 1;
+
+		source->contents[i] = malloc(FILE_SIZES[i] + 1);
+		if (!source->contents[i]) Panic("bench-archive: unable to allocate %zu bytes\n", FILE_SIZES[i]);
+
+		fillFile(source->contents[i], FILE_SIZES[i], i);
+
+		FILE *file = fopen(source->paths[i], "wb");
+		if (!file) Panic("bench-archive: unable to create %s\n", source->paths[i]);
+
+		if (fwrite(source->contents[i], 1, FILE_SIZES[i], file) != FILE_SIZES[i] || fclose(file) != 0)
+			Panic("bench-archive: unable to write %s\n", source->paths[i]);
+	}
+}
+
+static void destroySource(Source *source) {
+	/* Removes the source files and their directory */
+	uint32_t i;
+	for (i = 0; i < FILES; i++) {
+		unlink(source->paths[i]);
+		free(source->contents[i]);
+	}
+
+	rmdir(source->directory);
+}
+
+static Archive packSource(Source *source, const char *name, const char *flags) {
+	/* Packs the source files into an archive called name beside them and
+	opens it */
+	const char *pack = getenv("SODA_PACK");
+	if (!pack) pack = "./pack";
+
+	char path[2 * PATH_SIZE];
+	snprintf(path, sizeof(path), "%s/%s", source->directory, name);
+
+	char command[FILES * PATH_SIZE + 2 * PATH_SIZE];
+	int length = snprintf(command, sizeof(command), "%s %s %s", pack, flags, path);
+
+	uint32_t i;
+	for (i = 0; i < FILES; i++)
+		length += snprintf(command + length, sizeof(command) - length, " %s", source->paths[i]);
+
+	/* pack prints a summary, the table so far has to come before it */
+	fflush(stdout);
+
+	if (system(command) != 0) Panic("bench-archive: '%s' failed\n", command);
+
+	Archive archive = OpenArchive(path);
+	unlink(path);
+
+	return archive;
+}
+
+static uint32_t checkStage(Stage *stage, Source *source) {
+	/* Stages the archive's blobs and panics unless each one matches its file,
+	returns the number of compressed blobs */
+	stage->staging = StageArchiveBlobs(stage->device, &stage->archive, stage->names, FILES, stage->offsets);
+
+	uint32_t i, compressed = 0;
+	for (i = 0; i < FILES; i++) {
+		const ArchiveEntry *entry = FindArchiveEntry(&stage->archive, source->names[i]);
+
+		if (entry->compression == ARCHIVE_ZSTD) compressed++;
+
+		if (stage->offsets[i] % STAGING_ALIGNMENT || stage->offsets[i] + FILE_SIZES[i] > stage->staging.size)
+			Panic("bench-archive: '%s' was staged out of bounds at %llu\n", source->names[i], (unsigned long long) stage->offsets[i]);
+
+		if (memcmp((const char *) stage->staging.mapped + stage->offsets[i], source->contents[i], FILE_SIZES[i]) != 0)
+			Panic("bench-archive: '%s' was staged with the wrong bytes\n", source->names[i]);
+	}
+
+	DestroyBuffer(stage->device, &stage->staging);
+
+	return compressed;
+}
+
+static void stageBlobs(void *data) {
+	Stage *stage = data;
+	stage->staging = StageArchiveBlobs(stage->device, &stage->archive, stage->names, FILES, stage->offsets);
+}
+
+static void destroyStaging(void *data) {
+	Stage *stage = data;
+	DestroyBuffer(stage->device, &stage->staging);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+
+	Source source;
+	createSource(&source);
+
+	Stage stored = {
+		.device = &device,
+		.archive = packSource(&source, "stored.pack", ""),
+		.names = source.names,
+	};
+
+	if (checkStage(&stored, &source) != 0) Panic("bench-archive: pack compressed blobs without -z\n");
+
+	RunBench(&bench, "archive_stage_stored", stageBlobs, destroyStaging, &stored);
+	CloseArchive(&stored.archive);
+
+#ifdef SODA_ZSTD
+	Stage compressed = {
+		.device = &device,
+		.archive = packSource(&source, "compressed.pack", "-z"),
+		.names = source.names,
+	};
+
+	/* The noise and the smallest blobs stay stored, the rest shrink */
+	uint32_t count = checkStage(&compressed, &source);
+	if (!count) Panic("bench-archive: pack -z didn't compress any blobs\n");
+
+	RunBench(&bench, "archive_stage_zstd", stageBlobs, destroyStaging, &compressed);
+	CloseArchive(&compressed.archive);
+
+	printf("%u blobs staged, %u of them compressed\n", FILES, count);
+#else
+	printf("%u blobs staged, build with ZSTD=1 to stage compressed ones\n", FILES);
+#endif
+
+	destroySource(&source);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
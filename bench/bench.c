@@ -0,0 +1,238 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "panic.h"
+
+/* code */
+
+static void usage(const char *program) {
+	/* Prints the options and exits */
+	fprintf(stderr,
+		"usage: %s [--iterations N] [--filter NAME] [--json PATH] [--append PATH] [--baseline PATH] [--tolerance FRACTION]\n",
+		program);
+
+	exit(2);
+}
+
+Bench CreateBench(int argc, char *argv[]) {
+	/* Returns a Bench configured from the command line */
+	Bench bench = {
+		.iterations = BENCH_ITERATIONS,
+		.tolerance = BENCH_TOLERANCE,
+	};
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		const char *option = argv[i];
+		if (i + 1 == argc) usage(argv[0]);
+
+		const char *value = argv[++i];
+
+		if (strcmp(option, "--iterations") == 0) bench.iterations = (uint32_t) strtoul(value, NULL, 10);
+		else if (strcmp(option, "--filter") == 0) bench.filter = value;
+		else if (strcmp(option, "--json") == 0) bench.json = value;
+		else if (strcmp(option, "--append") == 0) bench.json = value, bench.append = true;
+		else if (strcmp(option, "--baseline") == 0) bench.baseline = value;
+		else if (strcmp(option, "--tolerance") == 0) bench.tolerance = strtod(value, NULL);
+		else usage(argv[0]);
+	}
+
+	if (!bench.iterations) usage(argv[0]);
+
+	printf("%-32s %8s %14s %14s %14s\n", "benchmark", "n", "median us", "p99 us", "baseline");
+
+	return bench;
+}
+
+static uint64_t now() {
+	/* Returns a monotonic timestamp in nanoseconds */
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t) time.tv_sec * 1000000000ull + (uint64_t) time.tv_nsec;
+}
+
+static int compareSample(const void *a, const void *b) {
+	/* qsort comparator for ascending samples */
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double findBaseline(const char *path, const char *name) {
+	/* Returns the median_ns recorded for name in the baseline JSON file, or 0.
+	The file is one written by FinishBench, so it isn't parsed in general */
+	FILE *file = fopen(path, "r");
+	if (!file) return 0;
+
+	char key[BENCH_NAME_SIZE + 16];
+	snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+
+	char line[512];
+	double median = 0;
+	bool found = false;
+
+	while (fgets(line, sizeof(line), file)) {
+		if (!found) {
+			found = strstr(line, key) != NULL;
+			continue;
+		}
+
+		const char *value = strstr(line, "\"median_ns\":");
+		if (value) {
+			median = strtod(value + strlen("\"median_ns\":"), NULL);
+			break;
+		}
+
+		if (strstr(line, "\"name\":")) break;
+	}
+
+	fclose(file);
+
+	return median;
+}
+
+void RunBench(Bench *bench, const char *name, BenchMethod measure, BenchMethod after, void *data) {
+	/* Times iterations of measure, running after untimed between them. The
+	first call is a warm up and isn't recorded */
+	if (bench->filter && !strstr(name, bench->filter)) return;
+
+	if (bench->count == BENCH_MAX_RESULTS)
+		Panic("RunBench: more than %u benchmarks\n", BENCH_MAX_RESULTS);
+
+	uint32_t n = bench->iterations;
+	double *samples = calloc(n, sizeof(double));
+	if (!samples) Panic("RunBench: unable to allocate samples\n");
+
+	measure(data);
+	if (after) after(data);
+
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		uint64_t start = now();
+		measure(data);
+		samples[i] = (double) (now() - start);
+
+		if (after) after(data);
+	}
+
+	qsort(samples, n, sizeof(double), compareSample);
+
+	BenchResult *result = &bench->results[bench->count++];
+	*result = (BenchResult) {
+		.iterations = n,
+		.median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2,
+		.p99 = samples[(uint32_t) ceil(n * 0.99) - 1],
+		.min = samples[0],
+		.max = samples[n - 1],
+	};
+
+	snprintf(result->name, BENCH_NAME_SIZE, "%s", name);
+
+	for (i = 0; i < n; i++) result->mean += samples[i] / n;
+
+	if (bench->baseline) result->baseline = findBaseline(bench->baseline, name);
+
+	result->regressed = result->baseline && result->median > result->baseline * (1 + bench->tolerance);
+	if (result->regressed) bench->regressions += 1;
+
+	char baseline[32] = "-";
+	if (result->baseline)
+		snprintf(baseline, sizeof(baseline), "%+.1f%%%s", (result->median / result->baseline - 1) * 100, (result->regressed) ? " !" : "");
+
+	printf("%-32s %8u %14.2f %14.2f %14s\n", name, n, result->median / 1e3, result->p99 / 1e3, baseline);
+	fflush(stdout);
+
+	free(samples);
+}
+
+static char *readReport(const char *path, char **entries, size_t *size, uint32_t *regressions) {
+	/* Reads the report at path written by writeJson, and returns it so that
+	entries can point at its benchmarks. A missing report has none */
+	*entries = NULL;
+	*size = 0;
+	*regressions = 0;
+
+	FILE *file = fopen(path, "r");
+	if (!file) return NULL;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	rewind(file);
+
+	char *report = calloc(length + 1, 1);
+	if (!report || fread(report, 1, length, file) != (size_t) length)
+		Panic("readReport: unable to read %s\n", path);
+
+	fclose(file);
+
+	char *start = strstr(report, "\"benchmarks\": [\n");
+	char *end = (start) ? strstr(start, "\t],\n\t\"regressions\": ") : NULL;
+	if (!end) Panic("readReport: %s isn't a bench report\n", path);
+
+	*entries = start + strlen("\"benchmarks\": [\n");
+	*size = end - *entries;
+	*regressions = (uint32_t) strtoul(end + strlen("\t],\n\t\"regressions\": "), NULL, 10);
+
+	return report;
+}
+
+static void writeJson(Bench *bench) {
+	/* Writes the results to bench->json, one field per line so that
+	findBaseline can read it back. Appending keeps the benchmarks already in
+	it, so several programs can share a report */
+	char *entries = NULL;
+	size_t size = 0;
+	uint32_t regressions = 0;
+	char *report = (bench->append) ? readReport(bench->json, &entries, &size, &regressions) : NULL;
+
+	FILE *file = fopen(bench->json, "w");
+	if (!file) Panic("writeJson: unable to open %s\n", bench->json);
+
+	fprintf(file, "{\n\t\"benchmarks\": [\n");
+
+	/* The last kept benchmark needs a comma if more follow it */
+	if (size) {
+		fwrite(entries, 1, size - 1, file);
+		fprintf(file, "%s\n", (bench->count) ? "," : "");
+	}
+
+	free(report);
+
+	uint32_t i;
+	for (i = 0; i < bench->count; i++) {
+		BenchResult *result = &bench->results[i];
+
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", result->name);
+		fprintf(file, "\t\t\t\"iterations\": %u,\n", result->iterations);
+		fprintf(file, "\t\t\t\"median_ns\": %.0f,\n", result->median);
+		fprintf(file, "\t\t\t\"p99_ns\": %.0f,\n", result->p99);
+		fprintf(file, "\t\t\t\"min_ns\": %.0f,\n", result->min);
+		fprintf(file, "\t\t\t\"max_ns\": %.0f,\n", result->max);
+		fprintf(file, "\t\t\t\"mean_ns\": %.0f,\n", result->mean);
+		fprintf(file, "\t\t\t\"baseline_median_ns\": %.0f,\n", result->baseline);
+		fprintf(file, "\t\t\t\"regressed\": %s\n", (result->regressed) ? "true" : "false");
+		fprintf(file, "\t\t}%s\n", (i + 1 < bench->count) ? "," : "");
+	}
+
+	fprintf(file, "\t],\n\t\"regressions\": %u\n}\n", regressions + bench->regressions);
+	fclose(file);
+}
+
+int FinishBench(Bench *bench) {
+	/* Writes the JSON report and returns the exit status, which is 1 if any
+	benchmark regressed against the baseline */
+	if (bench->json) writeJson(bench);
+
+	if (bench->regressions)
+		printf("%u of %u benchmarks regressed by more than %.0f%%\n", bench->regressions, bench->count, bench->tolerance * 100);
+
+	return (bench->regressions) ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef _SODA_BENCH_H
+#define _SODA_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* constants */
+
+#define BENCH_MAX_RESULTS 64
+#define BENCH_NAME_SIZE 48
+
+/* Iterations when --iterations isn't given */
+#define BENCH_ITERATIONS 100
+
+/* A median more than this fraction over the baseline is a regression */
+#define BENCH_TOLERANCE 0.10
+
+/* types */
+
+typedef void (*BenchMethod)(void *);
+/* function pointer type for the code being measured, and for the untimed
+cleanup that runs after each iteration */
+
+typedef struct {
+	/* BenchResult summarises the samples of a benchmark in nanoseconds.
+	baseline is the median from the baseline file, or 0 if it had none */
+	char name[BENCH_NAME_SIZE];
+	uint32_t iterations;
+	double median, p99, min, max, mean, baseline;
+	bool regressed;
+} BenchResult;
+
+typedef struct {
+	/* Bench runs benchmarks and reports them as a table on stdout, and as JSON
+	if a path was given, which append adds to rather than replaces. Results
+	are compared to a baseline JSON file written by an earlier run */
+	uint32_t iterations;
+	double tolerance;
+	const char *json, *baseline, *filter;
+	bool append;
+
+	uint32_t count, regressions;
+	BenchResult results[BENCH_MAX_RESULTS];
+} Bench;
+
+/* methods */
+
+Bench CreateBench(int argc, char *argv[]);
+void RunBench(Bench *, const char *name, BenchMethod measure, BenchMethod after, void *data);
+int FinishBench(Bench *);
+
+#endif
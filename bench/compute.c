@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "bench.h"
+#include "buffers.h"
+#include "compute.h"
+#include "panic.h"
+#include "renderer.h"
+
+/* bench-compute measures dispatch throughput of Compute with a saxpy kernel on
+a headless renderer. compute_record times recording DISPATCHES dispatches, with
+the batches that fill up submitted on the way, and compute_saxpy the same
+dispatches through to WaitCompute. Each run's result is read back through the
+host mapping and checked. It runs on any compute capable ICD including
+lavapipe, SODA_SAXPY names a saxpy.comp.spv to use instead of the archive's:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-compute
+*/
+
+/* constants */
+
+#define ELEMENTS (1 << 18)
+#define WORKGROUP_SIZE 256
+#define DISPATCHES (2 * COMPUTE_BATCH_DISPATCHES)
+
+/* types */
+
+typedef struct {
+	/* Push constants of shaders/saxpy.comp */
+	float a;
+	uint32_t count;
+} Saxpy;
+
+typedef struct {
+	/* Run is the kernel and buffers the dispatches use. token completes with
+	the last dispatch recorded, and dispatches counts them so far */
+	Compute *compute;
+	ComputeKernel *kernel;
+	Buffer *x, *y;
+	Saxpy saxpy;
+	uint32_t groups;
+
+	ComputeToken token;
+	uint32_t dispatches;
+} Run;
+
+/* code */
+
+static void *readFile(const char *path, size_t *size) {
+	/* Returns the contents of the file at path, which the caller frees */
+	FILE *file = fopen(path, "rb");
+	if (!file) Panic("bench-compute: unable to open %s\n", path);
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	rewind(file);
+
+	void *data = malloc(*size);
+	if (!data || fread(data, 1, *size, file) != *size)
+		Panic("bench-compute: unable to read %s\n", path);
+
+	fclose(file);
+	return data;
+}
+
+static void recordDispatches(void *data) {
+	Run *run = data;
+	VkBuffer buffers[] = {run->x->buffer, run->y->buffer};
+
+	uint32_t i;
+	for (i = 0; i < DISPATCHES; i++)
+		run->token = Dispatch(run->compute, run->kernel, buffers, &run->saxpy, run->groups, 1, 1);
+
+	run->dispatches += DISPATCHES;
+}
+
+static void runDispatches(void *data) {
+	Run *run = data;
+
+	recordDispatches(run);
+	WaitCompute(run->compute, run->token);
+}
+
+static void checkResult(void *data) {
+	/* Waits for the dispatches, then checks each of them added a to every y
+	through the host mapping */
+	Run *run = data;
+
+	WaitCompute(run->compute, run->token);
+	InvalidateComputeBuffer(run->compute, run->y);
+
+	const float *y = run->y->mapped;
+	float expected = (float) run->dispatches;
+
+	if (y[0] != expected || y[ELEMENTS - 1] != expected)
+		Panic("bench-compute: y is %f, expected %f\n", y[0], expected);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+
+	/* The kernel comes from the shader archive, or from SODA_SAXPY */
+	const char *path = getenv("SODA_SAXPY");
+
+	void *code = NULL;
+	ArchiveBlob blob = {};
+	if (path) {
+		code = readFile(path, &blob.size);
+		blob.data = code;
+	} else if (device.shaders.archive) {
+		blob = FindArchiveBlob(device.shaders.archive, "saxpy.comp.spv");
+	}
+
+	if (!blob.data) Panic("bench-compute: saxpy.comp.spv not found, set SODA_SAXPY to its path\n");
+
+	Compute compute = CreateCompute(device);
+
+	ShaderConstant constants[] = {{.id = 0, .value = WORKGROUP_SIZE}};
+	ComputeKernel kernel = CreateComputeKernel(&compute, blob.data, blob.size, constants, 1, 2, sizeof(Saxpy));
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	Buffer x = CreateBuffer(&device, ELEMENTS * sizeof(float), usage, properties);
+	Buffer y = CreateBuffer(&device, ELEMENTS * sizeof(float), usage, properties);
+
+	uint32_t i;
+	for (i = 0; i < ELEMENTS; i++) {
+		((float *) x.mapped)[i] = 1.0f;
+		((float *) y.mapped)[i] = 0.0f;
+	}
+
+	Run run = {
+		.compute = &compute,
+		.kernel = &kernel,
+		.x = &x,
+		.y = &y,
+		.saxpy = {.a = 1.0f, .count = ELEMENTS},
+		.groups = (ELEMENTS + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+	};
+
+	RunBench(&bench, "compute_record", recordDispatches, checkResult, &run);
+	RunBench(&bench, "compute_saxpy", runDispatches, checkResult, &run);
+
+	printf("%u dispatches of %u elements checked\n", run.dispatches, ELEMENTS);
+
+	DestroyBuffer(&device, &y);
+	DestroyBuffer(&device, &x);
+	DestroyComputeKernel(&compute, &kernel);
+	DestroyCompute(&compute);
+	DestroyRenderer();
+	free(code);
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,171 @@
+/* bench-drawlist sorts a frame of DRAWS draws with the DrawList's radix sort,
+across a Jobs pool and on a single thread. Before timing, the sort and the
+merged batches are checked against qsort. It doesn't need a device:
+
+	./bench-drawlist
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "drawlist.h"
+#include "jobs.h"
+#include "panic.h"
+
+/* constants */
+
+#define DRAWS (1 << 18)
+
+/* Draws pick from a few passes and pipelines and many materials. Meshes follow
+the material, so draws with the same key can be merged into a batch, and the
+few depth buckets make equal keys common enough to test the sort's stability */
+#define PASSES 2
+#define PIPELINES 8
+#define MATERIALS 512
+#define MESHES 64
+#define DEPTHS 16
+
+/* code */
+
+static uint32_t randomInt(uint32_t *state) {
+	/* Returns the next xorshift value */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static void submitDraws(DrawList *list, uint32_t count) {
+	/* Submits count draws with random keys, the same every run */
+	uint32_t state = 0xd5a1;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		uint32_t pass = randomInt(&state) % PASSES;
+		uint32_t pipeline = randomInt(&state) % PIPELINES;
+		uint32_t material = randomInt(&state) % MATERIALS;
+		uint32_t depth = randomInt(&state) % DEPTHS;
+		uint32_t mesh = material % MESHES;
+
+		/* Handles only need to be distinct, they're never used */
+		SubmitDraw(list, (Draw) {
+			.key = DRAW_KEY(pass, pipeline, material, depth),
+			.pipeline = (VkPipeline) (uintptr_t) (pass * PIPELINES + pipeline + 1),
+			.layout = (VkPipelineLayout) (uintptr_t) (pipeline + 1),
+			.material = (VkDescriptorSet) (uintptr_t) (material + 1),
+			.mesh = {
+				.vertices = (VkBuffer) (uintptr_t) (mesh + 1),
+				.indices = (mesh % 4) ? (VkBuffer) (uintptr_t) (MESHES + mesh + 1) : VK_NULL_HANDLE,
+				.count = 36 + mesh,
+				.first_index = mesh * 3,
+			},
+			.instance = i,
+		});
+	}
+}
+
+static int compareSortItems(const void *a, const void *b) {
+	/* qsort comparator ordering DrawSortItems by key and then by Draw, which is
+	the order a stable sort of the submitted Draws gives */
+	const DrawSortItem *x = a, *y = b;
+
+	if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+	return (x->draw > y->draw) - (x->draw < y->draw);
+}
+
+static bool sameDrawState(const Draw *a, const Draw *b) {
+	/* Returns true if a and b could share an instanced draw */
+	return a->pipeline == b->pipeline && a->layout == b->layout && a->material == b->material &&
+		a->mesh.vertices == b->mesh.vertices && a->mesh.indices == b->mesh.indices &&
+		a->mesh.count == b->mesh.count && a->mesh.first_index == b->mesh.first_index &&
+		a->mesh.vertex_offset == b->mesh.vertex_offset;
+}
+
+static void checkDrawList(DrawList *list, uint32_t count) {
+	/* Sorts count draws and panics unless the order, batches and instances
+	match those built from a qsort of the same draws */
+	ResetDrawList(list);
+	submitDraws(list, count);
+	SortDrawList(list);
+
+	DrawSortItem *expected = malloc((count ? count : 1) * sizeof(DrawSortItem));
+	if (!expected) Panic("bench-drawlist: unable to allocate %u sort items\n", count);
+
+	uint32_t i;
+	for (i = 0; i < count; i++)
+		expected[i] = (DrawSortItem) {.key = list->draws[i].key, .draw = i};
+
+	qsort(expected, count, sizeof(DrawSortItem), compareSortItems);
+
+	uint32_t batches = 0;
+
+	for (i = 0; i < count; i++) {
+		const DrawSortItem *item = &list->sort.items[i];
+
+		if (item->key != expected[i].key || item->draw != expected[i].draw)
+			Panic("bench-drawlist: item %u of %u is draw %u, qsort put draw %u there\n", i, count, item->draw, expected[i].draw);
+
+		if (list->instances[i] != list->draws[expected[i].draw].instance)
+			Panic("bench-drawlist: instance %u of %u is %u, expected %u\n", i, count, list->instances[i], list->draws[expected[i].draw].instance);
+
+		/* A new batch starts wherever the state changes between neighbours */
+		if (i && sameDrawState(&list->draws[expected[i - 1].draw], &list->draws[expected[i].draw])) continue;
+
+		if (batches >= list->batches.count)
+			Panic("bench-drawlist: %u draws merged into %u batches, expected more\n", count, list->batches.count);
+
+		const DrawBatch *batch = &list->batches.data[batches++];
+
+		if (batch->draw != expected[i].draw || batch->first_instance != i)
+			Panic("bench-drawlist: batch %u starts at draw %u instance %u, expected draw %u instance %u\n",
+				batches - 1, batch->draw, batch->first_instance, expected[i].draw, i);
+
+		uint32_t end = i + 1;
+		while (end < count && sameDrawState(&list->draws[expected[i].draw], &list->draws[expected[end].draw])) end++;
+
+		if (batch->instance_count != end - i)
+			Panic("bench-drawlist: batch %u has %u instances, expected %u\n", batches - 1, batch->instance_count, end - i);
+	}
+
+	if (batches != list->batches.count)
+		Panic("bench-drawlist: %u draws merged into %u batches, expected %u\n", count, list->batches.count, batches);
+
+	free(expected);
+}
+
+static void sortDrawList(void *data) {
+	SortDrawList(data);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+	Jobs *jobs = CreateJobs(0);
+
+	DrawList list = CreateDrawList(DRAWS, jobs);
+
+	/* Small lists are sorted in one chunk, large ones are split over the pool */
+	uint32_t sizes[] = {0, 1, 1000, DRAWS};
+
+	uint32_t i;
+	for (i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+		checkDrawList(&list, sizes[i]);
+
+	RunBench(&bench, "drawlist_sort", sortDrawList, NULL, &list);
+
+	/* The same sort without the pool shows how the jobs scale */
+	list.jobs = NULL;
+	checkDrawList(&list, DRAWS);
+
+	RunBench(&bench, "drawlist_sort_serial", sortDrawList, NULL, &list);
+
+	printf("%u draws in %u batches, %u workers\n", list.count, list.batches.count, jobs->count);
+
+	DestroyDrawList(&list);
+	DestroyJobs(jobs);
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,106 @@
+/* bench-jobs runs CALLS batches back to back through a Jobs pool, each with
+its own data on the caller's stack and its own count. Every index has to run
+exactly once with its own batch's data, and a worker still holding a returned
+batch finds that data poisoned. It doesn't need a device:
+
+	./bench-jobs
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "bench.h"
+#include "jobs.h"
+#include "panic.h"
+
+/* constants */
+
+#define CALLS 4096
+#define MAX_COUNT 64
+
+/* Marks a Batch whose RunJobs is still running */
+#define BATCH_LIVE 0x10b5u
+
+/* types */
+
+typedef struct {
+	/* Batch is the data of one RunJobs call, hits counts the calls of each
+	index */
+	uint32_t live, call, count;
+	SDL_atomic_t hits[MAX_COUNT];
+} Batch;
+
+typedef struct {
+	/* Stress is the pool and the calls run on it so far */
+	Jobs *jobs;
+	uint32_t calls;
+} Stress;
+
+/* code */
+
+static void hitIndex(void *data, uint32_t index) {
+	/* Counts a call of index, panicking if its batch has already returned or
+	index belongs to a bigger batch */
+	Batch *batch = data;
+
+	if (batch->live != BATCH_LIVE)
+		Panic("bench-jobs: index %u ran after its batch returned\n", index);
+
+	if (index >= batch->count)
+		Panic("bench-jobs: index %u ran in call %u of %u indices\n", index, batch->call, batch->count);
+
+	SDL_AtomicAdd(&batch->hits[index], 1);
+}
+
+static void runCall(Jobs *jobs, Batch *batch, uint32_t call) {
+	/* Runs one batch, checks each index ran once, then poisons its data */
+	*batch = (Batch) {
+		.live = BATCH_LIVE,
+		.call = call,
+		/* Counts mostly shrink from call to call, so a worker claiming from
+		this call with the last one's count runs indices it doesn't have */
+		.count = MAX_COUNT - (call * 7) % (MAX_COUNT - 1),
+	};
+
+	RunJobs(jobs, hitIndex, batch, batch->count);
+
+	uint32_t i;
+	for (i = 0; i < batch->count; i++) {
+		int hits = SDL_AtomicGet(&batch->hits[i]);
+		if (hits != 1) Panic("bench-jobs: index %u of call %u ran %d times\n", i, call, hits);
+	}
+
+	memset(batch, 0, sizeof(*batch));
+}
+
+static void runCalls(void *data) {
+	/* Alternates between two Batches on this stack frame, so a worker still
+	holding the last call's data finds it poisoned rather than reused */
+	Stress *stress = data;
+	Batch batches[2];
+
+	uint32_t i;
+	for (i = 0; i < CALLS; i++) {
+		runCall(stress->jobs, &batches[stress->calls % 2], stress->calls);
+		stress->calls++;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	/* At least a few workers, so late wakeups happen even on one CPU */
+	uint32_t workers = (SDL_GetCPUCount() > 4) ? SDL_GetCPUCount() - 1 : 4;
+	Stress stress = {.jobs = CreateJobs(workers)};
+
+	RunBench(&bench, "jobs_back_to_back", runCalls, NULL, &stress);
+
+	printf("%u batches checked on %u workers\n", stress.calls, stress.jobs->count);
+
+	DestroyJobs(stress.jobs);
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,433 @@
+/* bench-lights shades a floor with clustered lights at 1080p on a headless
+renderer, for a growing number of lights scattered over it. lights_write
+measures writing the most lights on the CPU, lights_N_frame a whole frame of
+N lights including binning and shading on the GPU:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-lights
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "lights.h"
+#include "panic.h"
+#include "passes.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "textures.h"
+
+/* constants */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MAX_LIGHTS 16384
+
+/* Lights are scattered over a square of FIELD_SIZE around the camera */
+#define FIELD_SIZE 160.0f
+#define EYE_HEIGHT 6.0f
+#define EYE_PITCH 0.35f
+
+/* Every fifth light is a spot light */
+#define SPOT_EVERY 5
+
+/* types */
+
+typedef struct {
+	/* FloorConstants are the push constants of shaders/lit_floor.frag */
+	float plane[4];
+	float albedo[4];
+} FloorConstants;
+
+typedef struct {
+	/* SceneLight is a light of the scene in world space, it bobs up and down
+	by phase */
+	float position[3];
+	float range, phase;
+	float colour[3];
+} SceneLight;
+
+typedef struct {
+	/* Scene is the offscreen target, the command buffer that draws into it,
+	the floor's pipeline and the lights. count is the lights drawn and frame
+	counts the frames begun */
+	RendererDevice device;
+	Passes passes;
+	Texture texture;
+	RenderTarget target;
+
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+
+	Lights lights;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+
+	LightCamera camera;
+	FloorConstants floor;
+	SceneLight scene_lights[MAX_LIGHTS];
+	uint32_t count;
+	uint64_t frame;
+} Scene;
+
+/* constants */
+
+static const uint32_t LIGHT_COUNTS[] = {1024, 2560, 5120, 10240, MAX_LIGHTS};
+
+/* code */
+
+static VkPipeline createPipeline(Scene *scene) {
+	/* Creates the pipeline that covers the target with the floor */
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	VkPushConstantRange range = {
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.offset = 0,
+		.size = sizeof(FloorConstants),
+	};
+
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &scene->lights.set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &range,
+	};
+
+	if (vk->CreatePipelineLayout(scene->device.device, &layout_info, NULL, &scene->layout) != VK_SUCCESS)
+		Panic("createPipeline: unable to create VkPipelineLayout\n");
+
+	ShaderCache *cache = scene->device.shaders.cache;
+	Archive *archive = scene->device.shaders.archive;
+
+	if (!archive) Panic("createPipeline: bench-lights needs the shader archive\n");
+
+	ShaderModule *vertex = AcquireArchiveShader(cache, archive, "fullscreen.vert.spv");
+	ShaderModule *fragment = AcquireArchiveShader(cache, archive, "lit_floor.frag.spv");
+
+	VkPipelineShaderStageCreateInfo stages[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_VERTEX_BIT,
+			.module = vertex->module,
+			.pName = "main",
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.module = fragment->module,
+			.pName = "main",
+		},
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertex_input = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+	};
+
+	VkViewport viewport = {
+		.width = WIDTH,
+		.height = HEIGHT,
+		.maxDepth = 1.0f,
+	};
+
+	VkRect2D scissor = {.extent = {WIDTH, HEIGHT}};
+
+	VkPipelineViewportStateCreateInfo viewport_state = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.pViewports = &viewport,
+		.scissorCount = 1,
+		.pScissors = &scissor,
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterization = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = VK_CULL_MODE_NONE,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.lineWidth = 1.0f,
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisample = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+	};
+
+	VkPipelineColorBlendAttachmentState blend_attachment = {
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
+
+	VkPipelineColorBlendStateCreateInfo blend = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &blend_attachment,
+	};
+
+	VkGraphicsPipelineCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = 2,
+		.pStages = stages,
+		.pVertexInputState = &vertex_input,
+		.pInputAssemblyState = &input_assembly,
+		.pViewportState = &viewport_state,
+		.pRasterizationState = &rasterization,
+		.pMultisampleState = &multisample,
+		.pColorBlendState = &blend,
+		.layout = scene->layout,
+	};
+
+	PipelinePass pass = GetPipelinePass(&scene->passes, &scene->target);
+
+	VkPipelineRenderingCreateInfoKHR rendering_info;
+	ApplyPipelinePass(&pass, &create_info, &rendering_info);
+
+	VkPipeline pipeline;
+	if (vk->CreateGraphicsPipelines(scene->device.device, VK_NULL_HANDLE, 1, &create_info, NULL, &pipeline) != VK_SUCCESS)
+		Panic("createPipeline: unable to create the floor VkPipeline\n");
+
+	ReleaseShaderModule(cache, fragment);
+	ReleaseShaderModule(cache, vertex);
+
+	return pipeline;
+}
+
+static void createCamera(Scene *scene) {
+	/* Places the camera EYE_HEIGHT over the floor, pitched down by EYE_PITCH
+	radians. The view matrix rotates about x after moving the eye to the
+	origin, so the floor's normal in view space is the matrix's y column */
+	float c = cosf(EYE_PITCH), s = sinf(EYE_PITCH);
+
+	scene->camera = (LightCamera) {
+		.view = {
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, c, s, 0.0f,
+			0.0f, -s, c, 0.0f,
+			0.0f, -c * EYE_HEIGHT, -s * EYE_HEIGHT, 1.0f,
+		},
+		.fov = 1.0f,
+		.near = 0.1f,
+		.far = 200.0f,
+		.extent = {WIDTH, HEIGHT},
+	};
+
+	scene->floor = (FloorConstants) {
+		.plane = {0.0f, c, s, EYE_HEIGHT},
+		.albedo = {0.6f, 0.6f, 0.6f, 0.02f},
+	};
+}
+
+static void createLights(Scene *scene) {
+	/* Scatters the lights over the floor in front of the camera */
+	uint32_t state = 0x11947a5;
+
+	uint32_t i, j;
+	for (i = 0; i < MAX_LIGHTS; i++) {
+		float random[8];
+
+		for (j = 0; j < 8; j++) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+
+			random[j] = (float) (state >> 8) / (float) (1 << 24);
+		}
+
+		scene->scene_lights[i] = (SceneLight) {
+			.position = {(random[0] - 0.5f) * FIELD_SIZE, 0.5f + random[1] * 2.5f, -random[2] * FIELD_SIZE},
+			.range = 2.0f + random[3] * 4.0f,
+			.phase = random[4] * 6.283f,
+			.colour = {random[5] * 4.0f, random[6] * 4.0f, random[7] * 4.0f},
+		};
+	}
+}
+
+static Scene *createScene() {
+	/* Creates the target, the command buffer, the lights and the floor.
+	The scene is too big for the stack */
+	Scene *scene = calloc(1, sizeof(Scene));
+	if (!scene) Panic("createScene: unable to allocate Scene\n");
+
+	scene->device = GetRendererDevice();
+
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	scene->passes = CreatePasses(vk, scene->device.supports.dynamic_rendering);
+
+	VkExtent2D extent = {WIDTH, HEIGHT};
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	scene->texture = CreateTexture(&scene->device, extent, VK_FORMAT_R8G8B8A8_UNORM, usage);
+
+	scene->target = (RenderTarget) {
+		.image = scene->texture.image,
+		.view = scene->texture.view,
+		.format = scene->texture.format,
+		.extent = extent,
+		.load = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = scene->device.family.graphics,
+	};
+
+	if (vk->CreateCommandPool(scene->device.device, &pool_info, NULL, &scene->command_pool) != VK_SUCCESS)
+		Panic("createScene: unable to create VkCommandPool\n");
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = scene->command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (vk->AllocateCommandBuffers(scene->device.device, &allocate_info, &scene->command_buffer) != VK_SUCCESS)
+		Panic("createScene: unable to allocate VkCommandBuffer\n");
+
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+
+	if (vk->CreateFence(scene->device.device, &fence_info, NULL, &scene->fence) != VK_SUCCESS)
+		Panic("createScene: unable to create VkFence\n");
+
+	scene->lights = CreateLights(scene->device, MAX_LIGHTS);
+	scene->pipeline = createPipeline(scene);
+
+	createCamera(scene);
+	createLights(scene);
+
+	return scene;
+}
+
+static void destroyScene(Scene *scene) {
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	vk->DeviceWaitIdle(scene->device.device);
+
+	vk->DestroyPipeline(scene->device.device, scene->pipeline, NULL);
+	vk->DestroyPipelineLayout(scene->device.device, scene->layout, NULL);
+	DestroyLights(&scene->lights);
+	vk->DestroyFence(scene->device.device, scene->fence, NULL);
+	vk->DestroyCommandPool(scene->device.device, scene->command_pool, NULL);
+	DestroyPasses(&scene->passes);
+	DestroyTexture(&scene->device, &scene->texture);
+
+	free(scene);
+}
+
+static void writeLights(void *data) {
+	/* Writes the scene's first count lights, every fifth one a spot light
+	pointing down */
+	Scene *scene = data;
+
+	BeginLights(&scene->lights, scene->frame, &scene->camera);
+
+	float time = scene->frame * (1.0f / 60.0f);
+	float down[3] = {0.0f, -1.0f, 0.0f};
+
+	uint32_t i;
+	for (i = 0; i < scene->count; i++) {
+		SceneLight *light = &scene->scene_lights[i];
+		float position[3] = {light->position[0], light->position[1] + 0.5f * sinf(time + light->phase), light->position[2]};
+
+		if (i % SPOT_EVERY == 0)
+			AddSpotLight(&scene->lights, position, down, light->range * 1.5f, 0.6f, light->colour);
+		else
+			AddPointLight(&scene->lights, position, light->range, light->colour);
+	}
+}
+
+static void nextFrame(void *data) {
+	Scene *scene = data;
+	scene->frame++;
+}
+
+static void drawFrame(void *data) {
+	/* Writes, bins and shades a frame, then waits for it */
+	Scene *scene = data;
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	writeLights(scene);
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->BeginCommandBuffer(scene->command_buffer, &begin_info);
+
+	RecordLightBinning(&scene->lights, scene->command_buffer);
+
+	BeginPass(&scene->passes, scene->command_buffer, &scene->target);
+
+	vk->CmdBindPipeline(scene->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene->pipeline);
+	BindLights(&scene->lights, scene->command_buffer, scene->layout, 0);
+	vk->CmdPushConstants(scene->command_buffer, scene->layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(FloorConstants), &scene->floor);
+	vk->CmdDraw(scene->command_buffer, 3, 1, 0, 0);
+
+	EndPass(&scene->passes, scene->command_buffer, &scene->target);
+
+	vk->EndCommandBuffer(scene->command_buffer);
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &scene->command_buffer,
+	};
+
+	vk->QueueSubmit(scene->device.queue.graphics, 1, &submit_info, scene->fence);
+	vk->WaitForFences(scene->device.device, 1, &scene->fence, VK_TRUE, UINT64_MAX);
+}
+
+static void finishFrame(void *data) {
+	/* Resets the frame's objects */
+	Scene *scene = data;
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	vk->ResetFences(scene->device.device, 1, &scene->fence);
+	vk->ResetCommandBuffer(scene->command_buffer, 0);
+
+	scene->frame++;
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	Scene *scene = createScene();
+
+	/* The first frame creates the passes, it isn't part of the scene's cost */
+	drawFrame(scene);
+	finishFrame(scene);
+
+	scene->count = MAX_LIGHTS;
+	RunBench(&bench, "lights_write", writeLights, nextFrame, scene);
+
+	uint32_t i;
+	for (i = 0; i < sizeof(LIGHT_COUNTS) / sizeof(LIGHT_COUNTS[0]); i++) {
+		char name[BENCH_NAME_SIZE];
+		snprintf(name, sizeof(name), "lights_%u_frame", LIGHT_COUNTS[i]);
+
+		scene->count = LIGHT_COUNTS[i];
+		RunBench(&bench, name, drawFrame, finishFrame, scene);
+
+		printf("%u lights, %u in the frustum\n", scene->count, scene->lights.count);
+	}
+
+	destroyScene(scene);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,249 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "buffers.h"
+#include "compute.h"
+#include "panic.h"
+#include "primitives.h"
+#include "renderer.h"
+
+/* bench-primitives measures the elements per second of each primitive on a
+headless renderer, with the subgroup kernels when the device has them and
+with the portable ones. Each primitive's result is checked against the CPU
+before it's timed, and its input is restored between runs untimed. It needs
+shaders.pack and runs on any ICD including lavapipe:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-primitives
+*/
+
+/* constants */
+
+#define ELEMENTS (1 << 22)
+
+/* types */
+
+typedef enum {
+	/* Primitive is the primitive being measured */
+	PRIMITIVE_SCAN,
+	PRIMITIVE_REDUCE,
+	PRIMITIVE_SORT,
+	PRIMITIVE_SORT_PAIRS,
+	PRIMITIVE_COMPACT,
+	PRIMITIVE_COUNT,
+} Primitive;
+
+typedef struct {
+	/* Data is the input on the host and the buffers the primitives run on.
+	The buffers are host visible so the input can be restored before each
+	run and the output checked */
+	RendererDevice device;
+	uint32_t *input, *flags;
+	Buffer keys, values, output, mask, total;
+} Data;
+
+typedef struct {
+	/* Run is a primitive measured with one set of kernels */
+	Compute *compute;
+	Primitives *primitives;
+	Data *data;
+	Primitive primitive;
+} Run;
+
+/* constants */
+
+static const char *PRIMITIVE_NAMES[PRIMITIVE_COUNT] = {"scan", "reduce", "sort", "sort_pairs", "compact"};
+
+/* code */
+
+static Buffer createBuffer(RendererDevice *device, VkDeviceSize size) {
+	/* Creates a host visible storage buffer, in device local memory if the
+	device can map it */
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	if (FindMemoryType(device, UINT32_MAX, properties | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != NO_MEMORY_TYPE)
+		properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	return CreateBuffer(device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, properties);
+}
+
+static void restore(Data *data, Primitive primitive) {
+	/* Copies the input back into the buffers the primitive reads */
+	memcpy(data->keys.mapped, data->input, ELEMENTS * sizeof(uint32_t));
+
+	uint32_t i;
+	if (primitive == PRIMITIVE_SORT_PAIRS)
+		for (i = 0; i < ELEMENTS; i++) ((uint32_t *) data->values.mapped)[i] = i;
+
+	if (primitive == PRIMITIVE_COMPACT)
+		memcpy(data->mask.mapped, data->flags, ELEMENTS * sizeof(uint32_t));
+}
+
+static ComputeToken recordPrimitive(Primitives *primitives, Data *data, Primitive primitive) {
+	/* Records the primitive on the data */
+	switch (primitive) {
+		case PRIMITIVE_SCAN:
+			return ExclusiveScan(primitives, data->keys.buffer, data->output.buffer, ELEMENTS);
+
+		case PRIMITIVE_REDUCE:
+			return Reduce(primitives, data->keys.buffer, data->output.buffer, ELEMENTS);
+
+		case PRIMITIVE_SORT:
+			return RadixSort(primitives, data->keys.buffer, VK_NULL_HANDLE, ELEMENTS, 32);
+
+		case PRIMITIVE_SORT_PAIRS:
+			return RadixSort(primitives, data->keys.buffer, data->values.buffer, ELEMENTS, 32);
+
+		default:
+			return Compact(primitives, data->keys.buffer, data->mask.buffer, data->output.buffer, data->total.buffer, ELEMENTS);
+	}
+}
+
+static void check(Data *data, Primitive primitive) {
+	/* Panics if the output of the primitive differs from the CPU's */
+	const uint32_t *keys = data->keys.mapped, *values = data->values.mapped, *output = data->output.mapped;
+	const char *name = PRIMITIVE_NAMES[primitive];
+	uint32_t sum = 0, kept = 0;
+
+	uint32_t i;
+	for (i = 0; i < ELEMENTS; i++) {
+		switch (primitive) {
+			case PRIMITIVE_SCAN:
+				if (output[i] != sum) Panic("bench-primitives: %s is %u at %u, expected %u\n", name, output[i], i, sum);
+				break;
+
+			case PRIMITIVE_SORT:
+			case PRIMITIVE_SORT_PAIRS:
+				if (i && keys[i - 1] > keys[i]) Panic("bench-primitives: %s is out of order at %u\n", name, i);
+				if (primitive == PRIMITIVE_SORT_PAIRS && data->input[values[i]] != keys[i])
+					Panic("bench-primitives: %s lost the value of %u\n", name, i);
+				if (primitive == PRIMITIVE_SORT_PAIRS && i && keys[i - 1] == keys[i] && values[i - 1] > values[i])
+					Panic("bench-primitives: %s isn't stable at %u\n", name, i);
+				break;
+
+			case PRIMITIVE_COMPACT:
+				if (data->flags[i] && output[kept++] != data->input[i])
+					Panic("bench-primitives: %s is wrong at %u\n", name, kept - 1);
+				break;
+
+			default:
+				break;
+		}
+
+		sum += data->input[i];
+	}
+
+	if (primitive == PRIMITIVE_REDUCE && output[0] != sum)
+		Panic("bench-primitives: %s is %u, expected %u\n", name, output[0], sum);
+
+	if (primitive == PRIMITIVE_COMPACT && *(uint32_t *) data->total.mapped != kept)
+		Panic("bench-primitives: %s kept %u, expected %u\n", name, *(uint32_t *) data->total.mapped, kept);
+}
+
+static void runPrimitive(void *data) {
+	Run *run = data;
+	WaitCompute(run->compute, recordPrimitive(run->primitives, run->data, run->primitive));
+}
+
+static void restoreInput(void *data) {
+	Run *run = data;
+	restore(run->data, run->primitive);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+	Compute compute = CreateCompute(device);
+
+	Data data = {
+		.device = device,
+		.input = malloc(ELEMENTS * sizeof(uint32_t)),
+		.flags = malloc(ELEMENTS * sizeof(uint32_t)),
+		.keys = createBuffer(&device, ELEMENTS * sizeof(uint32_t)),
+		.values = createBuffer(&device, ELEMENTS * sizeof(uint32_t)),
+		.output = createBuffer(&device, ELEMENTS * sizeof(uint32_t)),
+		.mask = createBuffer(&device, ELEMENTS * sizeof(uint32_t)),
+		.total = createBuffer(&device, sizeof(uint32_t)),
+	};
+
+	if (!data.input || !data.flags) Panic("bench-primitives: unable to allocate the input\n");
+
+	/* xorshift keys, small enough that scan and reduce don't wrap, and flags
+	that keep about half of them */
+	uint32_t state = 0x50da50da;
+
+	uint32_t i;
+	for (i = 0; i < ELEMENTS; i++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		data.input[i] = state & 0x3ff;
+		data.flags[i] = (state >> 16) & 1;
+	}
+
+	char name[BENCH_NAME_SIZE];
+	const char *kernels[2] = {};
+	uint32_t blocks[2][2];
+
+	uint32_t pass;
+	for (pass = 0; pass < 2; pass++) {
+		bool portable = (pass == 1);
+		Primitives primitives = CreatePrimitives(&compute, portable);
+
+		/* without subgroups both passes would measure the same kernels */
+		if (!portable && !primitives.subgroups) {
+			DestroyPrimitives(&primitives);
+			continue;
+		}
+
+		kernels[pass] = (primitives.subgroups) ? "subgroup" : "portable";
+		blocks[pass][0] = primitives.workgroup;
+		blocks[pass][1] = primitives.items;
+
+		Run run = {
+			.compute = &compute,
+			.primitives = &primitives,
+			.data = &data,
+		};
+
+		for (run.primitive = 0; run.primitive < PRIMITIVE_COUNT; run.primitive++) {
+			restoreInput(&run);
+			runPrimitive(&run);
+			check(&data, run.primitive);
+
+			snprintf(name, sizeof(name), "primitives_%s_%s", PRIMITIVE_NAMES[run.primitive], kernels[pass]);
+			RunBench(&bench, name, runPrimitive, restoreInput, &run);
+		}
+
+		DestroyPrimitives(&primitives);
+	}
+
+	printf("elements: %u, subgroup size %u\n", ELEMENTS, device.subgroup.size);
+
+	for (pass = 0; pass < 2; pass++)
+		if (kernels[pass]) printf("%s kernels, %u x %u elements a block\n", kernels[pass], blocks[pass][0], blocks[pass][1]);
+
+	for (i = 0; i < bench.count; i++)
+		printf("%-32s %10.1f Melements/s at the median\n", bench.results[i].name, ELEMENTS / bench.results[i].median * 1e3);
+
+	DestroyBuffer(&device, &data.total);
+	DestroyBuffer(&device, &data.mask);
+	DestroyBuffer(&device, &data.output);
+	DestroyBuffer(&device, &data.values);
+	DestroyBuffer(&device, &data.keys);
+	free(data.flags);
+	free(data.input);
+
+	DestroyCompute(&compute);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,240 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "buffers.h"
+#include "panic.h"
+#include "readback.h"
+#include "renderer.h"
+
+/* bench-readback measures sustained device to host bandwidth through
+Readbacks. Reads of CHUNK bytes are kept IN_FLIGHT deep, readback_chunk times
+one step of that pipeline: waiting for the oldest read, summing it through its
+zero copy view so the host side is paid for too, and submitting the next.
+Every read's sum is checked. It runs on any ICD including lavapipe:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-readback
+*/
+
+/* constants */
+
+#define CHUNK (16u << 20)
+#define IN_FLIGHT 3
+
+/* Word the source buffer is filled with */
+#define PATTERN 0x50da50dau
+
+/* types */
+
+typedef struct {
+	/* Slot is a command buffer with the read it recorded, which completes
+	with value */
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	ReadbackFuture future;
+	uint64_t value;
+	bool pending;
+} Slot;
+
+typedef struct {
+	/* Stream is the reads kept in flight. reads counts the reads submitted,
+	and waiting the performance counter ticks spent waiting for them */
+	RendererDevice *device;
+	Readbacks *readbacks;
+	Buffer *source;
+	Slot slots[IN_FLIGHT];
+	uint64_t reads, consumed;
+	Uint64 waiting;
+} Stream;
+
+/* code */
+
+static void submit(RendererDevice *device, Slot *slot) {
+	/* Ends the slot's command buffer and submits it */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	vk->EndCommandBuffer(slot->command_buffer);
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &slot->command_buffer,
+	};
+
+	if (vk->QueueSubmit(device->queue.graphics, 1, &submit_info, slot->fence) != VK_SUCCESS)
+		Panic("bench-readback: unable to submit\n");
+}
+
+static void begin(RendererDevice *device, Slot *slot) {
+	/* Resets and begins the slot's command buffer */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->ResetFences(device->device, 1, &slot->fence);
+	vk->ResetCommandBuffer(slot->command_buffer, 0);
+	vk->BeginCommandBuffer(slot->command_buffer, &begin_info);
+}
+
+static void consume(Stream *stream, Slot *slot) {
+	/* Waits for the slot's read, then sums its words, panicking unless they
+	are the source's, and releases it */
+	const DeviceDispatch *vk = stream->device->dispatch.device;
+
+	Uint64 wait = SDL_GetPerformanceCounter();
+	vk->WaitForFences(stream->device->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+	stream->waiting += SDL_GetPerformanceCounter() - wait;
+
+	UpdateReadbacks(stream->readbacks, slot->value);
+
+	ReadbackView view = GetReadback(stream->readbacks, slot->future);
+	if (!view.data) Panic("bench-readback: read hasn't completed\n");
+
+	const uint32_t *words = view.data;
+	uint64_t sum = 0;
+
+	size_t i;
+	for (i = 0; i < view.size / sizeof(uint32_t); i++) sum += words[i];
+
+	if (sum != (uint64_t) PATTERN * (CHUNK / sizeof(uint32_t)))
+		Panic("bench-readback: read %llu read back the wrong data\n", (unsigned long long) slot->value);
+
+	ReleaseReadback(stream->readbacks, slot->future);
+	slot->pending = false;
+	stream->consumed += 1;
+}
+
+static void readChunk(void *data) {
+	/* Consumes the oldest read if it's in flight and submits the next one in
+	its slot. Read n completes with value n + 1 */
+	Stream *stream = data;
+	Slot *slot = &stream->slots[stream->reads % IN_FLIGHT];
+
+	if (slot->pending) consume(stream, slot);
+
+	begin(stream->device, slot);
+
+	slot->value = ++stream->reads;
+	slot->future = ReadbackBuffer(stream->readbacks, slot->command_buffer, stream->source->buffer, 0, CHUNK, slot->value);
+	slot->pending = true;
+
+	submit(stream->device, slot);
+}
+
+static void drainStream(Stream *stream) {
+	/* Consumes the reads still in flight, oldest first */
+	uint32_t i;
+	for (i = 0; i < IN_FLIGHT; i++) {
+		Slot *slot = &stream->slots[(stream->reads + i) % IN_FLIGHT];
+		if (slot->pending) consume(stream, slot);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	Readbacks readbacks = CreateReadbacks(device);
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	Buffer source = CreateBuffer(&device, CHUNK, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = device.family.graphics,
+	};
+
+	VkCommandPool command_pool;
+	if (vk->CreateCommandPool(device.device, &pool_info, NULL, &command_pool) != VK_SUCCESS)
+		Panic("bench-readback: unable to create VkCommandPool\n");
+
+	VkCommandBuffer command_buffers[IN_FLIGHT];
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = IN_FLIGHT,
+	};
+
+	if (vk->AllocateCommandBuffers(device.device, &allocate_info, command_buffers) != VK_SUCCESS)
+		Panic("bench-readback: unable to allocate VkCommandBuffers\n");
+
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+
+	Stream stream = {
+		.device = &device,
+		.readbacks = &readbacks,
+		.source = &source,
+	};
+
+	uint32_t i;
+	for (i = 0; i < IN_FLIGHT; i++) {
+		stream.slots[i].command_buffer = command_buffers[i];
+
+		if (vk->CreateFence(device.device, &fence_info, NULL, &stream.slots[i].fence) != VK_SUCCESS)
+			Panic("bench-readback: unable to create VkFence\n");
+	}
+
+	/* The source is filled once on the GPU, the first read also warms up the
+	pool so buffer creation isn't measured */
+	Slot *first = &stream.slots[0];
+	begin(&device, first);
+	vk->CmdFillBuffer(first->command_buffer, source.buffer, 0, CHUNK, PATTERN);
+
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+	};
+
+	vk->CmdPipelineBarrier(first->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	first->value = ++stream.reads;
+	first->future = ReadbackBuffer(&readbacks, first->command_buffer, source.buffer, 0, CHUNK, first->value);
+	first->pending = true;
+	submit(&device, first);
+
+	consume(&stream, first);
+	stream.consumed = stream.waiting = 0;
+
+	RunBench(&bench, "readback_chunk", readChunk, NULL, &stream);
+	drainStream(&stream);
+
+	/* --filter may have skipped the benchmark */
+	if (stream.consumed) {
+		printf("%llu reads of %u MB, %u in flight, %s memory, %.3f ms waiting per read\n",
+			(unsigned long long) stream.consumed, CHUNK >> 20, IN_FLIGHT,
+			(readbacks.properties & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? "cached" : "coherent",
+			stream.waiting * 1e3 / SDL_GetPerformanceFrequency() / stream.consumed);
+	}
+
+	for (i = 0; i < bench.count; i++) {
+		if (strcmp(bench.results[i].name, "readback_chunk") == 0)
+			printf("%.2f GB/s at the median\n", CHUNK / bench.results[i].median);
+	}
+
+	for (i = 0; i < IN_FLIGHT; i++) vk->DestroyFence(device.device, stream.slots[i].fence, NULL);
+	vk->DestroyCommandPool(device.device, command_pool, NULL);
+
+	DestroyBuffer(&device, &source);
+	DestroyReadbacks(&readbacks);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,304 @@
+/* bench-reload watches a compute pipeline with a ShaderReloader, rewrites its
+source in a temporary directory and waits for ApplyShaderReloads to swap the
+rebuilt pipeline in. Before timing it checks the new pipeline was built from
+the rewritten shader's SPIR-V, the old one is retired through the
+DeletionQueue at the frame's value, and a source that doesn't compile keeps
+the pipeline. reload_shader times a rewrite until the swap, compiler included.
+SODA_GLSLC names the compiler as it does for the reloader:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-reload
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "deletion.h"
+#include "panic.h"
+#include "reload.h"
+#include "renderer.h"
+
+/* constants */
+
+#define SOURCE "reload.comp"
+#define SHADER "reload.comp.spv"
+
+/* Milliseconds a reload may take before the bench gives up on it, and how
+long a broken source is given to not be swapped in */
+#define RELOAD_TIMEOUT_MS 10000
+#define BROKEN_WAIT_MS (8 * RELOAD_SETTLE_MS)
+
+/* types */
+
+typedef struct {
+	/* Watched is the pipeline the reloader rebuilds, and the SPIR-V it was last
+	built from. value stands in for the frame progress deletions are keyed by */
+	RendererDevice device;
+	ShaderReloader *reloader;
+	DeletionQueue deletions;
+	char directory[256];
+
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+
+	uint32_t *built;
+	size_t built_size;
+
+	uint32_t version;
+	uint64_t value;
+} Watched;
+
+/* code */
+
+static void writeSource(Watched *watched, uint32_t version, bool broken) {
+	/* Writes a compute shader that stores version, or one that doesn't compile.
+	It's written to a temporary file and renamed, as editors often do */
+	char path[512], temporary[512];
+	snprintf(path, sizeof(path), "%s/%s", watched->directory, SOURCE);
+	snprintf(temporary, sizeof(temporary), "%s/.%s.swp", watched->directory, SOURCE);
+
+	FILE *file = fopen(temporary, "w");
+	if (!file) Panic("bench-reload: unable to create %s\n", temporary);
+
+	fprintf(file,
+		"#version 450\n"
+		"layout(local_size_x = 1) in;\n"
+		"layout(set = 0, binding = 0) buffer Output { uint value; };\n"
+		"void main() { value = %uu; }\n%s", version, (broken) ? "this doesn't compile\n" : "");
+
+	if (fclose(file) != 0 || rename(temporary, path) != 0) Panic("bench-reload: unable to write %s\n", path);
+}
+
+static uint32_t *compileSource(Watched *watched, size_t *size) {
+	/* Compiles the source the way the reloader does and returns its SPIR-V */
+	const char *compiler = getenv("SODA_GLSLC");
+
+	char command[1024];
+	snprintf(command, sizeof(command), "%s -O -o - '%s/%s'", (compiler) ? compiler : "glslc", watched->directory, SOURCE);
+
+	FILE *output = popen(command, "r");
+	if (!output) Panic("bench-reload: unable to run '%s'\n", command);
+
+	size_t capacity = 1 << 20;
+	uint32_t *code = malloc(capacity);
+	if (!code) Panic("bench-reload: unable to allocate %zu bytes\n", capacity);
+
+	*size = fread(code, 1, capacity, output);
+
+	if (pclose(output) != 0 || !*size || *size == capacity) Panic("bench-reload: '%s' failed\n", command);
+
+	return code;
+}
+
+static VkPipeline buildPipeline(void *data, const ShaderCode *shaders) {
+	/* PipelineMethod of the watched pipeline, it keeps a copy of the SPIR-V
+	so the bench can check what was built */
+	Watched *watched = data;
+	const DeviceDispatch *vk = watched->device.dispatch.device;
+
+	VkShaderModuleCreateInfo module_info = {
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = shaders[0].size,
+		.pCode = shaders[0].code,
+	};
+
+	VkShaderModule module;
+	if (vk->CreateShaderModule(watched->device.device, &module_info, NULL, &module) != VK_SUCCESS) return VK_NULL_HANDLE;
+
+	VkComputePipelineCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = module,
+			.pName = "main",
+		},
+		.layout = watched->layout,
+	};
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	vk->CreateComputePipelines(watched->device.device, VK_NULL_HANDLE, 1, &create_info, NULL, &pipeline);
+	vk->DestroyShaderModule(watched->device.device, module, NULL);
+
+	if (!pipeline) return VK_NULL_HANDLE;
+
+	free(watched->built);
+	watched->built = malloc(shaders[0].size);
+	if (!watched->built) Panic("bench-reload: unable to allocate %zu bytes\n", shaders[0].size);
+
+	memcpy(watched->built, shaders[0].code, shaders[0].size);
+	watched->built_size = shaders[0].size;
+
+	return pipeline;
+}
+
+static void waitForSwap(Watched *watched, VkPipeline old) {
+	/* Applies reloads at pretend frame boundaries until the pipeline isn't old
+	any more */
+	uint32_t waited;
+	for (waited = 0; waited < RELOAD_TIMEOUT_MS && watched->pipeline == old; waited++) {
+		watched->value++;
+		ApplyShaderReloads(watched->reloader, &watched->deletions, watched->value);
+
+		if (watched->pipeline == old) usleep(1000);
+	}
+
+	if (watched->pipeline == old) Panic("bench-reload: the pipeline wasn't swapped after %u ms\n", RELOAD_TIMEOUT_MS);
+}
+
+static void checkReload(Watched *watched) {
+	/* Rewrites the source and panics unless the swapped pipeline was built from
+	its SPIR-V and the old one is deleted once its value completes */
+	VkPipeline old = watched->pipeline;
+
+	writeSource(watched, ++watched->version, false);
+	waitForSwap(watched, old);
+
+	if (!watched->pipeline) Panic("bench-reload: the pipeline was swapped for VK_NULL_HANDLE\n");
+
+	size_t size;
+	uint32_t *expected = compileSource(watched, &size);
+
+	if (size != watched->built_size || memcmp(expected, watched->built, size) != 0)
+		Panic("bench-reload: the swapped pipeline wasn't built from version %u\n", watched->version);
+
+	free(expected);
+
+	DeletionQueue *queue = &watched->deletions;
+	const Deletion *retired = &queue->deletions[queue->head];
+
+	if (queue->count != 1 || retired->type != DELETE_PIPELINE || retired->handle != (uint64_t) old)
+		Panic("bench-reload: the old pipeline wasn't queued for deletion\n");
+
+	if (retired->value != watched->value)
+		Panic("bench-reload: the old pipeline waits on %llu, not the frame it was swapped at\n", (unsigned long long) retired->value);
+
+	if (CollectDeletions(queue, watched->value - 1) != 0)
+		Panic("bench-reload: the old pipeline was deleted while its frame could still use it\n");
+
+	if (CollectDeletions(queue, watched->value) != 1)
+		Panic("bench-reload: the old pipeline wasn't deleted once its frame completed\n");
+}
+
+static void checkBroken(Watched *watched) {
+	/* A source that doesn't compile leaves the pipeline and the queue alone */
+	VkPipeline pipeline = watched->pipeline;
+
+	fprintf(stderr, "bench-reload: a compile error is expected here\n");
+	writeSource(watched, watched->version, true);
+
+	uint32_t waited;
+	for (waited = 0; waited < BROKEN_WAIT_MS; waited++) {
+		ApplyShaderReloads(watched->reloader, &watched->deletions, ++watched->value);
+		usleep(1000);
+	}
+
+	if (watched->pipeline != pipeline || watched->deletions.count)
+		Panic("bench-reload: a source that didn't compile replaced the pipeline\n");
+}
+
+static void reloadShader(void *data) {
+	Watched *watched = data;
+	VkPipeline old = watched->pipeline;
+
+	writeSource(watched, ++watched->version, false);
+	waitForSwap(watched, old);
+}
+
+static void collectPipelines(void *data) {
+	Watched *watched = data;
+	CollectDeletions(&watched->deletions, watched->value);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+
+	Watched watched = {
+		.device = GetRendererDevice(),
+	};
+
+	const DeviceDispatch *vk = watched.device.dispatch.device;
+	watched.deletions = CreateDeletionQueue(vk);
+
+	strcpy(watched.directory, "/tmp/soda-bench-reload-XXXXXX");
+	if (!mkdtemp(watched.directory)) Panic("bench-reload: unable to create a temporary directory\n");
+
+	VkDescriptorSetLayoutBinding binding = {
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	};
+
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindings = &binding,
+	};
+
+	if (vk->CreateDescriptorSetLayout(watched.device.device, &set_info, NULL, &watched.set_layout) != VK_SUCCESS)
+		Panic("bench-reload: unable to create VkDescriptorSetLayout\n");
+
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &watched.set_layout,
+	};
+
+	if (vk->CreatePipelineLayout(watched.device.device, &layout_info, NULL, &watched.layout) != VK_SUCCESS)
+		Panic("bench-reload: unable to create VkPipelineLayout\n");
+
+	/* The first version is built here, as an app builds its pipelines from the
+	archive before watching them */
+	writeSource(&watched, watched.version, false);
+
+	size_t size;
+	uint32_t *code = compileSource(&watched, &size);
+
+	watched.pipeline = buildPipeline(&watched, &(ShaderCode) {code, size});
+	if (!watched.pipeline) Panic("bench-reload: unable to build the first pipeline\n");
+
+	free(code);
+
+	const char *shaders[] = {SHADER};
+
+	watched.reloader = StartShaderReloader(watched.device, watched.directory);
+	WatchPipeline(watched.reloader, &watched.pipeline, shaders, 1, buildPipeline, &watched);
+
+	checkReload(&watched);
+	checkBroken(&watched);
+	checkReload(&watched);
+
+	RunBench(&bench, "reload_shader", reloadShader, collectPipelines, &watched);
+
+	printf("%u versions of %s swapped in\n", watched.version, SOURCE);
+
+	UnwatchPipeline(watched.reloader, &watched.pipeline);
+	StopShaderReloader(watched.reloader);
+
+	CollectDeletions(&watched.deletions, UINT64_MAX);
+	DestroyDeletionQueue(&watched.deletions);
+
+	vk->DestroyPipeline(watched.device.device, watched.pipeline, NULL);
+	vk->DestroyPipelineLayout(watched.device.device, watched.layout, NULL);
+	vk->DestroyDescriptorSetLayout(watched.device.device, watched.set_layout, NULL);
+
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", watched.directory, SOURCE);
+	unlink(path);
+	rmdir(watched.directory);
+
+	free(watched.built);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,265 @@
+/* bench-renderer measures the stages of renderer bring-up on a headless
+device. It includes refactor/instance.c so that the static stages can be
+timed on their own, and runs on software ICDs like lavapipe or SwiftShader:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-renderer
+
+record_loader and record_dispatch record the same barriers through the
+loader's exported trampolines and through the device's DeviceDispatch, the
+difference is the cost of the trampoline per command.
+*/
+
+#include "../refactor/instance.c"
+
+#include "bench.h"
+
+/* constants */
+
+/* Commands recorded per iteration of the recording benchmarks */
+#define RECORD_COMMANDS 1000
+
+/* types */
+
+typedef struct {
+	/* Submit is an empty command buffer submitted to the graphics queue */
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+} Submit;
+
+typedef struct {
+	/* Record is a command buffer that pipeline barriers are recorded into with
+	barrier, which is either the loader's or the device's entry point */
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	PFN_vkCmdPipelineBarrier barrier;
+} Record;
+
+/* code */
+
+static void instanceCreate(void *data) {
+	/* Creates the VkInstance with the prod Environment, validation layers
+	would dominate the measurement */
+	createInstance(&prod);
+}
+
+static void instanceDestroy(void *data) {
+	vk.dispatch.DestroyInstance(vk.instance, NULL);
+	free(vk.instance_extensions.names);
+	destroyVkExtensionProperties();
+
+	vk.instance = VK_NULL_HANDLE;
+}
+
+static void extensionValidation(void *data) {
+	/* Validates every extension the loader supports, the worst case for
+	setVkInstanceExtensions */
+	vk.instance_extensions = setVkInstanceExtensions(data);
+}
+
+static void extensionValidationFree(void *data) {
+	free(vk.instance_extensions.names);
+	vk.instance_extensions = (InstanceExtensions) {};
+}
+
+static void deviceEnumeration(void *data) {
+	vk.physical.count = countVkPhysicalDevices();
+	vk.physical.devices = createDevices(vk.physical.count);
+}
+
+static void deviceEnumerationFree(void *data) {
+	destroyDevices(vk.physical.devices, vk.physical.count);
+	vk.physical.devices = NULL;
+}
+
+static void logicalDeviceCreate(void *data) {
+	/* Loading the device's table is part of bringing it up */
+	vk.logical.device = createLogicalDevice(&vk.physical.devices[0]);
+	vk.logical.dispatch = LoadDeviceDispatch(&vk.dispatch, vk.logical.device);
+}
+
+static void logicalDeviceDestroy(void *data) {
+	vk.logical.dispatch.DestroyDevice(vk.logical.device, NULL);
+	vk.logical.device = VK_NULL_HANDLE;
+}
+
+static Submit createSubmit() {
+	/* Records an empty command buffer to measure submission overhead */
+	DeviceDispatch *dispatch = &vk.logical.dispatch;
+	Submit submit = {};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = vk.logical.physical->queue.family.graphics,
+	};
+
+	if (dispatch->CreateCommandPool(vk.logical.device, &pool_info, NULL, &submit.command_pool) != VK_SUCCESS)
+		Panic("createSubmit: unable to create VkCommandPool\n");
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = submit.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (dispatch->AllocateCommandBuffers(vk.logical.device, &allocate_info, &submit.command_buffer) != VK_SUCCESS)
+		Panic("createSubmit: unable to allocate VkCommandBuffer\n");
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+
+	dispatch->BeginCommandBuffer(submit.command_buffer, &begin_info);
+	dispatch->EndCommandBuffer(submit.command_buffer);
+
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+
+	if (dispatch->CreateFence(vk.logical.device, &fence_info, NULL, &submit.fence) != VK_SUCCESS)
+		Panic("createSubmit: unable to create VkFence\n");
+
+	return submit;
+}
+
+static void queueSubmit(void *data) {
+	/* Submits the empty command buffer and waits for it, the round trip that
+	bounds frame submission */
+	Submit *submit = data;
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &submit->command_buffer,
+	};
+
+	vk.logical.dispatch.QueueSubmit(vk.logical.queue.graphics, 1, &submit_info, submit->fence);
+	vk.logical.dispatch.WaitForFences(vk.logical.device, 1, &submit->fence, VK_TRUE, UINT64_MAX);
+}
+
+static void queueSubmitReset(void *data) {
+	Submit *submit = data;
+	vk.logical.dispatch.ResetFences(vk.logical.device, 1, &submit->fence);
+}
+
+static Record createRecord() {
+	/* Allocates a resettable command buffer for the recording benchmarks */
+	DeviceDispatch *dispatch = &vk.logical.dispatch;
+	Record record = {};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = vk.logical.physical->queue.family.graphics,
+	};
+
+	if (dispatch->CreateCommandPool(vk.logical.device, &pool_info, NULL, &record.command_pool) != VK_SUCCESS)
+		Panic("createRecord: unable to create VkCommandPool\n");
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = record.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (dispatch->AllocateCommandBuffers(vk.logical.device, &allocate_info, &record.command_buffer) != VK_SUCCESS)
+		Panic("createRecord: unable to allocate VkCommandBuffer\n");
+
+	return record;
+}
+
+static void recordBarriers(void *data) {
+	/* Records RECORD_COMMANDS memory barriers, a cheap command so the call
+	overhead is a large part of what's measured */
+	Record *record = data;
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+	};
+
+	vk.logical.dispatch.BeginCommandBuffer(record->command_buffer, &begin_info);
+
+	uint32_t i;
+	for (i = 0; i < RECORD_COMMANDS; i++)
+		record->barrier(record->command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	vk.logical.dispatch.EndCommandBuffer(record->command_buffer);
+}
+
+static void recordBarriersReset(void *data) {
+	Record *record = data;
+	vk.logical.dispatch.ResetCommandBuffer(record->command_buffer, 0);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	RunBench(&bench, "instance_create", instanceCreate, instanceDestroy, NULL);
+
+	createInstance(&prod);
+
+	/* The extension validation environment asks for every supported extension */
+	const char **names = calloc(vk.extension_properties.count, sizeof(const char *));
+	if (!names) Panic("bench-renderer: unable to allocate extension names\n");
+
+	uint32_t i;
+	for (i = 0; i < vk.extension_properties.count; i++)
+		names[i] = vk.extension_properties.properties[i].extensionName;
+
+	Environment validation = {
+		.instance_extensions = {
+			.names = names,
+			.count = vk.extension_properties.count,
+		},
+	};
+
+	InstanceExtensions instance_extensions = vk.instance_extensions;
+	RunBench(&bench, "extension_validation", extensionValidation, extensionValidationFree, &validation);
+	vk.instance_extensions = instance_extensions;
+
+	RunBench(&bench, "device_enumeration", deviceEnumeration, deviceEnumerationFree, NULL);
+
+	deviceEnumeration(NULL);
+	vk.logical.physical = &vk.physical.devices[0];
+
+	RunBench(&bench, "logical_device_create", logicalDeviceCreate, logicalDeviceDestroy, NULL);
+
+	logicalDeviceCreate(NULL);
+	vk.logical.dispatch.GetDeviceQueue(vk.logical.device, vk.logical.physical->queue.family.graphics, 0, &vk.logical.queue.graphics);
+
+	Submit submit = createSubmit();
+	RunBench(&bench, "queue_submit", queueSubmit, queueSubmitReset, &submit);
+
+	vk.logical.dispatch.DestroyFence(vk.logical.device, submit.fence, NULL);
+	vk.logical.dispatch.DestroyCommandPool(vk.logical.device, submit.command_pool, NULL);
+
+	Record record = createRecord();
+
+#ifndef SODA_VULKAN_DYNAMIC
+	/* Dynamic builds don't link the loader, so there are no trampolines */
+	record.barrier = vkCmdPipelineBarrier;
+	RunBench(&bench, "record_loader", recordBarriers, recordBarriersReset, &record);
+#endif
+
+	record.barrier = vk.logical.dispatch.CmdPipelineBarrier;
+	RunBench(&bench, "record_dispatch", recordBarriers, recordBarriersReset, &record);
+
+	vk.logical.dispatch.DestroyCommandPool(vk.logical.device, record.command_pool, NULL);
+
+	logicalDeviceDestroy(NULL);
+	deviceEnumerationFree(NULL);
+	instanceDestroy(NULL);
+	UnloadVulkan(&vk.loader);
+	free(names);
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,381 @@
+/* bench-residency pushes a heap over its budget with made up residents and
+checks what Residency releases: the least recently used first, lower
+priorities before higher ones, one mip level a sweep and never below
+min_levels, and nothing used by the current frame. A real Texture is evicted
+through its DeletionQueue too. residency_release times releasing RESIDENTS
+residents' worth of levels. It uses the fallback budget, so it runs on any ICD
+including lavapipe:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-residency
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "buffers.h"
+#include "deletion.h"
+#include "panic.h"
+#include "renderer.h"
+#include "residency.h"
+#include "textures.h"
+
+/* constants */
+
+#define MAX_FAKES 16
+#define MAX_DEMOTIONS 64
+
+#define RESIDENTS 4096
+#define LEVELS 8
+
+/* types */
+
+typedef struct {
+	/* Demotion is a call of a made up resident's DemoteMethod */
+	uint32_t fake, levels;
+} Demotion;
+
+typedef struct Test Test;
+
+typedef struct {
+	/* Fake is a made up resident, unit bytes a level */
+	Test *test;
+	uint32_t index, resident;
+	VkDeviceSize unit;
+} Fake;
+
+struct Test {
+	/* Test is a Residency over the heap of device local memory, budget is that
+	heap's fallback budget and demotions logs the DemoteMethod calls */
+	RendererDevice device;
+	Residency residency;
+	DeletionQueue deletions;
+	uint32_t heap;
+	VkDeviceSize budget;
+
+	uint32_t count;
+	Fake fakes[MAX_FAKES];
+
+	uint32_t demotions;
+	Demotion log[MAX_DEMOTIONS];
+};
+
+typedef struct {
+	/* Release is the Residency timed by residency_release, every resident is
+	restored after each update */
+	Residency residency;
+	DeletionQueue deletions;
+	VkDeviceSize unit;
+	uint32_t *residents;
+	uint64_t frame;
+} Release;
+
+/* code */
+
+static VkDeviceSize demoteFake(void *data, uint32_t levels, DeletionQueue *deletions, uint64_t value) {
+	/* Logs the demotion and returns the bytes of levels */
+	Fake *fake = data;
+	Test *test = fake->test;
+
+	if (test->demotions == MAX_DEMOTIONS) Panic("bench-residency: more than %u demotions\n", MAX_DEMOTIONS);
+	test->log[test->demotions++] = (Demotion) {fake->index, levels};
+
+	return levels * fake->unit;
+}
+
+static VkDeviceSize demoteCounted(void *data, uint32_t levels, DeletionQueue *deletions, uint64_t value) {
+	/* Returns the bytes of levels of a Release resident */
+	return levels * *(VkDeviceSize *) data;
+}
+
+static void createTest(Test *test, RendererDevice device) {
+	/* Creates an empty Residency that budgets from the heap sizes alone, so
+	its usage is what the made up residents add up to. test must not move
+	once residents are added */
+	*test = (Test) {
+		.device = device,
+		.residency = CreateResidency(device),
+		.deletions = CreateDeletionQueue(device.dispatch.device),
+	};
+
+	test->residency.device.supports.memory_budget = false;
+
+	uint32_t type = FindMemoryType(&test->device, UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (type == NO_MEMORY_TYPE) Panic("bench-residency: no device local memory type\n");
+
+	test->heap = test->residency.properties.memoryTypes[type].heapIndex;
+	test->budget = (VkDeviceSize) (test->residency.properties.memoryHeaps[test->heap].size * FALLBACK_BUDGET);
+}
+
+static void destroyTest(Test *test) {
+	CollectDeletions(&test->deletions, UINT64_MAX);
+	DestroyDeletionQueue(&test->deletions);
+	DestroyResidency(&test->residency);
+}
+
+static uint32_t addFake(Test *test, VkDeviceSize unit, uint32_t levels, uint32_t min_levels, uint32_t priority) {
+	/* Adds a made up resident of levels units and returns its index in the
+	test */
+	if (test->count == MAX_FAKES) Panic("bench-residency: more than %u fakes\n", MAX_FAKES);
+
+	Fake *fake = &test->fakes[test->count];
+	*fake = (Fake) {
+		.test = test,
+		.index = test->count,
+		.unit = unit,
+	};
+
+	fake->resident = AddResident(&test->residency, (ResidentInfo) {
+		.demote = demoteFake,
+		.data = fake,
+		.size = levels * unit,
+		.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		.levels = levels,
+		.min_levels = min_levels,
+		.priority = priority,
+	});
+
+	return test->count++;
+}
+
+static void touchFake(Test *test, uint32_t fake, uint64_t frame) {
+	/* Marks the made up resident as used by frame. The LRU lists are in the
+	order residents are touched, so tests touch them in frame order */
+	TouchResident(&test->residency, test->fakes[fake].resident, frame);
+}
+
+static void expectDemotions(Test *test, const char *name, const Demotion *expected, uint32_t count) {
+	/* Panics unless the logged demotions are expected, in order */
+	if (test->demotions != count)
+		Panic("bench-residency: %s made %u demotions, expected %u\n", name, test->demotions, count);
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		if (test->log[i].fake != expected[i].fake || test->log[i].levels != expected[i].levels)
+			Panic("bench-residency: %s demotion %u took fake %u to %u levels, expected fake %u to %u\n",
+				name, i, test->log[i].fake, test->log[i].levels, expected[i].fake, expected[i].levels);
+	}
+}
+
+static void checkLeastRecent(RendererDevice device) {
+	/* Ten residents make up the whole budget, releasing down to the low water
+	mark takes the two used longest ago */
+	Test test;
+	createTest(&test, device);
+
+	uint32_t order[10] = {3, 1, 9, 0, 4, 8, 2, 6, 5, 7};
+
+	uint32_t i;
+	for (i = 0; i < 10; i++) addFake(&test, test.budget / 10, 1, 0, 0);
+	for (i = 0; i < 10; i++) touchFake(&test, order[i], 1 + i);
+
+	UpdateResidency(&test.residency, 11, &test.deletions, 12);
+
+	Demotion expected[] = {{3, 0}, {1, 0}};
+	expectDemotions(&test, "least recently used", expected, 2);
+
+	if (test.residency.tracked[test.heap] != 8 * (test.budget / 10))
+		Panic("bench-residency: %llu bytes tracked after the release\n", (unsigned long long) test.residency.tracked[test.heap]);
+
+	/* Evicted residents left the lists, so they aren't released again */
+	test.demotions = 0;
+	touchFake(&test, addFake(&test, test.budget / 5, 1, 0, 0), 12);
+
+	UpdateResidency(&test.residency, 13, &test.deletions, 14);
+
+	Demotion again[] = {{9, 0}, {0, 0}};
+	expectDemotions(&test, "second release", again, 2);
+
+	destroyTest(&test);
+}
+
+static void checkPriorities(RendererDevice device) {
+	/* Priority 0 is exhausted before priority 1 is touched, however long ago
+	priority 1 was used */
+	Test test;
+	createTest(&test, device);
+
+	uint32_t i;
+	for (i = 0; i < 8; i++) touchFake(&test, addFake(&test, test.budget / 10, 1, 0, 1), 1 + i);
+	for (i = 0; i < 2; i++) touchFake(&test, addFake(&test, test.budget / 20, 1, 0, 0), 20 + i);
+	touchFake(&test, addFake(&test, test.budget / 10, 1, 0, 2), 30);
+
+	/* Priority 0 only has 0.1 of the 0.15 over the low water mark */
+	UpdateResidency(&test.residency, 31, &test.deletions, 32);
+
+	Demotion expected[] = {{8, 0}, {9, 0}, {0, 0}};
+	expectDemotions(&test, "priorities", expected, 3);
+
+	destroyTest(&test);
+}
+
+static void checkLevels(RendererDevice device) {
+	/* Each sweep takes one level off every resident in LRU order, and none go
+	below min_levels even if the heap stays over budget */
+	Test test;
+	createTest(&test, device);
+
+	/* 1.2 of the budget in two residents, 0.35 over the low water mark */
+	VkDeviceSize unit = (VkDeviceSize) (test.budget * 0.15);
+	touchFake(&test, addFake(&test, unit, 4, 0, 0), 2);
+	touchFake(&test, addFake(&test, unit, 4, 0, 0), 3);
+
+	UpdateResidency(&test.residency, 4, &test.deletions, 5);
+
+	Demotion sweeps[] = {{0, 3}, {1, 3}, {0, 2}};
+	expectDemotions(&test, "sweeps", sweeps, 3);
+	destroyTest(&test);
+
+	createTest(&test, device);
+
+	/* Twice the budget, but only one level of each can go */
+	uint32_t i;
+	for (i = 0; i < 4; i++) touchFake(&test, addFake(&test, test.budget / 8, 4, 3, 0), 1 + i);
+
+	UpdateResidency(&test.residency, 5, &test.deletions, 6);
+
+	Demotion floors[] = {{0, 3}, {1, 3}, {2, 3}, {3, 3}};
+	expectDemotions(&test, "min_levels", floors, 4);
+	destroyTest(&test);
+}
+
+static void checkCurrentFrame(RendererDevice device) {
+	/* Residents used by the frame being updated stay, even with the heap left
+	over budget */
+	Test test;
+	createTest(&test, device);
+
+	uint32_t i;
+	for (i = 0; i < 10; i++) addFake(&test, test.budget / 8, 1, 0, 0);
+
+	/* The heap is a quarter over, and only the two used before this frame
+	can go */
+	touchFake(&test, 9, 4);
+	touchFake(&test, 8, 5);
+	for (i = 0; i < 8; i++) touchFake(&test, i, 10);
+
+	UpdateResidency(&test.residency, 10, &test.deletions, 11);
+
+	Demotion expected[] = {{9, 0}, {8, 0}};
+	expectDemotions(&test, "current frame", expected, 2);
+
+	if (TouchResident(&test.residency, test.fakes[0].resident, 10) != 1)
+		Panic("bench-residency: a resident used this frame was released\n");
+
+	destroyTest(&test);
+}
+
+static void checkTexture(RendererDevice device) {
+	/* A Texture evicted by DemoteTexture is zeroed and destroyed through the
+	DeletionQueue once its value completes */
+	Test test;
+	createTest(&test, device);
+
+	VkExtent2D extent = {256, 256};
+	Texture texture = CreateTexture(&test.device, extent, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	uint32_t resident = AddResident(&test.residency, (ResidentInfo) {
+		.demote = DemoteTexture,
+		.data = &texture,
+		.size = texture.size,
+		.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		.levels = 1,
+	});
+
+	TouchResident(&test.residency, resident, 1);
+
+	/* The rest of the budget is in use by this frame */
+	touchFake(&test, addFake(&test, test.budget, 1, 0, 0), 2);
+	UpdateResidency(&test.residency, 2, &test.deletions, 3);
+
+	if (texture.image || texture.memory || texture.view)
+		Panic("bench-residency: the evicted texture still has its handles\n");
+
+	if (TouchResident(&test.residency, resident, 2) != 0)
+		Panic("bench-residency: the evicted texture is still resident\n");
+
+	if (CollectDeletions(&test.deletions, 2) != 0)
+		Panic("bench-residency: the texture was deleted before its value completed\n");
+
+	if (CollectDeletions(&test.deletions, 3) != 3)
+		Panic("bench-residency: the texture's image, view and memory weren't deleted\n");
+
+	RemoveResident(&test.residency, resident);
+	destroyTest(&test);
+}
+
+static void updateResidency(void *data) {
+	Release *release = data;
+	UpdateResidency(&release->residency, release->frame, &release->deletions, release->frame + 1);
+}
+
+static void restoreResidents(void *data) {
+	/* Makes every resident whole again and moves on a frame */
+	Release *release = data;
+
+	uint32_t i;
+	for (i = 0; i < RESIDENTS; i++) {
+		RestoreResident(&release->residency, release->residents[i], LEVELS, LEVELS * release->unit);
+		TouchResident(&release->residency, release->residents[i], release->frame);
+	}
+
+	release->frame++;
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+
+	checkLeastRecent(device);
+	checkPriorities(device);
+	checkLevels(device);
+	checkCurrentFrame(device);
+	checkTexture(device);
+
+	/* 1.2 of the budget spread over every resident, so each update takes a
+	level or two off most of them */
+	Test sizes;
+	createTest(&sizes, device);
+
+	Release release = {
+		.residency = CreateResidency(device),
+		.deletions = CreateDeletionQueue(device.dispatch.device),
+		.unit = (VkDeviceSize) (sizes.budget * 1.2) / (RESIDENTS * LEVELS),
+		.residents = malloc(RESIDENTS * sizeof(uint32_t)),
+		.frame = 1,
+	};
+
+	destroyTest(&sizes);
+
+	if (!release.residents) Panic("bench-residency: unable to allocate %u residents\n", RESIDENTS);
+	release.residency.device.supports.memory_budget = false;
+
+	uint32_t i;
+	for (i = 0; i < RESIDENTS; i++) {
+		release.residents[i] = AddResident(&release.residency, (ResidentInfo) {
+			.demote = demoteCounted,
+			.data = &release.unit,
+			.size = LEVELS * release.unit,
+			.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			.levels = LEVELS,
+			.priority = i % RESIDENCY_PRIORITIES,
+		});
+	}
+
+	restoreResidents(&release);
+	RunBench(&bench, "residency_release", updateResidency, restoreResidents, &release);
+
+	printf("%u residents of %u levels, checked LRU order, priorities, levels and the current frame\n", RESIDENTS, LEVELS);
+
+	free(release.residents);
+	DestroyDeletionQueue(&release.deletions);
+	DestroyResidency(&release.residency);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,147 @@
+/* bench-scene updates and culls a scene of NODES nodes with every SIMD
+kernel the CPU runs, across a Jobs pool, and once on a single thread with the
+widest kernels. It doesn't need a device:
+
+	./bench-scene
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "jobs.h"
+#include "panic.h"
+#include "scene.h"
+
+/* constants */
+
+#define NODES (1 << 20)
+
+/* Roots are scattered through a cube of FIELD_SIZE around the camera, every
+other node has BRANCHING children */
+#define ROOTS 1024
+#define BRANCHING 4
+#define FIELD_SIZE 1000.0f
+
+/* types */
+
+typedef struct {
+	/* Cull is the scene culled by a benchmark and the visible nodes */
+	Scene *scene;
+	float planes[6][4];
+	uint32_t *visible, count;
+} Cull;
+
+/* code */
+
+static float randomFloat(uint32_t *state) {
+	/* Returns an xorshift float in [0, 1) */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return (float) (*state >> 8) / (float) (1 << 24);
+}
+
+static void createNodes(Scene *scene) {
+	/* Adds ROOTS trees filled breadth first, children sit a little way from
+	their parents with a random rotation */
+	uint32_t state = 0x5ce7e;
+
+	uint32_t i, j;
+	for (i = 0; i < NODES; i++) {
+		uint32_t parent = (i < ROOTS) ? NO_SCENE_NODE : (i - ROOTS) / BRANCHING;
+		uint32_t node = AddSceneNode(scene, parent);
+
+		float spread = (i < ROOTS) ? FIELD_SIZE : 4.0f;
+		float position[3], rotation[4], length = 0.0f;
+
+		for (j = 0; j < 3; j++) position[j] = (randomFloat(&state) - 0.5f) * spread;
+		for (j = 0; j < 4; j++) {
+			rotation[j] = randomFloat(&state) - 0.5f;
+			length += rotation[j] * rotation[j];
+		}
+
+		for (j = 0; j < 4; j++) rotation[j] /= sqrtf(length);
+
+		float centre[3] = {0.0f, 0.0f, 0.0f};
+		SetSceneTransform(scene, node, position, rotation, 0.75f + randomFloat(&state) * 0.5f);
+		SetSceneBounds(scene, node, centre, 0.5f + randomFloat(&state));
+	}
+}
+
+static void getPlanes(float planes[6][4]) {
+	/* Returns the planes of a camera at the origin looking down -z, with a 1
+	radian vertical field of view at 16:9 */
+	float near = 0.1f, far = FIELD_SIZE;
+	float focal = 1.0f / tanf(0.5f);
+
+	float view_projection[16] = {
+		focal * 9.0f / 16.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, focal, 0.0f, 0.0f,
+		0.0f, 0.0f, far / (near - far), -1.0f,
+		0.0f, 0.0f, near * far / (near - far), 0.0f,
+	};
+
+	GetFrustumPlanes(view_projection, planes);
+}
+
+static void updateScene(void *data) {
+	UpdateScene(data);
+}
+
+static void cullScene(void *data) {
+	Cull *cull = data;
+	cull->count = CullScene(cull->scene, (const float (*)[4]) cull->planes, cull->visible);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+	Jobs *jobs = CreateJobs(0);
+
+	Scene scene = CreateScene(NODES, jobs);
+	SceneSimd widest = scene.simd;
+
+	createNodes(&scene);
+	UpdateScene(&scene);
+
+	Cull cull = {
+		.scene = &scene,
+		.visible = malloc(NODES * sizeof(uint32_t)),
+	};
+
+	if (!cull.visible) Panic("bench-scene: unable to allocate the visible nodes\n");
+	getPlanes(cull.planes);
+
+	char name[BENCH_NAME_SIZE];
+
+	SceneSimd simd;
+	for (simd = SCENE_SIMD_SCALAR; simd <= widest; simd++) {
+		SetSceneSimd(&scene, simd);
+
+		snprintf(name, sizeof(name), "scene_update_%s", GetSceneSimdName(simd));
+		RunBench(&bench, name, updateScene, NULL, &scene);
+
+		snprintf(name, sizeof(name), "scene_cull_%s", GetSceneSimdName(simd));
+		RunBench(&bench, name, cullScene, NULL, &cull);
+	}
+
+	/* The same kernels without the pool shows how the jobs scale */
+	scene.jobs = NULL;
+
+	snprintf(name, sizeof(name), "scene_update_%s_serial", GetSceneSimdName(widest));
+	RunBench(&bench, name, updateScene, NULL, &scene);
+
+	snprintf(name, sizeof(name), "scene_cull_%s_serial", GetSceneSimdName(widest));
+	RunBench(&bench, name, cullScene, NULL, &cull);
+
+	printf("%u nodes in %u levels, %u visible, %u workers\n", scene.count, scene.levels.count, cull.count, jobs->count);
+
+	free(cull.visible);
+	DestroyScene(&scene);
+	DestroyJobs(jobs);
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,243 @@
+/* bench-sprites draws a scene of SPRITES rotating sprites into an offscreen
+target on a headless renderer. sprites_write measures writing the instances
+and batches on the CPU, sprites_frame a whole frame including the GPU:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-sprites
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "deletion.h"
+#include "panic.h"
+#include "passes.h"
+#include "renderer.h"
+#include "sprites.h"
+#include "textures.h"
+
+/* constants */
+
+#define SPRITES 131072
+#define WIDTH 1920
+#define HEIGHT 1080
+
+/* Images of IMAGE_SIZE texels fill three atlas pages */
+#define IMAGES 40
+#define IMAGE_SIZE 512
+
+/* Consecutive sprites that share an image, so batches break at page changes */
+#define SPRITE_RUN 1024
+
+/* types */
+
+typedef struct {
+	/* Scene is the offscreen target, the command buffer that draws into it
+	and the sprites drawn. frame counts the frames begun */
+	RendererDevice device;
+	Passes passes;
+	Texture texture;
+	RenderTarget target;
+
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	DeletionQueue deletions;
+
+	Sprites sprites;
+	SpriteImage images[IMAGES];
+	uint64_t frame;
+} Scene;
+
+/* code */
+
+static SpriteImage addImage(Scene *scene, uint32_t index) {
+	/* Adds a disc image with a colour per index */
+	uint32_t *texels = malloc(IMAGE_SIZE * IMAGE_SIZE * sizeof(uint32_t));
+	if (!texels) Panic("addImage: unable to allocate texels\n");
+
+	uint32_t colour = 0xff000000u | ((index * 0x9e3779b9u) & 0x00ffffffu);
+	float radius = IMAGE_SIZE / 2.0f;
+
+	uint32_t x, y;
+	for (y = 0; y < IMAGE_SIZE; y++) {
+		for (x = 0; x < IMAGE_SIZE; x++) {
+			float dx = x + 0.5f - radius, dy = y + 0.5f - radius;
+			texels[y * IMAGE_SIZE + x] = (dx * dx + dy * dy < radius * radius) ? colour : 0;
+		}
+	}
+
+	SpriteImage image = AddSpriteImage(&scene->sprites, IMAGE_SIZE, IMAGE_SIZE, texels);
+	free(texels);
+
+	return image;
+}
+
+static Scene createScene() {
+	/* Creates the target, the command buffer and the sprites with their
+	images */
+	Scene scene = {
+		.device = GetRendererDevice(),
+	};
+
+	const DeviceDispatch *vk = scene.device.dispatch.device;
+
+	scene.passes = CreatePasses(vk, scene.device.supports.dynamic_rendering);
+
+	VkExtent2D extent = {WIDTH, HEIGHT};
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	scene.texture = CreateTexture(&scene.device, extent, VK_FORMAT_R8G8B8A8_UNORM, usage);
+
+	scene.target = (RenderTarget) {
+		.image = scene.texture.image,
+		.view = scene.texture.view,
+		.format = scene.texture.format,
+		.extent = extent,
+		.load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = scene.device.family.graphics,
+	};
+
+	if (vk->CreateCommandPool(scene.device.device, &pool_info, NULL, &scene.command_pool) != VK_SUCCESS)
+		Panic("createScene: unable to create VkCommandPool\n");
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = scene.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (vk->AllocateCommandBuffers(scene.device.device, &allocate_info, &scene.command_buffer) != VK_SUCCESS)
+		Panic("createScene: unable to allocate VkCommandBuffer\n");
+
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
+
+	if (vk->CreateFence(scene.device.device, &fence_info, NULL, &scene.fence) != VK_SUCCESS)
+		Panic("createScene: unable to create VkFence\n");
+
+	scene.deletions = CreateDeletionQueue(vk);
+	scene.sprites = CreateSprites(scene.device, &scene.passes, &scene.target, SPRITES);
+
+	uint32_t i;
+	for (i = 0; i < IMAGES; i++)
+		scene.images[i] = addImage(&scene, i);
+
+	return scene;
+}
+
+static void destroyScene(Scene *scene) {
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	vk->DeviceWaitIdle(scene->device.device);
+
+	DestroySprites(&scene->sprites);
+	DestroyDeletionQueue(&scene->deletions);
+	vk->DestroyFence(scene->device.device, scene->fence, NULL);
+	vk->DestroyCommandPool(scene->device.device, scene->command_pool, NULL);
+	DestroyPasses(&scene->passes);
+	DestroyTexture(&scene->device, &scene->texture);
+}
+
+static void writeSprites(void *data) {
+	/* Writes every sprite of the frame, spinning around the centre of the
+	target */
+	Scene *scene = data;
+
+	BeginSprites(&scene->sprites, scene->frame);
+
+	float time = scene->frame * (1.0f / 60.0f);
+
+	uint32_t i;
+	for (i = 0; i < SPRITES; i++) {
+		float angle = i * 0.001f + time;
+		float distance = (float) (i % HEIGHT) / 2.0f;
+
+		float x = WIDTH / 2.0f + cosf(angle) * distance;
+		float y = HEIGHT / 2.0f + sinf(angle) * distance;
+
+		const SpriteImage *image = &scene->images[(i / SPRITE_RUN) % IMAGES];
+		DrawSprite(&scene->sprites, image, x, y, 16.0f, 16.0f, angle, 0xc0ffffffu);
+	}
+}
+
+static void nextFrame(void *data) {
+	Scene *scene = data;
+	scene->frame++;
+}
+
+static void drawFrame(void *data) {
+	/* Writes, records and submits a frame, then waits for it */
+	Scene *scene = data;
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	writeSprites(scene);
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->BeginCommandBuffer(scene->command_buffer, &begin_info);
+
+	RecordSpriteUploads(&scene->sprites, scene->command_buffer, &scene->deletions, scene->frame + 1);
+
+	BeginPass(&scene->passes, scene->command_buffer, &scene->target);
+	RecordSprites(&scene->sprites, scene->command_buffer, scene->target.extent);
+	EndPass(&scene->passes, scene->command_buffer, &scene->target);
+
+	vk->EndCommandBuffer(scene->command_buffer);
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &scene->command_buffer,
+	};
+
+	vk->QueueSubmit(scene->device.queue.graphics, 1, &submit_info, scene->fence);
+	vk->WaitForFences(scene->device.device, 1, &scene->fence, VK_TRUE, UINT64_MAX);
+}
+
+static void finishFrame(void *data) {
+	/* Resets the frame's objects and frees the staging of its uploads */
+	Scene *scene = data;
+	const DeviceDispatch *vk = scene->device.dispatch.device;
+
+	vk->ResetFences(scene->device.device, 1, &scene->fence);
+	vk->ResetCommandBuffer(scene->command_buffer, 0);
+
+	CollectDeletions(&scene->deletions, scene->frame + 1);
+	scene->frame++;
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	Scene scene = createScene();
+
+	/* The first frame uploads the images, it isn't part of the scene's cost */
+	drawFrame(&scene);
+	finishFrame(&scene);
+
+	RunBench(&bench, "sprites_write", writeSprites, nextFrame, &scene);
+	RunBench(&bench, "sprites_frame", drawFrame, finishFrame, &scene);
+
+	printf("%u sprites in %u batches on %u pages\n", scene.sprites.count, scene.sprites.batches.count, scene.sprites.pages.count);
+
+	destroyScene(&scene);
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
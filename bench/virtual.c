@@ -0,0 +1,394 @@
+/* bench-virtual streams a virtual texture on a headless renderer, with sparse
+residency where the device has it and with the atlas. Nothing samples the
+texture, so each frame writes the feedback a view of REGION pages square of
+level 0 would. The page file is cut from a generated image by pages, which
+SODA_PAGES names if it isn't ./pages. Before timing, the view is settled in
+one corner and then the opposite one, and the residency of the pages and the
+table are checked:
+
+	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench-virtual
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bench.h"
+#include "panic.h"
+#include "renderer.h"
+#include "virtual.h"
+
+/* constants */
+
+#define IMAGE_SIZE 2048
+#define PAGES (IMAGE_SIZE / VIRTUAL_PAGE_SIZE)
+#define LEVELS 5
+
+/* The fewest slots a texture that evicts may have, so moving the view evicts
+every page the new view doesn't need */
+#define CAPACITY (VIRTUAL_RESERVE + LEVELS)
+
+#define REGION 2
+#define SETTLE_FRAMES 64
+#define PATH_SIZE 256
+
+/* types */
+
+typedef struct {
+	/* Stream is a VirtualTexture, the command buffer its frames are recorded
+	in, and the corner of the region of level 0 the frames request */
+	RendererDevice device;
+	VirtualTexture virtual;
+
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+
+	uint64_t frame;
+	uint32_t x, y;
+} Stream;
+
+/* code */
+
+static void cutPages(const char *directory, char *path) {
+	/* Writes an image of IMAGE_SIZE texels to directory and cuts it into the
+	page file at path */
+	char image[PATH_SIZE], command[4 * PATH_SIZE];
+	snprintf(image, sizeof(image), "%s/image.rgba", directory);
+	snprintf(path, PATH_SIZE, "%s/image.pages", directory);
+
+	FILE *file = fopen(image, "wb");
+	if (!file) Panic("bench-virtual: unable to create %s\n", image);
+
+	uint8_t row[IMAGE_SIZE * 4];
+
+	uint32_t x, y;
+	for (y = 0; y < IMAGE_SIZE; y++) {
+		for (x = 0; x < IMAGE_SIZE; x++) {
+			uint8_t *texel = row + x * 4;
+			texel[0] = (uint8_t) x;
+			texel[1] = (uint8_t) y;
+			texel[2] = (uint8_t) (x / VIRTUAL_PAGE_SIZE * PAGES + y / VIRTUAL_PAGE_SIZE);
+			texel[3] = 255;
+		}
+
+		if (fwrite(row, 1, sizeof(row), file) != sizeof(row)) Panic("bench-virtual: unable to write %s\n", image);
+	}
+
+	if (fclose(file) != 0) Panic("bench-virtual: unable to write %s\n", image);
+
+	const char *pages = getenv("SODA_PAGES");
+	snprintf(command, sizeof(command), "%s %s %s %u", (pages) ? pages : "./pages", path, image, IMAGE_SIZE);
+
+	/* pages prints a summary, the table so far has to come before it */
+	fflush(stdout);
+
+	if (system(command) != 0) Panic("bench-virtual: '%s' failed\n", command);
+	unlink(image);
+}
+
+static void createStream(Stream *stream, RendererDevice device, const char *path) {
+	/* Creates the VirtualTexture of the page file at path and the objects its
+	frames are recorded with */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	*stream = (Stream) {
+		.device = device,
+		.virtual = CreateVirtualTexture(device, path, CAPACITY),
+	};
+
+	if (stream->virtual.pages != PAGES || stream->virtual.levels != LEVELS)
+		Panic("bench-virtual: %s has %u levels of %u pages\n", path, stream->virtual.levels, stream->virtual.pages);
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = device.family.graphics,
+	};
+
+	if (vk->CreateCommandPool(device.device, &pool_info, NULL, &stream->command_pool) != VK_SUCCESS)
+		Panic("bench-virtual: unable to create VkCommandPool\n");
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = stream->command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (vk->AllocateCommandBuffers(device.device, &allocate_info, &stream->command_buffer) != VK_SUCCESS)
+		Panic("bench-virtual: unable to allocate VkCommandBuffer\n");
+
+	VkFenceCreateInfo fence_info = {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+	if (vk->CreateFence(device.device, &fence_info, NULL, &stream->fence) != VK_SUCCESS)
+		Panic("bench-virtual: unable to create VkFence\n");
+}
+
+static void destroyStream(Stream *stream) {
+	/* Destroys the stream, its frames have all been waited on */
+	const DeviceDispatch *vk = stream->device.dispatch.device;
+
+	vk->DestroyFence(stream->device.device, stream->fence, NULL);
+	vk->DestroyCommandPool(stream->device.device, stream->command_pool, NULL);
+	DestroyVirtualTexture(&stream->virtual);
+}
+
+static uint32_t getPage(Stream *stream, uint32_t level, uint32_t x, uint32_t y) {
+	/* Returns the number of the page at x, y of level */
+	return stream->virtual.first[level] + y * (PAGES >> level) + x;
+}
+
+static void recordTransferBarrier(const DeviceDispatch *vk, VkCommandBuffer command_buffer, VkAccessFlags dst_access) {
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = dst_access,
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+static void recordRequests(Stream *stream) {
+	/* Writes the level 0 pages of the region to the feedback, as the fragments
+	sampling it would, after it was cleared and before it's copied back */
+	const DeviceDispatch *vk = stream->device.dispatch.device;
+
+	uint32_t requests[1 + REGION * REGION] = {REGION * REGION};
+
+	uint32_t x, y;
+	for (y = 0; y < REGION; y++)
+		for (x = 0; x < REGION; x++)
+			requests[1 + y * REGION + x] = getPage(stream, 0, stream->x + x, stream->y + y);
+
+	recordTransferBarrier(vk, stream->command_buffer, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	uint32_t i;
+	for (i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+		VkDeviceSize offset = offsetof(VirtualFeedback, count) + i * sizeof(uint32_t);
+		vk->CmdFillBuffer(stream->command_buffer, stream->virtual.feedback.buffer, offset, sizeof(uint32_t), requests[i]);
+	}
+
+	recordTransferBarrier(vk, stream->command_buffer, VK_ACCESS_TRANSFER_READ_BIT);
+}
+
+static void drawFrame(void *data) {
+	/* Records, submits and waits for a frame of the stream */
+	Stream *stream = data;
+	const DeviceDispatch *vk = stream->device.dispatch.device;
+
+	BeginVirtualTexture(&stream->virtual, stream->frame);
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->ResetCommandBuffer(stream->command_buffer, 0);
+	vk->BeginCommandBuffer(stream->command_buffer, &begin_info);
+
+	RecordVirtualTexture(&stream->virtual, stream->command_buffer);
+	recordRequests(stream);
+	RecordVirtualFeedback(&stream->virtual, stream->command_buffer);
+
+	vk->EndCommandBuffer(stream->command_buffer);
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &stream->command_buffer,
+	};
+
+	if (vk->QueueSubmit(stream->device.queue.graphics, 1, &submit_info, stream->fence) != VK_SUCCESS)
+		Panic("bench-virtual: unable to submit\n");
+
+	vk->WaitForFences(stream->device.device, 1, &stream->fence, VK_TRUE, UINT64_MAX);
+	vk->ResetFences(stream->device.device, 1, &stream->fence);
+
+	stream->frame++;
+}
+
+static void panFrame(void *data) {
+	/* Moves the region a page along its rows, then draws a frame */
+	Stream *stream = data;
+
+	stream->x = (stream->x + 1) % (PAGES - REGION + 1);
+	if (!stream->x) stream->y = (stream->y + 1) % (PAGES - REGION + 1);
+
+	drawFrame(stream);
+}
+
+static bool isRegionResident(Stream *stream) {
+	/* Returns true if every page of the region is resident */
+	uint32_t x, y;
+	for (y = stream->y; y < stream->y + REGION; y++)
+		for (x = stream->x; x < stream->x + REGION; x++)
+			if (stream->virtual.page.states[getPage(stream, 0, x, y)] != VIRTUAL_RESIDENT) return false;
+
+	return true;
+}
+
+static void settleRegion(Stream *stream, uint32_t x, uint32_t y) {
+	/* Moves the region to x, y and draws frames until it's resident */
+	stream->x = x;
+	stream->y = y;
+
+	uint32_t i;
+	for (i = 0; i < SETTLE_FRAMES && !isRegionResident(stream); i++) {
+		drawFrame(stream);
+
+		/* The loader reads on its own thread */
+		if (!isRegionResident(stream)) usleep(1000);
+	}
+
+	if (!isRegionResident(stream))
+		Panic("bench-virtual: the region at %u, %u wasn't resident after %u frames\n", x, y, SETTLE_FRAMES);
+}
+
+static void checkPages(Stream *stream) {
+	/* Panics unless every page with a slot owns it and has a parent with a
+	slot, children counts the children with slots, and the slots add up */
+	VirtualTexture *virtual = &stream->virtual;
+	uint32_t used = 0;
+
+	uint32_t level, x, y;
+	for (level = 0; level < LEVELS; level++) {
+		for (y = 0; y < PAGES >> level; y++) {
+			for (x = 0; x < PAGES >> level; x++) {
+				uint32_t page = getPage(stream, level, x, y), slot = virtual->page.slots[page];
+
+				if (slot == NO_VIRTUAL_SLOT) {
+					if (virtual->page.states[page] == VIRTUAL_LOADED || virtual->page.states[page] == VIRTUAL_RESIDENT)
+						Panic("bench-virtual: page %u is loaded without a slot\n", page);
+
+					continue;
+				}
+
+				used += 1;
+
+				if (virtual->slot.slots[slot].page != page)
+					Panic("bench-virtual: page %u has slot %u, which holds page %u\n", page, slot, virtual->slot.slots[slot].page);
+
+				if (level + 1 < LEVELS && virtual->page.slots[getPage(stream, level + 1, x / 2, y / 2)] == NO_VIRTUAL_SLOT)
+					Panic("bench-virtual: page %u has a slot but its parent doesn't\n", page);
+
+				uint32_t children = 0, i;
+				for (i = 0; level && i < 4; i++)
+					children += virtual->page.slots[getPage(stream, level - 1, 2 * x + i % 2, 2 * y + i / 2)] != NO_VIRTUAL_SLOT;
+
+				if (virtual->page.children[page] != children)
+					Panic("bench-virtual: page %u counts %u children with slots, %u have them\n", page, virtual->page.children[page], children);
+			}
+		}
+	}
+
+	if (virtual->page.states[virtual->count - 1] != VIRTUAL_RESIDENT)
+		Panic("bench-virtual: the last level's page isn't resident\n");
+
+	if (used + virtual->slot.free_count + virtual->slot.retired_count != virtual->capacity)
+		Panic("bench-virtual: %u used, %u free and %u retired slots of %u\n", used, virtual->slot.free_count, virtual->slot.retired_count, virtual->capacity);
+}
+
+static void checkTable(Stream *stream) {
+	/* Panics unless every entry of the table is the finest resident page over
+	it, in its slot of the atlas when there's no sparse image */
+	VirtualTexture *virtual = &stream->virtual;
+
+	uint32_t level, x, y;
+	for (level = 0; level < LEVELS; level++) {
+		for (y = 0; y < PAGES >> level; y++) {
+			for (x = 0; x < PAGES >> level; x++) {
+				uint32_t resident = level, page = getPage(stream, level, x, y);
+
+				while (virtual->page.states[page] != VIRTUAL_RESIDENT) {
+					resident += 1;
+					page = getPage(stream, resident, x >> (resident - level), y >> (resident - level));
+				}
+
+				uint32_t slot = virtual->page.slots[page];
+				uint32_t expected = (virtual->sparse) ? VIRTUAL_TABLE_ENTRY(0, 0, resident) :
+					VIRTUAL_TABLE_ENTRY(slot % virtual->atlas, slot / virtual->atlas, resident);
+
+				uint32_t entry = virtual->table.entries[level][y * (PAGES >> level) + x];
+				if (entry != expected)
+					Panic("bench-virtual: entry %u, %u of level %u is 0x%06x, expected 0x%06x\n", x, y, level, entry, expected);
+			}
+		}
+	}
+}
+
+static void checkEvicted(Stream *stream, uint32_t x0, uint32_t y0) {
+	/* Panics unless the level 0 pages of the region that was at x0, y0 were
+	evicted */
+	uint32_t x, y;
+	for (y = y0; y < y0 + REGION; y++)
+		for (x = x0; x < x0 + REGION; x++)
+			if (stream->virtual.page.states[getPage(stream, 0, x, y)] != VIRTUAL_ABSENT)
+				Panic("bench-virtual: page %u, %u of level 0 wasn't evicted\n", x, y);
+}
+
+static void runStream(Bench *bench, RendererDevice device, const char *path) {
+	/* Settles and checks a stream in two corners, then times panning it */
+	Stream stream;
+	createStream(&stream, device, path);
+
+	const char *kind = (stream.virtual.sparse) ? "sparse" : "atlas";
+
+	if (device.supports.sparse_residency && !stream.virtual.sparse) {
+		printf("the device's sparse blocks aren't pages, only the atlas is run\n");
+		destroyStream(&stream);
+		return;
+	}
+
+	settleRegion(&stream, 0, 0);
+	checkPages(&stream);
+	checkTable(&stream);
+
+	settleRegion(&stream, PAGES - REGION, PAGES - REGION);
+	checkPages(&stream);
+	checkTable(&stream);
+	checkEvicted(&stream, 0, 0);
+
+	char name[BENCH_NAME_SIZE];
+	snprintf(name, sizeof(name), "virtual_pan_%s", kind);
+	RunBench(bench, name, panFrame, NULL, &stream);
+
+	/* Panning never waits for the loader, wherever it stopped has to settle */
+	settleRegion(&stream, stream.x, stream.y);
+	checkPages(&stream);
+	checkTable(&stream);
+
+	printf("%s: %llu frames, %u of %u slots free\n", kind, (unsigned long long) stream.frame, stream.virtual.slot.free_count, stream.virtual.capacity);
+
+	destroyStream(&stream);
+}
+
+int main(int argc, char *argv[]) {
+	Bench bench = CreateBench(argc, argv);
+
+	CreateHeadlessRenderer();
+	RendererDevice device = GetRendererDevice();
+
+	char directory[] = "/tmp/soda-bench-virtual-XXXXXX", path[PATH_SIZE];
+	if (!mkdtemp(directory)) Panic("bench-virtual: unable to create a temporary directory\n");
+
+	cutPages(directory, path);
+
+	/* The atlas is run on the same device with sparse residency turned off */
+	if (device.supports.sparse_residency) runStream(&bench, device, path);
+
+	device.supports.sparse_residency = false;
+	runStream(&bench, device, path);
+
+	unlink(path);
+	rmdir(directory);
+
+	DestroyRenderer();
+
+	return FinishBench(&bench);
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "capture.h"
+#include "panic.h"
+#include "renderer.h"
+
+/* code */
+
+uint32_t FindMemoryType(RendererDevice *device, uint32_t type_bits, VkMemoryPropertyFlags properties) {
+	/* Returns the first memory type allowed by type_bits that has all of the
+	properties, or NO_MEMORY_TYPE */
+	VkPhysicalDeviceMemoryProperties memory;
+	device->dispatch.instance->GetPhysicalDeviceMemoryProperties(device->physical_device, &memory);
+
+	uint32_t i;
+	for (i = 0; i < memory.memoryTypeCount; i++) {
+		if (!(type_bits & (1u << i))) continue;
+
+		if ((memory.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+
+	return NO_MEMORY_TYPE;
+}
+
+Buffer CreateBuffer(RendererDevice *device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+	/* Creates a Buffer and its memory, host visible memory stays mapped */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	VkBufferCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+
+	Buffer buffer = {
+		.size = size,
+		.properties = properties,
+	};
+
+	if (vk->CreateBuffer(device->device, &create_info, NULL, &buffer.buffer) != VK_SUCCESS)
+		Panic("CreateBuffer: unable to create VkBuffer of %llu bytes\n", (unsigned long long) size);
+
+	VkMemoryRequirements requirements;
+	vk->GetBufferMemoryRequirements(device->device, buffer.buffer, &requirements);
+
+	uint32_t type = FindMemoryType(device, requirements.memoryTypeBits, properties);
+	if (type == NO_MEMORY_TYPE)
+		Panic("CreateBuffer: no memory type with properties 0x%x\n", properties);
+
+	VkMemoryAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = type,
+	};
+
+	if (vk->AllocateMemory(device->device, &allocate_info, NULL, &buffer.memory) != VK_SUCCESS)
+		Panic("CreateBuffer: unable to allocate %llu bytes\n", (unsigned long long) requirements.size);
+
+	vk->BindBufferMemory(device->device, buffer.buffer, buffer.memory, 0);
+
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vk->MapMemory(device->device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &buffer.mapped) != VK_SUCCESS)
+			Panic("CreateBuffer: unable to map memory\n");
+	}
+
+	CaptureBuffer(&buffer, usage);
+
+	return buffer;
+}
+
+void DestroyBuffer(RendererDevice *device, Buffer *buffer) {
+	/* Destroys the Buffer and frees its memory */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	CaptureDestroyBuffer(buffer);
+
+	if (buffer->mapped) vk->UnmapMemory(device->device, buffer->memory);
+
+	vk->DestroyBuffer(device->device, buffer->buffer, NULL);
+	vk->FreeMemory(device->device, buffer->memory, NULL);
+
+	*buffer = (Buffer) {};
+}
+
+Buffer StageArchiveBlobs(RendererDevice *device, Archive *archive, const char *const *names, uint32_t count, VkDeviceSize *offsets) {
+	/* Returns a staging Buffer holding the blobs called names, each at its
+	offset. Blobs are read or decompressed straight from the archive's mapping
+	into the staging memory. Every blob is prefetched before any is read, so
+	their reads are issued together rather than one fault at a time */
+	const ArchiveEntry **entries = malloc(count * sizeof(ArchiveEntry *));
+	if (!entries) Panic("StageArchiveBlobs: unable to allocate %u entries\n", count);
+
+	VkDeviceSize size = 0;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		entries[i] = FindArchiveEntry(archive, names[i]);
+		if (!entries[i]) Panic("StageArchiveBlobs: no blob called '%s' in the archive\n", names[i]);
+
+		PrefetchArchiveEntry(archive, entries[i]);
+
+		offsets[i] = size;
+		size = (size + entries[i]->size + STAGING_ALIGNMENT - 1) & ~((VkDeviceSize) STAGING_ALIGNMENT - 1);
+	}
+
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	Buffer staging = CreateBuffer(device, (size) ? size : STAGING_ALIGNMENT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties);
+
+	for (i = 0; i < count; i++)
+		ReadArchiveEntry(archive, entries[i], (char *) staging.mapped + offsets[i]);
+
+	free(entries);
+
+	return staging;
+}
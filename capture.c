@@ -0,0 +1,341 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "capture.h"
+#include "compute.h"
+#include "panic.h"
+#include "shaders.h"
+
+/* namespaces */
+
+static struct capture {
+	/* capture is a namespace for the file being captured to. The hooks are
+	called from the modules that submit work and do nothing unless a capture
+	has been started */
+	FILE *file;
+	SDL_mutex *mutex;
+	bool exit_registered;
+
+	uint32_t next_id, count;
+	CaptureObject objects[CAPTURE_MAX_OBJECTS];
+} capture;
+
+/* constants */
+
+static const uint64_t HASH_OFFSET = 0xcbf29ce484222325ULL;
+static const uint64_t HASH_PRIME = 0x100000001b3ULL;
+
+/* code */
+
+static uint64_t hashBytes(const void *data, size_t size) {
+	/* Returns a 64 bit FNV-1a style hash of data, taken 8 bytes at a time */
+	const uint8_t *bytes = data;
+	uint64_t hash = HASH_OFFSET ^ size;
+
+	size_t i;
+	for (i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+
+		hash ^= word;
+		hash *= HASH_PRIME;
+		hash ^= hash >> 29;
+	}
+
+	for (; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static uint32_t findObject(uint32_t kind, uint64_t handle) {
+	/* Returns the slot holding the object, or the empty slot it would go in */
+	uint32_t mask = CAPTURE_MAX_OBJECTS - 1;
+	uint32_t slot = (uint32_t) (hashBytes(&handle, sizeof(handle)) ^ kind) & mask;
+
+	while (capture.objects[slot].handle) {
+		CaptureObject *object = &capture.objects[slot];
+		if (object->handle == handle && object->kind == kind) break;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+static CaptureObject *addObject(uint32_t kind, uint64_t handle) {
+	/* Tracks handle under a new id */
+	if (capture.count == CAPTURE_MAX_OBJECTS - 1)
+		Panic("addObject: more than %u live objects to capture\n", CAPTURE_MAX_OBJECTS - 1);
+
+	CaptureObject *object = &capture.objects[findObject(kind, handle)];
+	*object = (CaptureObject) {
+		.handle = handle,
+		.kind = kind,
+		.id = ++capture.next_id,
+	};
+
+	capture.count += 1;
+
+	return object;
+}
+
+static CaptureObject *getObject(uint32_t kind, uint64_t handle) {
+	/* Returns the tracked object for handle, it must have been created while
+	capturing */
+	CaptureObject *object = &capture.objects[findObject(kind, handle)];
+	if (!object->handle)
+		Panic("getObject: a handle used by the capture was created before it started\n");
+
+	return object;
+}
+
+static void removeObject(uint32_t kind, uint64_t handle) {
+	/* Stops tracking handle, shifting back the objects that probed past it */
+	uint32_t mask = CAPTURE_MAX_OBJECTS - 1;
+	uint32_t slot = findObject(kind, handle);
+	if (!capture.objects[slot].handle) return;
+
+	capture.objects[slot] = (CaptureObject) {};
+	capture.count -= 1;
+
+	uint32_t next = (slot + 1) & mask;
+	while (capture.objects[next].handle) {
+		CaptureObject object = capture.objects[next];
+		capture.objects[next] = (CaptureObject) {};
+
+		capture.objects[findObject(object.kind, object.handle)] = object;
+		next = (next + 1) & mask;
+	}
+}
+
+static void writeRecord(CaptureOp op, const void *payload, size_t size, const void *extra, size_t extra_size, const void *tail, size_t tail_size) {
+	/* Writes a record whose payload is made of up to three parts */
+	CaptureRecord record = {
+		.op = op,
+		.size = (uint32_t) (size + extra_size + tail_size),
+	};
+
+	fwrite(&record, sizeof(record), 1, capture.file);
+	fwrite(payload, 1, size, capture.file);
+
+	if (extra_size) fwrite(extra, 1, extra_size, capture.file);
+	if (tail_size) fwrite(tail, 1, tail_size, capture.file);
+}
+
+void StartCapture(const char *path) {
+	/* Starts capturing submitted work to the file at path. The capture is
+	stopped at exit so that it's complete */
+	if (capture.file) return;
+
+	capture.file = fopen(path, "wb");
+	if (!capture.file) Panic("StartCapture: unable to open %s\n", path);
+
+	/* Records are small, so they're batched into large writes */
+	setvbuf(capture.file, NULL, _IOFBF, 1 << 20);
+
+	capture.mutex = SDL_CreateMutex();
+	if (!capture.mutex) Panic("StartCapture: unable to create mutex\n");
+
+	CaptureHeader header = {
+		.magic = CAPTURE_MAGIC,
+		.version = CAPTURE_VERSION,
+	};
+
+	fwrite(&header, sizeof(header), 1, capture.file);
+
+	if (!capture.exit_registered) atexit(StopCapture);
+	capture.exit_registered = true;
+}
+
+void StopCapture() {
+	/* Flushes and closes the capture file */
+	if (!capture.file) return;
+
+	fclose(capture.file);
+	SDL_DestroyMutex(capture.mutex);
+
+	bool exit_registered = capture.exit_registered;
+	capture = (struct capture) {
+		.exit_registered = exit_registered,
+	};
+}
+
+void CaptureBuffer(const Buffer *buffer, VkBufferUsageFlags usage) {
+	/* Records the creation of buffer */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureObject *object = addObject(CAPTURE_BUFFER_CREATE, (uint64_t) buffer->buffer);
+	object->mapped = buffer->mapped;
+	object->size = buffer->size;
+
+	CaptureBufferCreateData payload = {
+		.id = object->id,
+		.usage = usage,
+		.properties = buffer->properties,
+		.size = buffer->size,
+	};
+
+	writeRecord(CAPTURE_BUFFER_CREATE, &payload, sizeof(payload), NULL, 0, NULL, 0);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureDestroyBuffer(const Buffer *buffer) {
+	/* Records the destruction of buffer */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureDestroyData payload = {
+		.id = getObject(CAPTURE_BUFFER_CREATE, (uint64_t) buffer->buffer)->id,
+	};
+
+	writeRecord(CAPTURE_BUFFER_DESTROY, &payload, sizeof(payload), NULL, 0, NULL, 0);
+	removeObject(CAPTURE_BUFFER_CREATE, (uint64_t) buffer->buffer);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureKernel(const ComputeKernel *kernel, const uint32_t *code, size_t size, const ShaderConstant *constants, uint32_t count) {
+	/* Records the SPIR-V and specialisation of a new kernel */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureKernelCreateData payload = {
+		.id = addObject(CAPTURE_KERNEL_CREATE, (uint64_t) kernel->pipeline)->id,
+		.constants = count,
+		.buffers = kernel->buffers,
+		.push_constants = kernel->push_constants,
+		.size = size,
+	};
+
+	writeRecord(CAPTURE_KERNEL_CREATE, &payload, sizeof(payload), constants, count * sizeof(ShaderConstant), code, size);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureDestroyKernel(const ComputeKernel *kernel) {
+	/* Records the destruction of kernel */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureDestroyData payload = {
+		.id = getObject(CAPTURE_KERNEL_CREATE, (uint64_t) kernel->pipeline)->id,
+	};
+
+	writeRecord(CAPTURE_KERNEL_DESTROY, &payload, sizeof(payload), NULL, 0, NULL, 0);
+	removeObject(CAPTURE_KERNEL_CREATE, (uint64_t) kernel->pipeline);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureDispatch(const ComputeKernel *kernel, const VkBuffer *buffers, const void *push_constants, uint32_t x, uint32_t y, uint32_t z) {
+	/* Records a dispatch, the host visible buffers it uses are recorded at the
+	next submit as they may still be written until then */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureDispatchData payload = {
+		.kernel = getObject(CAPTURE_KERNEL_CREATE, (uint64_t) kernel->pipeline)->id,
+		.x = x,
+		.y = y,
+		.z = z,
+	};
+
+	uint32_t ids[MAX_KERNEL_BUFFERS];
+
+	uint32_t i;
+	for (i = 0; i < kernel->buffers; i++) {
+		CaptureObject *object = getObject(CAPTURE_BUFFER_CREATE, (uint64_t) buffers[i]);
+
+		ids[i] = object->id;
+		object->pending = object->mapped != NULL;
+	}
+
+	writeRecord(CAPTURE_DISPATCH, &payload, sizeof(payload), ids, kernel->buffers * sizeof(uint32_t), push_constants, kernel->push_constants);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureSubmit(ComputeToken token) {
+	/* Records the contents of the host visible buffers used since the last
+	submit, skipping the ones that haven't changed, then the submit of the
+	batch that signals token */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	uint32_t i;
+	for (i = 0; i < CAPTURE_MAX_OBJECTS; i++) {
+		CaptureObject *object = &capture.objects[i];
+		if (!object->pending) continue;
+
+		object->pending = false;
+
+		uint64_t hash = hashBytes(object->mapped, object->size);
+		if (hash == object->hash) continue;
+
+		object->hash = hash;
+
+		CaptureBufferWriteData payload = {
+			.id = object->id,
+			.size = object->size,
+		};
+
+		writeRecord(CAPTURE_BUFFER_WRITE, &payload, sizeof(payload), object->mapped, object->size, NULL, 0);
+	}
+
+	CaptureSubmitData payload = {
+		.token = token,
+	};
+
+	writeRecord(CAPTURE_SUBMIT, &payload, sizeof(payload), NULL, 0, NULL, 0);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureWait(ComputeToken token) {
+	/* Records a wait for token. Tokens count submits from before the capture
+	started, replays map them onto their own through the submits' tokens */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureWaitData payload = {
+		.token = token,
+	};
+
+	writeRecord(CAPTURE_WAIT, &payload, sizeof(payload), NULL, 0, NULL, 0);
+
+	SDL_UnlockMutex(capture.mutex);
+}
+
+void CaptureFrame(uint64_t frame) {
+	/* Marks the end of a frame so that replays can time frames */
+	if (!capture.file) return;
+
+	SDL_LockMutex(capture.mutex);
+
+	CaptureFrameData payload = {
+		.frame = frame,
+	};
+
+	writeRecord(CAPTURE_FRAME, &payload, sizeof(payload), NULL, 0, NULL, 0);
+
+	SDL_UnlockMutex(capture.mutex);
+}
@@ -0,0 +1,460 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "capture.h"
+#include "compute.h"
+#include "panic.h"
+#include "readback.h"
+#include "renderer.h"
+#include "shaders.h"
+
+/* code */
+
+static VkDescriptorPool createBatchDescriptorPool(Compute *compute) {
+	/* Creates a VkDescriptorPool big enough for a full batch of dispatches */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	VkDescriptorPoolSize size = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = COMPUTE_BATCH_DISPATCHES * MAX_KERNEL_BUFFERS,
+	};
+
+	VkDescriptorPoolCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = COMPUTE_BATCH_DISPATCHES,
+		.poolSizeCount = 1,
+		.pPoolSizes = &size,
+	};
+
+	VkDescriptorPool pool;
+	if (vk->CreateDescriptorPool(compute->device.device, &create_info, NULL, &pool) != VK_SUCCESS)
+		Panic("createBatchDescriptorPool: unable to create VkDescriptorPool\n");
+
+	return pool;
+}
+
+static VkSemaphore createTimeline(const DeviceDispatch *vk) {
+	/* Creates a timeline VkSemaphore starting at 0 */
+	VkSemaphoreTypeCreateInfo type_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+
+	VkSemaphoreCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &type_info,
+	};
+
+	VkSemaphore semaphore;
+	if (vk->CreateSemaphore(vk->device, &create_info, NULL, &semaphore) != VK_SUCCESS)
+		Panic("createTimeline: unable to create timeline VkSemaphore\n");
+
+	return semaphore;
+}
+
+Compute CreateCompute(RendererDevice device) {
+	/* Creates the command buffers, descriptor pools and timeline for
+	dispatching on device's compute queue */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	if (!device.supports.timeline_semaphore)
+		Panic("CreateCompute: the device doesn't support timeline semaphores\n");
+
+	Compute compute = {
+		.device = device,
+		.deletions = CreateDeletionQueue(device.dispatch.device),
+	};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = device.family.compute,
+	};
+
+	if (vk->CreateCommandPool(device.device, &pool_info, NULL, &compute.command_pool) != VK_SUCCESS)
+		Panic("CreateCompute: unable to create VkCommandPool\n");
+
+	VkCommandBuffer command_buffers[COMPUTE_BATCHES];
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = compute.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = COMPUTE_BATCHES,
+	};
+
+	if (vk->AllocateCommandBuffers(device.device, &allocate_info, command_buffers) != VK_SUCCESS)
+		Panic("CreateCompute: unable to allocate VkCommandBuffers\n");
+
+	uint32_t i;
+	for (i = 0; i < COMPUTE_BATCHES; i++) {
+		compute.batches[i] = (ComputeBatch) {
+			.command_buffer = command_buffers[i],
+			.descriptors = createBatchDescriptorPool(&compute),
+		};
+	}
+
+	compute.timeline = createTimeline(device.dispatch.device);
+
+	return compute;
+}
+
+void DestroyCompute(Compute *compute) {
+	/* Waits for the submitted batches, then destroys compute */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+	VkDevice device = compute->device.device;
+
+	SubmitCompute(compute);
+	WaitCompute(compute, compute->submitted);
+
+	uint32_t i;
+	for (i = 0; i < COMPUTE_BATCHES; i++)
+		vk->DestroyDescriptorPool(device, compute->batches[i].descriptors, NULL);
+
+	vk->DestroyCommandPool(device, compute->command_pool, NULL);
+	vk->DestroySemaphore(device, compute->timeline, NULL);
+	DestroyDeletionQueue(&compute->deletions);
+
+	*compute = (Compute) {};
+}
+
+ComputeKernel CreateComputeKernel(Compute *compute, const uint32_t *code, size_t size, const ShaderConstant *constants, uint32_t count, uint32_t buffers, uint32_t push_constants) {
+	/* Creates a ComputeKernel from SPIR-V. The module comes from the renderer's
+	ShaderCache, and constants specialise it e.g. for the workgroup size */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+	VkDevice device = compute->device.device;
+
+	if (buffers > MAX_KERNEL_BUFFERS)
+		Panic("CreateComputeKernel: %u buffers is more than %u\n", buffers, MAX_KERNEL_BUFFERS);
+
+	ComputeKernel kernel = {
+		.module = AcquireShaderModule(compute->device.shaders.cache, code, size),
+		.buffers = buffers,
+		.push_constants = push_constants,
+	};
+
+	VkDescriptorSetLayoutBinding bindings[MAX_KERNEL_BUFFERS];
+
+	uint32_t i;
+	for (i = 0; i < buffers; i++) {
+		bindings[i] = (VkDescriptorSetLayoutBinding) {
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		};
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = buffers,
+		.pBindings = bindings,
+	};
+
+	if (vk->CreateDescriptorSetLayout(device, &set_info, NULL, &kernel.set_layout) != VK_SUCCESS)
+		Panic("CreateComputeKernel: unable to create VkDescriptorSetLayout\n");
+
+	VkPushConstantRange range = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = push_constants,
+	};
+
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &kernel.set_layout,
+		.pushConstantRangeCount = (push_constants) ? 1 : 0,
+		.pPushConstantRanges = &range,
+	};
+
+	if (vk->CreatePipelineLayout(device, &layout_info, NULL, &kernel.layout) != VK_SUCCESS)
+		Panic("CreateComputeKernel: unable to create VkPipelineLayout\n");
+
+	ShaderVariant variant = CreateShaderVariant(kernel.module, VK_SHADER_STAGE_COMPUTE_BIT, constants, count);
+
+	VkComputePipelineCreateInfo pipeline_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = GetShaderStage(&variant),
+		.layout = kernel.layout,
+	};
+
+	if (vk->CreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &kernel.pipeline) != VK_SUCCESS)
+		Panic("CreateComputeKernel: unable to create compute VkPipeline\n");
+
+	CaptureKernel(&kernel, code, size, constants, count);
+
+	return kernel;
+}
+
+void DestroyComputeKernel(Compute *compute, ComputeKernel *kernel) {
+	/* Destroys the kernel, it must not be used by a batch in flight */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+	VkDevice device = compute->device.device;
+
+	CaptureDestroyKernel(kernel);
+
+	vk->DestroyPipeline(device, kernel->pipeline, NULL);
+	vk->DestroyPipelineLayout(device, kernel->layout, NULL);
+	vk->DestroyDescriptorSetLayout(device, kernel->set_layout, NULL);
+	ReleaseShaderModule(compute->device.shaders.cache, kernel->module);
+
+	*kernel = (ComputeKernel) {};
+}
+
+void RetireComputeKernel(Compute *compute, ComputeKernel *kernel, ComputeToken token) {
+	/* Destroys the kernel once the dispatches up to token have completed,
+	without waiting for them. The module is released now as the pipeline
+	doesn't need it */
+	CaptureDestroyKernel(kernel);
+
+	DeleteLater(&compute->deletions, DELETE_PIPELINE, (uint64_t) kernel->pipeline, token);
+	DeleteLater(&compute->deletions, DELETE_PIPELINE_LAYOUT, (uint64_t) kernel->layout, token);
+	DeleteLater(&compute->deletions, DELETE_DESCRIPTOR_SET_LAYOUT, (uint64_t) kernel->set_layout, token);
+	ReleaseShaderModule(compute->device.shaders.cache, kernel->module);
+
+	*kernel = (ComputeKernel) {};
+}
+
+static ComputeBatch *beginBatch(Compute *compute) {
+	/* Starts recording the next batch once the GPU is done with its last use */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	ComputeBatch *batch = &compute->batches[compute->current];
+
+	WaitCompute(compute, batch->token);
+
+	uint64_t completed = 0;
+	vk->GetSemaphoreCounterValue(compute->device.device, compute->timeline, &completed);
+	CollectDeletions(&compute->deletions, completed);
+
+	vk->ResetDescriptorPool(compute->device.device, batch->descriptors, 0);
+	vk->ResetCommandBuffer(batch->command_buffer, 0);
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->BeginCommandBuffer(batch->command_buffer, &begin_info);
+
+	/* Submissions aren't memory dependencies, so the batch waits on the
+	dispatches and readback copies of earlier batches itself */
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+
+	VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vk->CmdPipelineBarrier(batch->command_buffer, src_stages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	batch->token = compute->submitted + 1;
+	batch->dispatches = 0;
+	compute->recording = true;
+
+	return batch;
+}
+
+static VkDescriptorSet writeBufferSet(Compute *compute, ComputeBatch *batch, ComputeKernel *kernel, const VkBuffer *buffers) {
+	/* Allocates a descriptor set from the batch and points it at buffers */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	VkDescriptorSetAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = batch->descriptors,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &kernel->set_layout,
+	};
+
+	VkDescriptorSet set;
+	if (vk->AllocateDescriptorSets(compute->device.device, &allocate_info, &set) != VK_SUCCESS)
+		Panic("Dispatch: unable to allocate VkDescriptorSet\n");
+
+	VkDescriptorBufferInfo infos[MAX_KERNEL_BUFFERS];
+	VkWriteDescriptorSet writes[MAX_KERNEL_BUFFERS];
+
+	uint32_t i;
+	for (i = 0; i < kernel->buffers; i++) {
+		infos[i] = (VkDescriptorBufferInfo) {
+			.buffer = buffers[i],
+			.offset = 0,
+			.range = VK_WHOLE_SIZE,
+		};
+
+		writes[i] = (VkWriteDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = set,
+			.dstBinding = i,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &infos[i],
+		};
+	}
+
+	vk->UpdateDescriptorSets(compute->device.device, kernel->buffers, writes, 0, NULL);
+
+	return set;
+}
+
+ComputeToken Dispatch(Compute *compute, ComputeKernel *kernel, const VkBuffer *buffers, const void *push_constants, uint32_t x, uint32_t y, uint32_t z) {
+	/* Records a dispatch of kernel into the current batch and returns the token
+	that completes with it. Dispatches run in order, each one sees the writes
+	of the ones before it in this batch or earlier ones */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	if (compute->recording && compute->batches[compute->current].dispatches == COMPUTE_BATCH_DISPATCHES)
+		SubmitCompute(compute);
+
+	ComputeBatch *batch = (compute->recording) ? &compute->batches[compute->current] : beginBatch(compute);
+	VkCommandBuffer command_buffer = batch->command_buffer;
+
+	/* The first dispatch of a batch is ordered by beginBatch */
+	if (batch->dispatches) {
+		VkMemoryBarrier barrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		};
+
+		vk->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	}
+
+	VkDescriptorSet set = writeBufferSet(compute, batch, kernel, buffers);
+
+	vk->CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->layout, 0, 1, &set, 0, NULL);
+
+	if (kernel->push_constants)
+		vk->CmdPushConstants(command_buffer, kernel->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel->push_constants, push_constants);
+
+	vk->CmdDispatch(command_buffer, x, y, z);
+	batch->dispatches += 1;
+
+	CaptureDispatch(kernel, buffers, push_constants, x, y, z);
+
+	return batch->token;
+}
+
+ReadbackFuture ReadbackCompute(Compute *compute, Readbacks *readbacks, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+	/* Records a read of buffer after the dispatches recorded so far, which
+	completes with the batch's token */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	ComputeBatch *batch = (compute->recording) ? &compute->batches[compute->current] : beginBatch(compute);
+	VkCommandBuffer command_buffer = batch->command_buffer;
+
+	VkMemoryBarrier before = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before, 0, NULL, 0, NULL);
+
+	ReadbackFuture future = ReadbackBuffer(readbacks, command_buffer, buffer, offset, size, batch->token);
+
+	/* Later dispatches may overwrite buffer, they wait for the copy */
+	vk->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+
+	return future;
+}
+
+ComputeToken SubmitCompute(Compute *compute) {
+	/* Submits the current batch, if there is one, in a single vkQueueSubmit and
+	returns the token of the last submitted batch */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	if (!compute->recording) return compute->submitted;
+
+	ComputeBatch *batch = &compute->batches[compute->current];
+
+	/* The host reads mapped outputs once token completes, which needs their
+	writes made available to it */
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+
+	vk->CmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+	vk->EndCommandBuffer(batch->command_buffer);
+
+	CaptureSubmit(batch->token);
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &batch->token,
+	};
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_info,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch->command_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &compute->timeline,
+	};
+
+	if (vk->QueueSubmit(compute->device.queue.compute, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+		Panic("SubmitCompute: unable to submit batch\n");
+
+	compute->submitted = batch->token;
+	compute->current = (compute->current + 1) % COMPUTE_BATCHES;
+	compute->recording = false;
+
+	return compute->submitted;
+}
+
+bool PollCompute(Compute *compute, ComputeToken token) {
+	/* Returns true if the work for token has completed, it doesn't submit so a
+	token from the batch being recorded stays incomplete until SubmitCompute */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	uint64_t value = 0;
+	vk->GetSemaphoreCounterValue(compute->device.device, compute->timeline, &value);
+
+	return value >= token;
+}
+
+void WaitCompute(Compute *compute, ComputeToken token) {
+	/* Blocks until the work for token has completed, submitting the current
+	batch if token belongs to it */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	if (token > compute->submitted) SubmitCompute(compute);
+
+	CaptureWait(token);
+
+	VkSemaphoreWaitInfo wait_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &compute->timeline,
+		.pValues = &token,
+	};
+
+	if (vk->WaitSemaphores(compute->device.device, &wait_info, UINT64_MAX) != VK_SUCCESS)
+		Panic("WaitCompute: unable to wait for token %llu\n", (unsigned long long) token);
+}
+
+void InvalidateComputeBuffer(Compute *compute, const Buffer *buffer) {
+	/* Makes the writes of completed dispatches to a mapped buffer visible to
+	the host, memory that isn't coherent has to be invalidated first */
+	const DeviceDispatch *vk = compute->device.dispatch.device;
+
+	if (buffer->properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+
+	VkMappedMemoryRange range = {
+		.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = buffer->memory,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+
+	vk->InvalidateMappedMemoryRanges(compute->device.device, 1, &range);
+}
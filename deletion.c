@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "capture.h"
+#include "deletion.h"
+#include "dispatch.h"
+#include "panic.h"
+
+/* constants */
+
+/* Descriptor sets freed to the same pool by one vkFreeDescriptorSets */
+#define MAX_FREED_SETS 64
+
+/* code */
+
+DeletionQueue CreateDeletionQueue(const DeviceDispatch *vk) {
+	/* Returns an empty DeletionQueue for the device vk was loaded from */
+	return (DeletionQueue) {
+		.vk = vk,
+	};
+}
+
+static void growDeletionQueue(DeletionQueue *queue) {
+	/* Doubles the ring, unwrapping the deletions to the start of it */
+	uint32_t capacity = (queue->capacity) ? queue->capacity * 2 : INITIAL_DELETIONS;
+
+	Deletion *deletions = malloc(capacity * sizeof(Deletion));
+	if (!deletions) Panic("growDeletionQueue: unable to allocate %u Deletions\n", capacity);
+
+	uint32_t i;
+	for (i = 0; i < queue->count; i++)
+		deletions[i] = queue->deletions[(queue->head + i) % queue->capacity];
+
+	free(queue->deletions);
+
+	queue->deletions = deletions;
+	queue->capacity = capacity;
+	queue->head = 0;
+}
+
+void DeleteLater(DeletionQueue *queue, DeletionType type, uint64_t handle, uint64_t value) {
+	/* Queues handle to be destroyed once value has completed, a value of 0
+	means the GPU never used it */
+	if (!handle) return;
+
+	if (queue->count == queue->capacity) growDeletionQueue(queue);
+
+	if (value < queue->last) value = queue->last;
+	queue->last = value;
+
+	queue->deletions[(queue->head + queue->count) % queue->capacity] = (Deletion) {
+		.value = value,
+		.type = type,
+		.handle = handle,
+	};
+
+	queue->count += 1;
+}
+
+void DeleteBufferLater(DeletionQueue *queue, Buffer *buffer, uint64_t value) {
+	/* Queues the Buffer and its memory and unsets buffer, the mapping goes with
+	the memory */
+	CaptureDestroyBuffer(buffer);
+
+	DeleteLater(queue, DELETE_BUFFER, (uint64_t) buffer->buffer, value);
+	DeleteLater(queue, DELETE_MEMORY, (uint64_t) buffer->memory, value);
+
+	*buffer = (Buffer) {};
+}
+
+void DeleteDescriptorSetLater(DeletionQueue *queue, VkDescriptorPool pool, VkDescriptorSet set, uint64_t value) {
+	/* Queues set to be freed to pool, which must have been created with
+	VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT */
+	if (!set) return;
+
+	DeleteLater(queue, DELETE_DESCRIPTOR_SET, (uint64_t) set, value);
+	queue->deletions[(queue->head + queue->count - 1) % queue->capacity].pool = pool;
+}
+
+static uint32_t freeDescriptorSets(DeletionQueue *queue, uint64_t completed) {
+	/* Frees the run of completed descriptor sets at the head that share a
+	pool in a single call, returns how many were freed */
+	VkDescriptorPool pool = queue->deletions[queue->head].pool;
+	VkDescriptorSet sets[MAX_FREED_SETS];
+
+	uint32_t count = 0;
+	while (count < MAX_FREED_SETS && count < queue->count) {
+		Deletion *deletion = &queue->deletions[(queue->head + count) % queue->capacity];
+		if (deletion->value > completed || deletion->type != DELETE_DESCRIPTOR_SET || deletion->pool != pool) break;
+
+		sets[count++] = (VkDescriptorSet) deletion->handle;
+	}
+
+	queue->vk->FreeDescriptorSets(queue->vk->device, pool, count, sets);
+
+	return count;
+}
+
+static void deleteObject(DeletionQueue *queue, Deletion *deletion) {
+	/* Destroys the object of a Deletion */
+	const DeviceDispatch *vk = queue->vk;
+	VkDevice device = vk->device;
+
+	switch (deletion->type) {
+		case DELETE_BUFFER: vk->DestroyBuffer(device, (VkBuffer) deletion->handle, NULL); break;
+		case DELETE_MEMORY: vk->FreeMemory(device, (VkDeviceMemory) deletion->handle, NULL); break;
+		case DELETE_IMAGE: vk->DestroyImage(device, (VkImage) deletion->handle, NULL); break;
+		case DELETE_IMAGE_VIEW: vk->DestroyImageView(device, (VkImageView) deletion->handle, NULL); break;
+		case DELETE_SAMPLER: vk->DestroySampler(device, (VkSampler) deletion->handle, NULL); break;
+		case DELETE_PIPELINE: vk->DestroyPipeline(device, (VkPipeline) deletion->handle, NULL); break;
+		case DELETE_PIPELINE_LAYOUT: vk->DestroyPipelineLayout(device, (VkPipelineLayout) deletion->handle, NULL); break;
+		case DELETE_DESCRIPTOR_SET_LAYOUT: vk->DestroyDescriptorSetLayout(device, (VkDescriptorSetLayout) deletion->handle, NULL); break;
+		case DELETE_DESCRIPTOR_POOL: vk->DestroyDescriptorPool(device, (VkDescriptorPool) deletion->handle, NULL); break;
+		case DELETE_FRAMEBUFFER: vk->DestroyFramebuffer(device, (VkFramebuffer) deletion->handle, NULL); break;
+		case DELETE_SEMAPHORE: vk->DestroySemaphore(device, (VkSemaphore) deletion->handle, NULL); break;
+		case DELETE_QUERY_POOL: vk->DestroyQueryPool(device, (VkQueryPool) deletion->handle, NULL); break;
+		case DELETE_DESCRIPTOR_SET: break;
+	}
+}
+
+uint32_t CollectDeletions(DeletionQueue *queue, uint64_t completed) {
+	/* Destroys every queued object whose value has completed and returns how
+	many there were. The queue is in value order so it stops at the first one
+	still in use */
+	uint32_t deleted = 0;
+
+	while (queue->count && queue->deletions[queue->head].value <= completed) {
+		uint32_t count = 1;
+
+		if (queue->deletions[queue->head].type == DELETE_DESCRIPTOR_SET) count = freeDescriptorSets(queue, completed);
+		else deleteObject(queue, &queue->deletions[queue->head]);
+
+		queue->head = (queue->head + count) % queue->capacity;
+		queue->count -= count;
+		deleted += count;
+	}
+
+	return deleted;
+}
+
+void DestroyDeletionQueue(DeletionQueue *queue) {
+	/* Destroys everything still queued, the GPU must be done with all of it */
+	CollectDeletions(queue, UINT64_MAX);
+	free(queue->deletions);
+
+	*queue = (DeletionQueue) {};
+}
@@ -0,0 +1,89 @@
+#include <stddef.h>
+
+#ifdef SODA_VULKAN_DYNAMIC
+#include <dlfcn.h>
+#endif
+
+#include <vulkan/vulkan.h>
+
+#include "dispatch.h"
+#include "panic.h"
+
+/* constants */
+
+#ifdef SODA_VULKAN_DYNAMIC
+static const char *VULKAN_LIBRARIES[] = {
+	/* The loader's soname, then the development symlink */
+	"libvulkan.so.1",
+	"libvulkan.so",
+};
+#endif
+
+/* code */
+
+static PFN_vkGetInstanceProcAddr getInstanceProcAddr(VulkanLoader *loader) {
+	/* Returns the loader's entry point. SODA_VULKAN_DYNAMIC builds don't link
+	libvulkan, they open it at runtime */
+#ifdef SODA_VULKAN_DYNAMIC
+	uint32_t i;
+	for (i = 0; i < sizeof(VULKAN_LIBRARIES) / sizeof(VULKAN_LIBRARIES[0]) && !loader->library; i++)
+		loader->library = dlopen(VULKAN_LIBRARIES[i], RTLD_NOW | RTLD_LOCAL);
+
+	if (!loader->library) Panic("LoadVulkan: unable to open %s\n", VULKAN_LIBRARIES[0]);
+
+	return (PFN_vkGetInstanceProcAddr) dlsym(loader->library, "vkGetInstanceProcAddr");
+#else
+	return vkGetInstanceProcAddr;
+#endif
+}
+
+VulkanLoader LoadVulkan() {
+	/* Returns the functions that are called before there is a VkInstance */
+	VulkanLoader loader = {};
+
+	loader.GetInstanceProcAddr = getInstanceProcAddr(&loader);
+	if (!loader.GetInstanceProcAddr) Panic("LoadVulkan: unable to find vkGetInstanceProcAddr\n");
+
+#define LOAD(name) loader.name = (PFN_vk##name) loader.GetInstanceProcAddr(VK_NULL_HANDLE, "vk" #name);
+	LOADER_FUNCTIONS(LOAD)
+#undef LOAD
+
+	return loader;
+}
+
+void UnloadVulkan(VulkanLoader *loader) {
+	/* Closes libvulkan if it was opened at runtime, every table loaded through
+	loader is invalid afterwards */
+#ifdef SODA_VULKAN_DYNAMIC
+	if (loader->library) dlclose(loader->library);
+#endif
+
+	*loader = (VulkanLoader) {};
+}
+
+InstanceDispatch LoadInstanceDispatch(const VulkanLoader *loader, VkInstance instance) {
+	/* Returns the table of instance's functions */
+	InstanceDispatch dispatch = {
+		.instance = instance,
+	};
+
+#define LOAD(name) dispatch.name = (PFN_vk##name) loader->GetInstanceProcAddr(instance, "vk" #name);
+	INSTANCE_FUNCTIONS(LOAD)
+#undef LOAD
+
+	return dispatch;
+}
+
+DeviceDispatch LoadDeviceDispatch(const InstanceDispatch *instance, VkDevice device) {
+	/* Returns the table of device's functions, each VkDevice needs its own as
+	the pointers are only valid for the device they were loaded from */
+	DeviceDispatch dispatch = {
+		.device = device,
+	};
+
+#define LOAD(name) dispatch.name = (PFN_vk##name) instance->GetDeviceProcAddr(device, "vk" #name);
+	DEVICE_FUNCTIONS(LOAD)
+#undef LOAD
+
+	return dispatch;
+}
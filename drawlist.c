@@ -0,0 +1,290 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "drawlist.h"
+#include "jobs.h"
+#include "panic.h"
+
+/* constants */
+
+/* Sorting happens one byte at a time */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+/* Chunks smaller than this cost more to hand to a worker than to sort */
+static const uint32_t MIN_SORT_CHUNK = 4096;
+
+/* types */
+
+typedef struct {
+	/* RadixPass is the state shared by the workers during one radix pass */
+	DrawList *list;
+	uint32_t shift, chunks;
+} RadixPass;
+
+/* code */
+
+static void *reallocArray(void *data, uint32_t count, size_t size) {
+	/* Resizes data to hold count elements of size, panics on failure */
+	void *resized = realloc(data, count * size);
+	if (!resized) Panic("drawlist/reallocArray: unable to allocate %u elements\n", count);
+
+	return resized;
+}
+
+static void reserveDrawList(DrawList *list, uint32_t capacity) {
+	/* Grows the arrays in list so they can hold at least capacity Draws */
+	if (capacity <= list->capacity) return;
+
+	list->draws = reallocArray(list->draws, capacity, sizeof(Draw));
+	list->sort.items = reallocArray(list->sort.items, capacity, sizeof(DrawSortItem));
+	list->sort.scratch = reallocArray(list->sort.scratch, capacity, sizeof(DrawSortItem));
+	list->batches.data = reallocArray(list->batches.data, capacity, sizeof(DrawBatch));
+	list->instances = reallocArray(list->instances, capacity, sizeof(uint32_t));
+
+	list->capacity = capacity;
+}
+
+DrawList CreateDrawList(uint32_t capacity, Jobs *jobs) {
+	/* Allocates a DrawList, jobs may be NULL to sort on the calling thread */
+	DrawList list = {
+		.jobs = jobs,
+		.sort.chunks = (jobs) ? jobs->count + 1 : 1,
+	};
+
+	list.sort.histograms = calloc(list.sort.chunks, sizeof(*list.sort.histograms));
+	if (!list.sort.histograms)
+		Panic("CreateDrawList: unable to allocate histograms\n");
+
+	reserveDrawList(&list, capacity ? capacity : 1);
+
+	return list;
+}
+
+void DestroyDrawList(DrawList *list) {
+	/* Deallocates the DrawList and unsets its members */
+	free(list->draws);
+	free(list->sort.items);
+	free(list->sort.scratch);
+	free(list->sort.histograms);
+	free(list->batches.data);
+	free(list->instances);
+
+	*list = (DrawList) {};
+}
+
+void ResetDrawList(DrawList *list) {
+	/* Empties the DrawList for the next frame, keeping its allocations */
+	list->count = 0;
+	list->batches.count = 0;
+}
+
+void SubmitDraw(DrawList *list, Draw draw) {
+	/* Appends draw to the DrawList */
+	if (list->count == list->capacity)
+		reserveDrawList(list, list->capacity * 2);
+
+	list->draws[list->count++] = draw;
+}
+
+static void chunkRange(RadixPass *pass, uint32_t chunk, uint32_t *begin, uint32_t *end) {
+	/* Sets the [begin, end) range of items that belong to chunk */
+	uint64_t count = pass->list->count;
+
+	*begin = (uint32_t) (count * chunk / pass->chunks);
+	*end = (uint32_t) (count * (chunk + 1) / pass->chunks);
+}
+
+static void countDigits(void *data, uint32_t chunk) {
+	/* Job that builds the digit histogram for one chunk */
+	RadixPass *pass = data;
+	DrawSortItem *items = pass->list->sort.items;
+	uint32_t *histogram = pass->list->sort.histograms[chunk];
+
+	memset(histogram, 0, RADIX_BUCKETS * sizeof(uint32_t));
+
+	uint32_t i, begin, end;
+	chunkRange(pass, chunk, &begin, &end);
+
+	for (i = begin; i < end; i++)
+		histogram[(items[i].key >> pass->shift) & (RADIX_BUCKETS - 1)] += 1;
+}
+
+static void scatterDigits(void *data, uint32_t chunk) {
+	/* Job that moves one chunk's items to their sorted offsets in scratch */
+	RadixPass *pass = data;
+	DrawSortItem *items = pass->list->sort.items;
+	DrawSortItem *scratch = pass->list->sort.scratch;
+	uint32_t *offsets = pass->list->sort.histograms[chunk];
+
+	uint32_t i, begin, end;
+	chunkRange(pass, chunk, &begin, &end);
+
+	for (i = begin; i < end; i++) {
+		uint32_t digit = (items[i].key >> pass->shift) & (RADIX_BUCKETS - 1);
+		scratch[offsets[digit]++] = items[i];
+	}
+}
+
+static void prefixDigits(DrawList *list, uint32_t chunks) {
+	/* Turns the per-chunk histograms into scatter offsets. Earlier chunks come
+	first within a digit, which keeps the sort stable */
+	uint32_t digit, chunk, offset = 0;
+
+	for (digit = 0; digit < RADIX_BUCKETS; digit++) {
+		for (chunk = 0; chunk < chunks; chunk++) {
+			uint32_t count = list->sort.histograms[chunk][digit];
+			list->sort.histograms[chunk][digit] = offset;
+			offset += count;
+		}
+	}
+}
+
+static uint64_t varyingKeyBits(DrawList *list) {
+	/* Returns the bits that differ between any of the keys, passes over bytes
+	where every key is the same can be skipped */
+	uint64_t first = list->sort.items[0].key, varying = 0;
+
+	uint32_t i;
+	for (i = 1; i < list->count; i++)
+		varying |= list->sort.items[i].key ^ first;
+
+	return varying;
+}
+
+static void radixSort(DrawList *list) {
+	/* Sorts the DrawSortItems by key with a least significant digit radix sort,
+	splitting each pass over the Jobs pool */
+	uint32_t chunks = list->count / MIN_SORT_CHUNK;
+	if (chunks > list->sort.chunks) chunks = list->sort.chunks;
+	if (chunks < 1) chunks = 1;
+
+	uint64_t varying = varyingKeyBits(list);
+
+	uint32_t i;
+	for (i = 0; i < RADIX_PASSES; i++) {
+		RadixPass pass = {
+			.list = list,
+			.shift = i * RADIX_BITS,
+			.chunks = chunks,
+		};
+
+		if (!((varying >> pass.shift) & (RADIX_BUCKETS - 1))) continue;
+
+		RunJobs(list->jobs, countDigits, &pass, chunks);
+		prefixDigits(list, chunks);
+		RunJobs(list->jobs, scatterDigits, &pass, chunks);
+
+		DrawSortItem *items = list->sort.items;
+		list->sort.items = list->sort.scratch;
+		list->sort.scratch = items;
+	}
+}
+
+static bool sameDrawState(Draw *a, Draw *b) {
+	/* Returns true if a and b can be recorded in the same instanced draw */
+	return a->pipeline == b->pipeline &&
+		a->layout == b->layout &&
+		a->material == b->material &&
+		a->mesh.vertices == b->mesh.vertices &&
+		a->mesh.indices == b->mesh.indices &&
+		a->mesh.count == b->mesh.count &&
+		a->mesh.first_index == b->mesh.first_index &&
+		a->mesh.vertex_offset == b->mesh.vertex_offset;
+}
+
+static void mergeBatches(DrawList *list) {
+	/* Merges runs of sorted Draws with the same state into DrawBatches */
+	DrawBatch *batch = NULL;
+	list->batches.count = 0;
+
+	uint32_t i;
+	for (i = 0; i < list->count; i++) {
+		uint32_t index = list->sort.items[i].draw;
+		Draw *draw = &list->draws[index];
+
+		list->instances[i] = draw->instance;
+
+		if (batch && sameDrawState(&list->draws[batch->draw], draw)) {
+			batch->instance_count += 1;
+			continue;
+		}
+
+		batch = &list->batches.data[list->batches.count++];
+		*batch = (DrawBatch) {
+			.draw = index,
+			.first_instance = i,
+			.instance_count = 1,
+		};
+	}
+}
+
+void SortDrawList(DrawList *list) {
+	/* Sorts the submitted Draws by key and merges them into DrawBatches */
+	if (!list->count) {
+		list->batches.count = 0;
+		return;
+	}
+
+	uint32_t i;
+	for (i = 0; i < list->count; i++) {
+		list->sort.items[i] = (DrawSortItem) {
+			.key = list->draws[i].key,
+			.draw = i,
+		};
+	}
+
+	radixSort(list);
+	mergeBatches(list);
+}
+
+void RecordDrawList(DrawList *list, const DeviceDispatch *vk, VkCommandBuffer command_buffer) {
+	/* Records the DrawBatches into command_buffer through the table of the
+	device it belongs to, only binding the state that changes between
+	consecutive batches */
+	Draw bound = {};
+
+	uint32_t i;
+	for (i = 0; i < list->batches.count; i++) {
+		DrawBatch *batch = &list->batches.data[i];
+		Draw *draw = &list->draws[batch->draw];
+
+		if (draw->pipeline != bound.pipeline) {
+			vk->CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw->pipeline);
+			bound.pipeline = draw->pipeline;
+		}
+
+		if (draw->layout != bound.layout) {
+			/* sets bound with an incompatible layout are disturbed */
+			bound.layout = draw->layout;
+			bound.material = VK_NULL_HANDLE;
+		}
+
+		if (draw->material && draw->material != bound.material) {
+			vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw->layout, 0, 1, &draw->material, 0, NULL);
+			bound.material = draw->material;
+		}
+
+		if (draw->mesh.vertices && draw->mesh.vertices != bound.mesh.vertices) {
+			VkDeviceSize offset = 0;
+			vk->CmdBindVertexBuffers(command_buffer, 0, 1, &draw->mesh.vertices, &offset);
+			bound.mesh.vertices = draw->mesh.vertices;
+		}
+
+		if (!draw->mesh.indices) {
+			vk->CmdDraw(command_buffer, draw->mesh.count, batch->instance_count, (uint32_t) draw->mesh.vertex_offset, batch->first_instance);
+			continue;
+		}
+
+		if (draw->mesh.indices != bound.mesh.indices) {
+			vk->CmdBindIndexBuffer(command_buffer, draw->mesh.indices, 0, VK_INDEX_TYPE_UINT32);
+			bound.mesh.indices = draw->mesh.indices;
+		}
+
+		vk->CmdDrawIndexed(command_buffer, draw->mesh.count, batch->instance_count, draw->mesh.first_index, draw->mesh.vertex_offset, batch->first_instance);
+	}
+}
@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+#include "events.h"
+#include "panic.h"
+
+/* code */
+
+EventQueue *CreateEventQueue() {
+	/* Allocates an empty EventQueue */
+	EventQueue *queue = calloc(1, sizeof(EventQueue));
+	if (!queue) Panic("CreateEventQueue: unable to allocate EventQueue\n");
+
+	return queue;
+}
+
+void DestroyEventQueue(EventQueue *queue) {
+	/* Frees the queue, neither thread may be using it */
+	free(queue);
+}
+
+bool PushEvent(EventQueue *queue, const SDL_Event *event) {
+	/* Copies event into the queue and returns false if it is full. Only the
+	producer thread may call PushEvent */
+	uint32_t tail = (uint32_t) SDL_AtomicGet(&queue->tail);
+	uint32_t head = (uint32_t) SDL_AtomicGet(&queue->head);
+
+	if (tail - head == EVENT_QUEUE_SIZE) return false;
+
+	queue->events[tail & (EVENT_QUEUE_SIZE - 1)] = *event;
+
+	/* SDL_AtomicSet is a full barrier, so the event is visible before tail */
+	SDL_AtomicSet(&queue->tail, (int) (tail + 1));
+
+	return true;
+}
+
+bool PopEvent(EventQueue *queue, SDL_Event *event) {
+	/* Copies the oldest event out of the queue and returns false if it is
+	empty. Only the consumer thread may call PopEvent */
+	uint32_t head = (uint32_t) SDL_AtomicGet(&queue->head);
+	uint32_t tail = (uint32_t) SDL_AtomicGet(&queue->tail);
+
+	if (head == tail) return false;
+
+	*event = queue->events[head & (EVENT_QUEUE_SIZE - 1)];
+
+	SDL_AtomicSet(&queue->head, (int) (head + 1));
+
+	return true;
+}
@@ -0,0 +1,369 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "capture.h"
+#include "frames.h"
+#include "pacing.h"
+#include "panic.h"
+#include "passes.h"
+#include "renderer.h"
+#include "swapchain.h"
+
+/* code */
+
+Frames CreateFrames(RendererDevice device, VkSurfaceKHR surface, VkExtent2D extent) {
+	/* Creates the per frame command buffers and synchronisation for surface,
+	the swapchain itself is created by the first BeginFrame */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	Frames frames = {
+		.device = device,
+		.surface = surface,
+		.passes = CreatePasses(device.dispatch.device, device.supports.dynamic_rendering),
+		.pacer = CreatePacer(&device, FRAMES_IN_FLIGHT - 1),
+		.deletions = CreateDeletionQueue(device.dispatch.device),
+		.extent = extent,
+		.stale = true,
+	};
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = device.family.graphics,
+	};
+
+	if (vk->CreateCommandPool(device.device, &pool_info, NULL, &frames.command_pool) != VK_SUCCESS)
+		Panic("CreateFrames: unable to create VkCommandPool\n");
+
+	VkCommandBuffer command_buffers[FRAMES_IN_FLIGHT];
+
+	VkCommandBufferAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = frames.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = FRAMES_IN_FLIGHT,
+	};
+
+	if (vk->AllocateCommandBuffers(device.device, &allocate_info, command_buffers) != VK_SUCCESS)
+		Panic("CreateFrames: unable to allocate VkCommandBuffers\n");
+
+	/* Fences start signalled so the first wait on each frame returns */
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+
+	VkSemaphoreCreateInfo semaphore_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		Frame *frame = &frames.frames[i];
+		frame->command_buffer = command_buffers[i];
+
+		if (vk->CreateFence(device.device, &fence_info, NULL, &frame->fence) != VK_SUCCESS)
+			Panic("CreateFrames: unable to create VkFence\n");
+
+		if (vk->CreateSemaphore(device.device, &semaphore_info, NULL, &frame->acquired) != VK_SUCCESS)
+			Panic("CreateFrames: unable to create VkSemaphore\n");
+	}
+
+	return frames;
+}
+
+static void destroyRetired(Frames *frames, uint32_t index) {
+	/* Destroys a retired swapchain along with the framebuffers cached for it */
+	Swapchain *swapchain = &frames->retired.swapchains[index].swapchain;
+
+	uint32_t i;
+	for (i = 0; i < swapchain->count; i++)
+		ForgetPassView(&frames->passes, swapchain->views[i]);
+
+	DestroySwapchain(&frames->device, swapchain);
+
+	frames->retired.swapchains[index] = frames->retired.swapchains[--frames->retired.count];
+}
+
+static void collectRetired(Frames *frames) {
+	/* Destroys the retired swapchains that no frame in flight can be using */
+	uint32_t i = 0;
+	while (i < frames->retired.count) {
+		if (frames->frame < frames->retired.swapchains[i].frame + FRAMES_IN_FLIGHT) {
+			i++;
+			continue;
+		}
+
+		destroyRetired(frames, i);
+	}
+}
+
+static void waitFrames(Frames *frames) {
+	/* Blocks until every frame in flight has finished */
+	const DeviceDispatch *vk = frames->device.dispatch.device;
+
+	VkFence fences[FRAMES_IN_FLIGHT];
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) fences[i] = frames->frames[i].fence;
+
+	vk->WaitForFences(frames->device.device, FRAMES_IN_FLIGHT, fences, VK_TRUE, UINT64_MAX);
+}
+
+static void retireSwapchain(Frames *frames) {
+	/* Moves the current swapchain to the retired list. That list is only full
+	if swapchains are replaced faster than once a frame, then it waits */
+	if (!frames->swapchain.swapchain) return;
+
+	if (frames->retired.count == MAX_RETIRED_SWAPCHAINS) {
+		waitFrames(frames);
+
+		while (frames->retired.count) destroyRetired(frames, 0);
+	}
+
+	frames->retired.swapchains[frames->retired.count++] = (RetiredSwapchain) {
+		.swapchain = frames->swapchain,
+		.frame = frames->frame,
+	};
+
+	frames->swapchain = (Swapchain) {};
+}
+
+static bool recreateSwapchain(Frames *frames) {
+	/* Replaces the stale swapchain and returns true if the new one has images */
+	Swapchain swapchain = CreateSwapchain(&frames->device, frames->surface, frames->extent, &frames->swapchain);
+
+	retireSwapchain(frames);
+	frames->swapchain = swapchain;
+
+	/* A surface without area stays stale until it has one */
+	frames->stale = !swapchain.swapchain;
+
+	return !frames->stale;
+}
+
+void DestroyFrames(Frames *frames) {
+	/* Waits for the frames in flight and presentation to finish, then destroys
+	frames and its swapchains */
+	const DeviceDispatch *vk = frames->device.dispatch.device;
+	VkDevice device = frames->device.device;
+
+	waitFrames(frames);
+	if (frames->device.queue.present) vk->QueueWaitIdle(frames->device.queue.present);
+
+	while (frames->retired.count) destroyRetired(frames, 0);
+	DestroySwapchain(&frames->device, &frames->swapchain);
+	DestroyPasses(&frames->passes);
+	DestroyDeletionQueue(&frames->deletions);
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		vk->DestroyFence(device, frames->frames[i].fence, NULL);
+		vk->DestroySemaphore(device, frames->frames[i].acquired, NULL);
+	}
+
+	vk->DestroyCommandPool(device, frames->command_pool, NULL);
+
+	*frames = (Frames) {};
+}
+
+void ResizeFrames(Frames *frames, VkExtent2D extent) {
+	/* Records the new drawable size, the swapchain is recreated when the next
+	frame begins */
+	frames->extent = extent;
+	frames->stale = true;
+}
+
+void MinimizeFrames(Frames *frames, bool minimized) {
+	/* Stops or restarts frame production, the surface may have changed while
+	it was minimized so restoring recreates the swapchain */
+	frames->minimized = minimized;
+	if (!minimized) frames->stale = true;
+}
+
+void PaceFrames(Frames *windows, uint32_t count) {
+	/* Waits for the frame of each window that has to be displayed before its
+	next one can be, then sleeps so that the next frames start just in time.
+	The windows' presents are batched, so the window that needs its frame
+	soonest paces them all. Call it before sampling input so the input is as
+	recent as possible */
+	Uint64 start = UINT64_MAX;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		Frames *frames = &windows[i];
+		Pacer *pacer = &frames->pacer;
+
+		if (frames->minimized || frames->frame < pacer->queued) continue;
+
+		uint64_t frame = frames->frame - pacer->queued;
+		CompletePacedFrame(pacer, frame, frames->frames[frame % FRAMES_IN_FLIGHT].fence);
+
+		Uint64 paced = GetPacedStart(pacer);
+		if (paced < start) start = paced;
+	}
+
+	if (start != UINT64_MAX) SleepPacedStart(start);
+
+	for (i = 0; i < count; i++) {
+		if (!windows[i].minimized) StartPacedFrame(&windows[i].pacer, windows[i].frame);
+	}
+}
+
+Frame *BeginFrame(Frames *frames) {
+	/* Waits for the frame slot to be free, acquires a swapchain image and
+	begins the frame's command buffer. Returns NULL when there is nothing to
+	draw into, the caller should try again after handling events */
+	const DeviceDispatch *vk = frames->device.dispatch.device;
+
+	Frame *frame = &frames->frames[frames->frame % FRAMES_IN_FLIGHT];
+	VkDevice device = frames->device.device;
+
+	vk->WaitForFences(device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+	collectRetired(frames);
+
+	/* Every frame up to the one that last used this slot has finished */
+	if (frames->frame >= FRAMES_IN_FLIGHT)
+		CollectDeletions(&frames->deletions, frames->frame - FRAMES_IN_FLIGHT + 1);
+
+	if (frames->minimized) return NULL;
+	if (frames->stale && !recreateSwapchain(frames)) return NULL;
+
+	VkResult result = vk->AcquireNextImageKHR(device, frames->swapchain.swapchain, UINT64_MAX, frame->acquired, VK_NULL_HANDLE, &frame->image);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		frames->stale = true;
+		return NULL;
+	}
+
+	if (result == VK_SUBOPTIMAL_KHR) frames->stale = true;
+	else if (result != VK_SUCCESS) Panic("BeginFrame: unable to acquire swapchain image\n");
+
+	/* The fence is only reset once the frame is certain to be submitted */
+	vk->ResetFences(device, 1, &frame->fence);
+	vk->ResetCommandBuffer(frame->command_buffer, 0);
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vk->BeginCommandBuffer(frame->command_buffer, &begin_info);
+
+	return frame;
+}
+
+RenderTarget GetFrameTarget(Frames *frames, Frame *frame) {
+	/* Returns a RenderTarget that clears the frame's swapchain image and leaves
+	it ready to present */
+	return (RenderTarget) {
+		.image = frames->swapchain.images[frame->image],
+		.view = frames->swapchain.views[frame->image],
+		.format = frames->swapchain.format.format,
+		.extent = frames->swapchain.extent,
+		.load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+	};
+}
+
+void EndFrame(Frames *frames, Frame *frame) {
+	/* Submits the frame's command buffer and presents its image */
+	PresentBatch batch = {};
+
+	SubmitFrame(frames, frame, &batch);
+	PresentFrames(&batch);
+}
+
+void SubmitFrame(Frames *frames, Frame *frame, PresentBatch *batch) {
+	/* Submits the frame's command buffer and adds its image to batch, which
+	must be presented before frames begins another frame */
+	const DeviceDispatch *vk = frames->device.dispatch.device;
+
+	if (batch->count == MAX_RENDERER_WINDOWS)
+		Panic("SubmitFrame: more than %u frames in a PresentBatch\n", MAX_RENDERER_WINDOWS);
+
+	vk->EndCommandBuffer(frame->command_buffer);
+
+	VkSemaphore rendered = frames->swapchain.rendered[frame->image];
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &frame->acquired,
+		.pWaitDstStageMask = &wait_stage,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &frame->command_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &rendered,
+	};
+
+	if (vk->QueueSubmit(frames->device.queue.graphics, 1, &submit_info, frame->fence) != VK_SUCCESS)
+		Panic("SubmitFrame: unable to submit frame\n");
+
+	uint32_t index = batch->count++;
+
+	batch->frames[index] = frames;
+	batch->swapchains[index] = frames->swapchain.swapchain;
+	batch->rendered[index] = rendered;
+	batch->images[index] = frame->image;
+	batch->present_ids[index] = SubmitPacedFrame(&frames->pacer, frames->frame, frames->swapchain.swapchain);
+}
+
+void PresentFrames(PresentBatch *batch) {
+	/* Presents every image in batch with one vkQueuePresentKHR, then empties
+	it. Each swapchain gets its own result, so only the windows whose
+	swapchains are out of date recreate them */
+	if (!batch->count) return;
+
+	Frames *first = batch->frames[0];
+	const DeviceDispatch *vk = first->device.dispatch.device;
+
+	VkResult results[MAX_RENDERER_WINDOWS];
+
+	VkPresentIdKHR present_ids = {
+		.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+		.swapchainCount = batch->count,
+		.pPresentIds = batch->present_ids,
+	};
+
+	VkPresentInfoKHR present_info = {
+		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+		.pNext = (first->pacer.wait_for_present) ? &present_ids : NULL,
+		.waitSemaphoreCount = batch->count,
+		.pWaitSemaphores = batch->rendered,
+		.swapchainCount = batch->count,
+		.pSwapchains = batch->swapchains,
+		.pImageIndices = batch->images,
+		.pResults = results,
+	};
+
+	VkResult result = vk->QueuePresentKHR(first->device.queue.present, &present_info);
+
+	/* Any other error leaves results unreliable */
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR)
+		Panic("PresentFrames: unable to present\n");
+
+	CaptureFrame(first->frame);
+
+	uint32_t i;
+	for (i = 0; i < batch->count; i++) {
+		Frames *frames = batch->frames[i];
+
+		if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR) frames->stale = true;
+		else if (results[i] != VK_SUCCESS) Panic("PresentFrames: unable to present\n");
+
+		frames->frame += 1;
+	}
+
+	batch->count = 0;
+}
+
+uint64_t GetFrameProgress(Frames *frames) {
+	/* Returns the value to queue deletions in frames->deletions with for
+	objects used by the frame being recorded */
+	return frames->frame + 1;
+}
@@ -0,0 +1,68 @@
+#ifndef _SODA_ARCHIVE_H
+#define _SODA_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* constants */
+
+#define ARCHIVE_MAGIC "SODAPACK"
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_NAME_SIZE 48
+
+/* Blobs start on a page, so SPIR-V and vertex data can be read in place and
+each blob is faulted in or read ahead without touching its neighbours */
+#define ARCHIVE_ALIGNMENT 4096
+
+/* types */
+
+typedef enum {
+	/* ArchiveCompression is how a blob is stored. Reading ARCHIVE_ZSTD blobs
+	needs a build with ZSTD=1 */
+	ARCHIVE_STORED,
+	ARCHIVE_ZSTD,
+} ArchiveCompression;
+
+typedef struct {
+	/* ArchiveHeader is at the start of the file, it is followed by count
+	ArchiveEntries sorted by name and then the blobs */
+	char magic[8];
+	uint32_t version, count;
+} ArchiveHeader;
+
+typedef struct {
+	/* ArchiveEntry locates a named blob relative to the start of the file. The
+	blob takes stored bytes in the file and size bytes once decompressed */
+	char name[ARCHIVE_NAME_SIZE];
+	uint64_t offset, size, stored;
+	uint32_t compression, padding;
+} ArchiveEntry;
+
+typedef struct {
+	/* ArchiveBlob is a view of a blob's contents, data is NULL if the blob
+	wasn't found */
+	const void *data;
+	size_t size;
+} ArchiveBlob;
+
+typedef struct {
+	/* Archive is a read-only memory mapping of a packed archive file.
+	decompressed holds the contents of the compressed blobs that were viewed
+	with FindArchiveBlob, by entry */
+	void *data;
+	size_t size;
+	const ArchiveHeader *header;
+	const ArchiveEntry *entries;
+	void **decompressed;
+} Archive;
+
+/* methods */
+
+Archive OpenArchive(const char *path);
+void CloseArchive(Archive *);
+const ArchiveEntry *FindArchiveEntry(Archive *, const char *name);
+ArchiveBlob FindArchiveBlob(Archive *, const char *name);
+void PrefetchArchiveEntry(Archive *, const ArchiveEntry *);
+void ReadArchiveEntry(Archive *, const ArchiveEntry *, void *destination);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _SODA_ATLAS_H
+#define _SODA_ATLAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* types */
+
+typedef struct {
+	/* AtlasRect is a packed rectangle in texels on one page of an Atlas */
+	uint32_t page, x, y, width, height;
+} AtlasRect;
+
+typedef struct {
+	/* AtlasNode is a segment of a page's skyline, the top edge of the packed
+	rectangles from x to x + width is at y */
+	uint32_t x, y, width;
+} AtlasNode;
+
+typedef struct {
+	/* AtlasPage is the skyline of one page, ordered by x. It has at most one
+	node per column so nodes holds size of them */
+	uint32_t count;
+	AtlasNode *nodes;
+} AtlasPage;
+
+typedef struct {
+	/* Atlas packs rectangles into square pages of size texels with the skyline
+	bottom left heuristic, and adds a page when none has room */
+	uint32_t size;
+	uint32_t count, capacity;
+	AtlasPage *pages;
+} Atlas;
+
+/* methods */
+
+Atlas CreateAtlas(uint32_t size);
+void DestroyAtlas(Atlas *);
+bool PackAtlas(Atlas *, uint32_t width, uint32_t height, AtlasRect *);
+
+#endif
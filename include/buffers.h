@@ -0,0 +1,36 @@
+#ifndef _SODA_BUFFERS_H
+#define _SODA_BUFFERS_H
+
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "renderer.h"
+
+/* constants */
+
+#define NO_MEMORY_TYPE UINT32_MAX
+
+/* Blobs staged together start on STAGING_ALIGNMENT, which suits buffer copies
+and image copies of any texel size */
+#define STAGING_ALIGNMENT 16
+
+/* types */
+
+typedef struct {
+	/* Buffer is a VkBuffer bound to its own VkDeviceMemory. mapped is the
+	persistent host mapping, or NULL if the memory isn't host visible */
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkMemoryPropertyFlags properties;
+	void *mapped;
+} Buffer;
+
+/* methods */
+
+uint32_t FindMemoryType(RendererDevice *, uint32_t type_bits, VkMemoryPropertyFlags);
+Buffer CreateBuffer(RendererDevice *, VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags);
+void DestroyBuffer(RendererDevice *, Buffer *);
+Buffer StageArchiveBlobs(RendererDevice *, Archive *, const char *const *names, uint32_t count, VkDeviceSize *offsets);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef _SODA_CAPTURE_H
+#define _SODA_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "compute.h"
+#include "shaders.h"
+
+/* constants */
+
+#define CAPTURE_MAGIC "SODACAPT"
+#define CAPTURE_VERSION 2
+
+/* Live buffers and kernels that can be tracked, it must be a power of 2 */
+#define CAPTURE_MAX_OBJECTS 4096
+
+/* types */
+
+typedef enum {
+	/* CaptureOp identifies a record, the payload structs follow */
+	CAPTURE_BUFFER_CREATE = 1,
+	CAPTURE_BUFFER_DESTROY,
+	CAPTURE_BUFFER_WRITE,
+	CAPTURE_KERNEL_CREATE,
+	CAPTURE_KERNEL_DESTROY,
+	CAPTURE_DISPATCH,
+	CAPTURE_SUBMIT,
+	CAPTURE_WAIT,
+	CAPTURE_FRAME,
+} CaptureOp;
+
+typedef struct {
+	/* CaptureHeader starts a capture file, it's followed by CaptureRecords
+	until the end of the file */
+	char magic[8];
+	uint32_t version, reserved;
+} CaptureHeader;
+
+typedef struct {
+	/* CaptureRecord precedes size bytes of payload for op */
+	uint32_t op, size;
+} CaptureRecord;
+
+typedef struct {
+	uint32_t id, usage, properties, reserved;
+	uint64_t size;
+} CaptureBufferCreateData;
+
+typedef struct {
+	/* Payload of CAPTURE_BUFFER_DESTROY and CAPTURE_KERNEL_DESTROY */
+	uint32_t id;
+} CaptureDestroyData;
+
+typedef struct {
+	/* Followed by size bytes that were in the buffer at submit */
+	uint32_t id, reserved;
+	uint64_t offset, size;
+} CaptureBufferWriteData;
+
+typedef struct {
+	/* Followed by constants ShaderConstants, then size bytes of SPIR-V */
+	uint32_t id, constants, buffers, push_constants;
+	uint64_t size;
+} CaptureKernelCreateData;
+
+typedef struct {
+	/* Followed by the ids of the kernel's buffers, then its push constants */
+	uint32_t kernel, x, y, z;
+} CaptureDispatchData;
+
+typedef struct {
+	/* Payload of CAPTURE_SUBMIT, token is the one the batch signals */
+	ComputeToken token;
+} CaptureSubmitData;
+
+typedef struct {
+	/* Payload of CAPTURE_WAIT */
+	ComputeToken token;
+} CaptureWaitData;
+
+typedef struct {
+	/* Payload of CAPTURE_FRAME, which marks the end of a frame */
+	uint64_t frame;
+} CaptureFrameData;
+
+typedef struct {
+	/* CaptureObject maps a live Vulkan handle to its id in the capture, kind
+	is the op that created it as handles of different types may be equal. Host
+	visible buffers keep their mapping so that their contents can be recorded,
+	hash is of the contents last recorded */
+	uint64_t handle;
+	uint32_t kind, id;
+	bool pending;
+	const void *mapped;
+	VkDeviceSize size;
+	uint64_t hash;
+} CaptureObject;
+
+/* methods */
+
+void StartCapture(const char *path);
+void StopCapture();
+
+void CaptureBuffer(const Buffer *, VkBufferUsageFlags);
+void CaptureDestroyBuffer(const Buffer *);
+void CaptureKernel(const ComputeKernel *, const uint32_t *code, size_t size, const ShaderConstant *, uint32_t count);
+void CaptureDestroyKernel(const ComputeKernel *);
+void CaptureDispatch(const ComputeKernel *, const VkBuffer *, const void *push_constants, uint32_t x, uint32_t y, uint32_t z);
+void CaptureSubmit(ComputeToken);
+void CaptureWait(ComputeToken);
+void CaptureFrame(uint64_t frame);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _SODA_COMPUTE_H
+#define _SODA_COMPUTE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "deletion.h"
+#include "readback.h"
+#include "renderer.h"
+#include "shaders.h"
+
+/* constants */
+
+/* Number of batches that can be in flight before Dispatch has to wait */
+#define COMPUTE_BATCHES 4
+
+/* Dispatches recorded into one batch before it's submitted automatically */
+#define COMPUTE_BATCH_DISPATCHES 256
+
+#define MAX_KERNEL_BUFFERS 8
+
+/* types */
+
+/* ComputeToken is the timeline value that a batch signals on completion */
+typedef uint64_t ComputeToken;
+
+typedef struct {
+	/* ComputeKernel is a compute pipeline whose storage buffers are bound at
+	set 0, bindings 0 to buffers - 1 */
+	ShaderModule *module;
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+	uint32_t buffers, push_constants;
+} ComputeKernel;
+
+typedef struct {
+	/* ComputeBatch is a command buffer of dispatches submitted together */
+	VkCommandBuffer command_buffer;
+	VkDescriptorPool descriptors;
+	ComputeToken token;
+	uint32_t dispatches;
+} ComputeBatch;
+
+typedef struct {
+	/* Compute dispatches kernels on the compute queue of the renderer's
+	logical device. Dispatches are batched into a single submit, and their
+	completion is tracked by a timeline semaphore */
+	RendererDevice device;
+	VkCommandPool command_pool;
+	VkSemaphore timeline;
+
+	/* submitted is the token of the last batch handed to the queue */
+	ComputeToken submitted;
+
+	uint32_t current;
+	bool recording;
+	ComputeBatch batches[COMPUTE_BATCHES];
+
+	/* deletions are keyed by the token of the last dispatch that used them */
+	DeletionQueue deletions;
+} Compute;
+
+/* methods */
+
+Compute CreateCompute(RendererDevice);
+void DestroyCompute(Compute *);
+
+ComputeKernel CreateComputeKernel(Compute *, const uint32_t *code, size_t size, const ShaderConstant *, uint32_t constants, uint32_t buffers, uint32_t push_constants);
+void DestroyComputeKernel(Compute *, ComputeKernel *);
+void RetireComputeKernel(Compute *, ComputeKernel *, ComputeToken);
+
+ComputeToken Dispatch(Compute *, ComputeKernel *, const VkBuffer *buffers, const void *push_constants, uint32_t x, uint32_t y, uint32_t z);
+ReadbackFuture ReadbackCompute(Compute *, Readbacks *, VkBuffer, VkDeviceSize offset, VkDeviceSize size);
+ComputeToken SubmitCompute(Compute *);
+bool PollCompute(Compute *, ComputeToken);
+void WaitCompute(Compute *, ComputeToken);
+void InvalidateComputeBuffer(Compute *, const Buffer *);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _SODA_DELETION_H
+#define _SODA_DELETION_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "dispatch.h"
+
+/* constants */
+
+#define INITIAL_DELETIONS 64
+
+/* types */
+
+typedef enum {
+	/* DeletionType is the kind of Vulkan object a Deletion destroys */
+	DELETE_BUFFER,
+	DELETE_MEMORY,
+	DELETE_IMAGE,
+	DELETE_IMAGE_VIEW,
+	DELETE_SAMPLER,
+	DELETE_PIPELINE,
+	DELETE_PIPELINE_LAYOUT,
+	DELETE_DESCRIPTOR_SET_LAYOUT,
+	DELETE_DESCRIPTOR_POOL,
+	DELETE_DESCRIPTOR_SET,
+	DELETE_FRAMEBUFFER,
+	DELETE_SEMAPHORE,
+	DELETE_QUERY_POOL,
+} DeletionType;
+
+typedef struct {
+	/* Deletion is an object waiting for the GPU to complete value. pool is the
+	VkDescriptorPool that a DELETE_DESCRIPTOR_SET is freed to */
+	uint64_t value;
+	DeletionType type;
+	uint64_t handle;
+	VkDescriptorPool pool;
+} Deletion;
+
+typedef struct {
+	/* DeletionQueue destroys objects once the GPU progress value they were last
+	used at has completed, so they can be released mid-session without waiting
+	for the device to go idle. Values are a timeline such as ComputeTokens or
+	frames, a value lower than the one queued before it is raised to it so the
+	queue stays in order, which can only delay a deletion */
+	const DeviceDispatch *vk;
+	uint64_t last;
+	uint32_t head, count, capacity;
+	Deletion *deletions;
+} DeletionQueue;
+
+/* methods */
+
+DeletionQueue CreateDeletionQueue(const DeviceDispatch *);
+void DestroyDeletionQueue(DeletionQueue *);
+void DeleteLater(DeletionQueue *, DeletionType, uint64_t handle, uint64_t value);
+void DeleteBufferLater(DeletionQueue *, Buffer *, uint64_t value);
+void DeleteDescriptorSetLater(DeletionQueue *, VkDescriptorPool, VkDescriptorSet, uint64_t value);
+uint32_t CollectDeletions(DeletionQueue *, uint64_t completed);
+
+#endif
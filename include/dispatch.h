@@ -0,0 +1,163 @@
+#ifndef _SODA_DISPATCH_H
+#define _SODA_DISPATCH_H
+
+#include <vulkan/vulkan.h>
+
+/* macros */
+
+/* The functions in each table are listed without their vk prefix, X(name)
+declares or loads PFN_vk##name name */
+#define LOADER_FUNCTIONS(X) \
+	X(CreateInstance) \
+	X(EnumerateInstanceExtensionProperties) \
+	X(EnumerateInstanceLayerProperties) \
+	X(EnumerateInstanceVersion)
+
+#define INSTANCE_FUNCTIONS(X) \
+	X(DestroyInstance) \
+	X(EnumeratePhysicalDevices) \
+	X(GetPhysicalDeviceProperties) \
+	X(GetPhysicalDeviceProperties2) \
+	X(GetPhysicalDeviceFeatures) \
+	X(GetPhysicalDeviceFeatures2) \
+	X(GetPhysicalDeviceMemoryProperties) \
+	X(GetPhysicalDeviceMemoryProperties2) \
+	X(GetPhysicalDeviceQueueFamilyProperties) \
+	X(EnumerateDeviceExtensionProperties) \
+	X(CreateDevice) \
+	X(GetDeviceProcAddr) \
+	X(DestroySurfaceKHR) \
+	X(GetPhysicalDeviceSurfaceSupportKHR) \
+	X(GetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(GetPhysicalDeviceSurfaceFormatsKHR) \
+	X(CreateDebugUtilsMessengerEXT) \
+	X(DestroyDebugUtilsMessengerEXT)
+
+#define DEVICE_FUNCTIONS(X) \
+	X(DestroyDevice) \
+	X(GetDeviceQueue) \
+	X(DeviceWaitIdle) \
+	X(QueueSubmit) \
+	X(QueueWaitIdle) \
+	X(CreateCommandPool) \
+	X(DestroyCommandPool) \
+	X(AllocateCommandBuffers) \
+	X(BeginCommandBuffer) \
+	X(EndCommandBuffer) \
+	X(ResetCommandBuffer) \
+	X(CreateFence) \
+	X(DestroyFence) \
+	X(ResetFences) \
+	X(WaitForFences) \
+	X(CreateSemaphore) \
+	X(DestroySemaphore) \
+	X(WaitSemaphores) \
+	X(GetSemaphoreCounterValue) \
+	X(CreateBuffer) \
+	X(DestroyBuffer) \
+	X(GetBufferMemoryRequirements) \
+	X(AllocateMemory) \
+	X(FreeMemory) \
+	X(BindBufferMemory) \
+	X(MapMemory) \
+	X(UnmapMemory) \
+	X(InvalidateMappedMemoryRanges) \
+	X(CreateImage) \
+	X(DestroyImage) \
+	X(GetImageMemoryRequirements) \
+	X(GetImageSparseMemoryRequirements) \
+	X(BindImageMemory) \
+	X(QueueBindSparse) \
+	X(GetFenceStatus) \
+	X(CreateImageView) \
+	X(DestroyImageView) \
+	X(CreateSampler) \
+	X(DestroySampler) \
+	X(CreateShaderModule) \
+	X(DestroyShaderModule) \
+	X(CreateDescriptorSetLayout) \
+	X(DestroyDescriptorSetLayout) \
+	X(CreateDescriptorPool) \
+	X(DestroyDescriptorPool) \
+	X(ResetDescriptorPool) \
+	X(AllocateDescriptorSets) \
+	X(FreeDescriptorSets) \
+	X(UpdateDescriptorSets) \
+	X(CreatePipelineLayout) \
+	X(DestroyPipelineLayout) \
+	X(CreateGraphicsPipelines) \
+	X(CreateComputePipelines) \
+	X(DestroyPipeline) \
+	X(CreateQueryPool) \
+	X(DestroyQueryPool) \
+	X(GetQueryPoolResults) \
+	X(CreateRenderPass) \
+	X(DestroyRenderPass) \
+	X(CreateFramebuffer) \
+	X(DestroyFramebuffer) \
+	X(CmdPipelineBarrier) \
+	X(CmdBindPipeline) \
+	X(CmdBindDescriptorSets) \
+	X(CmdPushConstants) \
+	X(CmdBindVertexBuffers) \
+	X(CmdBindIndexBuffer) \
+	X(CmdDraw) \
+	X(CmdDrawIndexed) \
+	X(CmdDispatch) \
+	X(CmdSetViewport) \
+	X(CmdSetScissor) \
+	X(CmdFillBuffer) \
+	X(CmdCopyBuffer) \
+	X(CmdCopyBufferToImage) \
+	X(CmdCopyImageToBuffer) \
+	X(CmdBlitImage) \
+	X(CmdResetQueryPool) \
+	X(CmdWriteTimestamp) \
+	X(CmdBeginRenderPass) \
+	X(CmdEndRenderPass) \
+	X(CmdBeginRendering) \
+	X(CmdEndRendering) \
+	X(CmdBeginRenderingKHR) \
+	X(CmdEndRenderingKHR) \
+	X(CreateSwapchainKHR) \
+	X(DestroySwapchainKHR) \
+	X(GetSwapchainImagesKHR) \
+	X(AcquireNextImageKHR) \
+	X(QueuePresentKHR) \
+	X(WaitForPresentKHR)
+
+#define DISPATCH_MEMBER(name) PFN_vk##name name;
+
+/* types */
+
+typedef struct {
+	/* VulkanLoader holds the functions that don't need an instance. library is
+	the libvulkan handle when it was opened at runtime, NULL when linked */
+	void *library;
+	PFN_vkGetInstanceProcAddr GetInstanceProcAddr;
+	LOADER_FUNCTIONS(DISPATCH_MEMBER)
+} VulkanLoader;
+
+typedef struct {
+	/* InstanceDispatch is a table of the functions of one VkInstance */
+	VkInstance instance;
+	INSTANCE_FUNCTIONS(DISPATCH_MEMBER)
+} InstanceDispatch;
+
+typedef struct {
+	/* DeviceDispatch is a table of the functions of one VkDevice, loaded with
+	vkGetDeviceProcAddr so calls go straight to the driver instead of through
+	the loader's trampolines. Functions of extensions that weren't enabled are
+	NULL */
+	VkDevice device;
+	DEVICE_FUNCTIONS(DISPATCH_MEMBER)
+} DeviceDispatch;
+
+/* methods */
+
+VulkanLoader LoadVulkan();
+void UnloadVulkan(VulkanLoader *);
+InstanceDispatch LoadInstanceDispatch(const VulkanLoader *, VkInstance);
+DeviceDispatch LoadDeviceDispatch(const InstanceDispatch *, VkDevice);
+
+#endif
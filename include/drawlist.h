@@ -0,0 +1,104 @@
+#ifndef _SODA_DRAWLIST_H
+#define _SODA_DRAWLIST_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "dispatch.h"
+#include "jobs.h"
+
+/* constants */
+
+/* A draw key packs, from most to least significant bits: the pass, the
+pipeline, the material and a depth bucket. Sorting the keys therefore groups
+draws by pass, then by the state that is the most expensive to rebind */
+#define DRAW_KEY_PASS_BITS 6
+#define DRAW_KEY_PIPELINE_BITS 14
+#define DRAW_KEY_MATERIAL_BITS 20
+#define DRAW_KEY_DEPTH_BITS 24
+
+#define DRAW_KEY_DEPTH_SHIFT 0
+#define DRAW_KEY_MATERIAL_SHIFT (DRAW_KEY_DEPTH_SHIFT + DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_PIPELINE_SHIFT (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_PASS_SHIFT (DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS)
+
+/* macros */
+
+#define DRAW_KEY_FIELD(value, bits, shift) \
+	(((uint64_t) (value) & ((UINT64_C(1) << (bits)) - 1)) << (shift))
+
+#define DRAW_KEY(pass, pipeline, material, depth) ( \
+	DRAW_KEY_FIELD(pass, DRAW_KEY_PASS_BITS, DRAW_KEY_PASS_SHIFT) | \
+	DRAW_KEY_FIELD(pipeline, DRAW_KEY_PIPELINE_BITS, DRAW_KEY_PIPELINE_SHIFT) | \
+	DRAW_KEY_FIELD(material, DRAW_KEY_MATERIAL_BITS, DRAW_KEY_MATERIAL_SHIFT) | \
+	DRAW_KEY_FIELD(depth, DRAW_KEY_DEPTH_BITS, DRAW_KEY_DEPTH_SHIFT))
+
+/* types */
+
+typedef struct {
+	/* Draw is a single submitted draw and the state it needs bound */
+	uint64_t key;
+
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	VkDescriptorSet material;
+
+	struct {
+		/* Namespace for the geometry, indices may be VK_NULL_HANDLE */
+		VkBuffer vertices, indices;
+		uint32_t count, first_index;
+		int32_t vertex_offset;
+	} mesh;
+
+	/* instance is the application's index for the per-instance data */
+	uint32_t instance;
+} Draw;
+
+typedef struct {
+	/* DrawBatch is a run of sorted draws that share all their state, recorded
+	as a single instanced draw */
+	uint32_t draw, first_instance, instance_count;
+} DrawBatch;
+
+typedef struct {
+	/* DrawSortItem pairs a key with the Draw it belongs to */
+	uint64_t key;
+	uint32_t draw;
+} DrawSortItem;
+
+typedef struct {
+	/* DrawList collects a frame's Draws, sorts them by key and merges them
+	into instanced DrawBatches */
+	uint32_t count, capacity;
+	Draw *draws;
+	Jobs *jobs;
+
+	struct {
+		/* Namespace for the radix sort's ping-pong buffers and histograms */
+		DrawSortItem *items, *scratch;
+		uint32_t chunks;
+		uint32_t (*histograms)[256];
+	} sort;
+
+	struct {
+		/* Namespace for the merged batches */
+		uint32_t count;
+		DrawBatch *data;
+	} batches;
+
+	/* instances holds the sorted Draw.instance values, DrawBatch.first_instance
+	indexes into it. Upload it where the vertex shader reads gl_InstanceIndex */
+	uint32_t *instances;
+} DrawList;
+
+/* methods */
+
+DrawList CreateDrawList(uint32_t capacity, Jobs *);
+void DestroyDrawList(DrawList *);
+void ResetDrawList(DrawList *);
+void SubmitDraw(DrawList *, Draw);
+void SortDrawList(DrawList *);
+void RecordDrawList(DrawList *, const DeviceDispatch *, VkCommandBuffer);
+
+#endif
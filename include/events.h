@@ -0,0 +1,39 @@
+#ifndef _SODA_EVENTS_H
+#define _SODA_EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+/* constants */
+
+/* Capacity of an EventQueue, it must be a power of 2 */
+#define EVENT_QUEUE_SIZE 1024
+
+#define CACHE_LINE_SIZE 64
+
+/* types */
+
+typedef struct {
+	/* EventQueue is a lock-free single producer, single consumer ring of
+	SDL_Events. The main thread pushes and the render thread pops. head and tail
+	count every event ever popped and pushed, and sit on their own cache lines
+	so the two threads don't contend */
+	SDL_atomic_t head;
+	char head_padding[CACHE_LINE_SIZE - sizeof(SDL_atomic_t)];
+
+	SDL_atomic_t tail;
+	char tail_padding[CACHE_LINE_SIZE - sizeof(SDL_atomic_t)];
+
+	SDL_Event events[EVENT_QUEUE_SIZE];
+} EventQueue;
+
+/* methods */
+
+EventQueue *CreateEventQueue();
+void DestroyEventQueue(EventQueue *);
+bool PushEvent(EventQueue *, const SDL_Event *);
+bool PopEvent(EventQueue *, SDL_Event *);
+
+#endif
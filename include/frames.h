@@ -0,0 +1,96 @@
+#ifndef _SODA_FRAMES_H
+#define _SODA_FRAMES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "pacing.h"
+#include "passes.h"
+#include "renderer.h"
+#include "swapchain.h"
+
+/* constants */
+
+#define FRAMES_IN_FLIGHT 2
+
+/* Retired swapchains wait FRAMES_IN_FLIGHT frames, and at most one swapchain
+is retired per frame */
+#define MAX_RETIRED_SWAPCHAINS (FRAMES_IN_FLIGHT + 1)
+
+/* types */
+
+typedef struct {
+	/* Frame is the per frame state that is reused every FRAMES_IN_FLIGHT
+	frames. fence is signalled when the GPU has finished the frame */
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkSemaphore acquired;
+
+	/* image is the swapchain image acquired for the frame */
+	uint32_t image;
+} Frame;
+
+typedef struct {
+	/* RetiredSwapchain is a replaced Swapchain that's destroyed once the frames
+	that used it have finished */
+	Swapchain swapchain;
+	uint64_t frame;
+} RetiredSwapchain;
+
+typedef struct {
+	/* Frames produces frames for a surface. Resizes only mark the swapchain as
+	stale, it is recreated at the start of the next frame without waiting for
+	the device to go idle */
+	RendererDevice device;
+	VkSurfaceKHR surface;
+	VkCommandPool command_pool;
+	Passes passes;
+	Pacer pacer;
+
+	Swapchain swapchain;
+	VkExtent2D extent;
+	bool stale, minimized;
+
+	struct {
+		/* Namespace for the swapchains waiting to be destroyed */
+		uint32_t count;
+		RetiredSwapchain swapchains[MAX_RETIRED_SWAPCHAINS];
+	} retired;
+
+	/* deletions are keyed by frame + 1, see GetFrameProgress */
+	DeletionQueue deletions;
+
+	/* frame counts every frame begun */
+	uint64_t frame;
+	Frame frames[FRAMES_IN_FLIGHT];
+} Frames;
+
+typedef struct {
+	/* PresentBatch gathers the frames submitted for several Frames, one per
+	window, so their images are presented by a single vkQueuePresentKHR */
+	uint32_t count;
+	Frames *frames[MAX_RENDERER_WINDOWS];
+	VkSwapchainKHR swapchains[MAX_RENDERER_WINDOWS];
+	VkSemaphore rendered[MAX_RENDERER_WINDOWS];
+	uint32_t images[MAX_RENDERER_WINDOWS];
+	uint64_t present_ids[MAX_RENDERER_WINDOWS];
+} PresentBatch;
+
+/* methods */
+
+Frames CreateFrames(RendererDevice, VkSurfaceKHR, VkExtent2D);
+void DestroyFrames(Frames *);
+void ResizeFrames(Frames *, VkExtent2D);
+void MinimizeFrames(Frames *, bool minimized);
+void PaceFrames(Frames *windows, uint32_t count);
+Frame *BeginFrame(Frames *);
+RenderTarget GetFrameTarget(Frames *, Frame *);
+void EndFrame(Frames *, Frame *);
+void SubmitFrame(Frames *, Frame *, PresentBatch *);
+void PresentFrames(PresentBatch *);
+uint64_t GetFrameProgress(Frames *);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _SODA_JOBS_H
+#define _SODA_JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+
+/* types */
+
+typedef void (*JobMethod)(void *, uint32_t);
+/* function pointer type for a job, it is called once for every index of a
+batch */
+
+typedef struct {
+	/* Jobs is a pool of worker threads that split batches of indexed work
+	between them */
+	uint32_t count;
+	SDL_Thread **threads;
+
+	SDL_mutex *mutex;
+	SDL_cond *start, *done;
+	bool quit;
+
+	struct {
+		/* Namespace for the batch that is currently being worked on. active
+		counts the workers inside it, guarded by mutex */
+		JobMethod method;
+		void *data;
+		uint32_t count, generation, active;
+		SDL_atomic_t next, finished;
+	} batch;
+} Jobs;
+
+/* methods */
+
+Jobs *CreateJobs(uint32_t workers);
+void DestroyJobs(Jobs *);
+void RunJobs(Jobs *, JobMethod, void *, uint32_t count);
+
+#endif
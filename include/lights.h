@@ -0,0 +1,104 @@
+#ifndef _SODA_LIGHTS_H
+#define _SODA_LIGHTS_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "frames.h"
+#include "renderer.h"
+
+/* constants */
+
+/* The cluster grid, it must match shaders/clustered.glsl */
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTERS (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+/* Lights a cluster keeps, the rest are dropped from its shading */
+#define MAX_CLUSTER_LIGHTS 256
+
+/* Invocations of a shaders/light_bin.comp workgroup */
+#define LIGHT_BIN_WORKGROUP 64
+
+/* types */
+
+typedef struct {
+	/* LightCamera is the view the lights are binned for. view is a column
+	major world to view matrix looking down -z with y up, fov is vertical in
+	radians and extent is the target's in pixels */
+	float view[16];
+	float fov, near, far;
+	VkExtent2D extent;
+} LightCamera;
+
+typedef struct {
+	/* LightHeader starts the light buffer of a frame, see Lights in
+	shaders/clustered.glsl */
+	float scale[2];
+	float near, far;
+	float extent[2];
+	float slice_scale, slice_bias;
+	uint32_t count;
+	uint32_t padding[3];
+} LightHeader;
+
+typedef struct {
+	/* Light is a light in view space as the shaders read it. A point light has
+	no direction and a cosine of -1, a spot light has the cosine and sine of
+	half its cone */
+	float position[3];
+	float range;
+	float colour[3];
+	float cosine;
+	float direction[3];
+	float sine;
+} Light;
+
+typedef struct {
+	/* Lights bins point and spot lights into a grid of clusters, CLUSTER_X by
+	CLUSTER_Y tiles of the target and CLUSTER_Z slices of depth. A compute pass
+	records the lights reaching each cluster, then fragment shaders including
+	shaders/clustered.glsl shade only the lights of their own cluster. Lights
+	are written into a persistently mapped staging buffer per frame in flight,
+	skipping those outside the camera's frustum, and copied to the device
+	before they're binned */
+	RendererDevice device;
+
+	/* set_layout is the one shading pipelines use for the lights */
+	VkDescriptorSetLayout set_layout;
+	VkDescriptorPool descriptors;
+	VkDescriptorSet set;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+
+	Buffer staging[FRAMES_IN_FLIGHT];
+	Buffer lights, counts, indices;
+
+	/* header and mapped point at the current frame's staging, count is the
+	lights written to it */
+	LightHeader *header;
+	Light *mapped;
+	uint32_t capacity, count, slice;
+
+	struct {
+		/* Namespace for the camera of the current frame. planes are the x or y
+		and z of the unit normals of the frustum's sides */
+		LightCamera data;
+		float planes[4][2];
+	} camera;
+} Lights;
+
+/* methods */
+
+Lights CreateLights(RendererDevice, uint32_t capacity);
+void DestroyLights(Lights *);
+void BeginLights(Lights *, uint64_t frame, const LightCamera *);
+void AddPointLight(Lights *, const float position[3], float range, const float colour[3]);
+void AddSpotLight(Lights *, const float position[3], const float direction[3], float range, float angle, const float colour[3]);
+void RecordLightBinning(Lights *, VkCommandBuffer);
+void BindLights(Lights *, VkCommandBuffer, VkPipelineLayout, uint32_t set);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _SODA_LOG_H
+#define _SODA_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+/* constants */
+
+/* Entries in the message ring, it must be a power of 2 */
+#define DEBUG_LOG_SIZE 1024
+
+/* Messages longer than this are truncated */
+#define DEBUG_LOG_MESSAGE_SIZE 512
+
+/* Distinct messageIdNumbers that are deduplicated, it must be a power of 2 */
+#define DEBUG_LOG_IDS 512
+
+/* Milliseconds between drains, and between reports of repeated messages */
+#define DEBUG_LOG_DRAIN_MS 10
+#define DEBUG_LOG_REPEAT_MS 1000
+
+/* types */
+
+typedef struct {
+	/* DebugLogFilter selects the messages the messenger is subscribed to. It is
+	applied by the driver so filtered messages cost nothing */
+	VkDebugUtilsMessageSeverityFlagsEXT severities;
+	VkDebugUtilsMessageTypeFlagsEXT types;
+} DebugLogFilter;
+
+typedef struct {
+	/* DebugLogEntry is a slot in the ring, sequence says whether it's free for
+	the producers or ready for the drain thread */
+	SDL_atomic_t sequence;
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+	VkDebugUtilsMessageTypeFlagsEXT type;
+	int32_t id;
+	char message[DEBUG_LOG_MESSAGE_SIZE];
+} DebugLogEntry;
+
+typedef struct {
+	/* DebugLogRepeat counts the repeats of a messageIdNumber after the first,
+	reported is only touched by the drain thread */
+	SDL_atomic_t id, count;
+	int reported;
+} DebugLogRepeat;
+
+/* methods */
+
+DebugLogFilter GetDebugLogFilter();
+void ApplyDebugLogFilter(VkDebugUtilsMessengerCreateInfoEXT *, DebugLogFilter);
+void StartDebugLog();
+void StopDebugLog();
+
+VKAPI_ATTR VkBool32 VKAPI_CALL DebugLogMessenger(
+	VkDebugUtilsMessageSeverityFlagBitsEXT,
+	VkDebugUtilsMessageTypeFlagsEXT,
+	const VkDebugUtilsMessengerCallbackDataEXT *,
+	void *
+);
+
+#endif
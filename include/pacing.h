@@ -0,0 +1,80 @@
+#ifndef _SODA_PACING_H
+#define _SODA_PACING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "renderer.h"
+
+/* constants */
+
+/* Frames remembered by a Pacer, it must be a power of 2 */
+#define PACING_HISTORY 16
+
+/* Time left between a frame finishing and its deadline to absorb jitter */
+#define PACING_MARGIN_US 1000
+
+/* Longest wait for a present before falling back to the frame's fence, a
+hidden window may never present */
+#define PRESENT_WAIT_TIMEOUT_NS 100000000ull
+
+/* types */
+
+typedef struct {
+	/* PacedFrame is the timeline of a frame in performance counter ticks. start
+	is when the CPU began the frame i.e. sampled input, completed is when it
+	reached the display or, when estimated, when the GPU finished it */
+	uint64_t frame;
+	VkSwapchainKHR swapchain;
+	Uint64 start, submitted, completed;
+	bool estimated;
+} PacedFrame;
+
+typedef struct {
+	/* FrameLatency is the input to photon latency of the last completed frame */
+	uint64_t frame;
+	double seconds;
+
+	/* estimated is true when it was measured to GPU completion because the
+	device can't wait for presents */
+	bool estimated;
+} FrameLatency;
+
+typedef struct {
+	/* Pacer delays the start of CPU work so that a frame is finished just in
+	time for its present, instead of waiting in a queue behind earlier frames.
+	With VK_KHR_present_wait it measures when frames are displayed, otherwise
+	it estimates from the fences of finished frames */
+	const DeviceDispatch *vk;
+	bool wait_for_present;
+
+	/* queued is how many frames may be between the CPU and the display */
+	uint32_t queued;
+
+	struct {
+		/* Namespace for the moving averages that predict the next frame, in
+		ticks. interval is between completions and work is start to completion */
+		double interval, work;
+	} estimate;
+
+	/* completed is the number of frames that have completed */
+	uint64_t completed;
+	Uint64 last_completed;
+
+	FrameLatency latency;
+	PacedFrame frames[PACING_HISTORY];
+} Pacer;
+
+/* methods */
+
+Pacer CreatePacer(RendererDevice *, uint32_t queued);
+void StartPacedFrame(Pacer *, uint64_t frame);
+uint64_t SubmitPacedFrame(Pacer *, uint64_t frame, VkSwapchainKHR);
+void CompletePacedFrame(Pacer *, uint64_t frame, VkFence);
+Uint64 GetPacedStart(Pacer *);
+void SleepPacedStart(Uint64 target);
+
+#endif
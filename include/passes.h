@@ -0,0 +1,92 @@
+#ifndef _SODA_PASSES_H
+#define _SODA_PASSES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "dispatch.h"
+
+/* types */
+
+typedef struct {
+	/* RenderTarget describes the colour attachment that a pass draws into */
+	VkImage image;
+	VkImageView view;
+	VkFormat format;
+	VkExtent2D extent;
+
+	VkAttachmentLoadOp load;
+	VkClearColorValue clear;
+
+	/* initial_layout is ignored unless load is VK_ATTACHMENT_LOAD_OP_LOAD */
+	VkImageLayout initial_layout, final_layout;
+} RenderTarget;
+
+typedef struct {
+	/* LegacyRenderPass is a cached VkRenderPass for drivers without dynamic
+	rendering */
+	VkFormat format;
+	VkAttachmentLoadOp load;
+	VkImageLayout initial_layout, final_layout;
+	VkRenderPass render_pass;
+} LegacyRenderPass;
+
+typedef struct {
+	/* LegacyFramebuffer is a cached VkFramebuffer for a RenderTarget view */
+	VkImageView view;
+	VkExtent2D extent;
+	VkRenderPass render_pass;
+	VkFramebuffer framebuffer;
+} LegacyFramebuffer;
+
+typedef struct {
+	/* PipelinePass is what makes a pipeline compatible with passes into a
+	kind of RenderTarget, render_pass is VK_NULL_HANDLE with dynamic
+	rendering. Unlike Passes it can be used from any thread */
+	VkRenderPass render_pass;
+	VkFormat format;
+} PipelinePass;
+
+typedef struct {
+	/* Passes begins and ends passes on a logical device. With dynamic rendering
+	it records vkCmdBeginRendering directly, otherwise it falls back to cached
+	VkRenderPass and VkFramebuffer objects */
+	const DeviceDispatch *vk;
+	bool dynamic;
+
+	struct {
+		/* Namespace for the dynamic rendering commands */
+		PFN_vkCmdBeginRenderingKHR begin;
+		PFN_vkCmdEndRenderingKHR end;
+	} cmd;
+
+	struct {
+		/* Namespace for the legacy render pass and framebuffer caches */
+		struct {
+			uint32_t count, capacity;
+			LegacyRenderPass *data;
+		} render_passes;
+
+		struct {
+			uint32_t count, capacity;
+			LegacyFramebuffer *data;
+		} framebuffers;
+	} legacy;
+} Passes;
+
+/* methods */
+
+Passes CreatePasses(const DeviceDispatch *, bool dynamic_rendering);
+void DestroyPasses(Passes *);
+void BeginPass(Passes *, VkCommandBuffer, RenderTarget *);
+void EndPass(Passes *, VkCommandBuffer, RenderTarget *);
+void SetPipelinePass(Passes *, VkGraphicsPipelineCreateInfo *, VkPipelineRenderingCreateInfoKHR *, RenderTarget *);
+PipelinePass GetPipelinePass(Passes *, RenderTarget *);
+void ApplyPipelinePass(const PipelinePass *, VkGraphicsPipelineCreateInfo *, VkPipelineRenderingCreateInfoKHR *);
+void ForgetPassView(Passes *, VkImageView);
+void RetirePassView(Passes *, VkImageView, DeletionQueue *, uint64_t value);
+
+#endif
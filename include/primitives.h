@@ -0,0 +1,53 @@
+#ifndef _SODA_PRIMITIVES_H
+#define _SODA_PRIMITIVES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "compute.h"
+
+/* constants */
+
+/* Largest workgroup the kernels are compiled for, devices with a lower limit
+get the largest power of 2 under it */
+#define MAX_PRIMITIVE_WORKGROUP 256
+
+/* Subgroups narrower than this don't pay for the extra kernels */
+#define MIN_PRIMITIVE_SUBGROUP 4
+
+/* Bits of key sorted by each radix pass */
+#define RADIX_BITS 4
+
+/* types */
+
+typedef struct {
+	/* Primitives are data parallel building blocks on Compute: exclusive scan,
+	reduction, radix sort and stream compaction of uint arrays. The kernels use
+	subgroup arithmetic when compute shaders have it, otherwise shared memory.
+	Each workgroup handles a block of workgroup * items elements */
+	Compute *compute;
+	bool subgroups;
+	uint32_t workgroup, items, block;
+
+	ComputeKernel reduce, scan, count, scatter, compact;
+
+	/* scratch holds block sums, counts and positions, keys and values are the
+	other half of a sort's ping pong. last is the token of the latest dispatch
+	using them, for retiring them when they grow */
+	Buffer scratch, keys, values;
+	ComputeToken last;
+} Primitives;
+
+/* methods */
+
+Primitives CreatePrimitives(Compute *, bool portable);
+void DestroyPrimitives(Primitives *);
+ComputeToken ExclusiveScan(Primitives *, VkBuffer src, VkBuffer dst, uint32_t count);
+ComputeToken Reduce(Primitives *, VkBuffer src, VkBuffer dst, uint32_t count);
+ComputeToken RadixSort(Primitives *, VkBuffer keys, VkBuffer values, uint32_t count, uint32_t bits);
+ComputeToken Compact(Primitives *, VkBuffer src, VkBuffer flags, VkBuffer dst, VkBuffer total, uint32_t count);
+
+#endif
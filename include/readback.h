@@ -0,0 +1,78 @@
+#ifndef _SODA_READBACK_H
+#define _SODA_READBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "renderer.h"
+#include "textures.h"
+
+/* constants */
+
+#define MAX_READBACKS 32
+
+/* Readback buffers are rounded up to a power of 2 of at least this many bytes
+so that they can be recycled for reads of a different size */
+#define MIN_READBACK_SIZE 65536
+
+/* types */
+
+typedef enum {
+	/* ReadbackState is where a ReadbackSlot is in its cycle */
+	READBACK_FREE,
+	READBACK_PENDING,
+	READBACK_READY,
+} ReadbackState;
+
+typedef struct {
+	/* ReadbackSlot is a host cached Buffer that a copy was recorded into. It
+	is ready once the progress value of the copy's submission has completed */
+	Buffer buffer;
+	ReadbackState state;
+	uint32_t generation;
+	uint64_t value;
+	VkDeviceSize size;
+
+	/* row_length is in bytes for texture reads, 0 for buffer reads */
+	uint32_t row_length;
+} ReadbackSlot;
+
+typedef struct {
+	/* ReadbackFuture refers to one read, generation tells it apart from later
+	reads that recycled the slot */
+	uint32_t slot, generation;
+} ReadbackFuture;
+
+typedef struct {
+	/* ReadbackView is the mapped memory of a completed read, it's valid until
+	the read is released. data is NULL if the read hasn't completed */
+	const void *data;
+	VkDeviceSize size;
+	uint32_t row_length;
+} ReadbackView;
+
+typedef struct {
+	/* Readbacks copies buffers and textures to the host without stalling.
+	Copies are recorded into recycled host cached buffers, and complete with
+	a progress value such as a frame or ComputeToken, like a DeletionQueue */
+	RendererDevice device;
+	VkMemoryPropertyFlags properties;
+	uint32_t count;
+	ReadbackSlot slots[MAX_READBACKS];
+} Readbacks;
+
+/* methods */
+
+Readbacks CreateReadbacks(RendererDevice);
+void DestroyReadbacks(Readbacks *);
+ReadbackFuture ReadbackBuffer(Readbacks *, VkCommandBuffer, VkBuffer, VkDeviceSize offset, VkDeviceSize size, uint64_t value);
+ReadbackFuture ReadbackTexture(Readbacks *, VkCommandBuffer, Texture *, VkRect2D, uint64_t value);
+void UpdateReadbacks(Readbacks *, uint64_t completed);
+bool PollReadback(Readbacks *, ReadbackFuture);
+ReadbackView GetReadback(Readbacks *, ReadbackFuture);
+void ReleaseReadback(Readbacks *, ReadbackFuture);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _SODA_RELOAD_H
+#define _SODA_RELOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "deletion.h"
+#include "renderer.h"
+
+/* constants */
+
+#define MAX_RELOAD_PIPELINES 64
+#define MAX_RELOADED_SHADERS 64
+#define MAX_PIPELINE_SHADERS 4
+#define RELOAD_PATH_SIZE 4096
+
+/* Milliseconds the reloader waits for changes before checking whether it
+should stop, and how long a burst of writes must be quiet before compiling,
+as editors often save in several steps */
+#define RELOAD_POLL_MS 100
+#define RELOAD_SETTLE_MS 50
+
+/* types */
+
+typedef struct {
+	/* ShaderCode is the SPIR-V of one shader of a pipeline */
+	const uint32_t *code;
+	size_t size;
+} ShaderCode;
+
+typedef VkPipeline (*PipelineMethod)(void *data, const ShaderCode *shaders);
+/* function pointer type that builds a pipeline from the SPIR-V of its shaders,
+in the order they were watched. It runs on the reloader's thread and returns
+VK_NULL_HANDLE if the pipeline couldn't be built */
+
+typedef struct {
+	/* ReloadedShader is the latest SPIR-V compiled for a shader, it's used
+	instead of the archive's from then on. name is the archive's name for it */
+	char name[ARCHIVE_NAME_SIZE];
+	uint32_t *code;
+	size_t size;
+} ReloadedShader;
+
+typedef struct {
+	/* ReloadPipeline is a pipeline that is rebuilt whenever one of its shaders
+	changes. pending is the rebuilt pipeline waiting for a frame boundary */
+	VkPipeline *pipeline, pending;
+	PipelineMethod build;
+	void *data;
+
+	uint32_t count;
+	char shaders[MAX_PIPELINE_SHADERS][ARCHIVE_NAME_SIZE];
+} ReloadPipeline;
+
+typedef struct {
+	/* ShaderReloader watches a directory of GLSL sources with inotify. Changed
+	sources are compiled and their pipelines rebuilt on its own thread, then
+	ApplyShaderReloads swaps them in at a frame boundary. lock guards the
+	shaders and pipelines */
+	RendererDevice device;
+	char directory[RELOAD_PATH_SIZE];
+	const char *compiler;
+	int inotify;
+
+	SDL_Thread *thread;
+	SDL_atomic_t running;
+	SDL_mutex *lock;
+
+	struct {
+		/* Namespace for the shaders compiled so far */
+		uint32_t count;
+		ReloadedShader data[MAX_RELOADED_SHADERS];
+	} shaders;
+
+	struct {
+		/* Namespace for the watched pipelines */
+		uint32_t count;
+		ReloadPipeline data[MAX_RELOAD_PIPELINES];
+	} pipelines;
+} ShaderReloader;
+
+/* methods */
+
+ShaderReloader *StartShaderReloader(RendererDevice, const char *directory);
+void StopShaderReloader(ShaderReloader *);
+void WatchPipeline(ShaderReloader *, VkPipeline *, const char **shaders, uint32_t count, PipelineMethod, void *data);
+void UnwatchPipeline(ShaderReloader *, VkPipeline *);
+void ApplyShaderReloads(ShaderReloader *, DeletionQueue *, uint64_t value);
+
+#endif
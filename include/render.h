@@ -0,0 +1,80 @@
+#ifndef _SODA_RENDER_H
+#define _SODA_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "drawlist.h"
+#include "events.h"
+#include "passes.h"
+#include "renderer.h"
+#include "residency.h"
+
+/* constants */
+
+/* Milliseconds the render thread sleeps when there is nothing to draw */
+#define RENDER_IDLE_DELAY 10
+
+/* Draws each window's DrawList holds before it first grows */
+#define RENDER_DRAW_CAPACITY 1024
+
+/* GPU milliseconds per frame that dynamic resolution aims for, under a 60 Hz
+interval to leave room for jitter */
+#define RENDER_GPU_BUDGET_MS 14.0
+
+/* types */
+
+typedef struct {
+	/* RenderWindow is a window the render thread draws into. id is its SDL
+	window id, which its window events carry */
+	uint32_t id;
+	VkSurfaceKHR surface;
+	VkExtent2D extent;
+} RenderWindow;
+
+typedef struct {
+	/* RenderContext is a window's frame as it's being recorded. The Draws
+	submitted to draws are sorted and recorded into target's pass once the
+	RenderMethod returns, command_buffer is outside of any pass until then so
+	uploads can be recorded into it. Textures and buffers added to residency
+	are released when the device runs short of memory, objects the frame uses
+	are deleted through deletions at value */
+	uint32_t window;
+	uint64_t frame;
+	DrawList *draws;
+	VkCommandBuffer command_buffer;
+	RenderTarget *target;
+
+	Residency *residency;
+	DeletionQueue *deletions;
+	uint64_t value;
+} RenderContext;
+
+typedef void (*RenderMethod)(void *data, RenderContext *);
+/* function pointer type for the code that fills a window's frame, it's called
+on the render thread once per window for every frame */
+
+typedef struct {
+	/* RenderThread produces frames on its own thread, it only learns about
+	input and window changes through events */
+	SDL_Thread *thread;
+	EventQueue *events;
+
+	/* draw fills each window's frame, with nothing to fill them the windows
+	are only cleared */
+	RenderMethod draw;
+	void *data;
+
+	uint32_t window_count;
+	RenderWindow windows[MAX_RENDERER_WINDOWS];
+} RenderThread;
+
+/* methods */
+
+RenderThread *StartRenderThread(EventQueue *, const RenderWindow *, uint32_t count, RenderMethod, void *data);
+void StopRenderThread(RenderThread *);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _SODA_RENDERER_H
+#define _SODA_RENDERER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "dispatch.h"
+#include "shaders.h"
+
+/* constants */
+
+/* Windows a renderer can open, they share its device and queues */
+#define MAX_RENDERER_WINDOWS 8
+
+/* types */
+
+typedef struct {
+	/* RendererDevice exposes the Vulkan handles of the renderer so that other
+	modules can build on its logical device. surfaces has a surface per window,
+	surface is the first of them or VK_NULL_HANDLE for a headless renderer */
+	VkInstance instance;
+	VkPhysicalDevice physical_device;
+	VkDevice device;
+	VkSurfaceKHR surface;
+	uint32_t api_version;
+
+	uint32_t surface_count;
+	VkSurfaceKHR surfaces[MAX_RENDERER_WINDOWS];
+
+	struct {
+		/* Namespace for the selected queue family indices, present can present
+		to every surface and is -1 when there are none */
+		int graphics, present, compute;
+	} family;
+
+	struct {
+		/* Namespace for the VkQueues retrieved from the logical device */
+		VkQueue graphics, present, compute;
+	} queue;
+
+	struct {
+		/* Namespace for the function tables of the instance and the logical
+		device, Vulkan calls go through these rather than the loader */
+		const InstanceDispatch *instance;
+		const DeviceDispatch *device;
+	} dispatch;
+
+	struct {
+		/* Namespace for the subgroup properties, size is 0 when the device is
+		older than Vulkan 1.1 */
+		uint32_t size;
+		VkShaderStageFlags stages;
+		VkSubgroupFeatureFlags operations;
+	} subgroup;
+
+	struct {
+		/* Namespace for the optional features enabled on the logical device */
+		bool dynamic_rendering, timeline_semaphore, swapchain, present_wait, memory_budget;
+		bool sparse_residency, fragment_atomics;
+	} supports;
+
+	struct {
+		/* Namespace for the shared ShaderModules, archive is NULL if no shader
+		archive was found */
+		ShaderCache *cache;
+		Archive *archive;
+	} shaders;
+} RendererDevice;
+
+/* methods */
+
+void CreateRenderer();
+void CreateMultiWindowRenderer(uint32_t windows);
+void CreateHeadlessRenderer();
+void DestroyRenderer();
+RendererDevice GetRendererDevice();
+SDL_Window *GetRendererWindow(uint32_t index);
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef _SODA_RESIDENCY_H
+#define _SODA_RESIDENCY_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "frames.h"
+#include "renderer.h"
+
+/* constants */
+
+#define NO_RESIDENT UINT32_MAX
+#define RESIDENCY_PRIORITIES 4
+
+/* Without VK_EXT_memory_budget a heap's budget is this fraction of its size,
+which leaves room for the rest of the system */
+#define FALLBACK_BUDGET 0.8
+
+/* Residents are released once a heap's usage goes over RESIDENCY_HIGH_WATER
+of its budget, until it's back under RESIDENCY_LOW_WATER, so the driver never
+has to page */
+#define RESIDENCY_HIGH_WATER 0.95
+#define RESIDENCY_LOW_WATER 0.85
+
+/* Released memory is only freed once the frames in flight have finished, the
+driver's usage lags behind by this many updates */
+#define RESIDENCY_LATENCY (FRAMES_IN_FLIGHT + 1)
+
+/* types */
+
+typedef VkDeviceSize (*DemoteMethod)(void *data, uint32_t levels, DeletionQueue *, uint64_t value);
+/* DemoteMethod releases a resident's memory down to levels mip levels, 0
+evicts it, and returns the bytes still resident. The GPU may still be using
+the memory, so it's released through the DeletionQueue at value */
+
+typedef struct {
+	/* MemoryBudget is the usage and budget of each memory heap in bytes. With
+	VK_EXT_memory_budget both come from the driver and cover the whole
+	process, otherwise budget is FALLBACK_BUDGET of the heap size and usage is
+	what Residency tracks */
+	uint32_t count;
+	VkDeviceSize usage[VK_MAX_MEMORY_HEAPS], budget[VK_MAX_MEMORY_HEAPS];
+} MemoryBudget;
+
+typedef struct {
+	/* ResidentInfo describes a texture or buffer added to Residency. levels
+	are its mip levels, 1 for buffers, and min_levels is how many demotion
+	keeps, 0 if it can be evicted. priority 0 is released first */
+	DemoteMethod demote;
+	void *data;
+	VkDeviceSize size;
+	VkMemoryPropertyFlags properties;
+	uint32_t levels, min_levels, priority;
+} ResidentInfo;
+
+typedef struct {
+	/* Resident is a resource Residency may release, prev and next link it
+	into the LRU list of its priority. Evicted residents aren't in a list, and
+	free ones chain through next */
+	DemoteMethod demote;
+	void *data;
+	VkDeviceSize size;
+	uint32_t heap, priority, levels, min_levels;
+	uint64_t used;
+	uint32_t prev, next;
+} Resident;
+
+typedef struct {
+	/* Residency keeps each heap's usage under its budget. Every frame the
+	least recently used residents of the lowest priority lose a mip level, or
+	are evicted once they can't be demoted, before the driver starts paging */
+	RendererDevice device;
+	VkPhysicalDeviceMemoryProperties properties;
+	MemoryBudget budget;
+	uint64_t frame;
+
+	/* tracked is the resident bytes of each heap, released the bytes released
+	in each of the last RESIDENCY_LATENCY updates */
+	VkDeviceSize tracked[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize released[RESIDENCY_LATENCY][VK_MAX_MEMORY_HEAPS];
+
+	uint32_t count, capacity, spare;
+	Resident *residents;
+
+	struct {
+		/* Namespace for the LRU list of each priority, head is the least
+		recently used */
+		uint32_t head, tail;
+	} lru[RESIDENCY_PRIORITIES];
+} Residency;
+
+/* methods */
+
+Residency CreateResidency(RendererDevice);
+void DestroyResidency(Residency *);
+uint32_t AddResident(Residency *, ResidentInfo);
+void RemoveResident(Residency *, uint32_t resident);
+uint32_t TouchResident(Residency *, uint32_t resident, uint64_t frame);
+void RestoreResident(Residency *, uint32_t resident, uint32_t levels, VkDeviceSize size);
+void UpdateResidency(Residency *, uint64_t frame, DeletionQueue *, uint64_t value);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _SODA_SCALING_H
+#define _SODA_SCALING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "frames.h"
+#include "passes.h"
+#include "renderer.h"
+#include "textures.h"
+
+/* constants */
+
+/* Bounds of the render scale of each axis */
+#define MIN_RENDER_SCALE 0.5
+#define MAX_RENDER_SCALE 1.0
+
+/* The scale moves in steps of 1 / RENDER_SCALE_STEPS, so a frame is drawn at
+one of a few extents and few legacy framebuffers are cached for them */
+#define RENDER_SCALE_STEPS 32
+
+/* GPU times within this fraction of the target leave the scale alone */
+#define SCALING_DEADBAND 0.05
+
+/* Weight of the newest GPU time in the moving average */
+#define SCALING_SMOOTHING 0.25
+
+/* Fraction of the way to the predicted scale that one adjustment moves */
+#define SCALING_GAIN 0.5
+
+/* types */
+
+typedef struct {
+	/* Scaler draws frames into an offscreen Texture at a fraction of the
+	swapchain's resolution and blits them up to the swapchain image. After
+	every frame the fraction is adjusted so that the GPU time, measured with
+	timestamps around the frame, holds target. Devices without timestamps or
+	swapchains that can't be blitted to are drawn at full resolution */
+	RendererDevice device;
+	bool timestamps;
+	VkQueryPool queries;
+
+	/* period is nanoseconds per tick, mask the valid bits of a timestamp */
+	double period;
+	uint64_t mask;
+
+	/* pending is frame + 1 of the timestamps in each frame's queries, or 0 if
+	they haven't been written */
+	uint64_t pending[FRAMES_IN_FLIGHT];
+
+	/* target and gpu are in nanoseconds, gpu is a moving average of the frames
+	drawn since settled, when scale last changed */
+	double target, gpu;
+	double scale;
+	uint64_t settled;
+
+	/* scaled is true when the current frame is drawn into texture at extent */
+	bool scaled;
+	VkExtent2D extent;
+	Texture texture;
+} Scaler;
+
+/* methods */
+
+Scaler CreateScaler(RendererDevice, double target_ms);
+void DestroyScaler(Scaler *, Frames *);
+RenderTarget BeginScaledFrame(Scaler *, Frames *, Frame *);
+void EndScaledFrame(Scaler *, Frames *, Frame *);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _SODA_SCENE_H
+#define _SODA_SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jobs.h"
+
+/* constants */
+
+#define NO_SCENE_NODE UINT32_MAX
+#define MAX_SCENE_DEPTH 64
+
+/* Nodes a job updates or culls at once, a multiple of every SIMD width */
+#define SCENE_CHUNK 8192
+
+/* types */
+
+typedef enum {
+	/* SceneSimd is the instruction set of the update and cull kernels. The 128
+	bit kernels are SSE2 on x86-64 and NEON on AArch64 */
+	SCENE_SIMD_SCALAR,
+	SCENE_SIMD_128,
+	SCENE_SIMD_AVX2,
+} SceneSimd;
+
+typedef struct {
+	/* SceneNodes are the nodes in slot order as a structure of arrays, each of
+	capacity elements. Local transforms are a position, a unit quaternion and
+	a uniform scale, bounds are a sphere. world is a row major 3x4 matrix, and
+	world_bounds the sphere it moves the bounds to */
+	float *position[3], *rotation[4], *scale;
+	float *centre[3], *radius;
+
+	float *world[12], *world_scale, *world_bounds[4];
+
+	/* handle is each slot's node, parent the slot of its parent */
+	uint32_t *handle, *parent;
+} SceneNodes;
+
+typedef struct {
+	/* Scene is a hierarchy of transforms with bounds. Slots are sorted by depth
+	so every parent is updated before its children, and each depth is updated
+	then culled in SIMD batches split across jobs. Nodes are referred to by a
+	handle that stays the same when slots are sorted */
+	Jobs *jobs;
+	SceneSimd simd;
+	uint32_t count, capacity;
+	bool sorted;
+
+	SceneNodes nodes;
+
+	struct {
+		/* Namespace for the nodes by handle */
+		uint32_t *slots, *parents, *depths;
+	} handles;
+
+	struct {
+		/* Namespace for the first slot of each depth, first[count] is the end
+		of the last one */
+		uint32_t count;
+		uint32_t first[MAX_SCENE_DEPTH + 1];
+	} levels;
+
+	struct {
+		/* Namespace for the scratch arrays of sorting and culling. visible
+		holds each chunk's visible handles at the chunk's slots */
+		float *floats;
+		uint32_t *uints, *visible, *counts;
+	} scratch;
+} Scene;
+
+/* methods */
+
+Scene CreateScene(uint32_t capacity, Jobs *);
+void DestroyScene(Scene *);
+bool SetSceneSimd(Scene *, SceneSimd);
+const char *GetSceneSimdName(SceneSimd);
+uint32_t AddSceneNode(Scene *, uint32_t parent);
+void SetSceneTransform(Scene *, uint32_t node, const float position[3], const float rotation[4], float scale);
+void SetSceneBounds(Scene *, uint32_t node, const float centre[3], float radius);
+void UpdateScene(Scene *);
+void GetFrustumPlanes(const float view_projection[16], float planes[6][4]);
+uint32_t CullScene(Scene *, const float planes[6][4], uint32_t *visible);
+void CopySceneWorlds(Scene *, const uint32_t *nodes, uint32_t count, float (*worlds)[12]);
+
+#endif
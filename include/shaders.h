@@ -0,0 +1,66 @@
+#ifndef _SODA_SHADERS_H
+#define _SODA_SHADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "dispatch.h"
+
+/* constants */
+
+#define MAX_SHADER_CONSTANTS 16
+
+/* types */
+
+typedef struct {
+	/* ShaderModule is a VkShaderModule shared by every pipeline that uses the
+	same SPIR-V. It is found by the hash of its code, and keeps a copy of the
+	code so that colliding hashes aren't mistaken for it */
+	uint64_t hash;
+	size_t size;
+	uint32_t *code;
+	uint32_t references;
+	VkShaderModule module;
+} ShaderModule;
+
+typedef struct {
+	/* ShaderCache is a content addressed registry of ShaderModules, it's an
+	open addressed hash table with a power of 2 capacity */
+	const DeviceDispatch *vk;
+	uint32_t count, capacity;
+	ShaderModule **slots;
+} ShaderCache;
+
+typedef struct {
+	/* ShaderConstant is the value of a specialization constant, every scalar
+	constant type (bool, int, uint and float) is 32 bits */
+	uint32_t id, value;
+} ShaderConstant;
+
+typedef struct {
+	/* ShaderVariant is a ShaderModule specialised with ShaderConstants, so one
+	module can serve many permutations */
+	ShaderModule *module;
+	VkShaderStageFlagBits stage;
+	const char *entry;
+
+	uint32_t count;
+	uint32_t data[MAX_SHADER_CONSTANTS];
+	VkSpecializationMapEntry entries[MAX_SHADER_CONSTANTS];
+	VkSpecializationInfo specialization;
+} ShaderVariant;
+
+/* methods */
+
+ShaderCache CreateShaderCache(const DeviceDispatch *);
+void DestroyShaderCache(ShaderCache *);
+ShaderModule *AcquireShaderModule(ShaderCache *, const uint32_t *code, size_t size);
+ShaderModule *AcquireArchiveShader(ShaderCache *, Archive *, const char *name);
+void ReleaseShaderModule(ShaderCache *, ShaderModule *);
+ShaderVariant CreateShaderVariant(ShaderModule *, VkShaderStageFlagBits, const ShaderConstant *, uint32_t count);
+VkPipelineShaderStageCreateInfo GetShaderStage(ShaderVariant *);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _SODA_SPRITES_H
+#define _SODA_SPRITES_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "atlas.h"
+#include "buffers.h"
+#include "deletion.h"
+#include "passes.h"
+#include "reload.h"
+#include "renderer.h"
+#include "residency.h"
+#include "textures.h"
+
+/* constants */
+
+/* Size in texels of an atlas page */
+#define SPRITE_PAGE_SIZE 2048
+
+#define MAX_SPRITE_PAGES 16
+
+/* Residency priority of tracked atlas pages, restoring one uploads a whole
+page so they're released after cheaper residents */
+#define SPRITE_PAGE_PRIORITY 1
+
+/* types */
+
+typedef struct {
+	/* SpriteImage is an image packed into the sprite atlas. uv is its
+	rectangle on the page as 16 bit unorm u0, v0, u1, v1 */
+	uint32_t page;
+	uint16_t uv[4];
+} SpriteImage;
+
+typedef struct {
+	/* SpriteInstance is the per instance vertex data of shaders/sprite.vert.
+	position is the centre and size the extent in pixels, colour is RGBA8 and
+	multiplies the image, rotation is in radians */
+	float position[2];
+	float size[2];
+	uint16_t uv[4];
+	uint32_t colour;
+	float rotation;
+} SpriteInstance;
+
+typedef struct {
+	/* SpriteBatch is a run of instances that sample the same page, drawn by one
+	instanced vkCmdDraw */
+	uint32_t page, first, count;
+} SpriteBatch;
+
+typedef struct {
+	/* SpriteUpload is an image waiting to be copied into its page, its texels
+	are at offset in the pending uploads */
+	uint32_t page;
+	VkRect2D region;
+	size_t offset;
+} SpriteUpload;
+
+typedef struct {
+	/* Sprites draws textured quads from an atlas with one instanced draw per
+	batch. Instances are written straight into a persistently mapped buffer
+	that has a slice per frame in flight */
+	RendererDevice device;
+	Atlas atlas;
+
+	VkSampler sampler;
+	VkDescriptorSetLayout set_layout;
+	VkDescriptorPool descriptors;
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+
+	/* pass is what the pipeline is built for, reloader is NULL unless the
+	sprites are watched */
+	PipelinePass pass;
+	ShaderReloader *reloader;
+
+	/* residency is NULL unless the pages are tracked, frame is the one the
+	sprites are being drawn for */
+	Residency *residency;
+	uint64_t frame;
+
+	struct {
+		/* Namespace for the atlas pages, each with its own descriptor set.
+		Tracked pages keep their texels on the host so they can be restored
+		after they're evicted */
+		uint32_t count;
+		Texture textures[MAX_SPRITE_PAGES];
+		VkDescriptorSet sets[MAX_SPRITE_PAGES];
+		uint32_t residents[MAX_SPRITE_PAGES];
+		uint32_t *texels[MAX_SPRITE_PAGES];
+	} pages;
+
+	struct {
+		/* Namespace for the descriptor sets of evicted pages, freed by the
+		next RecordSpriteUploads */
+		uint32_t count;
+		VkDescriptorSet sets[MAX_SPRITE_PAGES];
+	} retired;
+
+	struct {
+		/* Namespace for the images added since the last RecordSpriteUploads */
+		uint32_t count, capacity;
+		SpriteUpload *data;
+
+		size_t size, reserved;
+		uint8_t *texels;
+	} uploads;
+
+	/* instances holds capacity SpriteInstances per frame in flight, mapped
+	points at the slice of the current frame */
+	Buffer instances;
+	SpriteInstance *mapped;
+	uint32_t capacity, count, slice;
+
+	struct {
+		/* Namespace for the batches of the current frame */
+		uint32_t count, capacity;
+		SpriteBatch *data;
+	} batches;
+} Sprites;
+
+/* methods */
+
+Sprites CreateSprites(RendererDevice, Passes *, RenderTarget *, uint32_t capacity);
+void DestroySprites(Sprites *);
+void WatchSprites(Sprites *, ShaderReloader *);
+void TrackSprites(Sprites *, Residency *);
+SpriteImage AddSpriteImage(Sprites *, uint32_t width, uint32_t height, const uint32_t *texels);
+void BeginSprites(Sprites *, uint64_t frame);
+void DrawSprite(Sprites *, const SpriteImage *, float x, float y, float width, float height, float rotation, uint32_t colour);
+void RecordSpriteUploads(Sprites *, VkCommandBuffer, DeletionQueue *, uint64_t value);
+void RecordSprites(Sprites *, VkCommandBuffer, VkExtent2D);
+
+#endif
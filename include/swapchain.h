@@ -0,0 +1,39 @@
+#ifndef _SODA_SWAPCHAIN_H
+#define _SODA_SWAPCHAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "renderer.h"
+
+/* constants */
+
+#define MAX_SWAPCHAIN_IMAGES 8
+
+/* types */
+
+typedef struct {
+	/* Swapchain is a VkSwapchainKHR with a view of each image and a semaphore
+	per image that is signalled when rendering to it has finished. swapchain is
+	VK_NULL_HANDLE when the surface has no area e.g. the window is minimized.
+	usage is what the images support, always including colour attachment */
+	VkSwapchainKHR swapchain;
+	VkSurfaceFormatKHR format;
+	VkImageUsageFlags usage;
+	VkPresentModeKHR present_mode;
+	VkExtent2D extent;
+
+	uint32_t count;
+	VkImage images[MAX_SWAPCHAIN_IMAGES];
+	VkImageView views[MAX_SWAPCHAIN_IMAGES];
+	VkSemaphore rendered[MAX_SWAPCHAIN_IMAGES];
+} Swapchain;
+
+/* methods */
+
+Swapchain CreateSwapchain(RendererDevice *, VkSurfaceKHR, VkExtent2D, Swapchain *old);
+void DestroySwapchain(RendererDevice *, Swapchain *);
+
+#endif
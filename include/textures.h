@@ -0,0 +1,35 @@
+#ifndef _SODA_TEXTURES_H
+#define _SODA_TEXTURES_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "renderer.h"
+
+/* types */
+
+typedef struct {
+	/* Texture is a 2D VkImage with one mip level, bound to its own memory of
+	size bytes. layout is the layout the last recorded command leaves it in */
+	VkImage image;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkImageView view;
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageLayout layout;
+} Texture;
+
+/* methods */
+
+uint32_t GetTexelSize(VkFormat);
+Texture CreateTexture(RendererDevice *, VkExtent2D, VkFormat, VkImageUsageFlags);
+void DestroyTexture(RendererDevice *, Texture *);
+void DeleteTextureLater(DeletionQueue *, Texture *, uint64_t value);
+VkDeviceSize DemoteTexture(void *texture, uint32_t levels, DeletionQueue *, uint64_t value);
+void TransitionTexture(const DeviceDispatch *, VkCommandBuffer, Texture *, VkImageLayout);
+void CopyBufferToTexture(const DeviceDispatch *, VkCommandBuffer, VkBuffer, VkDeviceSize offset, Texture *, VkRect2D);
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef _SODA_VIRTUAL_H
+#define _SODA_VIRTUAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "frames.h"
+#include "renderer.h"
+
+/* constants */
+
+/* Pages are VIRTUAL_PAGE_SIZE texels square of VIRTUAL_FORMAT, the standard
+sparse block of a 32 bit format, so each page is bound on its own. These must
+match shaders/virtual.glsl */
+#define VIRTUAL_PAGE_SIZE 128
+#define VIRTUAL_PAGE_BYTES (VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE * 4)
+#define VIRTUAL_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+#define MAX_VIRTUAL_LEVELS 16
+#define MAX_VIRTUAL_REQUESTS 4096
+
+/* Pages uploaded per frame, and pages the loader thread may hold between
+being requested and uploaded */
+#define VIRTUAL_UPLOADS 16
+#define VIRTUAL_LOADS 64
+
+/* Slots kept free or retiring so a frame's uploads never wait on an eviction.
+Evicted slots are only reused once the frames that sampled them are done */
+#define VIRTUAL_RESERVE (VIRTUAL_UPLOADS * (FRAMES_IN_FLIGHT + 1))
+
+/* Slots of the indirection fallback's atlas are addressed with 8 bits */
+#define MAX_VIRTUAL_ATLAS 256
+
+#define NO_VIRTUAL_SLOT UINT32_MAX
+
+/* Page files are written by tools/pages, their pages start at
+PAGE_FILE_ALIGNMENT */
+#define PAGE_FILE_MAGIC "SVTP"
+#define PAGE_FILE_VERSION 1
+#define PAGE_FILE_ALIGNMENT 4096
+
+/* macros */
+
+/* VIRTUAL_TABLE_ENTRY packs the RGBA8 table entry of a page in the slot at x, y
+of the atlas, the alpha channel is unused */
+#define VIRTUAL_TABLE_ENTRY(x, y, level) ((uint32_t) (x) | ((uint32_t) (y) << 8) | ((uint32_t) (level) << 16))
+
+/* types */
+
+typedef struct {
+	/* PageFileHeader starts a page file. The texture is pages pages square at
+	level 0, a power of 2, and halves down to a single page. Pages follow as
+	RGBA8 texels, level by level and row by row within a level */
+	char magic[4];
+	uint32_t version, pages, levels;
+} PageFileHeader;
+
+typedef struct {
+	/* VirtualFeedback starts the feedback buffer, see shaders/virtual.glsl.
+	The fragments that sample the texture append the pages they need to
+	requests, a bitmap of one bit per page follows so each is added once */
+	uint32_t sparse, pages, levels, atlas, frame;
+	uint32_t count;
+	uint32_t requests[MAX_VIRTUAL_REQUESTS];
+} VirtualFeedback;
+
+typedef enum {
+	/* VirtualState is where a page is between the page file and memory. Loaded
+	pages have a slot and are waiting to be bound or uploaded */
+	VIRTUAL_ABSENT,
+	VIRTUAL_QUEUED,
+	VIRTUAL_LOADED,
+	VIRTUAL_RESIDENT,
+} VirtualState;
+
+typedef struct {
+	/* VirtualLoad is a page the loader thread reads into buffer, an index of
+	its memory */
+	uint32_t page, buffer;
+} VirtualLoad;
+
+typedef struct {
+	/* VirtualSlot is a page sized piece of memory, used is the last frame its
+	page was requested. bound is the page its memory is bound at in the sparse
+	image, which outlives page as unbinding waits until the slot is reused */
+	uint32_t page, bound;
+	uint64_t used;
+} VirtualSlot;
+
+typedef struct {
+	/* VirtualRect is the dirty part of a level of the table, x1 and y1 are
+	exclusive so it's empty when x0 isn't below x1 */
+	uint32_t x0, y0, x1, y1;
+} VirtualRect;
+
+typedef struct {
+	/* VirtualLoader reads pages from the page file on its own thread. queue
+	holds the loads to read and done the loads that were read, both are rings
+	guarded by mutex. spare is the main thread's stack of free buffers */
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *wake;
+	bool quit;
+	int fd;
+
+	uint8_t *memory;
+	VirtualLoad queue[VIRTUAL_LOADS], done[VIRTUAL_LOADS];
+	uint32_t queue_head, queue_count, done_head, done_count;
+	uint32_t spare[VIRTUAL_LOADS], spare_count;
+} VirtualLoader;
+
+typedef struct {
+	/* VirtualTexture streams the pages of a page file that the last frames
+	sampled into a fixed pool of slots, so its memory stays bounded however
+	large the texture is. With sparse residency the slots are bound into a
+	partially resident image, otherwise pages are copied into an atlas. Either
+	way the table holds the finest resident page over each page, which the
+	shaders clamp their level of detail to */
+	RendererDevice device;
+	bool sparse;
+	uint32_t pages, levels, count, capacity, atlas;
+	uint32_t first[MAX_VIRTUAL_LEVELS + 1];
+
+	VkDescriptorSetLayout set_layout;
+	VkDescriptorPool descriptors;
+	VkDescriptorSet set;
+	VkSampler sampler, table_sampler;
+
+	struct {
+		/* Namespace for the sparse image or atlas, and the table with a mip
+		level per level of the texture */
+		VkImage image, table;
+		VkImageView view, table_view;
+		VkDeviceMemory memory, table_memory;
+		VkImageLayout layout, table_layout;
+	} images;
+
+	/* Each frame in flight has staging for its uploads and table updates, and
+	a readback of the feedback it wrote */
+	Buffer feedback;
+	Buffer staging[FRAMES_IN_FLIGHT], readback[FRAMES_IN_FLIGHT];
+	bool written[FRAMES_IN_FLIGHT];
+	VkDeviceSize table_offset;
+	uint32_t slice;
+	uint64_t frame;
+
+	struct {
+		/* Namespace for the state of each page. slots is NO_VIRTUAL_SLOT unless
+		the page is loaded or resident, bound is the slot bound at the page in
+		the sparse image and children counts the children that have slots */
+		uint8_t *states, *children;
+		uint32_t *slots, *bound;
+	} page;
+
+	struct {
+		/* Namespace for the pool of slots, free is a stack and retired a ring of
+		the slots evicted at retired_frames */
+		VirtualSlot *slots;
+		uint32_t *free, free_count;
+		uint32_t *retired, retired_head, retired_count;
+		uint64_t *retired_frames;
+	} slot;
+
+	struct {
+		/* Namespace for the CPU copy of the table, an RGBA8 entry per page of
+		every level holding a slot's place in the atlas and its page's level */
+		uint32_t *entries[MAX_VIRTUAL_LEVELS];
+		VirtualRect dirty[MAX_VIRTUAL_LEVELS];
+	} table;
+
+	struct {
+		/* Namespace for the loads of the frame, uploads are copied into staging.
+		binding are waiting on fence for their sparse binds */
+		VirtualLoad uploads[VIRTUAL_UPLOADS], binding[VIRTUAL_UPLOADS];
+		uint32_t upload_count, binding_count;
+		VkFence fence;
+	} loads;
+
+	VirtualLoader *loader;
+} VirtualTexture;
+
+/* methods */
+
+VirtualTexture CreateVirtualTexture(RendererDevice, const char *path, uint32_t capacity);
+void DestroyVirtualTexture(VirtualTexture *);
+void BeginVirtualTexture(VirtualTexture *, uint64_t frame);
+void RecordVirtualTexture(VirtualTexture *, VkCommandBuffer);
+void RecordVirtualFeedback(VirtualTexture *, VkCommandBuffer);
+void BindVirtualTexture(VirtualTexture *, VkCommandBuffer, VkPipelineLayout, uint32_t set);
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "instance.h"
 #include "devices.h"
+#include "log.h"
 #include "panic.h"
 
 /* types */
@@ -16,10 +17,6 @@
 typedef bool (*ValidatePropertyNameMethod)(Instance, const char *);
 /* function pointer type for the Properties name validation methods */
 
-/* function prototypes */
-
-static VKAPI_ATTR VkBool32 VKAPI_CALL DebugMessengerCallback();
-
 /* data */
 
 VkDebugUtilsMessengerCreateInfoEXT DEBUG_UTILS_CREATE_INFO = {
@@ -27,15 +24,13 @@ VkDebugUtilsMessengerCreateInfoEXT DEBUG_UTILS_CREATE_INFO = {
 		.pNext = NULL,
 		.flags =	0,
 		.messageSeverity =
-			VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-			VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
 			VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
 			VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
 		.messageType =
 			VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
 			VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
 			VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-		.pfnUserCallback = DebugMessengerCallback,
+		.pfnUserCallback = DebugLogMessenger,
 		.pUserData = NULL,
 };
 
@@ -256,16 +251,7 @@ static bool ValidateRequiredLayers(Instance instance) {
 	return ValidateRequiredProperties(instance, instance.requires.layers, ValidLayerName);
 }
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL DebugMessengerCallback(
-	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-	VkDebugUtilsMessageTypeFlagsEXT messageType,
-	const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-	void *pUserData) {
-	fprintf(stderr, "%s\n", pCallbackData->pMessage);
-
-	return VK_FALSE;
-}
-
+#ifndef SODA_RELEASE
 static VkDebugUtilsMessengerEXT CreateDebugMessenger(VkInstance instance) {
 	/* Create the VkDebugUtilsMessengerEXT */
 	VkDebugUtilsMessengerEXT debug_messenger;
@@ -285,6 +271,7 @@ static void DestroyDebugMessenger(Instance *instance) {
 
 	destroy(instance->instance, instance->debug_messenger, NULL);
 }
+#endif
 
 Instance CreateInstance(RequiredProperties required_extensions) {
 	/* Creates the VkInstance and get the rest of the Vulkan's state */
@@ -308,10 +295,16 @@ Instance CreateInstance(RequiredProperties required_extensions) {
 		.apiVersion = VK_API_VERSION_1_0,
 	};
 
-	bool debug = true;
+#ifndef SODA_RELEASE
+	ApplyDebugLogFilter(&DEBUG_UTILS_CREATE_INFO, GetDebugLogFilter());
+	StartDebugLog();
+#endif
+
 	VkInstanceCreateInfo createInfo = {
 		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-		.pNext = (debug) ? &DEBUG_UTILS_CREATE_INFO : NULL,
+#ifndef SODA_RELEASE
+		.pNext = &DEBUG_UTILS_CREATE_INFO,
+#endif
 		.flags = 0,
 		.pApplicationInfo = &appInfo,
 		.enabledLayerCount = instance.requires.layers.count,
@@ -323,7 +316,9 @@ Instance CreateInstance(RequiredProperties required_extensions) {
 	return instance;
 	if (vkCreateInstance(&createInfo, NULL, &instance.instance) != VK_SUCCESS) Panic("renderer/vulkan: failed to create VkInstance\n");
 
+#ifndef SODA_RELEASE
 	instance.debug_messenger = CreateDebugMessenger(instance.instance);
+#endif
 
 	instance.physical_devices = GetPhysicalDevices(instance.instance);
 
@@ -341,7 +336,9 @@ void DestroyInstance(Instance *instance) {
 
 	DestroyRequiredProperties(instance->requires.extensions);
 	DestroyRequiredProperties(instance->requires.layers);
+#ifndef SODA_RELEASE
 	DestroyDebugMessenger(instance);
+#endif
 	vkDestroyInstance(instance->instance, NULL);
 }
 
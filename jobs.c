@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <SDL.h>
+
+#include "jobs.h"
+#include "panic.h"
+
+/* code */
+
+static void runBatch(Jobs *jobs, JobMethod method, void *data, uint32_t count) {
+	/* Claims indices from the current batch until there are none left. Callers
+	copy method, data and count under the mutex, and a worker only gets here
+	while its batch is unfinished, so RunJobs can't move on to the next batch
+	until it leaves */
+	while (true) {
+		uint32_t index = (uint32_t) SDL_AtomicAdd(&jobs->batch.next, 1);
+
+		if (index >= count) break;
+
+		method(data, index);
+
+		if ((uint32_t) SDL_AtomicAdd(&jobs->batch.finished, 1) + 1 < count) continue;
+
+		SDL_LockMutex(jobs->mutex);
+		SDL_CondSignal(jobs->done);
+		SDL_UnlockMutex(jobs->mutex);
+	}
+}
+
+static int jobsWorker(void *data) {
+	/* Sleeps until a new batch generation is published, then helps run it */
+	Jobs *jobs = data;
+	uint32_t seen = 0;
+
+	SDL_LockMutex(jobs->mutex);
+	while (true) {
+		while (!jobs->quit && jobs->batch.generation == seen)
+			SDL_CondWait(jobs->start, jobs->mutex);
+
+		if (jobs->quit) break;
+
+		seen = jobs->batch.generation;
+
+		/* A worker that wakes late may find its batch already finished and
+		RunJobs returned, its data could be gone and the next batch may be
+		published at any moment, so it waits for that one instead */
+		JobMethod method = jobs->batch.method;
+		void *batch_data = jobs->batch.data;
+		uint32_t count = jobs->batch.count;
+
+		if ((uint32_t) SDL_AtomicGet(&jobs->batch.finished) >= count) continue;
+
+		jobs->batch.active += 1;
+		SDL_UnlockMutex(jobs->mutex);
+
+		runBatch(jobs, method, batch_data, count);
+
+		SDL_LockMutex(jobs->mutex);
+		if (--jobs->batch.active == 0) SDL_CondSignal(jobs->done);
+	}
+	SDL_UnlockMutex(jobs->mutex);
+
+	return 0;
+}
+
+Jobs *CreateJobs(uint32_t workers) {
+	/* Allocates a Jobs pool, if workers is 0 there is one worker per extra CPU.
+	The thread calling RunJobs always takes part so the pool may be empty */
+	if (!workers) workers = (SDL_GetCPUCount() > 1) ? SDL_GetCPUCount() - 1 : 0;
+
+	Jobs *jobs = calloc(1, sizeof(Jobs));
+	if (!jobs) Panic("CreateJobs: unable to allocate Jobs\n");
+
+	jobs->threads = calloc(workers ? workers : 1, sizeof(SDL_Thread *));
+	if (!jobs->threads) Panic("CreateJobs: unable to allocate SDL_Thread array\n");
+
+	jobs->mutex = SDL_CreateMutex();
+	jobs->start = SDL_CreateCond();
+	jobs->done = SDL_CreateCond();
+
+	if (!jobs->mutex || !jobs->start || !jobs->done)
+		Panic("CreateJobs: unable to create synchronisation primitives: %s\n", SDL_GetError());
+
+	uint32_t i;
+	for (i = 0; i < workers; i++) {
+		jobs->threads[i] = SDL_CreateThread(jobsWorker, "soda/jobs", jobs);
+		if (!jobs->threads[i]) Panic("CreateJobs: unable to create thread: %s\n", SDL_GetError());
+	}
+
+	jobs->count = workers;
+
+	return jobs;
+}
+
+void DestroyJobs(Jobs *jobs) {
+	/* Stops the workers and deallocates the Jobs pool */
+	if (!jobs) return;
+
+	SDL_LockMutex(jobs->mutex);
+	jobs->quit = true;
+	SDL_CondBroadcast(jobs->start);
+	SDL_UnlockMutex(jobs->mutex);
+
+	uint32_t i;
+	for (i = 0; i < jobs->count; i++)
+		SDL_WaitThread(jobs->threads[i], NULL);
+
+	SDL_DestroyCond(jobs->done);
+	SDL_DestroyCond(jobs->start);
+	SDL_DestroyMutex(jobs->mutex);
+
+	free(jobs->threads);
+	free(jobs);
+}
+
+void RunJobs(Jobs *jobs, JobMethod method, void *data, uint32_t count) {
+	/* Calls method for every index in [0, count) across the pool and returns
+	once they have all finished. A NULL pool runs the batch inline */
+	if (!count) return;
+
+	if (!jobs || !jobs->count || count == 1) {
+		uint32_t i;
+		for (i = 0; i < count; i++) method(data, i);
+
+		return;
+	}
+
+	SDL_LockMutex(jobs->mutex);
+	jobs->batch.method = method;
+	jobs->batch.data = data;
+	jobs->batch.count = count;
+	SDL_AtomicSet(&jobs->batch.finished, 0);
+	SDL_AtomicSet(&jobs->batch.next, 0);
+	jobs->batch.generation += 1;
+	SDL_CondBroadcast(jobs->start);
+	SDL_UnlockMutex(jobs->mutex);
+
+	runBatch(jobs, method, data, count);
+
+	/* A worker still claiming from this batch would claim from the next one's
+	counter against this one's count, so the batch is over once they've left */
+	SDL_LockMutex(jobs->mutex);
+	while ((uint32_t) SDL_AtomicGet(&jobs->batch.finished) < count || jobs->batch.active)
+		SDL_CondWait(jobs->done, jobs->mutex);
+	SDL_UnlockMutex(jobs->mutex);
+}
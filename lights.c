@@ -0,0 +1,343 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "frames.h"
+#include "lights.h"
+#include "panic.h"
+#include "renderer.h"
+#include "shaders.h"
+
+/* constants */
+
+#define LIGHT_BINDINGS 3
+
+/* code */
+
+static void createPipeline(Lights *lights) {
+	/* Creates the binning kernel's pipeline, it shares the set layout with the
+	shading pipelines */
+	const DeviceDispatch *vk = lights->device.dispatch.device;
+
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &lights->set_layout,
+	};
+
+	if (vk->CreatePipelineLayout(lights->device.device, &layout_info, NULL, &lights->layout) != VK_SUCCESS)
+		Panic("createPipeline: unable to create VkPipelineLayout\n");
+
+	ShaderCache *cache = lights->device.shaders.cache;
+	Archive *archive = lights->device.shaders.archive;
+
+	if (!archive) Panic("createPipeline: lights need the shader archive\n");
+
+	ShaderModule *module = AcquireArchiveShader(cache, archive, "light_bin.comp.spv");
+	ShaderVariant variant = CreateShaderVariant(module, VK_SHADER_STAGE_COMPUTE_BIT, NULL, 0);
+
+	VkComputePipelineCreateInfo pipeline_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = GetShaderStage(&variant),
+		.layout = lights->layout,
+	};
+
+	if (vk->CreateComputePipelines(lights->device.device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &lights->pipeline) != VK_SUCCESS)
+		Panic("createPipeline: unable to create the light binning VkPipeline\n");
+
+	ReleaseShaderModule(cache, module);
+}
+
+static void createSet(Lights *lights) {
+	/* Creates the descriptor set of the lights and clusters */
+	const DeviceDispatch *vk = lights->device.dispatch.device;
+
+	VkDescriptorPoolSize pool_size = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = LIGHT_BINDINGS,
+	};
+
+	VkDescriptorPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &pool_size,
+	};
+
+	if (vk->CreateDescriptorPool(lights->device.device, &pool_info, NULL, &lights->descriptors) != VK_SUCCESS)
+		Panic("createSet: unable to create VkDescriptorPool\n");
+
+	VkDescriptorSetAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = lights->descriptors,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &lights->set_layout,
+	};
+
+	if (vk->AllocateDescriptorSets(lights->device.device, &allocate_info, &lights->set) != VK_SUCCESS)
+		Panic("createSet: unable to allocate VkDescriptorSet\n");
+
+	VkDescriptorBufferInfo buffer_infos[LIGHT_BINDINGS] = {
+		{.buffer = lights->lights.buffer, .range = VK_WHOLE_SIZE},
+		{.buffer = lights->counts.buffer, .range = VK_WHOLE_SIZE},
+		{.buffer = lights->indices.buffer, .range = VK_WHOLE_SIZE},
+	};
+
+	VkWriteDescriptorSet writes[LIGHT_BINDINGS];
+
+	uint32_t i;
+	for (i = 0; i < LIGHT_BINDINGS; i++) {
+		writes[i] = (VkWriteDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = lights->set,
+			.dstBinding = i,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &buffer_infos[i],
+		};
+	}
+
+	vk->UpdateDescriptorSets(lights->device.device, LIGHT_BINDINGS, writes, 0, NULL);
+}
+
+Lights CreateLights(RendererDevice device, uint32_t capacity) {
+	/* Creates Lights that bin up to capacity visible lights a frame */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	Lights lights = {
+		.device = device,
+		.capacity = capacity,
+	};
+
+	VkDescriptorSetLayoutBinding bindings[LIGHT_BINDINGS];
+
+	uint32_t i;
+	for (i = 0; i < LIGHT_BINDINGS; i++) {
+		bindings[i] = (VkDescriptorSetLayoutBinding) {
+			.binding = i,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		};
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = LIGHT_BINDINGS,
+		.pBindings = bindings,
+	};
+
+	if (vk->CreateDescriptorSetLayout(device.device, &set_info, NULL, &lights.set_layout) != VK_SUCCESS)
+		Panic("CreateLights: unable to create VkDescriptorSetLayout\n");
+
+	createPipeline(&lights);
+
+	/* Every fragment of a cluster reads its lights, so they're copied to the
+	device rather than read from host memory */
+	VkDeviceSize size = sizeof(LightHeader) + (VkDeviceSize) capacity * sizeof(Light);
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++)
+		lights.staging[i] = CreateBuffer(&device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties);
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	lights.lights = CreateBuffer(&device, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	lights.counts = CreateBuffer(&device, CLUSTERS * sizeof(uint32_t), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	size = (VkDeviceSize) CLUSTERS * MAX_CLUSTER_LIGHTS * sizeof(uint32_t);
+	lights.indices = CreateBuffer(&device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	createSet(&lights);
+
+	/* Nothing is binned until the first BeginLights */
+	lights.header = lights.staging[0].mapped;
+	lights.mapped = (Light *) (lights.header + 1);
+	*lights.header = (LightHeader) {};
+
+	return lights;
+}
+
+void DestroyLights(Lights *lights) {
+	/* Destroys the lights, no frame that used them may be in flight */
+	const DeviceDispatch *vk = lights->device.dispatch.device;
+	VkDevice device = lights->device.device;
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++)
+		DestroyBuffer(&lights->device, &lights->staging[i]);
+
+	DestroyBuffer(&lights->device, &lights->indices);
+	DestroyBuffer(&lights->device, &lights->counts);
+	DestroyBuffer(&lights->device, &lights->lights);
+
+	vk->DestroyPipeline(device, lights->pipeline, NULL);
+	vk->DestroyPipelineLayout(device, lights->layout, NULL);
+	vk->DestroyDescriptorPool(device, lights->descriptors, NULL);
+	vk->DestroyDescriptorSetLayout(device, lights->set_layout, NULL);
+
+	*lights = (Lights) {};
+}
+
+void BeginLights(Lights *lights, uint64_t frame, const LightCamera *camera) {
+	/* Starts the lights of frame, seen from camera, in its own staging, which
+	the GPU has finished reading once the frame's fence was waited on */
+	lights->slice = frame % FRAMES_IN_FLIGHT;
+	lights->header = lights->staging[lights->slice].mapped;
+	lights->mapped = (Light *) (lights->header + 1);
+	lights->count = 0;
+	lights->camera.data = *camera;
+
+	float scale_y = tanf(camera->fov / 2.0f);
+	float scale_x = scale_y * camera->extent.width / camera->extent.height;
+	float slice_scale = CLUSTER_Z / logf(camera->far / camera->near);
+
+	/* Written whole, as the mapping is write combined. The count follows in
+	RecordLightBinning */
+	*lights->header = (LightHeader) {
+		.scale = {scale_x, scale_y},
+		.near = camera->near,
+		.far = camera->far,
+		.extent = {(float) camera->extent.width, (float) camera->extent.height},
+		.slice_scale = slice_scale,
+		.slice_bias = -logf(camera->near) * slice_scale,
+	};
+
+	/* The sides pass through the eye, where x or y is depth * scale. Each is
+	the unit normal's x or y and z */
+	float x_length = sqrtf(1.0f + scale_x * scale_x), y_length = sqrtf(1.0f + scale_y * scale_y);
+
+	lights->camera.planes[0][0] = 1.0f / x_length;
+	lights->camera.planes[0][1] = scale_x / x_length;
+	lights->camera.planes[1][0] = -1.0f / x_length;
+	lights->camera.planes[1][1] = scale_x / x_length;
+	lights->camera.planes[2][0] = 1.0f / y_length;
+	lights->camera.planes[2][1] = scale_y / y_length;
+	lights->camera.planes[3][0] = -1.0f / y_length;
+	lights->camera.planes[3][1] = scale_y / y_length;
+}
+
+static void toView(const float view[16], const float world[3], float w, float out[3]) {
+	/* Transforms a point, w 1, or a direction, w 0, into view space */
+	uint32_t i;
+	for (i = 0; i < 3; i++)
+		out[i] = view[i] * world[0] + view[4 + i] * world[1] + view[8 + i] * world[2] + view[12 + i] * w;
+}
+
+static bool isVisible(Lights *lights, const float position[3], float range) {
+	/* Returns false if a light's sphere is outside of the camera's frustum */
+	float depth = -position[2];
+
+	if (depth + range < lights->camera.data.near) return false;
+	if (depth - range > lights->camera.data.far) return false;
+
+	uint32_t i;
+	for (i = 0; i < 4; i++) {
+		const float *plane = lights->camera.planes[i];
+		if (plane[0] * position[i / 2] + plane[1] * position[2] > range) return false;
+	}
+
+	return true;
+}
+
+static void addLight(Lights *lights, const Light *light) {
+	/* Writes a view space light unless it's outside of the frustum */
+	if (!isVisible(lights, light->position, light->range)) return;
+
+	if (lights->count == lights->capacity)
+		Panic("addLight: more than %u visible lights in a frame\n", lights->capacity);
+
+	lights->mapped[lights->count++] = *light;
+}
+
+void AddPointLight(Lights *lights, const float position[3], float range, const float colour[3]) {
+	/* Adds a light at a world position. Its colour is its intensity, range is
+	where it falls off to nothing */
+	Light light = {
+		.range = range,
+		.colour = {colour[0], colour[1], colour[2]},
+		.cosine = -1.0f,
+	};
+
+	toView(lights->camera.data.view, position, 1.0f, light.position);
+	addLight(lights, &light);
+}
+
+void AddSpotLight(Lights *lights, const float position[3], const float direction[3], float range, float angle, const float colour[3]) {
+	/* Adds a light at a world position shining along direction, in a cone
+	angle radians from it. The cone must be narrower than a hemisphere */
+	if (angle <= 0.0f || angle >= (float) M_PI / 2.0f)
+		Panic("AddSpotLight: a cone of %f radians isn't under pi / 2\n", angle);
+
+	Light light = {
+		.range = range,
+		.colour = {colour[0], colour[1], colour[2]},
+		.cosine = cosf(angle),
+		.sine = sinf(angle),
+	};
+
+	toView(lights->camera.data.view, position, 1.0f, light.position);
+	toView(lights->camera.data.view, direction, 0.0f, light.direction);
+
+	float length = sqrtf(light.direction[0] * light.direction[0] + light.direction[1] * light.direction[1] + light.direction[2] * light.direction[2]);
+	if (length == 0.0f) Panic("AddSpotLight: the direction has no length\n");
+
+	uint32_t i;
+	for (i = 0; i < 3; i++) light.direction[i] /= length;
+
+	addLight(lights, &light);
+}
+
+static void recordBarrier(const DeviceDispatch *vk, VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = src_access,
+		.dstAccessMask = dst_access,
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void RecordLightBinning(Lights *lights, VkCommandBuffer command_buffer) {
+	/* Records the binning of the frame's lights, outside of a pass and before
+	the passes that shade them */
+	const DeviceDispatch *vk = lights->device.dispatch.device;
+
+	lights->header->count = lights->count;
+
+	/* The previous frame's fragments may still be reading the lights and
+	clusters */
+	VkPipelineStageFlags fragment = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	VkPipelineStageFlags compute = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	VkPipelineStageFlags transfer = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	recordBarrier(vk, command_buffer, fragment, 0, transfer | compute, 0);
+
+	VkBufferCopy region = {
+		.size = sizeof(LightHeader) + (VkDeviceSize) lights->count * sizeof(Light),
+	};
+
+	vk->CmdCopyBuffer(command_buffer, lights->staging[lights->slice].buffer, lights->lights.buffer, 1, &region);
+	vk->CmdFillBuffer(command_buffer, lights->counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	recordBarrier(vk, command_buffer, transfer, VK_ACCESS_TRANSFER_WRITE_BIT, compute | fragment, access);
+
+	if (lights->count) {
+		vk->CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, lights->pipeline);
+		vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, lights->layout, 0, 1, &lights->set, 0, NULL);
+		vk->CmdDispatch(command_buffer, (lights->count + LIGHT_BIN_WORKGROUP - 1) / LIGHT_BIN_WORKGROUP, 1, 1);
+	}
+
+	recordBarrier(vk, command_buffer, compute, VK_ACCESS_SHADER_WRITE_BIT, fragment, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void BindLights(Lights *lights, VkCommandBuffer command_buffer, VkPipelineLayout layout, uint32_t set) {
+	/* Binds the frame's lights and clusters at set of a graphics pipeline
+	layout made with lights->set_layout */
+	const DeviceDispatch *vk = lights->device.dispatch.device;
+
+	vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &lights->set, 0, NULL);
+}
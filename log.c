@@ -0,0 +1,296 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "log.h"
+#include "panic.h"
+
+/* namespaces */
+
+static struct debug_log {
+	/* debug_log is a namespace for the messenger's ring and drain thread. Any
+	thread the driver calls back on may produce, only the drain thread consumes */
+	SDL_Thread *thread;
+	SDL_atomic_t running, quit, dropped;
+	bool exit_registered;
+
+	/* producers counts the callbacks between checking running and publishing
+	their message, StopDebugLog waits for them before the final drain */
+	SDL_atomic_t producers;
+
+	/* tail is claimed by the producers, head is only used by the drain thread */
+	SDL_atomic_t tail;
+	uint32_t head;
+
+	DebugLogEntry entries[DEBUG_LOG_SIZE];
+	DebugLogRepeat repeats[DEBUG_LOG_IDS];
+} debug_log;
+
+/* constants */
+
+static const struct {
+	/* Names for SODA_LOG_SEVERITY, from least to most severe */
+	const char *name;
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+} SEVERITIES[] = {
+	{"verbose", VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT},
+	{"info", VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT},
+	{"warning", VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT},
+	{"error", VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT},
+};
+
+static const struct {
+	/* Names for SODA_LOG_TYPES */
+	const char *name;
+	VkDebugUtilsMessageTypeFlagBitsEXT type;
+} TYPES[] = {
+	{"general", VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT},
+	{"validation", VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT},
+	{"performance", VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT},
+};
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+
+/* code */
+
+DebugLogFilter GetDebugLogFilter() {
+	/* Returns the filter set by the environment. SODA_LOG_SEVERITY is the least
+	severity to report (verbose, info, warning or error) and SODA_LOG_TYPES is a
+	comma separated list of types. Warnings and errors of every type are
+	reported by default */
+	DebugLogFilter filter = {
+		.severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+	};
+
+	uint32_t i;
+	const char *severity = getenv("SODA_LOG_SEVERITY");
+	if (severity) {
+		filter.severities = 0;
+
+		bool found = false;
+		for (i = 0; i < ARRAY_SIZE(SEVERITIES); i++) {
+			found = found || strcmp(severity, SEVERITIES[i].name) == 0;
+			if (found) filter.severities |= SEVERITIES[i].severity;
+		}
+
+		if (!found) Panic("GetDebugLogFilter: unknown SODA_LOG_SEVERITY '%s'\n", severity);
+	}
+
+	const char *types = getenv("SODA_LOG_TYPES");
+	for (i = 0; i < ARRAY_SIZE(TYPES); i++) {
+		if (!types || strstr(types, TYPES[i].name)) filter.types |= TYPES[i].type;
+	}
+
+	if (!filter.types) Panic("GetDebugLogFilter: no known types in SODA_LOG_TYPES '%s'\n", types);
+
+	return filter;
+}
+
+void ApplyDebugLogFilter(VkDebugUtilsMessengerCreateInfoEXT *create_info, DebugLogFilter filter) {
+	/* Subscribes create_info to the messages that pass filter */
+	create_info->messageSeverity = filter.severities;
+	create_info->messageType = filter.types;
+}
+
+static const char *severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+	/* Returns the SODA_LOG_SEVERITY name of severity */
+	uint32_t i;
+	for (i = 0; i < ARRAY_SIZE(SEVERITIES); i++)
+		if (SEVERITIES[i].severity == severity) return SEVERITIES[i].name;
+
+	return "unknown";
+}
+
+static void printMessage(VkDebugUtilsMessageSeverityFlagBitsEXT severity, int32_t id, const char *message) {
+	/* Writes a message to stderr */
+	fprintf(stderr, "vulkan %s 0x%08x: %s\n", severityName(severity), (uint32_t) id, message);
+}
+
+static bool isRepeat(int32_t id) {
+	/* Returns true if id has been seen before, in which case its count is
+	incremented. Slots are claimed with a compare and swap and never freed */
+	if (!id) return false;
+
+	uint32_t slot = ((uint32_t) id * 2654435761u) & (DEBUG_LOG_IDS - 1);
+
+	uint32_t i;
+	for (i = 0; i < DEBUG_LOG_IDS; i++) {
+		DebugLogRepeat *repeat = &debug_log.repeats[(slot + i) & (DEBUG_LOG_IDS - 1)];
+		int current = SDL_AtomicGet(&repeat->id);
+
+		if (current == id) {
+			SDL_AtomicAdd(&repeat->count, 1);
+			return true;
+		}
+
+		if (current) continue;
+
+		if (SDL_AtomicCAS(&repeat->id, 0, id)) return false;
+
+		/* Another thread claimed the slot, it may have been for the same id */
+		if (SDL_AtomicGet(&repeat->id) == id) {
+			SDL_AtomicAdd(&repeat->count, 1);
+			return true;
+		}
+	}
+
+	/* The table is full, so the message is logged every time */
+	return false;
+}
+
+static bool pushMessage(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, int32_t id, const char *message) {
+	/* Copies the message into the ring, returns false if it is full. This is
+	a bounded multiple producer queue where each slot's sequence is the ticket
+	of the producer that may write it next */
+	uint32_t position = (uint32_t) SDL_AtomicGet(&debug_log.tail);
+	DebugLogEntry *entry;
+
+	while (true) {
+		entry = &debug_log.entries[position & (DEBUG_LOG_SIZE - 1)];
+		int difference = (int) ((uint32_t) SDL_AtomicGet(&entry->sequence) - position);
+
+		if (difference < 0) return false;
+
+		if (difference == 0 && SDL_AtomicCAS(&debug_log.tail, (int) position, (int) (position + 1))) break;
+
+		position = (uint32_t) SDL_AtomicGet(&debug_log.tail);
+	}
+
+	entry->severity = severity;
+	entry->type = type;
+	entry->id = id;
+
+	strncpy(entry->message, message, DEBUG_LOG_MESSAGE_SIZE - 1);
+	entry->message[DEBUG_LOG_MESSAGE_SIZE - 1] = '\0';
+
+	SDL_AtomicSet(&entry->sequence, (int) (position + 1));
+
+	return true;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL DebugLogMessenger(
+	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageType,
+	const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+	void *pUserData
+) {
+	/* Queues the message for the drain thread without blocking the calling
+	thread. Before StartDebugLog and after StopDebugLog it prints directly */
+	int32_t id = pCallbackData->messageIdNumber;
+	const char *message = (pCallbackData->pMessage) ? pCallbackData->pMessage : "";
+
+	SDL_AtomicAdd(&debug_log.producers, 1);
+
+	if (!SDL_AtomicGet(&debug_log.running)) {
+		SDL_AtomicAdd(&debug_log.producers, -1);
+		printMessage(messageSeverity, id, message);
+		return VK_FALSE;
+	}
+
+	if (!isRepeat(id) && !pushMessage(messageSeverity, messageType, id, message))
+		SDL_AtomicAdd(&debug_log.dropped, 1);
+
+	SDL_AtomicAdd(&debug_log.producers, -1);
+
+	return VK_FALSE;
+}
+
+static void drainMessages() {
+	/* Prints the messages that are ready, in the order they were claimed */
+	while (true) {
+		DebugLogEntry *entry = &debug_log.entries[debug_log.head & (DEBUG_LOG_SIZE - 1)];
+		int difference = (int) ((uint32_t) SDL_AtomicGet(&entry->sequence) - (debug_log.head + 1));
+
+		if (difference < 0) break;
+
+		printMessage(entry->severity, entry->id, entry->message);
+
+		SDL_AtomicSet(&entry->sequence, (int) (debug_log.head + DEBUG_LOG_SIZE));
+		debug_log.head += 1;
+	}
+}
+
+static void reportRepeats() {
+	/* Prints how often each message was repeated since the last report */
+	uint32_t i;
+	for (i = 0; i < DEBUG_LOG_IDS; i++) {
+		DebugLogRepeat *repeat = &debug_log.repeats[i];
+
+		int id = SDL_AtomicGet(&repeat->id);
+		if (!id) continue;
+
+		int count = SDL_AtomicGet(&repeat->count);
+		if (count == repeat->reported) continue;
+
+		fprintf(stderr, "vulkan 0x%08x: repeated %d more times\n", (uint32_t) id, count - repeat->reported);
+		repeat->reported = count;
+	}
+
+	int dropped = SDL_AtomicSet(&debug_log.dropped, 0);
+	if (dropped) fprintf(stderr, "vulkan: dropped %d messages, the log is full\n", dropped);
+}
+
+static int drainThread(void *data) {
+	/* Drains the ring every DEBUG_LOG_DRAIN_MS and reports repeats every
+	DEBUG_LOG_REPEAT_MS until StopDebugLog */
+	Uint32 reported = SDL_GetTicks();
+
+	while (!SDL_AtomicGet(&debug_log.quit)) {
+		drainMessages();
+
+		if (SDL_GetTicks() - reported >= DEBUG_LOG_REPEAT_MS) {
+			reportRepeats();
+			reported = SDL_GetTicks();
+		}
+
+		SDL_Delay(DEBUG_LOG_DRAIN_MS);
+	}
+
+	drainMessages();
+	reportRepeats();
+
+	return 0;
+}
+
+void StartDebugLog() {
+	/* Starts the drain thread, messages are queued from now on. The log is
+	stopped at exit so queued messages are flushed */
+	if (SDL_AtomicGet(&debug_log.running)) return;
+
+	uint32_t i;
+	for (i = 0; i < DEBUG_LOG_SIZE; i++) SDL_AtomicSet(&debug_log.entries[i].sequence, (int) i);
+
+	SDL_AtomicSet(&debug_log.tail, 0);
+	SDL_AtomicSet(&debug_log.quit, 0);
+	debug_log.head = 0;
+
+	debug_log.thread = SDL_CreateThread(drainThread, "soda log", NULL);
+	if (!debug_log.thread) Panic("StartDebugLog: unable to create thread: %s\n", SDL_GetError());
+
+	SDL_AtomicSet(&debug_log.running, 1);
+
+	if (!debug_log.exit_registered) atexit(StopDebugLog);
+	debug_log.exit_registered = true;
+}
+
+void StopDebugLog() {
+	/* Flushes the queued messages and stops the drain thread. Messages are
+	printed directly afterwards */
+	if (!SDL_AtomicGet(&debug_log.running)) return;
+
+	SDL_AtomicSet(&debug_log.running, 0);
+
+	/* A producer that saw the log running may have claimed a slot it hasn't
+	published yet, the drain thread would stop short of it */
+	while (SDL_AtomicGet(&debug_log.producers)) SDL_Delay(1);
+
+	SDL_AtomicSet(&debug_log.quit, 1);
+
+	SDL_WaitThread(debug_log.thread, NULL);
+	debug_log.thread = NULL;
+}
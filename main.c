@@ -1,24 +1,86 @@
-#include "instance.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 
-void CreateRenderer();
+#include <SDL.h>
+#include <SDL_vulkan.h>
+#include <vulkan/vulkan.h>
+
+#include "events.h"
+#include "render.h"
+#include "renderer.h"
+
+static VkExtent2D drawableExtent(SDL_Window *window) {
+	/* Returns the size of window in pixels, which differs from its size in
+	screen coordinates on high DPI displays */
+	int width = 0, height = 0;
+	SDL_Vulkan_GetDrawableSize(window, &width, &height);
+
+	return (VkExtent2D) {width, height};
+}
+
+static bool mustDeliver(SDL_Event *event) {
+	/* Mouse motion is superseded by the next motion event so it can be dropped
+	when the render thread falls behind, anything else is retried */
+	return event->type != SDL_MOUSEMOTION;
+}
+
+static uint32_t countWindows() {
+	/* Returns the number of windows to open, SODA_WINDOWS opens one per display
+	of a multi display setup */
+	const char *windows = getenv("SODA_WINDOWS");
+	if (!windows) return 1;
+
+	uint32_t count = (uint32_t) strtoul(windows, NULL, 10);
+
+	return (count) ? count : 1;
+}
 
 int main(int argc, char *argv[]) {
-  CreateRenderer();
-
-//    Instance instance = CreateSDLInstance();
-//    while (1) {
-//        SDL_Event e;
-
-//    	while (SDL_PollEvent(&e)) {
-//		    switch(e.type) {
-//        		case SDL_QUIT:
-//				return 0;
-//				break;
-//		    }
-//	    }
-//    }
-
-//  DestroySDLInstance(&instance);
+	CreateMultiWindowRenderer(countWindows());
+
+	RendererDevice device = GetRendererDevice();
+
+	RenderWindow windows[MAX_RENDERER_WINDOWS];
+
+	uint32_t i;
+	for (i = 0; i < device.surface_count; i++) {
+		SDL_Window *window = GetRendererWindow(i);
+
+		windows[i] = (RenderWindow) {
+			.id = SDL_GetWindowID(window),
+			.surface = device.surfaces[i],
+			.extent = drawableExtent(window),
+		};
+	}
+
+	/* Events are pumped here on the main thread and rendering happens on its
+	own thread, so a stalled event loop doesn't stop frames. There's no scene
+	yet, so the windows are only cleared */
+	EventQueue *events = CreateEventQueue();
+	RenderThread *render = StartRenderThread(events, windows, device.surface_count, NULL, NULL);
+
+	bool running = true;
+	while (running) {
+		SDL_Event event;
+		if (!SDL_WaitEvent(&event)) continue;
+
+		if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+			VkExtent2D extent = drawableExtent(SDL_GetWindowFromID(event.window.windowID));
+
+			event.window.data1 = extent.width;
+			event.window.data2 = extent.height;
+		}
+
+		if (event.type == SDL_QUIT) running = false;
+
+		while (!PushEvent(events, &event) && mustDeliver(&event))
+			SDL_Delay(1);
+	}
+
+	StopRenderThread(render);
+	DestroyEventQueue(events);
+	DestroyRenderer();
 
 	return 0;
 }
@@ -0,0 +1,127 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "pacing.h"
+#include "panic.h"
+#include "renderer.h"
+
+/* constants */
+
+/* Weight of a new sample in the moving averages */
+static const double PACING_SMOOTHING = 0.1;
+
+/* Completions further apart than this many intervals aren't sampled */
+static const double PACING_MAX_GAP = 4.0;
+
+/* code */
+
+Pacer CreatePacer(RendererDevice *device, uint32_t queued) {
+	/* Returns a Pacer that lets queued frames wait for the display, 1 gives the
+	lowest latency */
+	Pacer pacer = {
+		.vk = device->dispatch.device,
+		.wait_for_present = device->supports.present_wait,
+		.queued = (queued) ? queued : 1,
+	};
+
+	return pacer;
+}
+
+void StartPacedFrame(Pacer *pacer, uint64_t frame) {
+	/* Records that the CPU has started frame */
+	pacer->frames[frame & (PACING_HISTORY - 1)] = (PacedFrame) {
+		.frame = frame,
+		.start = SDL_GetPerformanceCounter(),
+	};
+}
+
+uint64_t SubmitPacedFrame(Pacer *pacer, uint64_t frame, VkSwapchainKHR swapchain) {
+	/* Records that frame is being presented to swapchain and returns the
+	present id to tag it with, ids start at 1 as 0 means no id */
+	PacedFrame *paced = &pacer->frames[frame & (PACING_HISTORY - 1)];
+
+	paced->submitted = SDL_GetPerformanceCounter();
+	paced->swapchain = swapchain;
+
+	return frame + 1;
+}
+
+static bool waitForPresent(Pacer *pacer, PacedFrame *paced) {
+	/* Waits for the frame to reach the display, returns false if the present
+	can't be waited for */
+	if (!pacer->wait_for_present || !paced->swapchain) return false;
+
+	VkResult result = pacer->vk->WaitForPresentKHR(pacer->vk->device, paced->swapchain, paced->frame + 1, PRESENT_WAIT_TIMEOUT_NS);
+
+	return result == VK_SUCCESS;
+}
+
+static double smooth(double average, double sample) {
+	/* Returns the moving average with sample added */
+	return (average) ? average + (sample - average) * PACING_SMOOTHING : sample;
+}
+
+void CompletePacedFrame(Pacer *pacer, uint64_t frame, VkFence fence) {
+	/* Waits for frame to complete and updates the estimates and latency. fence
+	must be the one frame was submitted with */
+	if (frame < pacer->completed) return;
+
+	PacedFrame *paced = &pacer->frames[frame & (PACING_HISTORY - 1)];
+	if (paced->frame != frame || !paced->submitted) return;
+
+	paced->estimated = !waitForPresent(pacer, paced);
+	if (paced->estimated) pacer->vk->WaitForFences(pacer->vk->device, 1, &fence, VK_TRUE, UINT64_MAX);
+
+	paced->completed = SDL_GetPerformanceCounter();
+
+	double work = (double) (paced->completed - paced->start);
+
+	/* work follows spikes immediately so the next frame isn't started too late,
+	and only decays slowly */
+	pacer->estimate.work = (work > pacer->estimate.work) ? work : smooth(pacer->estimate.work, work);
+
+	/* Gaps far longer than usual e.g. while minimized aren't intervals */
+	double interval = (double) (paced->completed - pacer->last_completed);
+	bool gap = pacer->estimate.interval && interval > PACING_MAX_GAP * pacer->estimate.interval;
+
+	if (pacer->last_completed && !gap)
+		pacer->estimate.interval = smooth(pacer->estimate.interval, interval);
+
+	pacer->latency = (FrameLatency) {
+		.frame = frame,
+		.seconds = work / (double) SDL_GetPerformanceFrequency(),
+		.estimated = paced->estimated,
+	};
+
+	pacer->completed = frame + 1;
+	pacer->last_completed = paced->completed;
+}
+
+Uint64 GetPacedStart(Pacer *pacer) {
+	/* Returns when the next frame should start so that it completes queued
+	intervals after the last one, less the margin, or 0 if it can start now */
+	if (!pacer->last_completed || !pacer->estimate.interval) return 0;
+
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	double margin = (double) frequency * PACING_MARGIN_US / 1e6;
+	double delay = pacer->queued * pacer->estimate.interval - pacer->estimate.work - margin;
+
+	return (delay > 0) ? pacer->last_completed + (Uint64) delay : 0;
+}
+
+void SleepPacedStart(Uint64 target) {
+	/* Sleeps until target, a start returned by GetPacedStart */
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (target <= now) return;
+
+	/* SDL_Delay can oversleep by a millisecond, so the rest is spun */
+	Uint32 ms = (Uint32) ((target - now) * 1000 / frequency);
+	if (ms > 1) SDL_Delay(ms - 1);
+
+	while (SDL_GetPerformanceCounter() < target);
+}
@@ -0,0 +1,401 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "passes.h"
+#include "panic.h"
+
+/* types */
+
+typedef struct {
+	/* LayoutAccess is the stage and access that goes with an image layout */
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+} LayoutAccess;
+
+/* code */
+
+static LayoutAccess getLayoutAccess(VkImageLayout layout) {
+	/* Returns the stage and access that uses an image in layout */
+	switch (layout) {
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return (LayoutAccess) { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return (LayoutAccess) { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return (LayoutAccess) { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return (LayoutAccess) {
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+			};
+
+		default:
+			/* UNDEFINED and PRESENT_SRC only need execution ordering */
+			return (LayoutAccess) { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 };
+	}
+}
+
+static VkImageLayout getInitialLayout(RenderTarget *target) {
+	/* Returns the layout the target is in when the pass begins */
+	return (target->load == VK_ATTACHMENT_LOAD_OP_LOAD) ? target->initial_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+static void transitionTarget(Passes *passes, VkCommandBuffer command_buffer, RenderTarget *target, VkImageLayout from, VkImageLayout to) {
+	/* Records the barrier a render pass would have made for the target */
+	if (from == to) return;
+
+	LayoutAccess src = getLayoutAccess(from), dst = getLayoutAccess(to);
+
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = src.access,
+		.dstAccessMask = dst.access,
+		.oldLayout = from,
+		.newLayout = to,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = target->image,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = 1,
+			.layerCount = 1,
+		},
+	};
+
+	passes->vk->CmdPipelineBarrier(command_buffer, src.stage, dst.stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+Passes CreatePasses(const DeviceDispatch *vk, bool dynamic_rendering) {
+	/* Returns Passes for the device vk was loaded from, using dynamic rendering
+	when it's enabled */
+	Passes passes = {
+		.vk = vk,
+	};
+
+	if (!dynamic_rendering) return passes;
+
+	/* The KHR entry points are only loaded when the extension is enabled,
+	otherwise the device has dynamic rendering through Vulkan 1.3 */
+	passes.cmd.begin = vk->CmdBeginRenderingKHR;
+	passes.cmd.end = vk->CmdEndRenderingKHR;
+
+	if (!passes.cmd.begin || !passes.cmd.end) {
+		passes.cmd.begin = (PFN_vkCmdBeginRenderingKHR) vk->CmdBeginRendering;
+		passes.cmd.end = (PFN_vkCmdEndRenderingKHR) vk->CmdEndRendering;
+	}
+
+	passes.dynamic = passes.cmd.begin && passes.cmd.end;
+
+	return passes;
+}
+
+void DestroyPasses(Passes *passes) {
+	/* Destroys the cached legacy objects and unsets passes */
+	uint32_t i;
+	for (i = 0; i < passes->legacy.framebuffers.count; i++)
+		passes->vk->DestroyFramebuffer(passes->vk->device, passes->legacy.framebuffers.data[i].framebuffer, NULL);
+
+	for (i = 0; i < passes->legacy.render_passes.count; i++)
+		passes->vk->DestroyRenderPass(passes->vk->device, passes->legacy.render_passes.data[i].render_pass, NULL);
+
+	free(passes->legacy.framebuffers.data);
+	free(passes->legacy.render_passes.data);
+
+	*passes = (Passes) {};
+}
+
+static void *growCache(void *data, uint32_t *capacity, size_t size) {
+	/* Doubles the capacity of a legacy cache array */
+	uint32_t grown = (*capacity) ? *capacity * 2 : 4;
+
+	void *resized = realloc(data, grown * size);
+	if (!resized) Panic("passes/growCache: unable to allocate %u cache entries\n", grown);
+
+	*capacity = grown;
+
+	return resized;
+}
+
+static VkRenderPass createLegacyRenderPass(Passes *passes, RenderTarget *target) {
+	/* Creates a single subpass VkRenderPass for the RenderTarget */
+	VkAttachmentDescription attachment = {
+		.format = target->format,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.loadOp = target->load,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout = getInitialLayout(target),
+		.finalLayout = target->final_layout,
+	};
+
+	VkAttachmentReference reference = {
+		.attachment = 0,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	};
+
+	VkSubpassDescription subpass = {
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &reference,
+	};
+
+	/* The implicit dependency out of the pass makes no writes visible, so
+	whatever uses the final layout next e.g. a blit waits explicitly */
+	LayoutAccess next = getLayoutAccess(target->final_layout);
+
+	VkSubpassDependency dependencies[] = {
+		{
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		},
+		{
+			.srcSubpass = 0,
+			.dstSubpass = VK_SUBPASS_EXTERNAL,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = next.stage,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = next.access,
+		},
+	};
+
+	VkRenderPassCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &attachment,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = 2,
+		.pDependencies = dependencies,
+	};
+
+	VkRenderPass render_pass;
+	if (passes->vk->CreateRenderPass(passes->vk->device, &create_info, NULL, &render_pass) != VK_SUCCESS)
+		Panic("createLegacyRenderPass: unable to create VkRenderPass\n");
+
+	return render_pass;
+}
+
+static VkRenderPass getLegacyRenderPass(Passes *passes, RenderTarget *target) {
+	/* Returns the cached VkRenderPass for target, creating it if it's missing */
+	VkImageLayout initial_layout = getInitialLayout(target);
+
+	uint32_t i;
+	for (i = 0; i < passes->legacy.render_passes.count; i++) {
+		LegacyRenderPass *cached = &passes->legacy.render_passes.data[i];
+
+		if (cached->format == target->format &&
+			cached->load == target->load &&
+			cached->initial_layout == initial_layout &&
+			cached->final_layout == target->final_layout)
+			return cached->render_pass;
+	}
+
+	if (passes->legacy.render_passes.count == passes->legacy.render_passes.capacity)
+		passes->legacy.render_passes.data = growCache(passes->legacy.render_passes.data, &passes->legacy.render_passes.capacity, sizeof(LegacyRenderPass));
+
+	LegacyRenderPass *created = &passes->legacy.render_passes.data[passes->legacy.render_passes.count++];
+	*created = (LegacyRenderPass) {
+		.format = target->format,
+		.load = target->load,
+		.initial_layout = initial_layout,
+		.final_layout = target->final_layout,
+		.render_pass = createLegacyRenderPass(passes, target),
+	};
+
+	return created->render_pass;
+}
+
+static VkFramebuffer getLegacyFramebuffer(Passes *passes, RenderTarget *target, VkRenderPass render_pass) {
+	/* Returns the cached VkFramebuffer for target, creating it if it's missing */
+	uint32_t i;
+	for (i = 0; i < passes->legacy.framebuffers.count; i++) {
+		LegacyFramebuffer *cached = &passes->legacy.framebuffers.data[i];
+
+		if (cached->view == target->view &&
+			cached->render_pass == render_pass &&
+			cached->extent.width == target->extent.width &&
+			cached->extent.height == target->extent.height)
+			return cached->framebuffer;
+	}
+
+	VkFramebufferCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = render_pass,
+		.attachmentCount = 1,
+		.pAttachments = &target->view,
+		.width = target->extent.width,
+		.height = target->extent.height,
+		.layers = 1,
+	};
+
+	VkFramebuffer framebuffer;
+	if (passes->vk->CreateFramebuffer(passes->vk->device, &create_info, NULL, &framebuffer) != VK_SUCCESS)
+		Panic("getLegacyFramebuffer: unable to create VkFramebuffer\n");
+
+	if (passes->legacy.framebuffers.count == passes->legacy.framebuffers.capacity)
+		passes->legacy.framebuffers.data = growCache(passes->legacy.framebuffers.data, &passes->legacy.framebuffers.capacity, sizeof(LegacyFramebuffer));
+
+	passes->legacy.framebuffers.data[passes->legacy.framebuffers.count++] = (LegacyFramebuffer) {
+		.view = target->view,
+		.extent = target->extent,
+		.render_pass = render_pass,
+		.framebuffer = framebuffer,
+	};
+
+	return framebuffer;
+}
+
+void ForgetPassView(Passes *passes, VkImageView view) {
+	/* Destroys the cached framebuffers that use view, call it before the view
+	is destroyed e.g. when the swapchain is recreated */
+	uint32_t i = 0;
+	while (i < passes->legacy.framebuffers.count) {
+		LegacyFramebuffer *cached = &passes->legacy.framebuffers.data[i];
+
+		if (cached->view != view) {
+			i++;
+			continue;
+		}
+
+		passes->vk->DestroyFramebuffer(passes->vk->device, cached->framebuffer, NULL);
+		*cached = passes->legacy.framebuffers.data[--passes->legacy.framebuffers.count];
+	}
+}
+
+void RetirePassView(Passes *passes, VkImageView view, DeletionQueue *queue, uint64_t value) {
+	/* Forgets the cached framebuffers that use view like ForgetPassView, but
+	they're destroyed once the queue reaches value as frames in flight may
+	still use them */
+	uint32_t i = 0;
+	while (i < passes->legacy.framebuffers.count) {
+		LegacyFramebuffer *cached = &passes->legacy.framebuffers.data[i];
+
+		if (cached->view != view) {
+			i++;
+			continue;
+		}
+
+		DeleteLater(queue, DELETE_FRAMEBUFFER, (uint64_t) cached->framebuffer, value);
+		*cached = passes->legacy.framebuffers.data[--passes->legacy.framebuffers.count];
+	}
+}
+
+void BeginPass(Passes *passes, VkCommandBuffer command_buffer, RenderTarget *target) {
+	/* Begins a pass that draws into target */
+	VkRect2D area = {
+		.extent = target->extent,
+	};
+
+	VkClearValue clear = {
+		.color = target->clear,
+	};
+
+	if (passes->dynamic) {
+		transitionTarget(passes, command_buffer, target, getInitialLayout(target), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+		VkRenderingAttachmentInfoKHR attachment = {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+			.imageView = target->view,
+			.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.loadOp = target->load,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = clear,
+		};
+
+		VkRenderingInfoKHR rendering_info = {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+			.renderArea = area,
+			.layerCount = 1,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &attachment,
+		};
+
+		passes->cmd.begin(command_buffer, &rendering_info);
+
+		return;
+	}
+
+	VkRenderPass render_pass = getLegacyRenderPass(passes, target);
+
+	VkRenderPassBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = render_pass,
+		.framebuffer = getLegacyFramebuffer(passes, target, render_pass),
+		.renderArea = area,
+		.clearValueCount = 1,
+		.pClearValues = &clear,
+	};
+
+	passes->vk->CmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void EndPass(Passes *passes, VkCommandBuffer command_buffer, RenderTarget *target) {
+	/* Ends the pass and leaves target in its final_layout */
+	if (!passes->dynamic) {
+		passes->vk->CmdEndRenderPass(command_buffer);
+		return;
+	}
+
+	passes->cmd.end(command_buffer);
+	transitionTarget(passes, command_buffer, target, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, target->final_layout);
+}
+
+void SetPipelinePass(Passes *passes, VkGraphicsPipelineCreateInfo *create_info, VkPipelineRenderingCreateInfoKHR *rendering_info, RenderTarget *target) {
+	/* Makes create_info compatible with passes that draw into target. The
+	dynamic path chains rendering_info, which must outlive the pipeline's
+	creation */
+	if (!passes->dynamic) {
+		create_info->renderPass = getLegacyRenderPass(passes, target);
+		create_info->subpass = 0;
+		return;
+	}
+
+	*rendering_info = (VkPipelineRenderingCreateInfoKHR) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+		.pNext = create_info->pNext,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &target->format,
+	};
+
+	create_info->pNext = rendering_info;
+	create_info->renderPass = VK_NULL_HANDLE;
+}
+
+PipelinePass GetPipelinePass(Passes *passes, RenderTarget *target) {
+	/* Returns the PipelinePass for target, so pipelines can be created later
+	or on another thread without touching passes */
+	return (PipelinePass) {
+		.render_pass = (passes->dynamic) ? VK_NULL_HANDLE : getLegacyRenderPass(passes, target),
+		.format = target->format,
+	};
+}
+
+void ApplyPipelinePass(const PipelinePass *pass, VkGraphicsPipelineCreateInfo *create_info, VkPipelineRenderingCreateInfoKHR *rendering_info) {
+	/* Makes create_info compatible with pass like SetPipelinePass. pass and
+	rendering_info must outlive the pipeline's creation */
+	if (pass->render_pass) {
+		create_info->renderPass = pass->render_pass;
+		create_info->subpass = 0;
+		return;
+	}
+
+	*rendering_info = (VkPipelineRenderingCreateInfoKHR) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+		.pNext = create_info->pNext,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &pass->format,
+	};
+
+	create_info->pNext = rendering_info;
+	create_info->renderPass = VK_NULL_HANDLE;
+}
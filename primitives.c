@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "buffers.h"
+#include "compute.h"
+#include "deletion.h"
+#include "panic.h"
+#include "primitives.h"
+#include "renderer.h"
+#include "shaders.h"
+
+/* constants */
+
+#define RADIX (1 << RADIX_BITS)
+
+/* The lowest maxComputeWorkGroupCount[0] Vulkan allows */
+#define MAX_PRIMITIVE_GROUPS 65535
+
+/* types */
+
+typedef struct {
+	/* Push constants of shaders/reduce.comp, offsets are in elements */
+	uint32_t count, src_offset, dst_offset;
+} ReduceConstants;
+
+typedef struct {
+	/* Push constants of shaders/scan.comp */
+	uint32_t count, src_offset, dst_offset, offsets_offset, add_offsets;
+} ScanConstants;
+
+typedef struct {
+	/* Push constants of shaders/radix_count.comp */
+	uint32_t count, shift, groups;
+} CountConstants;
+
+typedef struct {
+	/* Push constants of shaders/radix_scatter.comp */
+	uint32_t count, shift, groups, has_values;
+} ScatterConstants;
+
+typedef struct {
+	/* Push constants of shaders/compact.comp */
+	uint32_t count, positions_offset;
+} CompactConstants;
+
+/* code */
+
+static uint32_t getWorkgroupSize(RendererDevice *device) {
+	/* Returns the largest power of 2 workgroup up to MAX_PRIMITIVE_WORKGROUP
+	that the device allows */
+	VkPhysicalDeviceProperties properties;
+	device->dispatch.instance->GetPhysicalDeviceProperties(device->physical_device, &properties);
+
+	uint32_t limit = properties.limits.maxComputeWorkGroupInvocations;
+	if (properties.limits.maxComputeWorkGroupSize[0] < limit) limit = properties.limits.maxComputeWorkGroupSize[0];
+
+	uint32_t size = MAX_PRIMITIVE_WORKGROUP;
+	while (size > limit) size /= 2;
+
+	return size;
+}
+
+static bool supportsSubgroups(RendererDevice *device) {
+	/* Returns true if compute shaders have subgroup arithmetic */
+	VkSubgroupFeatureFlags required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+
+	if (!(device->subgroup.stages & VK_SHADER_STAGE_COMPUTE_BIT)) return false;
+	if ((device->subgroup.operations & required) != required) return false;
+
+	return device->subgroup.size >= MIN_PRIMITIVE_SUBGROUP;
+}
+
+static ComputeKernel createKernel(Primitives *primitives, const char *name, bool variant, uint32_t buffers, uint32_t push_constants) {
+	/* Creates the kernel called name from the shader archive, specialised for
+	the device's block. Kernels with a variant have a subgroup build */
+	Archive *archive = primitives->compute->device.shaders.archive;
+	if (!archive) Panic("createKernel: primitives need the shader archive\n");
+
+	char path[ARCHIVE_NAME_SIZE];
+	snprintf(path, sizeof(path), (variant && primitives->subgroups) ? "%s.subgroup.comp.spv" : "%s.comp.spv", name);
+
+	ArchiveBlob blob = FindArchiveBlob(archive, path);
+	if (!blob.data) Panic("createKernel: no SPIR-V called '%s' in the archive\n", path);
+
+	ShaderConstant constants[] = {
+		{.id = 0, .value = primitives->items},
+		{.id = 1, .value = primitives->workgroup},
+	};
+
+	return CreateComputeKernel(primitives->compute, blob.data, blob.size, constants, 2, buffers, push_constants);
+}
+
+Primitives CreatePrimitives(Compute *compute, bool portable) {
+	/* Creates the kernels for compute's device. Subgroup kernels are used when
+	the device has them, unless portable asks for the shared memory ones */
+	RendererDevice *device = &compute->device;
+
+	Primitives primitives = {
+		.compute = compute,
+		.subgroups = !portable && supportsSubgroups(device),
+		.workgroup = getWorkgroupSize(device),
+	};
+
+	/* With subgroups of 32 or more the workgroup scan is two subgroup
+	operations, so blocks are made bigger to spend the time on loads */
+	primitives.items = (primitives.subgroups && device->subgroup.size >= 32) ? 8 : 4;
+	primitives.block = primitives.workgroup * primitives.items;
+
+	primitives.reduce = createKernel(&primitives, "reduce", true, 2, sizeof(ReduceConstants));
+	primitives.scan = createKernel(&primitives, "scan", true, 3, sizeof(ScanConstants));
+	primitives.count = createKernel(&primitives, "radix_count", false, 2, sizeof(CountConstants));
+	primitives.scatter = createKernel(&primitives, "radix_scatter", true, 5, sizeof(ScatterConstants));
+	primitives.compact = createKernel(&primitives, "compact", false, 5, sizeof(CompactConstants));
+
+	return primitives;
+}
+
+void DestroyPrimitives(Primitives *primitives) {
+	/* Waits for the primitives' dispatches, then destroys their kernels and
+	buffers */
+	Compute *compute = primitives->compute;
+
+	WaitCompute(compute, primitives->last);
+
+	DestroyComputeKernel(compute, &primitives->reduce);
+	DestroyComputeKernel(compute, &primitives->scan);
+	DestroyComputeKernel(compute, &primitives->count);
+	DestroyComputeKernel(compute, &primitives->scatter);
+	DestroyComputeKernel(compute, &primitives->compact);
+
+	DestroyBuffer(&compute->device, &primitives->scratch);
+	DestroyBuffer(&compute->device, &primitives->keys);
+	DestroyBuffer(&compute->device, &primitives->values);
+
+	*primitives = (Primitives) {};
+}
+
+static uint32_t countGroups(Primitives *primitives, uint32_t count) {
+	/* Returns the workgroups that cover count elements */
+	uint32_t groups = (count + primitives->block - 1) / primitives->block;
+
+	if (groups > MAX_PRIMITIVE_GROUPS)
+		Panic("countGroups: %u elements is more than %u blocks\n", count, MAX_PRIMITIVE_GROUPS);
+
+	return groups;
+}
+
+static uint32_t countSums(Primitives *primitives, uint32_t count) {
+	/* Returns the scratch elements taken by the block sums of every level of a
+	scan or reduction of count elements */
+	uint32_t sums = 0, groups;
+
+	for (groups = countGroups(primitives, count); groups > 1; groups = countGroups(primitives, groups))
+		sums += groups;
+
+	return sums;
+}
+
+static void reserveBuffer(Primitives *primitives, Buffer *buffer, uint32_t elements) {
+	/* Grows buffer to hold at least elements uints. The old buffer is deleted
+	once the last dispatch that used it has completed */
+	VkDeviceSize size = (VkDeviceSize) elements * sizeof(uint32_t);
+	if (buffer->buffer && buffer->size >= size) return;
+
+	if (buffer->buffer) DeleteBufferLater(&primitives->compute->deletions, buffer, primitives->last);
+
+	VkDeviceSize rounded = 4096;
+	while (rounded < size) rounded *= 2;
+
+	*buffer = CreateBuffer(&primitives->compute->device, rounded, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+static void dispatchKernel(Primitives *primitives, ComputeKernel *kernel, const VkBuffer *buffers, const void *constants, uint32_t groups) {
+	/* Dispatches groups workgroups of kernel and remembers its token */
+	primitives->last = Dispatch(primitives->compute, kernel, buffers, constants, groups, 1, 1);
+}
+
+static void scanLevel(Primitives *primitives, VkBuffer src, uint32_t src_offset, VkBuffer dst, uint32_t dst_offset, uint32_t count, uint32_t sums) {
+	/* Records an exclusive scan of count elements. When there's more than one
+	block their sums go in scratch from element sums on, and are scanned the
+	same way to give each block its offset */
+	VkBuffer scratch = primitives->scratch.buffer;
+	uint32_t groups = countGroups(primitives, count);
+
+	if (groups > 1) {
+		ReduceConstants reduce = {count, src_offset, sums};
+		VkBuffer buffers[] = {src, scratch};
+
+		dispatchKernel(primitives, &primitives->reduce, buffers, &reduce, groups);
+		scanLevel(primitives, scratch, sums, scratch, sums, groups, sums + groups);
+	}
+
+	ScanConstants scan = {count, src_offset, dst_offset, sums, groups > 1};
+	VkBuffer buffers[] = {src, dst, scratch};
+
+	dispatchKernel(primitives, &primitives->scan, buffers, &scan, groups);
+}
+
+ComputeToken ExclusiveScan(Primitives *primitives, VkBuffer src, VkBuffer dst, uint32_t count) {
+	/* Records dst[i] = src[0] + ... + src[i - 1] for count uints, src and dst
+	may be the same buffer */
+	if (!count) return primitives->last;
+
+	reserveBuffer(primitives, &primitives->scratch, countSums(primitives, count));
+	scanLevel(primitives, src, 0, dst, 0, count, 0);
+
+	return primitives->last;
+}
+
+ComputeToken Reduce(Primitives *primitives, VkBuffer src, VkBuffer dst, uint32_t count) {
+	/* Records the sum of count uints of src into dst[0], blocks are summed
+	until one is left */
+	if (!count) return primitives->last;
+
+	reserveBuffer(primitives, &primitives->scratch, countSums(primitives, count));
+
+	VkBuffer from = src;
+	uint32_t offset = 0, sums = 0;
+	uint32_t groups = countGroups(primitives, count);
+
+	while (groups > 1) {
+		ReduceConstants reduce = {count, offset, sums};
+		VkBuffer buffers[] = {from, primitives->scratch.buffer};
+
+		dispatchKernel(primitives, &primitives->reduce, buffers, &reduce, groups);
+
+		from = primitives->scratch.buffer;
+		offset = sums;
+		sums += groups;
+		count = groups;
+		groups = countGroups(primitives, count);
+	}
+
+	ReduceConstants reduce = {count, offset, 0};
+	VkBuffer buffers[] = {from, dst};
+
+	dispatchKernel(primitives, &primitives->reduce, buffers, &reduce, 1);
+
+	return primitives->last;
+}
+
+ComputeToken RadixSort(Primitives *primitives, VkBuffer keys, VkBuffer values, uint32_t count, uint32_t bits) {
+	/* Records a stable sort of count uint keys by their low bits, in place.
+	values is VK_NULL_HANDLE or as many uints that move with their keys. An
+	even number of passes is made so the result ends up back in keys */
+	if (!count) return primitives->last;
+
+	uint32_t passes = (bits + RADIX_BITS - 1) / RADIX_BITS;
+	passes += passes & 1;
+
+	uint32_t groups = countGroups(primitives, count);
+	uint32_t counts = RADIX * groups;
+
+	reserveBuffer(primitives, &primitives->scratch, counts + countSums(primitives, counts));
+	reserveBuffer(primitives, &primitives->keys, count);
+	if (values) reserveBuffer(primitives, &primitives->values, count);
+
+	VkBuffer scratch = primitives->scratch.buffer;
+	VkBuffer keys_in = keys, keys_out = primitives->keys.buffer;
+	VkBuffer values_in = (values) ? values : scratch, values_out = (values) ? primitives->values.buffer : scratch;
+
+	uint32_t pass;
+	for (pass = 0; pass < passes; pass++) {
+		uint32_t shift = pass * RADIX_BITS;
+
+		CountConstants count_constants = {count, shift, groups};
+		VkBuffer count_buffers[] = {keys_in, scratch};
+		dispatchKernel(primitives, &primitives->count, count_buffers, &count_constants, groups);
+
+		scanLevel(primitives, scratch, 0, scratch, 0, counts, counts);
+
+		ScatterConstants scatter = {count, shift, groups, values != VK_NULL_HANDLE};
+		VkBuffer scatter_buffers[] = {keys_in, keys_out, scratch, values_in, values_out};
+		dispatchKernel(primitives, &primitives->scatter, scatter_buffers, &scatter, groups);
+
+		VkBuffer swap = keys_in;
+		keys_in = keys_out;
+		keys_out = swap;
+
+		swap = values_in;
+		values_in = values_out;
+		values_out = swap;
+	}
+
+	return primitives->last;
+}
+
+ComputeToken Compact(Primitives *primitives, VkBuffer src, VkBuffer flags, VkBuffer dst, VkBuffer total, uint32_t count) {
+	/* Records a copy of the uints of src whose flag is 1 to the start of dst,
+	in order, and their number to total[0]. flags must be 0 or 1 */
+	if (!count) return primitives->last;
+
+	reserveBuffer(primitives, &primitives->scratch, count + countSums(primitives, count));
+
+	VkBuffer scratch = primitives->scratch.buffer;
+	scanLevel(primitives, flags, 0, scratch, 0, count, count);
+
+	CompactConstants compact = {count, 0};
+	VkBuffer buffers[] = {src, flags, scratch, dst, total};
+	dispatchKernel(primitives, &primitives->compact, buffers, &compact, countGroups(primitives, count));
+
+	return primitives->last;
+}
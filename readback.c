@@ -0,0 +1,219 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "panic.h"
+#include "readback.h"
+#include "renderer.h"
+#include "textures.h"
+
+/* code */
+
+Readbacks CreateReadbacks(RendererDevice device) {
+	/* Creates Readbacks on device. Host cached memory makes reading the results
+	fast, devices without it fall back to coherent memory */
+	Readbacks readbacks = {
+		.device = device,
+		.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+	};
+
+	if (FindMemoryType(&device, UINT32_MAX, readbacks.properties) == NO_MEMORY_TYPE)
+		readbacks.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	return readbacks;
+}
+
+void DestroyReadbacks(Readbacks *readbacks) {
+	/* Destroys every buffer, the GPU must be done with pending reads and their
+	views become invalid */
+	uint32_t i;
+	for (i = 0; i < readbacks->count; i++)
+		DestroyBuffer(&readbacks->device, &readbacks->slots[i].buffer);
+
+	*readbacks = (Readbacks) {};
+}
+
+static VkDeviceSize roundReadbackSize(VkDeviceSize size) {
+	/* Returns the power of 2 buffer size that holds size bytes */
+	VkDeviceSize rounded = MIN_READBACK_SIZE;
+	while (rounded < size) rounded *= 2;
+
+	return rounded;
+}
+
+static uint32_t acquireSlot(Readbacks *readbacks, VkDeviceSize size, uint64_t value) {
+	/* Returns a free slot with a buffer of at least size bytes. The smallest
+	that fits is recycled, then a free one is regrown, then a slot is added */
+	uint32_t best = MAX_READBACKS, spare = MAX_READBACKS;
+
+	uint32_t i;
+	for (i = 0; i < readbacks->count; i++) {
+		ReadbackSlot *slot = &readbacks->slots[i];
+		if (slot->state != READBACK_FREE) continue;
+
+		spare = i;
+
+		if (slot->buffer.size >= size && (best == MAX_READBACKS || slot->buffer.size < readbacks->slots[best].buffer.size))
+			best = i;
+	}
+
+	if (best == MAX_READBACKS) {
+		if (spare != MAX_READBACKS) {
+			best = spare;
+			DestroyBuffer(&readbacks->device, &readbacks->slots[best].buffer);
+		} else if (readbacks->count < MAX_READBACKS) {
+			best = readbacks->count++;
+		} else {
+			Panic("acquireSlot: more than %u reads outstanding\n", MAX_READBACKS);
+		}
+
+		VkDeviceSize rounded = roundReadbackSize(size);
+		readbacks->slots[best].buffer = CreateBuffer(&readbacks->device, rounded, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbacks->properties);
+	}
+
+	ReadbackSlot *slot = &readbacks->slots[best];
+	slot->state = READBACK_PENDING;
+	slot->value = value;
+	slot->size = size;
+	slot->row_length = 0;
+
+	return best;
+}
+
+static void makeHostVisible(Readbacks *readbacks, VkCommandBuffer command_buffer) {
+	/* Records the barrier that makes the copies visible to host reads once the
+	submission has completed */
+	const DeviceDispatch *vk = readbacks->device.dispatch.device;
+
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+ReadbackFuture ReadbackBuffer(Readbacks *readbacks, VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint64_t value) {
+	/* Records a copy of size bytes of buffer at offset, which completes once
+	the submission of command_buffer reaches value. Writes to buffer must
+	have been made available to transfer reads */
+	const DeviceDispatch *vk = readbacks->device.dispatch.device;
+
+	uint32_t index = acquireSlot(readbacks, size, value);
+	ReadbackSlot *slot = &readbacks->slots[index];
+
+	VkBufferCopy copy = {
+		.srcOffset = offset,
+		.dstOffset = 0,
+		.size = size,
+	};
+
+	vk->CmdCopyBuffer(command_buffer, buffer, slot->buffer.buffer, 1, &copy);
+	makeHostVisible(readbacks, command_buffer);
+
+	return (ReadbackFuture) {index, slot->generation};
+}
+
+ReadbackFuture ReadbackTexture(Readbacks *readbacks, VkCommandBuffer command_buffer, Texture *texture, VkRect2D region, uint64_t value) {
+	/* Records a copy of region of the texture as tightly packed rows, outside
+	of a pass. The texture is left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL */
+	const DeviceDispatch *vk = readbacks->device.dispatch.device;
+
+	uint32_t texel = GetTexelSize(texture->format);
+	if (!texel) Panic("ReadbackTexture: unsupported format %d\n", texture->format);
+
+	uint32_t row_length = region.extent.width * texel;
+	VkDeviceSize size = (VkDeviceSize) row_length * region.extent.height;
+
+	uint32_t index = acquireSlot(readbacks, size, value);
+	ReadbackSlot *slot = &readbacks->slots[index];
+	slot->row_length = row_length;
+
+	TransitionTexture(vk, command_buffer, texture, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+	VkBufferImageCopy copy = {
+		.bufferOffset = 0,
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.layerCount = 1,
+		},
+		.imageOffset = {region.offset.x, region.offset.y, 0},
+		.imageExtent = {region.extent.width, region.extent.height, 1},
+	};
+
+	vk->CmdCopyImageToBuffer(command_buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.buffer, 1, &copy);
+	makeHostVisible(readbacks, command_buffer);
+
+	return (ReadbackFuture) {index, slot->generation};
+}
+
+void UpdateReadbacks(Readbacks *readbacks, uint64_t completed) {
+	/* Marks the reads whose value has completed as ready. Memory that isn't
+	coherent is invalidated so the host sees the copies */
+	const DeviceDispatch *vk = readbacks->device.dispatch.device;
+
+	uint32_t i;
+	for (i = 0; i < readbacks->count; i++) {
+		ReadbackSlot *slot = &readbacks->slots[i];
+		if (slot->state != READBACK_PENDING || slot->value > completed) continue;
+
+		if (!(slot->buffer.properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			VkMappedMemoryRange range = {
+				.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+				.memory = slot->buffer.memory,
+				.offset = 0,
+				.size = VK_WHOLE_SIZE,
+			};
+
+			vk->InvalidateMappedMemoryRanges(readbacks->device.device, 1, &range);
+		}
+
+		slot->state = READBACK_READY;
+	}
+}
+
+static ReadbackSlot *getSlot(Readbacks *readbacks, ReadbackFuture future) {
+	/* Returns the slot of future, or NULL if the read was released */
+	if (future.slot >= readbacks->count) return NULL;
+
+	ReadbackSlot *slot = &readbacks->slots[future.slot];
+	if (slot->generation != future.generation || slot->state == READBACK_FREE) return NULL;
+
+	return slot;
+}
+
+bool PollReadback(Readbacks *readbacks, ReadbackFuture future) {
+	/* Returns true if the read has completed, as of the last UpdateReadbacks */
+	ReadbackSlot *slot = getSlot(readbacks, future);
+
+	return slot && slot->state == READBACK_READY;
+}
+
+ReadbackView GetReadback(Readbacks *readbacks, ReadbackFuture future) {
+	/* Returns a view of the read straight from the mapped buffer, data is NULL
+	until the read has completed */
+	ReadbackSlot *slot = getSlot(readbacks, future);
+	if (!slot || slot->state != READBACK_READY) return (ReadbackView) {};
+
+	return (ReadbackView) {
+		.data = slot->buffer.mapped,
+		.size = slot->size,
+		.row_length = slot->row_length,
+	};
+}
+
+void ReleaseReadback(Readbacks *readbacks, ReadbackFuture future) {
+	/* Returns the read's buffer to the pool, its view becomes invalid. A read
+	still pending must not be released */
+	ReadbackSlot *slot = getSlot(readbacks, future);
+	if (!slot) return;
+
+	if (slot->state == READBACK_PENDING)
+		Panic("ReleaseReadback: read %u hasn't completed\n", future.slot);
+
+	slot->state = READBACK_FREE;
+	slot->generation++;
+}
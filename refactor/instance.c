@@ -1,10 +1,20 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <SDL.h>
 #include <SDL_vulkan.h>
 #include <vulkan/vulkan.h>
 
+#include "archive.h"
+#include "capture.h"
+#include "dispatch.h"
+#include "log.h"
 #include "panic.h"
+#include "renderer.h"
+#include "shaders.h"
 
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 
@@ -19,6 +29,9 @@ typedef struct {
 /* Container for required Vulkan Validation Layers */
 typedef InstanceExtensions ValidationLayers;
 
+/* Container for enabled Vulkan Device Extensions */
+typedef InstanceExtensions DeviceExtensions;
+
 typedef struct {
 	/* Type that describes the settings required for an environment e.g. dev,
 	prod,	etc. */
@@ -44,6 +57,34 @@ typedef struct {
 		VkPhysicalDeviceFeatures features;
   } physical;
 
+	struct {
+		/* Container for the subgroup properties, size is 0 before Vulkan 1.1 */
+		uint32_t size;
+		VkShaderStageFlags stages;
+		VkSubgroupFeatureFlags operations;
+	} subgroup;
+
+	struct {
+		/* Container for the supported VkExtensionProperties and the names of the
+		ones to enable */
+		uint32_t count;
+		VkExtensionProperties *properties;
+		DeviceExtensions enabled;
+	} extension;
+
+	struct {
+		/* Container for the optional features that the device can enable */
+		bool dynamic_rendering, timeline_semaphore, swapchain, present_wait, memory_budget;
+		bool sparse_residency, fragment_atomics;
+	} supports;
+
+	struct {
+		/* Container for the memory heaps and types, local is the size of the
+		device local heaps in bytes */
+		VkPhysicalDeviceMemoryProperties properties;
+		VkDeviceSize local;
+	} memory;
+
 	struct {
 		/* Container for queue related attributes */
 		float priorities;
@@ -56,7 +97,7 @@ typedef struct {
 
 		struct {
 			/* Container for VkQueueFamilyProperties attributes */
-			int graphics, present;
+			int graphics, present, compute;
 			uint32_t count;
 			VkQueueFamilyProperties *properties;
 		} family;
@@ -69,14 +110,19 @@ typedef struct {
 
 static struct sdl {
 	/* sdl is a namespace containing SDL related variables */
-	SDL_Window *window;
+	SDL_Window *windows[MAX_RENDERER_WINDOWS];
+	uint32_t window_count;
 	InstanceExtensions instance_extensions;
 } sdl;
 
 static struct vk {
 	/* vk is a namespace containing Vulkan related variables */
+	VulkanLoader loader;
 	VkInstance instance;
-	VkSurfaceKHR surface;
+	InstanceDispatch dispatch;
+	uint32_t api_version;
+	VkSurfaceKHR surfaces[MAX_RENDERER_WINDOWS];
+	uint32_t surface_count;
 	struct extension_properties {
 		/* extension_properties is a namespace containing the VkExtensionProperties data */
 		VkExtensionProperties *properties;
@@ -94,8 +140,21 @@ static struct vk {
 
 	struct {
 		VkDevice device;
+		DeviceDispatch dispatch;
+		Device *physical;
+
+		struct {
+			/* Container for the VkQueues retrieved from the logical device */
+			VkQueue graphics, present, compute;
+		} queue;
 	} logical;
 
+	struct {
+		/* Namespace for the shared ShaderModules and the mapped shader archive */
+		ShaderCache cache;
+		Archive archive;
+	} shaders;
+
 	struct {
 		Device *devices;
 		uint32_t count;
@@ -105,6 +164,7 @@ static struct vk {
 
 /* constants */
 
+#ifndef SODA_RELEASE
 static const char *DEV_INSTANCE_EXTENSIONS[] = {
 	/* These are the required extensions when debug mode is enabled */
 	"VK_EXT_debug_utils",
@@ -115,20 +175,18 @@ static const char *DEV_VALIDATION_LAYERS[] = {
 	"VK_LAYER_KHRONOS_validation"
 };
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL devDebugUtilsMessenger();
-
 VkDebugUtilsMessengerCreateInfoEXT DEBUG_UTILS_MESSENGER_CREATE_INFO = {
+	/* The severities and types are replaced by GetDebugLogFilter when the
+	instance is created */
 	.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
 	.messageSeverity =
-		VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-		VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
 		VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
 		VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
 	.messageType =
 		VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
 		VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
 		VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-	.pfnUserCallback = devDebugUtilsMessenger,
+	.pfnUserCallback = DebugLogMessenger,
 };
 
 static Environment dev = {
@@ -145,30 +203,44 @@ static Environment dev = {
 
 	.debug_utils.messenger.create_info = &DEBUG_UTILS_MESSENGER_CREATE_INFO,
 };
+#endif
 
 /* The prod Environment excludes layers and extensions for debugging Vulkan */
 static Environment prod;
 
-/* methods */
-
-static VKAPI_ATTR VkBool32 VKAPI_CALL devDebugUtilsMessenger(
-	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-	VkDebugUtilsMessageTypeFlagsEXT messageType,
-	const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-	void *pUserData
-) {
-	/* Prints the pCallbackData->pMessage */
-	fprintf(stderr, "%s\n", pCallbackData->pMessage);
+/* The Environment is selected at compile time, soda-release defines
+SODA_RELEASE so the debugging code isn't compiled into it at all */
+#ifdef SODA_RELEASE
+#define ENVIRONMENT prod
+#else
+#define ENVIRONMENT dev
+#endif
 
-	return VK_FALSE;
-}
+/* methods */
 
-static struct sdl initSDL() {
-	/* Setup the sdl namespace */
+static struct sdl initSDL(uint32_t windows) {
+	/* Setup the sdl namespace with windows windows, each centred on a display
+	of its own while there are displays to go round */
 	if(SDL_Init(SDL_INIT_VIDEO))
 		Panic("initSDL: failed to SDL_Init");
 
-	SDL_Window *window = SDL_CreateWindow("soda: SDL/Vulkan", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN);
+	struct sdl result = {
+		.window_count = windows,
+	};
+
+	int displays = SDL_GetNumVideoDisplays();
+	if (displays < 1) displays = 1;
+
+	uint32_t i;
+	for (i = 0; i < windows; i++) {
+		int position = SDL_WINDOWPOS_CENTERED_DISPLAY(i % displays);
+
+		result.windows[i] = SDL_CreateWindow("soda: SDL/Vulkan", position, position, 800, 600, SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+		if (!result.windows[i]) Panic("initSDL: unable to create window %u: %s\n", i, SDL_GetError());
+	}
+
+	/* Every window needs the same instance extensions */
+	SDL_Window *window = result.windows[0];
 
 	uint32_t count = 0;
 	SDL_Vulkan_GetInstanceExtensions(window, &count, NULL);
@@ -179,20 +251,20 @@ static struct sdl initSDL() {
 
 	SDL_Vulkan_GetInstanceExtensions(window, &count, names);
 
-	return (struct sdl) {
-		.instance_extensions = {
-				.count = count,
-				.names = names,
-		},
-		.window = window,
+	result.instance_extensions = (InstanceExtensions) {
+		.count = count,
+		.names = names,
 	};
+
+	return result;
 }
 
 static void destroySDL() {
 	/* Free and unset the SDL Namespace */
 	free(sdl.instance_extensions.names);
 
-	SDL_DestroyWindow(sdl.window);
+	uint32_t i;
+	for (i = 0; i < sdl.window_count; i++) SDL_DestroyWindow(sdl.windows[i]);
 
 	sdl = (struct sdl) {};
 }
@@ -202,15 +274,28 @@ static VkExtensionProperties *getVkExtensionProperties(uint32_t count) {
 	VkExtensionProperties *properties = calloc(count, sizeof(VkExtensionProperties));
 	if (!properties) Panic("getExtensionsProperties: unable to allocate VkExtensionProperties");
 
-	vkEnumerateInstanceExtensionProperties(NULL, &count, properties);
+	vk.loader.EnumerateInstanceExtensionProperties(NULL, &count, properties);
 
 	return properties;
 }
 
+static uint32_t getApiVersion() {
+	/* Returns the Vulkan version to create the VkInstance with, 1.3 if the
+	loader has it and 1.2 otherwise. Loaders without vkEnumerateInstanceVersion
+	only have 1.0 */
+	uint32_t version = VK_API_VERSION_1_0;
+	if (vk.loader.EnumerateInstanceVersion) vk.loader.EnumerateInstanceVersion(&version);
+
+	if (version < VK_API_VERSION_1_2)
+		Panic("getApiVersion: Vulkan 1.2 required, the loader has %u.%u\n", VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version));
+
+	return (version >= VK_API_VERSION_1_3) ? VK_API_VERSION_1_3 : VK_API_VERSION_1_2;
+}
+
 static uint32_t countVkExtensionProperties() {
 	/* Count the supported VkExtensionProperties in vk.extension namespace */
 	uint32_t count = 0;
-	vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+	vk.loader.EnumerateInstanceExtensionProperties(NULL, &count, NULL);
 
 	return count;
 }
@@ -234,6 +319,7 @@ static inline uint32_t totalSources(InstanceExtensions *sources, int target) {
 	return count;
 }
 
+#ifndef SODA_RELEASE
 static bool validInstanceExtension(const char *name) {
 	/* Checks the name of an Instance Extension, returns true if it's valid and
 	false if it's not */
@@ -245,6 +331,7 @@ static bool validInstanceExtension(const char *name) {
 
 	return false;
 }
+#endif
 
 static InstanceExtensions setVkInstanceExtensions(Environment *environment) {
 	/* Validates and sets vk.instance_extensions namespace */
@@ -269,12 +356,15 @@ static InstanceExtensions setVkInstanceExtensions(Environment *environment) {
 		dst += source->count;
 	}
 
+#ifndef SODA_RELEASE
+	/* Release builds leave it to vkCreateInstance to reject the extensions */
 	for (i = 0; i < count; i++) {
 		const char *name = names[i];
 		if (validInstanceExtension(names[i])) continue;
 
 		Panic("setVkInstanceExtensions: Invalid Instance Extension requested: %s\n", name);
 	}
+#endif
 
 	return (InstanceExtensions) {
 		.count = count,
@@ -282,43 +372,50 @@ static InstanceExtensions setVkInstanceExtensions(Environment *environment) {
 	};
 }
 
+static Archive openShaderArchive() {
+	/* Maps the packed shader archive named by SODA_SHADER_ARCHIVE, or
+	shaders.pack, if there is one */
+	const char *path = getenv("SODA_SHADER_ARCHIVE");
+	if (!path) path = "shaders.pack";
+
+	if (access(path, R_OK) != 0) return (Archive) {};
+
+	return OpenArchive(path);
+}
+
+#ifndef SODA_RELEASE
 static VkDebugUtilsMessengerEXT *createDebugUtilsMessenger(VkDebugUtilsMessengerCreateInfoEXT *create_info) {
 	/* Initialise and return VkDebugUtilsMessengerEXT if create_info is set */
 	if (!create_info) return NULL;
 
-	PFN_vkCreateDebugUtilsMessengerEXT create =
-		(PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(vk.instance, "vkCreateDebugUtilsMessengerEXT");
-
-	if (!create)
+	if (!vk.dispatch.CreateDebugUtilsMessengerEXT)
 		Panic("initDebugUtilsMessenger: unable to get vkCreateDebugUtilsMessengerEXT\n");
 
 	VkDebugUtilsMessengerEXT *messenger = calloc(1, sizeof(VkDebugUtilsMessengerEXT));
 	if (!messenger)
 		Panic("initDebugUtilsMessenger: unable to allocate 'messenger'\n");
 
-	create(vk.instance, create_info, NULL, messenger);
+	vk.dispatch.CreateDebugUtilsMessengerEXT(vk.instance, create_info, NULL, messenger);
 
 	return messenger;
 }
 
 static VkDebugUtilsMessengerEXT *destroyDebugUtilsMessenger(VkDebugUtilsMessengerEXT *messenger) {
 	/* Free and unset messenger */
-	PFN_vkDestroyDebugUtilsMessengerEXT destroy =
-		(PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(vk.instance, "vkDestroyDebugUtilsMessengerEXT");
-
-	if (!destroy)
+	if (!vk.dispatch.DestroyDebugUtilsMessengerEXT)
 		Panic("initDebugUtilsMessenger: unable to get vkDestroyDebugUtilsMessengerEXT\n");
 
-	destroy(vk.instance, *messenger, NULL);
+	vk.dispatch.DestroyDebugUtilsMessengerEXT(vk.instance, *messenger, NULL);
 	free(messenger);
 
 	return NULL;
 }
+#endif
 
 static uint32_t countVkPhysicalDevices() {
   /* Counts the VkPhysicalDevice */
   uint32_t count = 0;
-  vkEnumeratePhysicalDevices(vk.instance, &count, NULL);
+  vk.dispatch.EnumeratePhysicalDevices(vk.instance, &count, NULL);
 
   return count;
 }
@@ -330,7 +427,7 @@ static VkPhysicalDevice *getVkPhysicalDevices(uint32_t count) {
   if (!devices)
     Panic("getVkPhysicalDevices: unable to allocate VkPhysicalDevice array\n");
 
-  vkEnumeratePhysicalDevices(vk.instance, &count, devices);
+  vk.dispatch.EnumeratePhysicalDevices(vk.instance, &count, devices);
 
   return devices;
 }
@@ -338,7 +435,7 @@ static VkPhysicalDevice *getVkPhysicalDevices(uint32_t count) {
 static uint32_t countQueueFamilyProperties(VkPhysicalDevice physical_device) {
   /* Counts the VkPhysicalDeviceQueueFamilyProperties */
   uint32_t count = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
+	vk.dispatch.GetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
 
   return count;
 }
@@ -350,11 +447,194 @@ static VkQueueFamilyProperties *getQueueFamilyProperties(VkPhysicalDevice physic
   if (!properties)
     Panic("getQueueFamiliesProperties: unable to allocate VkQueueFamilyProperties array\n");
 
-  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, properties);
+  vk.dispatch.GetPhysicalDeviceQueueFamilyProperties(physical_device, &count, properties);
 
   return properties;
 }
 
+static uint32_t countDeviceExtensionProperties(VkPhysicalDevice physical_device) {
+	/* Counts the VkExtensionProperties supported by the VkPhysicalDevice */
+	uint32_t count = 0;
+	vk.dispatch.EnumerateDeviceExtensionProperties(physical_device, NULL, &count, NULL);
+
+	return count;
+}
+
+static VkExtensionProperties *getDeviceExtensionProperties(VkPhysicalDevice physical_device, uint32_t count) {
+	/* Allocate and return the VkExtensionProperties supported by the
+	VkPhysicalDevice */
+	VkExtensionProperties *properties = calloc(count ? count : 1, sizeof(VkExtensionProperties));
+	if (!properties)
+		Panic("getDeviceExtensionProperties: unable to allocate VkExtensionProperties array\n");
+
+	vk.dispatch.EnumerateDeviceExtensionProperties(physical_device, NULL, &count, properties);
+
+	return properties;
+}
+
+static bool supportsDeviceExtension(Device *device, const char *name) {
+	/* Returns true if the device supports the named extension */
+	uint32_t i;
+	for (i = 0; i < device->extension.count; i++)
+		if (strcmp(name, device->extension.properties[i].extensionName) == 0) return true;
+
+	return false;
+}
+
+static bool enableDeviceExtension(Device *device, const char *name) {
+	/* Adds name to the extensions to enable if the device supports it */
+	if (!supportsDeviceExtension(device, name)) return false;
+
+	device->extension.enabled.names[device->extension.enabled.count++] = name;
+
+	return true;
+}
+
+static uint32_t getDeviceApiVersion(Device *device) {
+	/* Returns the Vulkan version that can be used with device, which is capped
+	by the version the VkInstance was created with */
+	uint32_t version = device->physical.properties.apiVersion;
+
+	return (version < vk.api_version) ? version : vk.api_version;
+}
+
+static void setSubgroupProperties(Device *device) {
+	/* Sets the subgroup size and the subgroup operations of the device, which
+	compute kernels are tuned with */
+	if (getDeviceApiVersion(device) < VK_API_VERSION_1_1) return;
+
+	VkPhysicalDeviceSubgroupProperties subgroup = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+	};
+
+	VkPhysicalDeviceProperties2 properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &subgroup,
+	};
+
+	vk.dispatch.GetPhysicalDeviceProperties2(device->physical.device, &properties);
+
+	device->subgroup.size = subgroup.subgroupSize;
+	device->subgroup.stages = subgroup.supportedStages;
+	device->subgroup.operations = subgroup.supportedOperations;
+}
+
+static void setDynamicRendering(Device *device) {
+	/* Sets supports.dynamic_rendering if the device can use vkCmdBeginRendering,
+	either through Vulkan 1.3 or VK_KHR_dynamic_rendering */
+	if (getDeviceApiVersion(device) < VK_API_VERSION_1_1) return;
+
+	bool core = getDeviceApiVersion(device) >= VK_API_VERSION_1_3;
+	if (!core && !supportsDeviceExtension(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) return;
+
+	/* The extension depends on two more that are only core from Vulkan 1.2 */
+	bool dependencies = getDeviceApiVersion(device) < VK_API_VERSION_1_2;
+	if (dependencies && !supportsDeviceExtension(device, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME)) return;
+	if (dependencies && !supportsDeviceExtension(device, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)) return;
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+	};
+
+	VkPhysicalDeviceFeatures2 features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &dynamic_rendering,
+	};
+
+	vk.dispatch.GetPhysicalDeviceFeatures2(device->physical.device, &features);
+	if (!dynamic_rendering.dynamicRendering) return;
+
+	if (!core) enableDeviceExtension(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+
+	if (dependencies) {
+		enableDeviceExtension(device, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+		enableDeviceExtension(device, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+	}
+
+	device->supports.dynamic_rendering = true;
+}
+
+static void setTimelineSemaphore(Device *device) {
+	/* Sets supports.timeline_semaphore if the device has Vulkan 1.2 timeline
+	semaphores, which are used to track GPU progress */
+	if (getDeviceApiVersion(device) < VK_API_VERSION_1_2) return;
+
+	VkPhysicalDeviceVulkan12Features vulkan12 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+	};
+
+	VkPhysicalDeviceFeatures2 features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &vulkan12,
+	};
+
+	vk.dispatch.GetPhysicalDeviceFeatures2(device->physical.device, &features);
+
+	device->supports.timeline_semaphore = vulkan12.timelineSemaphore;
+}
+
+static void setPresentWait(Device *device) {
+	/* Sets supports.present_wait if the device can tag presents with an id and
+	wait for them to reach the display, which frame pacing relies on */
+	if (!device->supports.swapchain) return;
+	if (!supportsDeviceExtension(device, VK_KHR_PRESENT_ID_EXTENSION_NAME)) return;
+	if (!supportsDeviceExtension(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) return;
+
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+	};
+
+	VkPhysicalDevicePresentIdFeaturesKHR present_id = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+		.pNext = &present_wait,
+	};
+
+	VkPhysicalDeviceFeatures2 features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &present_id,
+	};
+
+	vk.dispatch.GetPhysicalDeviceFeatures2(device->physical.device, &features);
+	if (!present_id.presentId || !present_wait.presentWait) return;
+
+	enableDeviceExtension(device, VK_KHR_PRESENT_ID_EXTENSION_NAME);
+	enableDeviceExtension(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+	device->supports.present_wait = true;
+}
+
+static void setMemoryBudget(Device *device) {
+	/* Sets supports.memory_budget if the device can report the usage and budget
+	of its heaps through VK_EXT_memory_budget */
+	if (getDeviceApiVersion(device) < VK_API_VERSION_1_1) return;
+
+	device->supports.memory_budget = enableDeviceExtension(device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+static void setMemory(Device *device) {
+	/* Sets the device's memory properties and the total size of its device
+	local heaps */
+	vk.dispatch.GetPhysicalDeviceMemoryProperties(device->physical.device, &device->memory.properties);
+
+	uint32_t i;
+	for (i = 0; i < device->memory.properties.memoryHeapCount; i++) {
+		VkMemoryHeap *heap = &device->memory.properties.memoryHeaps[i];
+		if (heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) device->memory.local += heap->size;
+	}
+}
+
+static void setSparseResidency(Device *device) {
+	/* Sets supports.sparse_residency if 2D images can be partially resident and
+	the graphics queue can bind their memory, which virtual textures use */
+	VkPhysicalDeviceFeatures *features = &device->physical.features;
+	if (!features->sparseBinding || !features->sparseResidencyImage2D) return;
+
+	int graphics = device->queue.family.graphics;
+	if (graphics < 0) return;
+
+	device->supports.sparse_residency = (device->queue.family.properties[graphics].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
+}
+
 /* 0 is a valid VkQueueFamilyProperties index so NO_QUEUE_FAMILY is -1 */
 static const int NO_QUEUE_FAMILY = -1;
 
@@ -362,6 +642,20 @@ static const int NO_QUEUE_FAMILY = -1;
 hasn't been set yet */
 #define SET_QUEUE_FAMILY(target, value) target = (target == NO_QUEUE_FAMILY) ? value : target
 
+static bool canPresent(Device *device, int family) {
+	/* Returns true if the queue family can present to every surface, so one
+	present queue serves all of the windows */
+	uint32_t i;
+	for (i = 0; i < vk.surface_count; i++) {
+		VkBool32 can_present = VK_FALSE;
+		vk.dispatch.GetPhysicalDeviceSurfaceSupportKHR(device->physical.device, family, vk.surfaces[i], &can_present);
+
+		if (!can_present) return false;
+	}
+
+	return true;
+}
+
 static void setQueueFamilies(Device *device) {
 	/* setQueueFamilies will set the queue_family for device to the first index it
 	finds. */
@@ -373,12 +667,18 @@ static void setQueueFamilies(Device *device) {
 		if (properties->queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			SET_QUEUE_FAMILY(device->queue.family.graphics, i);
 
-		VkBool32 can_present = VK_FALSE;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device->physical.device, i, vk.surface, &can_present);
+		/* a compute family without graphics can run alongside the frame */
+		if ((properties->queueFlags & VK_QUEUE_COMPUTE_BIT) && !(properties->queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			SET_QUEUE_FAMILY(device->queue.family.compute, i);
 
-		if (can_present)
+		if (!vk.surface_count) continue;
+
+		if (canPresent(device, i))
 			SET_QUEUE_FAMILY(device->queue.family.present, i);
 	}
+
+	/* graphics families always support compute */
+	SET_QUEUE_FAMILY(device->queue.family.compute, device->queue.family.graphics);
 }
 
 static void setQueueCreateInfo(Device *device) {
@@ -394,13 +694,14 @@ static void setQueueCreateInfo(Device *device) {
 	int queue_family[] = {
 		device->queue.family.graphics,
 		device->queue.family.present,
+		device->queue.family.compute,
 	};
 
 	int i, count = 0;
 	for (i = 0; i < ARRAY_SIZE(queue_family); i++) {
 		int family_index = queue_family[i];
 
-		if (created[family_index]) continue;
+		if (family_index == NO_QUEUE_FAMILY || created[family_index]) continue;
 
 		device->queue.create.info[count] = (VkDeviceQueueCreateInfo) {
 			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -415,7 +716,9 @@ static void setQueueCreateInfo(Device *device) {
 
 	device->queue.create.count = count;
 
+#ifndef SODA_RELEASE
 	printf("device->queue.create.count: %d\n", device->queue.create.count);
+#endif
 	free(created);
 }
 
@@ -434,8 +737,27 @@ static Device *createDevices(uint32_t count) {
 		VkPhysicalDevice physical_device = physical_devices[i];
 
 		device->physical.device = physical_device;
-		vkGetPhysicalDeviceProperties(physical_device, &(device->physical.properties));
-		vkGetPhysicalDeviceFeatures(physical_device, &(device->physical.features));
+		vk.dispatch.GetPhysicalDeviceProperties(physical_device, &(device->physical.properties));
+		vk.dispatch.GetPhysicalDeviceFeatures(physical_device, &(device->physical.features));
+		setSubgroupProperties(device);
+
+		device->extension.count = countDeviceExtensionProperties(physical_device);
+		device->extension.properties = getDeviceExtensionProperties(physical_device, device->extension.count);
+
+		device->extension.enabled.names = calloc(device->extension.count ? device->extension.count : 1, sizeof(const char *));
+		if (!device->extension.enabled.names)
+			Panic("createDevices: unable to allocate enabled extension names\n");
+
+		setDynamicRendering(device);
+		setTimelineSemaphore(device);
+
+		/* Presenting to the surfaces needs VK_KHR_swapchain */
+		if (vk.surface_count)
+			device->supports.swapchain = enableDeviceExtension(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+		setPresentWait(device);
+		setMemory(device);
+		setMemoryBudget(device);
 
 		device->queue.priorities = 1.0f;
 		device->queue.family.count = countQueueFamilyProperties(physical_device);
@@ -443,10 +765,15 @@ static Device *createDevices(uint32_t count) {
 
 		device->queue.family.graphics =
 		device->queue.family.present =
+		device->queue.family.compute =
 			NO_QUEUE_FAMILY;
 
 		setQueueFamilies(device);
 		setQueueCreateInfo(device);
+		setSparseResidency(device);
+
+		/* Feedback passes write to storage buffers from fragment shaders */
+		device->supports.fragment_atomics = device->physical.features.fragmentStoresAndAtomics;
 
 		device->create.info = (VkDeviceCreateInfo) {
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
@@ -460,13 +787,75 @@ static Device *createDevices(uint32_t count) {
 	return devices;
 }
 
+static void destroyDevices(Device *devices, uint32_t count) {
+	/* Frees the Device array and everything createDevices allocated for it */
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		free(devices[i].extension.properties);
+		free(devices[i].extension.enabled.names);
+		free(devices[i].queue.create.info);
+		free(devices[i].queue.family.properties);
+	}
+
+	free(devices);
+}
+
 static VkDevice createLogicalDevice(Device *device) {
-	VkPhysicalDeviceFeatures features = {0};
+	/* Creates the VkDevice with the extensions and optional features that were
+	found in createDevices */
+	VkPhysicalDeviceFeatures features = {
+		.sparseBinding = device->supports.sparse_residency,
+		.sparseResidencyImage2D = device->supports.sparse_residency,
+		.fragmentStoresAndAtomics = device->supports.fragment_atomics,
+	};
+
 	device->create.info.pEnabledFeatures = &features;
 
+	device->create.info.enabledExtensionCount = device->extension.enabled.count;
+	device->create.info.ppEnabledExtensionNames = device->extension.enabled.names;
+
+	void *next = NULL;
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+		.dynamicRendering = VK_TRUE,
+	};
+
+	if (device->supports.dynamic_rendering) {
+		dynamic_rendering.pNext = next;
+		next = &dynamic_rendering;
+	}
+
+	VkPhysicalDeviceVulkan12Features vulkan12 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.timelineSemaphore = device->supports.timeline_semaphore,
+	};
+
+	if (device->supports.timeline_semaphore) {
+		vulkan12.pNext = next;
+		next = &vulkan12;
+	}
+
+	VkPhysicalDevicePresentIdFeaturesKHR present_id = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+		.presentId = VK_TRUE,
+	};
+
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+		.pNext = &present_id,
+		.presentWait = VK_TRUE,
+	};
+
+	if (device->supports.present_wait) {
+		present_id.pNext = next;
+		next = &present_wait;
+	}
+
+	device->create.info.pNext = next;
 
 	VkDevice logical_device;
-	if (vkCreateDevice(device->physical.device, &device->create.info, NULL, &logical_device) == VK_SUCCESS)
+	if (vk.dispatch.CreateDevice(device->physical.device, &device->create.info, NULL, &logical_device) == VK_SUCCESS)
 		return logical_device;
 
 	Panic("createLogicalDevice: unable to create logical device\n");
@@ -474,17 +863,27 @@ static VkDevice createLogicalDevice(Device *device) {
 	return 0;
 }
 
-void CreateRenderer() {
-	/* Creates the VkInstance and get the rest of the Vulkan's state */
-
-	Environment *environment = &dev;
-
-	sdl = initSDL();
+static void createInstance(Environment *environment) {
+	/* Creates the VkInstance with the extensions required by the environment
+	and SDL, if SDL has been initialised. The loader is only loaded once */
+	if (!vk.loader.GetInstanceProcAddr) vk.loader = LoadVulkan();
 
+#ifndef SODA_RELEASE
 	vk.extension_properties.count = countVkExtensionProperties();
 	vk.extension_properties.properties = getVkExtensionProperties(vk.extension_properties.count);
+#endif
 
 	vk.instance_extensions = setVkInstanceExtensions(environment);
+	vk.api_version = getApiVersion();
+
+#ifndef SODA_RELEASE
+	/* Messages are filtered by the driver and logged off the calling thread */
+	VkDebugUtilsMessengerCreateInfoEXT *messenger = environment->debug_utils.messenger.create_info;
+	if (messenger) {
+		ApplyDebugLogFilter(messenger, GetDebugLogFilter());
+		StartDebugLog();
+	}
+#endif
 
 	VkApplicationInfo application_info = {
 		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -492,7 +891,7 @@ void CreateRenderer() {
 		.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
 		.pEngineName = "soda",
 		.engineVersion = VK_MAKE_VERSION(1, 0, 0),
-		.apiVersion = VK_API_VERSION_1_2,
+		.apiVersion = vk.api_version,
 	};
 
 	VkInstanceCreateInfo create_info = {
@@ -505,19 +904,220 @@ void CreateRenderer() {
 		.ppEnabledExtensionNames = vk.instance_extensions.names,
 	};
 
-	VkResult result = vkCreateInstance(&create_info, NULL, &vk.instance);
+	VkResult result = vk.loader.CreateInstance(&create_info, NULL, &vk.instance);
 
 	if (result != VK_SUCCESS)
 		Panic("CreateInstance: failed to create VkInstance\n");
 
+	vk.dispatch = LoadInstanceDispatch(&vk.loader, vk.instance);
+
+#ifndef SODA_RELEASE
 	vk.debug_utils.messenger = createDebugUtilsMessenger(environment->debug_utils.messenger.create_info);
+#endif
+}
+
+static int rankDeviceType(VkPhysicalDeviceType type) {
+	/* Returns how strongly a device of type is preferred, discrete GPUs have
+	their own memory so they come first */
+	switch (type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+		default: return 0;
+	}
+}
+
+static Device *selectDevice(Device *devices, uint32_t count) {
+	/* Returns the Device to create the logical device on. Devices without a
+	graphics queue, or that can't present to every surface there is, are
+	skipped. The rest are ranked by type, then by device local memory */
+	Device *selected = NULL;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		Device *device = &devices[i];
 
-	SDL_Vulkan_CreateSurface(sdl.window, vk.instance, &vk.surface);
+		if (device->queue.family.graphics == NO_QUEUE_FAMILY) continue;
+		if (vk.surface_count && (!device->supports.swapchain || device->queue.family.present == NO_QUEUE_FAMILY)) continue;
 
+		if (selected) {
+			int rank = rankDeviceType(device->physical.properties.deviceType);
+			int best = rankDeviceType(selected->physical.properties.deviceType);
+
+			if (rank < best || (rank == best && device->memory.local <= selected->memory.local)) continue;
+		}
+
+		selected = device;
+	}
+
+	if (!selected)
+		Panic("selectDevice: none of the %u devices can render%s\n", count, vk.surface_count ? " to the surfaces" : "");
+
+#ifndef SODA_RELEASE
+	printf("selectDevice: %s, %llu MB device local\n", selected->physical.properties.deviceName,
+		(unsigned long long) (selected->memory.local >> 20));
+#endif
+
+	return selected;
+}
+
+static void createDevice() {
+	/* Creates the Devices, then the logical device and its queues. The present
+	queue is only retrieved if there are surfaces */
 	vk.physical.count = countVkPhysicalDevices();
 	vk.physical.devices = createDevices(vk.physical.count);
 
-	vk.logical.device = createLogicalDevice(&vk.physical.devices[0]);
+	vk.logical.physical = selectDevice(vk.physical.devices, vk.physical.count);
+
+	vk.logical.device = createLogicalDevice(vk.logical.physical);
+	vk.logical.dispatch = LoadDeviceDispatch(&vk.dispatch, vk.logical.device);
+
+	DeviceDispatch *dispatch = &vk.logical.dispatch;
+
+	dispatch->GetDeviceQueue(vk.logical.device, vk.logical.physical->queue.family.graphics, 0, &vk.logical.queue.graphics);
+	dispatch->GetDeviceQueue(vk.logical.device, vk.logical.physical->queue.family.compute, 0, &vk.logical.queue.compute);
+
+	if (vk.logical.physical->queue.family.present != NO_QUEUE_FAMILY)
+		dispatch->GetDeviceQueue(vk.logical.device, vk.logical.physical->queue.family.present, 0, &vk.logical.queue.present);
+
+	vk.shaders.cache = CreateShaderCache(dispatch);
+	vk.shaders.archive = openShaderArchive();
+
+	/* SODA_CAPTURE records the submitted work for tools/replay */
+	const char *capture = getenv("SODA_CAPTURE");
+	if (capture) StartCapture(capture);
 
 	//puts(vk.physical[0].physical.properties.deviceName);
 }
+
+void CreateRenderer() {
+	/* Creates the SDL window, the VkInstance and get the rest of the Vulkan's
+	state */
+	CreateMultiWindowRenderer(1);
+}
+
+void CreateMultiWindowRenderer(uint32_t windows) {
+	/* Creates windows SDL windows with a surface each, which share the
+	VkInstance, the logical device and its queues */
+	Environment *environment = &ENVIRONMENT;
+
+	if (!windows || windows > MAX_RENDERER_WINDOWS)
+		Panic("CreateMultiWindowRenderer: %u windows isn't between 1 and %u\n", windows, MAX_RENDERER_WINDOWS);
+
+	sdl = initSDL(windows);
+
+	createInstance(environment);
+
+	uint32_t i;
+	for (i = 0; i < windows; i++) {
+		if (!SDL_Vulkan_CreateSurface(sdl.windows[i], vk.instance, &vk.surfaces[i]))
+			Panic("CreateMultiWindowRenderer: unable to create VkSurfaceKHR: %s\n", SDL_GetError());
+	}
+
+	vk.surface_count = windows;
+
+	createDevice();
+}
+
+void CreateHeadlessRenderer() {
+	/* Creates the VkInstance and logical device without a window or surface,
+	for compute and offscreen work */
+	Environment *environment = &ENVIRONMENT;
+
+	createInstance(environment);
+	createDevice();
+}
+
+void DestroyRenderer() {
+	/* Waits for the device to go idle then destroys everything CreateRenderer
+	or CreateHeadlessRenderer created */
+	vk.logical.dispatch.DeviceWaitIdle(vk.logical.device);
+	StopCapture();
+
+	DestroyShaderCache(&vk.shaders.cache);
+	CloseArchive(&vk.shaders.archive);
+
+	vk.logical.dispatch.DestroyDevice(vk.logical.device, NULL);
+	destroyDevices(vk.physical.devices, vk.physical.count);
+
+	uint32_t i;
+	for (i = 0; i < vk.surface_count; i++)
+		vk.dispatch.DestroySurfaceKHR(vk.instance, vk.surfaces[i], NULL);
+
+#ifndef SODA_RELEASE
+	if (vk.debug_utils.messenger)
+		vk.debug_utils.messenger = destroyDebugUtilsMessenger(vk.debug_utils.messenger);
+
+	StopDebugLog();
+#endif
+
+	vk.dispatch.DestroyInstance(vk.instance, NULL);
+
+	free(vk.instance_extensions.names);
+	destroyVkExtensionProperties();
+	UnloadVulkan(&vk.loader);
+
+	if (sdl.window_count) {
+		destroySDL();
+		SDL_Quit();
+	}
+
+	vk = (struct vk) {};
+}
+
+RendererDevice GetRendererDevice() {
+	/* Returns the handles of the renderer's logical device */
+	Device *device = vk.logical.physical;
+
+	RendererDevice renderer = {
+		.instance = vk.instance,
+		.physical_device = device->physical.device,
+		.device = vk.logical.device,
+		.surface = vk.surfaces[0],
+		.api_version = getDeviceApiVersion(device),
+		.surface_count = vk.surface_count,
+		.dispatch = {
+			.instance = &vk.dispatch,
+			.device = &vk.logical.dispatch,
+		},
+		.family = {
+			.graphics = device->queue.family.graphics,
+			.present = device->queue.family.present,
+			.compute = device->queue.family.compute,
+		},
+		.queue = {
+			.graphics = vk.logical.queue.graphics,
+			.present = vk.logical.queue.present,
+			.compute = vk.logical.queue.compute,
+		},
+		.subgroup = {
+			.size = device->subgroup.size,
+			.stages = device->subgroup.stages,
+			.operations = device->subgroup.operations,
+		},
+		.supports = {
+			.dynamic_rendering = device->supports.dynamic_rendering,
+			.timeline_semaphore = device->supports.timeline_semaphore,
+			.swapchain = device->supports.swapchain,
+			.present_wait = device->supports.present_wait,
+			.memory_budget = device->supports.memory_budget,
+			.sparse_residency = device->supports.sparse_residency,
+			.fragment_atomics = device->supports.fragment_atomics,
+		},
+		.shaders = {
+			.cache = &vk.shaders.cache,
+			.archive = (vk.shaders.archive.data) ? &vk.shaders.archive : NULL,
+		},
+	};
+
+	memcpy(renderer.surfaces, vk.surfaces, sizeof(vk.surfaces));
+
+	return renderer;
+}
+
+SDL_Window *GetRendererWindow(uint32_t index) {
+	/* Returns the renderer's window at index, or NULL if there isn't one e.g.
+	for a headless renderer */
+	return (index < sdl.window_count) ? sdl.windows[index] : NULL;
+}
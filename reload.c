@@ -0,0 +1,354 @@
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "deletion.h"
+#include "panic.h"
+#include "reload.h"
+#include "renderer.h"
+
+/* constants */
+
+/* Sources with these extensions are compiled, the SPIR-V is named after the
+source with .spv appended like the Makefile's */
+static const char *SHADER_EXTENSIONS[] = {".vert", ".frag", ".comp", ".geom", ".tesc", ".tese"};
+
+/* code */
+
+static bool isShaderSource(const char *name) {
+	/* Returns true if name ends in one of the SHADER_EXTENSIONS */
+	size_t length = strlen(name);
+
+	uint32_t i;
+	for (i = 0; i < sizeof(SHADER_EXTENSIONS) / sizeof(SHADER_EXTENSIONS[0]); i++) {
+		size_t extension = strlen(SHADER_EXTENSIONS[i]);
+		if (length > extension && strcmp(name + length - extension, SHADER_EXTENSIONS[i]) == 0) return true;
+	}
+
+	return false;
+}
+
+static uint32_t readChanges(ShaderReloader *reloader, char changed[][ARCHIVE_NAME_SIZE], uint32_t count) {
+	/* Adds the shader sources named by the pending inotify events to changed,
+	once each, and returns the new count */
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	ssize_t length = read(reloader->inotify, buffer, sizeof(buffer));
+
+	ssize_t offset = 0;
+	while (offset < length) {
+		const struct inotify_event *event = (const struct inotify_event *) (buffer + offset);
+		offset += sizeof(struct inotify_event) + event->len;
+
+		if (!event->len || !isShaderSource(event->name)) continue;
+		if (strlen(event->name) + sizeof(".spv") > ARCHIVE_NAME_SIZE) continue;
+
+		uint32_t i;
+		for (i = 0; i < count; i++)
+			if (strcmp(changed[i], event->name) == 0) break;
+
+		if (i == count && count < MAX_RELOADED_SHADERS)
+			strcpy(changed[count++], event->name);
+	}
+
+	return count;
+}
+
+static uint32_t *compileShader(ShaderReloader *reloader, const char *source, size_t *size) {
+	/* Compiles source in the watched directory and returns its SPIR-V, or NULL
+	if it didn't compile. The compiler's errors go to stderr */
+	char command[2 * RELOAD_PATH_SIZE];
+
+	if (strchr(reloader->directory, '\'') || strchr(source, '\'')) return NULL;
+	snprintf(command, sizeof(command), "%s -O -o - '%s/%s'", reloader->compiler, reloader->directory, source);
+
+	FILE *output = popen(command, "r");
+	if (!output) return NULL;
+
+	size_t capacity = 65536, length = 0;
+	uint8_t *code = malloc(capacity);
+
+	while (code) {
+		length += fread(code + length, 1, capacity - length, output);
+		if (length < capacity) break;
+
+		capacity *= 2;
+
+		uint8_t *grown = realloc(code, capacity);
+		if (!grown) free(code);
+		code = grown;
+	}
+
+	int status = pclose(output);
+
+	if (!code || status != 0 || !length || length % sizeof(uint32_t)) {
+		free(code);
+		return NULL;
+	}
+
+	*size = length;
+	return (uint32_t *) code;
+}
+
+static ShaderCode findShader(ShaderReloader *reloader, const char *name) {
+	/* Returns the latest SPIR-V called name, from the reloaded shaders or else
+	the archive. code is NULL if there is neither */
+	uint32_t i;
+	for (i = 0; i < reloader->shaders.count; i++) {
+		ReloadedShader *shader = &reloader->shaders.data[i];
+		if (strcmp(shader->name, name) == 0) return (ShaderCode) {shader->code, shader->size};
+	}
+
+	if (!reloader->device.shaders.archive) return (ShaderCode) {};
+
+	ArchiveBlob blob = FindArchiveBlob(reloader->device.shaders.archive, name);
+	return (ShaderCode) {blob.data, blob.size};
+}
+
+static void storeShader(ShaderReloader *reloader, const char *name, uint32_t *code, size_t size) {
+	/* Makes code the latest SPIR-V called name, taking ownership of it */
+	ReloadedShader *shader = NULL;
+
+	uint32_t i;
+	for (i = 0; i < reloader->shaders.count; i++)
+		if (strcmp(reloader->shaders.data[i].name, name) == 0) shader = &reloader->shaders.data[i];
+
+	if (!shader) {
+		if (reloader->shaders.count == MAX_RELOADED_SHADERS)
+			Panic("storeShader: more than %u reloaded shaders\n", MAX_RELOADED_SHADERS);
+
+		shader = &reloader->shaders.data[reloader->shaders.count++];
+		strcpy(shader->name, name);
+	}
+
+	free(shader->code);
+	shader->code = code;
+	shader->size = size;
+}
+
+static bool usesShader(ReloadPipeline *pipeline, const char *name) {
+	/* Returns true if the pipeline was built from the shader called name */
+	uint32_t i;
+	for (i = 0; i < pipeline->count; i++)
+		if (strcmp(pipeline->shaders[i], name) == 0) return true;
+
+	return false;
+}
+
+static void rebuildPipeline(ShaderReloader *reloader, ReloadPipeline *pipeline) {
+	/* Builds the pipeline from the latest SPIR-V of its shaders. A rebuild that
+	wasn't swapped in yet was never used, so it's destroyed straight away */
+	const DeviceDispatch *vk = reloader->device.dispatch.device;
+
+	ShaderCode shaders[MAX_PIPELINE_SHADERS];
+
+	uint32_t i;
+	for (i = 0; i < pipeline->count; i++) {
+		shaders[i] = findShader(reloader, pipeline->shaders[i]);
+
+		if (!shaders[i].code) {
+			fprintf(stderr, "rebuildPipeline: no SPIR-V called '%s'\n", pipeline->shaders[i]);
+			return;
+		}
+	}
+
+	VkPipeline rebuilt = pipeline->build(pipeline->data, shaders);
+	if (!rebuilt) {
+		fprintf(stderr, "rebuildPipeline: unable to rebuild the pipeline of '%s'\n", pipeline->shaders[0]);
+		return;
+	}
+
+	if (pipeline->pending) vk->DestroyPipeline(reloader->device.device, pipeline->pending, NULL);
+	pipeline->pending = rebuilt;
+}
+
+static void reloadShader(ShaderReloader *reloader, const char *source) {
+	/* Compiles source then rebuilds every pipeline that uses it. Compiling
+	happens outside the lock, so only the rebuilds hold up frame boundaries */
+	char name[ARCHIVE_NAME_SIZE];
+	snprintf(name, sizeof(name), "%s.spv", source);
+
+	size_t size;
+	uint32_t *code = compileShader(reloader, source, &size);
+
+	if (!code) {
+		fprintf(stderr, "reloadShader: '%s' didn't compile, its pipelines are kept\n", source);
+		return;
+	}
+
+	SDL_LockMutex(reloader->lock);
+
+	storeShader(reloader, name, code, size);
+
+	uint32_t i;
+	for (i = 0; i < reloader->pipelines.count; i++) {
+		ReloadPipeline *pipeline = &reloader->pipelines.data[i];
+		if (usesShader(pipeline, name)) rebuildPipeline(reloader, pipeline);
+	}
+
+	SDL_UnlockMutex(reloader->lock);
+}
+
+static int reloaderThread(void *data) {
+	/* Collects changes until they've been quiet for RELOAD_SETTLE_MS, then
+	reloads them, until the reloader is stopped */
+	ShaderReloader *reloader = data;
+
+	char changed[MAX_RELOADED_SHADERS][ARCHIVE_NAME_SIZE];
+	uint32_t count = 0;
+
+	while (SDL_AtomicGet(&reloader->running)) {
+		struct pollfd fd = {
+			.fd = reloader->inotify,
+			.events = POLLIN,
+		};
+
+		if (poll(&fd, 1, (count) ? RELOAD_SETTLE_MS : RELOAD_POLL_MS) > 0) {
+			count = readChanges(reloader, changed, count);
+			continue;
+		}
+
+		uint32_t i;
+		for (i = 0; i < count; i++) reloadShader(reloader, changed[i]);
+
+		count = 0;
+	}
+
+	return 0;
+}
+
+ShaderReloader *StartShaderReloader(RendererDevice device, const char *directory) {
+	/* Starts watching directory for changed shader sources. SODA_GLSLC names
+	the compiler, glslc by default */
+	ShaderReloader *reloader = calloc(1, sizeof(ShaderReloader));
+	if (!reloader) Panic("StartShaderReloader: unable to allocate ShaderReloader\n");
+
+	if (strlen(directory) >= RELOAD_PATH_SIZE)
+		Panic("StartShaderReloader: '%s' is longer than %d characters\n", directory, RELOAD_PATH_SIZE - 1);
+
+	reloader->device = device;
+	strcpy(reloader->directory, directory);
+
+	const char *compiler = getenv("SODA_GLSLC");
+	reloader->compiler = (compiler) ? compiler : "glslc";
+
+	reloader->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (reloader->inotify < 0) Panic("StartShaderReloader: unable to initialise inotify\n");
+
+	/* Editors that save by renaming a temporary file only produce IN_MOVED_TO */
+	if (inotify_add_watch(reloader->inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		Panic("StartShaderReloader: unable to watch '%s'\n", directory);
+
+	reloader->lock = SDL_CreateMutex();
+	if (!reloader->lock) Panic("StartShaderReloader: unable to create mutex: %s\n", SDL_GetError());
+
+	SDL_AtomicSet(&reloader->running, 1);
+
+	reloader->thread = SDL_CreateThread(reloaderThread, "soda reload", reloader);
+	if (!reloader->thread) Panic("StartShaderReloader: unable to create thread: %s\n", SDL_GetError());
+
+	return reloader;
+}
+
+void StopShaderReloader(ShaderReloader *reloader) {
+	/* Stops the thread and destroys the rebuilt pipelines that were never
+	swapped in. Watched pipelines belong to their owners */
+	const DeviceDispatch *vk = reloader->device.dispatch.device;
+
+	SDL_AtomicSet(&reloader->running, 0);
+	SDL_WaitThread(reloader->thread, NULL);
+
+	uint32_t i;
+	for (i = 0; i < reloader->pipelines.count; i++) {
+		VkPipeline pending = reloader->pipelines.data[i].pending;
+		if (pending) vk->DestroyPipeline(reloader->device.device, pending, NULL);
+	}
+
+	for (i = 0; i < reloader->shaders.count; i++) free(reloader->shaders.data[i].code);
+
+	close(reloader->inotify);
+	SDL_DestroyMutex(reloader->lock);
+	free(reloader);
+}
+
+void WatchPipeline(ShaderReloader *reloader, VkPipeline *pipeline, const char **shaders, uint32_t count, PipelineMethod build, void *data) {
+	/* Rebuilds *pipeline with build whenever one of the shaders, named as in
+	the archive, changes. pipeline and data must stay put until it's unwatched */
+	if (count > MAX_PIPELINE_SHADERS)
+		Panic("WatchPipeline: %u shaders is more than %u\n", count, MAX_PIPELINE_SHADERS);
+
+	SDL_LockMutex(reloader->lock);
+
+	if (reloader->pipelines.count == MAX_RELOAD_PIPELINES)
+		Panic("WatchPipeline: more than %u watched pipelines\n", MAX_RELOAD_PIPELINES);
+
+	ReloadPipeline *watched = &reloader->pipelines.data[reloader->pipelines.count++];
+
+	*watched = (ReloadPipeline) {
+		.pipeline = pipeline,
+		.build = build,
+		.data = data,
+		.count = count,
+	};
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		if (strlen(shaders[i]) >= ARCHIVE_NAME_SIZE)
+			Panic("WatchPipeline: '%s' is longer than %d characters\n", shaders[i], ARCHIVE_NAME_SIZE - 1);
+
+		strcpy(watched->shaders[i], shaders[i]);
+	}
+
+	SDL_UnlockMutex(reloader->lock);
+}
+
+void UnwatchPipeline(ShaderReloader *reloader, VkPipeline *pipeline) {
+	/* Stops rebuilding *pipeline, waiting for a rebuild in progress. A rebuild
+	that wasn't swapped in is destroyed */
+	const DeviceDispatch *vk = reloader->device.dispatch.device;
+
+	SDL_LockMutex(reloader->lock);
+
+	uint32_t i;
+	for (i = 0; i < reloader->pipelines.count; i++) {
+		ReloadPipeline *watched = &reloader->pipelines.data[i];
+		if (watched->pipeline != pipeline) continue;
+
+		if (watched->pending) vk->DestroyPipeline(reloader->device.device, watched->pending, NULL);
+
+		*watched = reloader->pipelines.data[--reloader->pipelines.count];
+		break;
+	}
+
+	SDL_UnlockMutex(reloader->lock);
+}
+
+void ApplyShaderReloads(ShaderReloader *reloader, DeletionQueue *deletions, uint64_t value) {
+	/* Swaps the rebuilt pipelines in, at a frame boundary on the thread that
+	records with them. The old pipelines are deleted once the queue reaches
+	value. It never waits, if the reloader is rebuilding the swap is left to
+	the next frame */
+	if (SDL_TryLockMutex(reloader->lock) != 0) return;
+
+	uint32_t i;
+	for (i = 0; i < reloader->pipelines.count; i++) {
+		ReloadPipeline *watched = &reloader->pipelines.data[i];
+		if (!watched->pending) continue;
+
+		DeleteLater(deletions, DELETE_PIPELINE, (uint64_t) *watched->pipeline, value);
+
+		*watched->pipeline = watched->pending;
+		watched->pending = VK_NULL_HANDLE;
+	}
+
+	SDL_UnlockMutex(reloader->lock);
+}
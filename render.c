@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "drawlist.h"
+#include "events.h"
+#include "frames.h"
+#include "jobs.h"
+#include "panic.h"
+#include "passes.h"
+#include "render.h"
+#include "renderer.h"
+#include "residency.h"
+#include "scaling.h"
+
+/* code */
+
+static int32_t findWindow(RenderThread *render, uint32_t id) {
+	/* Returns the index of the window with the SDL window id, or -1 */
+	uint32_t i;
+	for (i = 0; i < render->window_count; i++)
+		if (render->windows[i].id == id) return i;
+
+	return -1;
+}
+
+static bool handleEvent(RenderThread *render, Frames *windows, SDL_Event *event) {
+	/* Applies event to the Frames of its window and returns false once the
+	thread should quit. Window sizes arrive as drawable pixels, main converts
+	them before pushing */
+	if (event->type == SDL_QUIT) return false;
+	if (event->type != SDL_WINDOWEVENT) return true;
+
+	int32_t index = findWindow(render, event->window.windowID);
+	if (index < 0) return true;
+
+	Frames *frames = &windows[index];
+
+	switch (event->window.event) {
+		case SDL_WINDOWEVENT_SIZE_CHANGED:
+			ResizeFrames(frames, (VkExtent2D) {event->window.data1, event->window.data2});
+			break;
+
+		case SDL_WINDOWEVENT_MINIMIZED:
+			MinimizeFrames(frames, true);
+			break;
+
+		case SDL_WINDOWEVENT_RESTORED:
+		case SDL_WINDOWEVENT_MAXIMIZED:
+		case SDL_WINDOWEVENT_SHOWN:
+			MinimizeFrames(frames, false);
+			break;
+	}
+
+	return true;
+}
+
+static int renderThread(void *data) {
+	/* Drains the event queue then renders a frame for every window, until
+	SDL_QUIT arrives. The windows share the device, and their frames are
+	presented together */
+	RenderThread *render = data;
+	uint32_t count = render->window_count;
+
+	Frames *windows = calloc(count, sizeof(Frames));
+	Scaler *scalers = calloc(count, sizeof(Scaler));
+	DrawList *draws = calloc(count, sizeof(DrawList));
+	if (!windows || !scalers || !draws) Panic("renderThread: unable to allocate %u windows\n", count);
+
+	/* The windows' DrawLists share one pool, they're sorted one at a time */
+	Jobs *jobs = CreateJobs(0);
+	const DeviceDispatch *vk = GetRendererDevice().dispatch.device;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		windows[i] = CreateFrames(GetRendererDevice(), render->windows[i].surface, render->windows[i].extent);
+		scalers[i] = CreateScaler(GetRendererDevice(), RENDER_GPU_BUDGET_MS);
+		draws[i] = CreateDrawList(RENDER_DRAW_CAPACITY, jobs);
+	}
+
+	Residency residency = CreateResidency(GetRendererDevice());
+
+	uint64_t frame_count = 0;
+
+	bool running = true;
+	while (running) {
+		/* Every window is paced, the one that needs its frame soonest sets when
+		they all start as their presents are batched */
+		PaceFrames(windows, count);
+
+		SDL_Event event;
+		while (running && PopEvent(render->events, &event))
+			running = handleEvent(render, windows, &event);
+
+		if (!running) break;
+
+		Frame *frames[MAX_RENDERER_WINDOWS];
+		int32_t last = -1;
+
+		for (i = 0; i < count; i++) {
+			frames[i] = BeginFrame(&windows[i]);
+			if (frames[i]) last = i;
+		}
+
+		/* Minimized windows and surfaces without area both leave nothing to
+		draw, retrying straight away would spin on CreateSwapchain */
+		if (last < 0) {
+			SDL_Delay(RENDER_IDLE_DELAY);
+			continue;
+		}
+
+		/* Released memory waits on the last window's frame, which is submitted
+		after every other frame that could use it */
+		UpdateResidency(&residency, frame_count++, &windows[last].deletions, GetFrameProgress(&windows[last]));
+
+		PresentBatch batch = {};
+
+		for (i = 0; i < count; i++) {
+			if (!frames[i]) continue;
+
+			RenderTarget target = BeginScaledFrame(&scalers[i], &windows[i], frames[i]);
+
+			ResetDrawList(&draws[i]);
+
+			if (render->draw) {
+				RenderContext context = {
+					.window = i,
+					.frame = frame_count - 1,
+					.draws = &draws[i],
+					.command_buffer = frames[i]->command_buffer,
+					.target = &target,
+					.residency = &residency,
+					.deletions = &windows[i].deletions,
+					.value = GetFrameProgress(&windows[i]),
+				};
+
+				render->draw(render->data, &context);
+			}
+
+			SortDrawList(&draws[i]);
+
+			BeginPass(&windows[i].passes, frames[i]->command_buffer, &target);
+			RecordDrawList(&draws[i], vk, frames[i]->command_buffer);
+			EndPass(&windows[i].passes, frames[i]->command_buffer, &target);
+
+			EndScaledFrame(&scalers[i], &windows[i], frames[i]);
+			SubmitFrame(&windows[i], frames[i], &batch);
+		}
+
+		PresentFrames(&batch);
+	}
+
+	DestroyResidency(&residency);
+
+	for (i = 0; i < count; i++) {
+		DestroyDrawList(&draws[i]);
+		DestroyScaler(&scalers[i], &windows[i]);
+		DestroyFrames(&windows[i]);
+	}
+
+	DestroyJobs(jobs);
+
+	free(draws);
+	free(scalers);
+	free(windows);
+
+	return 0;
+}
+
+RenderThread *StartRenderThread(EventQueue *events, const RenderWindow *windows, uint32_t count, RenderMethod draw, void *data) {
+	/* Starts rendering to the count windows on a new thread that consumes
+	events, draw is called with data to fill each window's frames and may be
+	NULL */
+	RenderThread *render = calloc(1, sizeof(RenderThread));
+	if (!render) Panic("StartRenderThread: unable to allocate RenderThread\n");
+
+	if (!count || count > MAX_RENDERER_WINDOWS)
+		Panic("StartRenderThread: %u windows isn't between 1 and %u\n", count, MAX_RENDERER_WINDOWS);
+
+	*render = (RenderThread) {
+		.events = events,
+		.draw = draw,
+		.data = data,
+		.window_count = count,
+	};
+
+	memcpy(render->windows, windows, count * sizeof(RenderWindow));
+
+	render->thread = SDL_CreateThread(renderThread, "soda render", render);
+	if (!render->thread) Panic("StartRenderThread: unable to create thread: %s\n", SDL_GetError());
+
+	return render;
+}
+
+void StopRenderThread(RenderThread *render) {
+	/* Waits for the render thread to finish, an SDL_QUIT must have been pushed */
+	SDL_WaitThread(render->thread, NULL);
+
+	free(render);
+}
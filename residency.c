@@ -0,0 +1,287 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "panic.h"
+#include "renderer.h"
+#include "residency.h"
+
+/* code */
+
+Residency CreateResidency(RendererDevice device) {
+	/* Creates an empty Residency for device's heaps */
+	Residency residency = {
+		.device = device,
+		.spare = NO_RESIDENT,
+	};
+
+	device.dispatch.instance->GetPhysicalDeviceMemoryProperties(device.physical_device, &residency.properties);
+
+	uint32_t i;
+	for (i = 0; i < RESIDENCY_PRIORITIES; i++)
+		residency.lru[i].head = residency.lru[i].tail = NO_RESIDENT;
+
+	return residency;
+}
+
+void DestroyResidency(Residency *residency) {
+	/* Frees the residents, the resources they describe are left to their owners */
+	free(residency->residents);
+
+	*residency = (Residency) {};
+}
+
+static Resident *getResident(Residency *residency, uint32_t index) {
+	/* Returns the resident at index, which must have been added */
+	if (index >= residency->count || !residency->residents[index].demote)
+		Panic("getResident: %u isn't a resident\n", index);
+
+	return &residency->residents[index];
+}
+
+static void unlinkResident(Residency *residency, uint32_t index) {
+	/* Removes the resident from its LRU list */
+	Resident *resident = &residency->residents[index];
+	uint32_t *head = &residency->lru[resident->priority].head;
+	uint32_t *tail = &residency->lru[resident->priority].tail;
+
+	if (resident->prev != NO_RESIDENT) residency->residents[resident->prev].next = resident->next;
+	else *head = resident->next;
+
+	if (resident->next != NO_RESIDENT) residency->residents[resident->next].prev = resident->prev;
+	else *tail = resident->prev;
+
+	resident->prev = resident->next = NO_RESIDENT;
+}
+
+static void appendResident(Residency *residency, uint32_t index) {
+	/* Adds the resident to the most recently used end of its LRU list */
+	Resident *resident = &residency->residents[index];
+	uint32_t *head = &residency->lru[resident->priority].head;
+	uint32_t *tail = &residency->lru[resident->priority].tail;
+
+	resident->prev = *tail;
+	resident->next = NO_RESIDENT;
+
+	if (*tail != NO_RESIDENT) residency->residents[*tail].next = index;
+	else *head = index;
+
+	*tail = index;
+}
+
+static uint32_t allocateResident(Residency *residency) {
+	/* Returns the index of a free resident, growing the array if none are */
+	if (residency->spare != NO_RESIDENT) {
+		uint32_t index = residency->spare;
+		residency->spare = residency->residents[index].next;
+
+		return index;
+	}
+
+	if (residency->count == residency->capacity) {
+		uint32_t capacity = (residency->capacity) ? residency->capacity * 2 : 64;
+
+		Resident *residents = realloc(residency->residents, capacity * sizeof(Resident));
+		if (!residents) Panic("allocateResident: unable to allocate %u Residents\n", capacity);
+
+		residency->residents = residents;
+		residency->capacity = capacity;
+	}
+
+	return residency->count++;
+}
+
+uint32_t AddResident(Residency *residency, ResidentInfo info) {
+	/* Adds a resource that is fully resident and returns its index. Its heap
+	is the one FindMemoryType would allocate info.properties from */
+	if (!info.demote) Panic("AddResident: a DemoteMethod is required\n");
+	if (info.priority >= RESIDENCY_PRIORITIES)
+		Panic("AddResident: priority %u is over %u\n", info.priority, RESIDENCY_PRIORITIES - 1);
+
+	uint32_t type = FindMemoryType(&residency->device, UINT32_MAX, info.properties);
+	if (type == NO_MEMORY_TYPE) Panic("AddResident: no memory type has properties 0x%x\n", info.properties);
+
+	uint32_t index = allocateResident(residency);
+
+	residency->residents[index] = (Resident) {
+		.demote = info.demote,
+		.data = info.data,
+		.size = info.size,
+		.heap = residency->properties.memoryTypes[type].heapIndex,
+		.priority = info.priority,
+		.levels = info.levels,
+		.min_levels = info.min_levels,
+		.used = residency->frame,
+	};
+
+	residency->tracked[residency->residents[index].heap] += info.size;
+	appendResident(residency, index);
+
+	return index;
+}
+
+void RemoveResident(Residency *residency, uint32_t index) {
+	/* Stops tracking the resident, once its owner has destroyed it */
+	Resident *resident = getResident(residency, index);
+
+	if (resident->levels) unlinkResident(residency, index);
+	residency->tracked[resident->heap] -= resident->size;
+
+	*resident = (Resident) {
+		.prev = NO_RESIDENT,
+		.next = residency->spare,
+	};
+
+	residency->spare = index;
+}
+
+uint32_t TouchResident(Residency *residency, uint32_t index, uint64_t frame) {
+	/* Marks the resident as used by frame and returns its resident mip levels,
+	0 if it was evicted and has to be restored before it's used */
+	Resident *resident = getResident(residency, index);
+	resident->used = frame;
+
+	if (resident->levels) {
+		unlinkResident(residency, index);
+		appendResident(residency, index);
+	}
+
+	return resident->levels;
+}
+
+void RestoreResident(Residency *residency, uint32_t index, uint32_t levels, VkDeviceSize size) {
+	/* Records that the owner has made levels mip levels of the resident, size
+	bytes, resident again */
+	Resident *resident = getResident(residency, index);
+
+	if (resident->levels && !levels) unlinkResident(residency, index);
+	if (!resident->levels && levels) appendResident(residency, index);
+
+	residency->tracked[resident->heap] += size - resident->size;
+
+	resident->levels = levels;
+	resident->size = size;
+}
+
+static VkDeviceSize demoteResident(Residency *residency, uint32_t index, uint32_t levels, DeletionQueue *deletions, uint64_t value) {
+	/* Demotes the resident to levels mip levels and returns the bytes released */
+	Resident *resident = &residency->residents[index];
+
+	VkDeviceSize size = resident->demote(resident->data, levels, deletions, value);
+	if (size > resident->size) size = resident->size;
+
+	VkDeviceSize released = resident->size - size;
+	residency->tracked[resident->heap] -= released;
+
+	resident->size = size;
+	resident->levels = levels;
+
+	if (!levels) unlinkResident(residency, index);
+
+	return released;
+}
+
+static VkDeviceSize releaseHeap(Residency *residency, uint32_t heap, VkDeviceSize excess, DeletionQueue *deletions, uint64_t value) {
+	/* Releases at least excess bytes of heap if it can and returns how many it
+	released. Each sweep takes one mip level off the least recently used
+	residents first, and a priority is exhausted before the next is touched.
+	Residents used by the current frame are never released */
+	VkDeviceSize released = 0;
+
+	uint32_t priority;
+	for (priority = 0; priority < RESIDENCY_PRIORITIES && released < excess; priority++) {
+		bool progress = true;
+
+		while (progress && released < excess) {
+			progress = false;
+
+			uint32_t index = residency->lru[priority].head;
+			while (index != NO_RESIDENT && released < excess) {
+				Resident *resident = &residency->residents[index];
+				uint32_t next = resident->next;
+
+				/* the rest of the list was used more recently still */
+				if (resident->used >= residency->frame) break;
+
+				if (resident->heap == heap && resident->levels > resident->min_levels) {
+					released += demoteResident(residency, index, resident->levels - 1, deletions, value);
+					progress = true;
+				}
+
+				index = next;
+			}
+		}
+	}
+
+	return released;
+}
+
+static void updateBudget(Residency *residency) {
+	/* Queries the usage and budget of every heap. The driver's usage doesn't
+	drop until released memory has been deleted, so recent releases are taken
+	off it */
+	MemoryBudget *budget = &residency->budget;
+	VkMemoryHeap *heaps = residency->properties.memoryHeaps;
+	budget->count = residency->properties.memoryHeapCount;
+
+	uint32_t i;
+	if (!residency->device.supports.memory_budget) {
+		for (i = 0; i < budget->count; i++) {
+			budget->budget[i] = (VkDeviceSize) (heaps[i].size * FALLBACK_BUDGET);
+			budget->usage[i] = residency->tracked[i];
+		}
+
+		return;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+
+	VkPhysicalDeviceMemoryProperties2 properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &memory_budget,
+	};
+
+	residency->device.dispatch.instance->GetPhysicalDeviceMemoryProperties2(residency->device.physical_device, &properties);
+
+	for (i = 0; i < budget->count; i++) {
+		VkDeviceSize usage = memory_budget.heapUsage[i];
+
+		uint32_t j;
+		for (j = 0; j < RESIDENCY_LATENCY; j++)
+			usage -= (residency->released[j][i] < usage) ? residency->released[j][i] : usage;
+
+		budget->budget[i] = memory_budget.heapBudget[i];
+		budget->usage[i] = usage;
+	}
+}
+
+void UpdateResidency(Residency *residency, uint64_t frame, DeletionQueue *deletions, uint64_t value) {
+	/* Updates the budget at the start of frame, then releases residents from
+	every heap that went over RESIDENCY_HIGH_WATER of its budget. Their memory
+	is deleted once deletions reaches value */
+	residency->frame = frame;
+
+	VkDeviceSize *released = residency->released[frame % RESIDENCY_LATENCY];
+	memset(released, 0, sizeof(residency->released[0]));
+
+	updateBudget(residency);
+
+	MemoryBudget *budget = &residency->budget;
+
+	uint32_t i;
+	for (i = 0; i < budget->count; i++) {
+		if (budget->usage[i] <= (VkDeviceSize) (budget->budget[i] * RESIDENCY_HIGH_WATER)) continue;
+
+		VkDeviceSize low = (VkDeviceSize) (budget->budget[i] * RESIDENCY_LOW_WATER);
+		VkDeviceSize freed = releaseHeap(residency, i, budget->usage[i] - low, deletions, value);
+
+		released[i] += freed;
+		budget->usage[i] -= (freed < budget->usage[i]) ? freed : budget->usage[i];
+	}
+}
@@ -0,0 +1,257 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion.h"
+#include "frames.h"
+#include "panic.h"
+#include "passes.h"
+#include "renderer.h"
+#include "scaling.h"
+#include "textures.h"
+
+/* code */
+
+static uint32_t getTimestampBits(RendererDevice *device) {
+	/* Returns the valid bits of timestamps on the graphics queue, 0 if it
+	can't write them */
+	const InstanceDispatch *instance = device->dispatch.instance;
+
+	uint32_t count = 0;
+	instance->GetPhysicalDeviceQueueFamilyProperties(device->physical_device, &count, NULL);
+
+	VkQueueFamilyProperties *families = malloc(count * sizeof(VkQueueFamilyProperties));
+	if (!families) Panic("getTimestampBits: unable to allocate %u VkQueueFamilyProperties\n", count);
+
+	instance->GetPhysicalDeviceQueueFamilyProperties(device->physical_device, &count, families);
+	uint32_t bits = families[device->family.graphics].timestampValidBits;
+
+	free(families);
+	return bits;
+}
+
+Scaler CreateScaler(RendererDevice device, double target_ms) {
+	/* Creates a Scaler that holds the GPU time of frames at target_ms */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	Scaler scaler = {
+		.device = device,
+		.target = target_ms * 1e6,
+		.scale = MAX_RENDER_SCALE,
+	};
+
+	uint32_t bits = getTimestampBits(&device);
+	if (!bits) return scaler;
+
+	VkPhysicalDeviceProperties properties;
+	device.dispatch.instance->GetPhysicalDeviceProperties(device.physical_device, &properties);
+
+	scaler.period = properties.limits.timestampPeriod;
+	scaler.mask = (bits < 64) ? (1ull << bits) - 1 : UINT64_MAX;
+
+	/* Each frame in flight has a query before and after its work */
+	VkQueryPoolCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = 2 * FRAMES_IN_FLIGHT,
+	};
+
+	if (vk->CreateQueryPool(device.device, &create_info, NULL, &scaler.queries) != VK_SUCCESS)
+		Panic("CreateScaler: unable to create VkQueryPool\n");
+
+	scaler.timestamps = true;
+
+	return scaler;
+}
+
+void DestroyScaler(Scaler *scaler, Frames *frames) {
+	/* Destroys the scaler once the frames it drew have finished, frames must
+	be destroyed after it */
+	uint64_t value = GetFrameProgress(frames);
+
+	if (scaler->texture.image) {
+		RetirePassView(&frames->passes, scaler->texture.view, &frames->deletions, value);
+		DeleteTextureLater(&frames->deletions, &scaler->texture, value);
+	}
+
+	if (scaler->queries) DeleteLater(&frames->deletions, DELETE_QUERY_POOL, (uint64_t) scaler->queries, value);
+
+	*scaler = (Scaler) {};
+}
+
+static void adjustScale(Scaler *scaler, uint64_t frame) {
+	/* Moves the scale part of the way to the one predicted to hit the target.
+	GPU time follows the pixel count, which is the square of the scale */
+	double ratio = scaler->target / scaler->gpu;
+	if (fabs(ratio - 1.0) < SCALING_DEADBAND) return;
+
+	double predicted = scaler->scale * sqrt(ratio);
+	double scale = scaler->scale + (predicted - scaler->scale) * SCALING_GAIN;
+
+	/* Outside the deadband the scale always moves at least one step */
+	scale = round(scale * RENDER_SCALE_STEPS) / RENDER_SCALE_STEPS;
+	if (scale == scaler->scale)
+		scale += ((ratio > 1.0) ? 1.0 : -1.0) / RENDER_SCALE_STEPS;
+
+	if (scale < MIN_RENDER_SCALE) scale = MIN_RENDER_SCALE;
+	if (scale > MAX_RENDER_SCALE) scale = MAX_RENDER_SCALE;
+	if (scale == scaler->scale) return;
+
+	/* Frames in flight were drawn at the old scale, their times are ignored */
+	scaler->scale = scale;
+	scaler->settled = frame;
+	scaler->gpu = 0.0;
+}
+
+static void measureFrame(Scaler *scaler, uint32_t slot) {
+	/* Reads the timestamps of the last frame drawn in slot, whose fence has
+	been waited on, and feeds its GPU time to the controller */
+	const DeviceDispatch *vk = scaler->device.dispatch.device;
+
+	if (!scaler->pending[slot]) return;
+
+	uint64_t frame = scaler->pending[slot] - 1;
+	scaler->pending[slot] = 0;
+
+	uint64_t ticks[2];
+	VkResult result = vk->GetQueryPoolResults(scaler->device.device, scaler->queries, 2 * slot, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS || frame < scaler->settled) return;
+
+	double gpu = (double) ((ticks[1] - ticks[0]) & scaler->mask) * scaler->period;
+
+	scaler->gpu = (scaler->gpu > 0.0) ? scaler->gpu + (gpu - scaler->gpu) * SCALING_SMOOTHING : gpu;
+	adjustScale(scaler, frame + FRAMES_IN_FLIGHT);
+}
+
+static void resizeTexture(Scaler *scaler, Frames *frames) {
+	/* Replaces the texture when the swapchain's extent or format changed, the
+	old one is retired with the frames that used it */
+	Swapchain *swapchain = &frames->swapchain;
+	Texture *texture = &scaler->texture;
+
+	bool matches = texture->image && texture->format == swapchain->format.format &&
+		texture->extent.width == swapchain->extent.width && texture->extent.height == swapchain->extent.height;
+
+	if (matches) return;
+
+	if (texture->image) {
+		uint64_t value = GetFrameProgress(frames);
+
+		RetirePassView(&frames->passes, texture->view, &frames->deletions, value);
+		DeleteTextureLater(&frames->deletions, texture, value);
+	}
+
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	*texture = CreateTexture(&scaler->device, swapchain->extent, swapchain->format.format, usage);
+}
+
+static uint32_t scaleAxis(uint32_t size, double scale) {
+	/* Returns size scaled, at least 1 */
+	uint32_t scaled = (uint32_t) (size * scale + 0.5);
+	return (scaled) ? scaled : 1;
+}
+
+RenderTarget BeginScaledFrame(Scaler *scaler, Frames *frames, Frame *frame) {
+	/* Returns the target to draw the frame into, call it first in the frame's
+	command buffer so the GPU time covers all of its work. The target is the
+	swapchain image when the frame can't be scaled */
+	const DeviceDispatch *vk = scaler->device.dispatch.device;
+
+	RenderTarget target = GetFrameTarget(frames, frame);
+
+	scaler->scaled = scaler->timestamps && (frames->swapchain.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	if (!scaler->scaled) return target;
+
+	uint32_t slot = frames->frame % FRAMES_IN_FLIGHT;
+	measureFrame(scaler, slot);
+
+	vk->CmdResetQueryPool(frame->command_buffer, scaler->queries, 2 * slot, 2);
+	vk->CmdWriteTimestamp(frame->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, scaler->queries, 2 * slot);
+	scaler->pending[slot] = frames->frame + 1;
+
+	resizeTexture(scaler, frames);
+
+	scaler->extent = (VkExtent2D) {
+		scaleAxis(target.extent.width, scaler->scale),
+		scaleAxis(target.extent.height, scaler->scale),
+	};
+
+	/* The pass discards the texture, this only orders it after the blit of
+	the previous frame */
+	TransitionTexture(vk, frame->command_buffer, &scaler->texture, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+	return (RenderTarget) {
+		.image = scaler->texture.image,
+		.view = scaler->texture.view,
+		.format = scaler->texture.format,
+		.extent = scaler->extent,
+		.load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.clear = target.clear,
+		.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	};
+}
+
+void EndScaledFrame(Scaler *scaler, Frames *frames, Frame *frame) {
+	/* Blits the drawn frame up to the swapchain image, leaving it ready to
+	present, after the pass into the target has ended */
+	const DeviceDispatch *vk = scaler->device.dispatch.device;
+
+	if (!scaler->scaled) return;
+
+	/* The pass left the texture in its final layout */
+	scaler->texture.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	RenderTarget target = GetFrameTarget(frames, frame);
+
+	VkImageSubresourceRange range = {
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = 1,
+		.layerCount = 1,
+	};
+
+	/* The acquire semaphore is waited on at colour attachment output, the
+	barrier chains the blit after it */
+	VkImageMemoryBarrier acquire = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = target.image,
+		.subresourceRange = range,
+	};
+
+	vk->CmdPipelineBarrier(frame->command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &acquire);
+
+	VkImageBlit blit = {
+		.srcSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+		.srcOffsets = {{0, 0, 0}, {scaler->extent.width, scaler->extent.height, 1}},
+		.dstSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+		.dstOffsets = {{0, 0, 0}, {target.extent.width, target.extent.height, 1}},
+	};
+
+	bool scaled = scaler->extent.width != target.extent.width || scaler->extent.height != target.extent.height;
+	VkFilter filter = (scaled) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+	vk->CmdBlitImage(frame->command_buffer, scaler->texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+
+	VkImageMemoryBarrier present = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = target.image,
+		.subresourceRange = range,
+	};
+
+	vk->CmdPipelineBarrier(frame->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &present);
+
+	uint32_t slot = frames->frame % FRAMES_IN_FLIGHT;
+	vk->CmdWriteTimestamp(frame->command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, scaler->queries, 2 * slot + 1);
+}
@@ -0,0 +1,675 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "jobs.h"
+#include "panic.h"
+#include "scene.h"
+
+/* constants */
+
+/* Arrays are aligned for the widest SIMD loads */
+#define SCENE_ALIGNMENT 32
+
+/* Arrays in SceneNodes that are set through handles, and that the update
+writes */
+#define LOCAL_FLOATS 12
+#define WORLD_FLOATS 17
+
+/* macros */
+
+/* The math of the kernels is written once for floats and for vectors of
+them, which take the same operators */
+
+#define LOCAL_MATRIX(m, x, y, z, w, s, px, py, pz) do { \
+	(m)[0] = (s) * (1.0f - 2.0f * ((y) * (y) + (z) * (z))); \
+	(m)[1] = (s) * 2.0f * ((x) * (y) - (w) * (z)); \
+	(m)[2] = (s) * 2.0f * ((x) * (z) + (w) * (y)); \
+	(m)[3] = (px); \
+	(m)[4] = (s) * 2.0f * ((x) * (y) + (w) * (z)); \
+	(m)[5] = (s) * (1.0f - 2.0f * ((x) * (x) + (z) * (z))); \
+	(m)[6] = (s) * 2.0f * ((y) * (z) - (w) * (x)); \
+	(m)[7] = (py); \
+	(m)[8] = (s) * 2.0f * ((x) * (z) - (w) * (y)); \
+	(m)[9] = (s) * 2.0f * ((y) * (z) + (w) * (x)); \
+	(m)[10] = (s) * (1.0f - 2.0f * ((x) * (x) + (y) * (y))); \
+	(m)[11] = (pz); \
+} while (0)
+
+#define COMPOSE(world, parent, local) do { \
+	uint32_t row_, column_; \
+	for (row_ = 0; row_ < 3; row_++) { \
+		for (column_ = 0; column_ < 4; column_++) { \
+			(world)[row_ * 4 + column_] = (parent)[row_ * 4] * (local)[column_] + \
+				(parent)[row_ * 4 + 1] * (local)[4 + column_] + \
+				(parent)[row_ * 4 + 2] * (local)[8 + column_]; \
+		} \
+		(world)[row_ * 4 + 3] += (parent)[row_ * 4 + 3]; \
+	} \
+} while (0)
+
+#define TRANSFORM(out, m, x, y, z) do { \
+	(out)[0] = (m)[0] * (x) + (m)[1] * (y) + (m)[2] * (z) + (m)[3]; \
+	(out)[1] = (m)[4] * (x) + (m)[5] * (y) + (m)[6] * (z) + (m)[7]; \
+	(out)[2] = (m)[8] * (x) + (m)[9] * (y) + (m)[10] * (z) + (m)[11]; \
+} while (0)
+
+#define PLANE_DISTANCE(plane, x, y, z, r) \
+	((x) * (plane)[0] + (y) * (plane)[1] + (z) * (plane)[2] + (plane)[3] + (r))
+
+/* types */
+
+typedef float Float4 __attribute__((vector_size(16)));
+typedef int32_t Int4 __attribute__((vector_size(16)));
+typedef float Float8 __attribute__((vector_size(32)));
+typedef int32_t Int8 __attribute__((vector_size(32)));
+
+typedef struct {
+	/* SceneJob is an update or a cull of the slots [start, end), one chunk of
+	SCENE_CHUNK slots per job */
+	Scene *scene;
+	uint32_t start, end;
+	bool root;
+	const float (*planes)[4];
+} SceneJob;
+
+/* code */
+
+static void *allocArray(uint32_t capacity, size_t size) {
+	/* Allocates an array of capacity elements aligned for SIMD */
+	size_t bytes = (size_t) capacity * size;
+	bytes = (bytes + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+
+	void *data = aligned_alloc(SCENE_ALIGNMENT, (bytes) ? bytes : SCENE_ALIGNMENT);
+	if (!data) Panic("scene/allocArray: unable to allocate %u elements\n", capacity);
+
+	return data;
+}
+
+static void *growArray(void *data, uint32_t count, uint32_t capacity, size_t size) {
+	/* Moves the first count elements of data into a new array of capacity */
+	void *grown = allocArray(capacity, size);
+
+	if (data) memcpy(grown, data, (size_t) count * size);
+	free(data);
+
+	return grown;
+}
+
+static uint32_t listLocals(SceneNodes *nodes, float **fields[LOCAL_FLOATS]) {
+	/* Lists the arrays set through handles, they move when slots are sorted */
+	uint32_t count = 0, i;
+
+	for (i = 0; i < 3; i++) fields[count++] = &nodes->position[i];
+	for (i = 0; i < 4; i++) fields[count++] = &nodes->rotation[i];
+	fields[count++] = &nodes->scale;
+	for (i = 0; i < 3; i++) fields[count++] = &nodes->centre[i];
+	fields[count++] = &nodes->radius;
+
+	return count;
+}
+
+static uint32_t listWorlds(SceneNodes *nodes, float **fields[WORLD_FLOATS]) {
+	/* Lists the arrays written by the update */
+	uint32_t count = 0, i;
+
+	for (i = 0; i < 12; i++) fields[count++] = &nodes->world[i];
+	fields[count++] = &nodes->world_scale;
+	for (i = 0; i < 4; i++) fields[count++] = &nodes->world_bounds[i];
+
+	return count;
+}
+
+static void reserveScene(Scene *scene, uint32_t capacity) {
+	/* Grows every array so the scene holds at least capacity nodes */
+	if (capacity <= scene->capacity) return;
+
+	if (capacity < scene->capacity * 2) capacity = scene->capacity * 2;
+
+	SceneNodes *nodes = &scene->nodes;
+	float **locals[LOCAL_FLOATS], **worlds[WORLD_FLOATS];
+
+	uint32_t i;
+	for (i = 0; i < listLocals(nodes, locals); i++)
+		*locals[i] = growArray(*locals[i], scene->count, capacity, sizeof(float));
+
+	for (i = 0; i < listWorlds(nodes, worlds); i++)
+		*worlds[i] = growArray(*worlds[i], scene->count, capacity, sizeof(float));
+
+	nodes->handle = growArray(nodes->handle, scene->count, capacity, sizeof(uint32_t));
+	nodes->parent = growArray(nodes->parent, scene->count, capacity, sizeof(uint32_t));
+
+	scene->handles.slots = growArray(scene->handles.slots, scene->count, capacity, sizeof(uint32_t));
+	scene->handles.parents = growArray(scene->handles.parents, scene->count, capacity, sizeof(uint32_t));
+	scene->handles.depths = growArray(scene->handles.depths, scene->count, capacity, sizeof(uint32_t));
+
+	uint32_t chunks = (capacity + SCENE_CHUNK - 1) / SCENE_CHUNK;
+
+	scene->scratch.floats = growArray(scene->scratch.floats, 0, capacity, sizeof(float));
+	scene->scratch.uints = growArray(scene->scratch.uints, 0, capacity, sizeof(uint32_t));
+	scene->scratch.visible = growArray(scene->scratch.visible, 0, capacity, sizeof(uint32_t));
+	scene->scratch.counts = growArray(scene->scratch.counts, 0, chunks, sizeof(uint32_t));
+
+	scene->capacity = capacity;
+}
+
+static SceneSimd detectSimd() {
+	/* Returns the widest kernels the CPU can run */
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SCENE_SIMD_AVX2;
+
+	return SCENE_SIMD_128;
+#elif defined(__aarch64__)
+	return SCENE_SIMD_128;
+#else
+	return SCENE_SIMD_SCALAR;
+#endif
+}
+
+Scene CreateScene(uint32_t capacity, Jobs *jobs) {
+	/* Creates an empty scene with room for capacity nodes, jobs may be NULL to
+	update and cull on the calling thread. It uses the widest kernels the CPU
+	runs, so one binary suits every machine */
+	Scene scene = {
+		.jobs = jobs,
+		.simd = detectSimd(),
+		.sorted = true,
+	};
+
+	reserveScene(&scene, (capacity) ? capacity : 1);
+
+	return scene;
+}
+
+void DestroyScene(Scene *scene) {
+	SceneNodes *nodes = &scene->nodes;
+	float **locals[LOCAL_FLOATS], **worlds[WORLD_FLOATS];
+
+	uint32_t i;
+	for (i = 0; i < listLocals(nodes, locals); i++) free(*locals[i]);
+	for (i = 0; i < listWorlds(nodes, worlds); i++) free(*worlds[i]);
+
+	free(nodes->handle);
+	free(nodes->parent);
+	free(scene->handles.slots);
+	free(scene->handles.parents);
+	free(scene->handles.depths);
+	free(scene->scratch.floats);
+	free(scene->scratch.uints);
+	free(scene->scratch.visible);
+	free(scene->scratch.counts);
+
+	*scene = (Scene) {};
+}
+
+bool SetSceneSimd(Scene *scene, SceneSimd simd) {
+	/* Uses the kernels of simd from now on, if the CPU can run them */
+	if (simd > detectSimd()) return false;
+
+	scene->simd = simd;
+	return true;
+}
+
+const char *GetSceneSimdName(SceneSimd simd) {
+	switch (simd) {
+		case SCENE_SIMD_SCALAR:
+			return "scalar";
+
+		case SCENE_SIMD_128:
+#if defined(__aarch64__)
+			return "neon";
+#else
+			return "sse2";
+#endif
+
+		case SCENE_SIMD_AVX2:
+			return "avx2";
+	}
+
+	return "unknown";
+}
+
+uint32_t AddSceneNode(Scene *scene, uint32_t parent) {
+	/* Adds a node with an identity transform and empty bounds under parent,
+	which is NO_SCENE_NODE for a root. Returns the node's handle */
+	if (parent != NO_SCENE_NODE && parent >= scene->count)
+		Panic("AddSceneNode: there is no node %u\n", parent);
+
+	uint32_t depth = (parent == NO_SCENE_NODE) ? 0 : scene->handles.depths[parent] + 1;
+	if (depth == MAX_SCENE_DEPTH) Panic("AddSceneNode: nodes can't be more than %u deep\n", MAX_SCENE_DEPTH);
+
+	reserveScene(scene, scene->count + 1);
+
+	/* The node's slot is appended, which only stays in depth order if the
+	node is the deepest so far */
+	uint32_t node = scene->count++;
+	uint32_t last = (node) ? scene->handles.depths[scene->nodes.handle[node - 1]] : 0;
+
+	scene->sorted = scene->sorted && depth >= last;
+	scene->handles.slots[node] = node;
+	scene->handles.parents[node] = parent;
+	scene->handles.depths[node] = depth;
+
+	scene->nodes.handle[node] = node;
+	scene->nodes.parent[node] = (parent == NO_SCENE_NODE) ? NO_SCENE_NODE : scene->handles.slots[parent];
+
+	float position[3] = {0.0f, 0.0f, 0.0f}, rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	SetSceneTransform(scene, node, position, rotation, 1.0f);
+	SetSceneBounds(scene, node, position, 0.0f);
+
+	/* Levels are rebuilt on sorting, otherwise the new slot ends the last */
+	if (scene->sorted) {
+		if (depth == scene->levels.count) scene->levels.first[scene->levels.count++] = node;
+		scene->levels.first[scene->levels.count] = scene->count;
+	}
+
+	return node;
+}
+
+void SetSceneTransform(Scene *scene, uint32_t node, const float position[3], const float rotation[4], float scale) {
+	/* Sets the transform of node relative to its parent, rotation is a unit
+	quaternion x, y, z, w. It reaches the world matrices at the next
+	UpdateScene */
+	if (node >= scene->count) Panic("SetSceneTransform: there is no node %u\n", node);
+
+	SceneNodes *nodes = &scene->nodes;
+	uint32_t slot = scene->handles.slots[node], i;
+
+	for (i = 0; i < 3; i++) nodes->position[i][slot] = position[i];
+	for (i = 0; i < 4; i++) nodes->rotation[i][slot] = rotation[i];
+	nodes->scale[slot] = scale;
+}
+
+void SetSceneBounds(Scene *scene, uint32_t node, const float centre[3], float radius) {
+	/* Sets the bounding sphere of node in its own space */
+	if (node >= scene->count) Panic("SetSceneBounds: there is no node %u\n", node);
+
+	SceneNodes *nodes = &scene->nodes;
+	uint32_t slot = scene->handles.slots[node], i;
+
+	for (i = 0; i < 3; i++) nodes->centre[i][slot] = centre[i];
+	nodes->radius[slot] = radius;
+}
+
+static void sortScene(Scene *scene) {
+	/* Moves the slots into depth order with a counting sort. Nodes keep their
+	order within a depth */
+	SceneNodes *nodes = &scene->nodes;
+	uint32_t first[MAX_SCENE_DEPTH + 1] = {};
+	uint32_t *slots = scene->handles.slots, *depths = scene->handles.depths;
+
+	uint32_t node, depth;
+	for (node = 0; node < scene->count; node++) first[depths[node] + 1]++;
+
+	scene->levels.count = 0;
+	for (depth = 0; depth < MAX_SCENE_DEPTH; depth++) {
+		if (first[depth + 1]) scene->levels.count = depth + 1;
+		first[depth + 1] += first[depth];
+	}
+
+	memcpy(scene->levels.first, first, sizeof(first));
+	scene->levels.first[scene->levels.count] = scene->count;
+
+	/* moved is the new slot of each node */
+	uint32_t *moved = scene->scratch.uints;
+	for (node = 0; node < scene->count; node++) moved[node] = first[depths[node]]++;
+
+	float **locals[LOCAL_FLOATS];
+
+	uint32_t i;
+	for (i = 0; i < listLocals(nodes, locals); i++) {
+		float *from = *locals[i], *to = scene->scratch.floats;
+
+		for (node = 0; node < scene->count; node++) to[moved[node]] = from[slots[node]];
+
+		*locals[i] = to;
+		scene->scratch.floats = from;
+	}
+
+	for (node = 0; node < scene->count; node++) {
+		slots[node] = moved[node];
+		nodes->handle[slots[node]] = node;
+	}
+
+	for (node = 0; node < scene->count; node++) {
+		uint32_t parent = scene->handles.parents[node];
+		nodes->parent[slots[node]] = (parent == NO_SCENE_NODE) ? NO_SCENE_NODE : slots[parent];
+	}
+
+	scene->sorted = true;
+}
+
+static void updateScalar(SceneNodes *nodes, uint32_t start, uint32_t end, bool root) {
+	/* Updates the world matrices and bounds of the slots one at a time */
+	uint32_t i, j;
+	for (i = start; i < end; i++) {
+		float local[12], world[12], bounds[3];
+
+		float x = nodes->rotation[0][i], y = nodes->rotation[1][i], z = nodes->rotation[2][i], w = nodes->rotation[3][i];
+		float scale = nodes->scale[i];
+
+		LOCAL_MATRIX(local, x, y, z, w, scale, nodes->position[0][i], nodes->position[1][i], nodes->position[2][i]);
+
+		if (root) {
+			memcpy(world, local, sizeof(world));
+		} else {
+			uint32_t p = nodes->parent[i];
+			float parent[12];
+
+			for (j = 0; j < 12; j++) parent[j] = nodes->world[j][p];
+
+			COMPOSE(world, parent, local);
+			scale *= nodes->world_scale[p];
+		}
+
+		TRANSFORM(bounds, world, nodes->centre[0][i], nodes->centre[1][i], nodes->centre[2][i]);
+
+		for (j = 0; j < 12; j++) nodes->world[j][i] = world[j];
+		for (j = 0; j < 3; j++) nodes->world_bounds[j][i] = bounds[j];
+
+		nodes->world_scale[i] = scale;
+		nodes->world_bounds[3][i] = nodes->radius[i] * scale;
+	}
+}
+
+static uint32_t cullScalar(SceneNodes *nodes, const float planes[6][4], uint32_t start, uint32_t end, uint32_t *visible) {
+	/* Writes the handles of the slots whose bounds touch the frustum, one slot
+	at a time, and returns how many there are */
+	uint32_t count = 0, i, j;
+	for (i = start; i < end; i++) {
+		float x = nodes->world_bounds[0][i], y = nodes->world_bounds[1][i];
+		float z = nodes->world_bounds[2][i], r = nodes->world_bounds[3][i];
+
+		bool inside = true;
+		for (j = 0; j < 6; j++) inside = inside && PLANE_DISTANCE(planes[j], x, y, z, r) >= 0.0f;
+
+		if (inside) visible[count++] = nodes->handle[i];
+	}
+
+	return count;
+}
+
+static inline Float4 load4(const float *data) {
+	Float4 vector;
+	memcpy(&vector, data, sizeof(vector));
+
+	return vector;
+}
+
+static inline void store4(float *data, Float4 vector) {
+	memcpy(data, &vector, sizeof(vector));
+}
+
+static inline Float4 gather4(const float *data, const uint32_t *indices) {
+	return (Float4) {data[indices[0]], data[indices[1]], data[indices[2]], data[indices[3]]};
+}
+
+static void update128(SceneNodes *nodes, uint32_t start, uint32_t end, bool root) {
+	/* Updates 4 slots at a time with 128 bit vectors, the compiler emits SSE2
+	or NEON for them */
+	uint32_t i, j;
+	for (i = start; i + 4 <= end; i += 4) {
+		Float4 local[12], world[12], bounds[3];
+
+		Float4 x = load4(nodes->rotation[0] + i), y = load4(nodes->rotation[1] + i);
+		Float4 z = load4(nodes->rotation[2] + i), w = load4(nodes->rotation[3] + i);
+		Float4 scale = load4(nodes->scale + i);
+
+		LOCAL_MATRIX(local, x, y, z, w, scale, load4(nodes->position[0] + i), load4(nodes->position[1] + i), load4(nodes->position[2] + i));
+
+		if (root) {
+			memcpy(world, local, sizeof(world));
+		} else {
+			const uint32_t *p = nodes->parent + i;
+			Float4 parent[12];
+
+			for (j = 0; j < 12; j++) parent[j] = gather4(nodes->world[j], p);
+
+			COMPOSE(world, parent, local);
+			scale *= gather4(nodes->world_scale, p);
+		}
+
+		TRANSFORM(bounds, world, load4(nodes->centre[0] + i), load4(nodes->centre[1] + i), load4(nodes->centre[2] + i));
+
+		for (j = 0; j < 12; j++) store4(nodes->world[j] + i, world[j]);
+		for (j = 0; j < 3; j++) store4(nodes->world_bounds[j] + i, bounds[j]);
+
+		store4(nodes->world_scale + i, scale);
+		store4(nodes->world_bounds[3] + i, load4(nodes->radius + i) * scale);
+	}
+
+	updateScalar(nodes, i, end, root);
+}
+
+static uint32_t cull128(SceneNodes *nodes, const float planes[6][4], uint32_t start, uint32_t end, uint32_t *visible) {
+	/* Culls 4 slots at a time with 128 bit vectors. Handles are written
+	without branching and only kept if they're visible */
+	uint32_t count = 0, i, j, k;
+	for (i = start; i + 4 <= end; i += 4) {
+		Float4 x = load4(nodes->world_bounds[0] + i), y = load4(nodes->world_bounds[1] + i);
+		Float4 z = load4(nodes->world_bounds[2] + i), r = load4(nodes->world_bounds[3] + i);
+		Float4 zero = {};
+
+		Int4 inside = {-1, -1, -1, -1};
+		for (j = 0; j < 6; j++) inside &= PLANE_DISTANCE(planes[j], x, y, z, r) >= zero;
+
+		for (k = 0; k < 4; k++) {
+			visible[count] = nodes->handle[i + k];
+			count -= inside[k];
+		}
+	}
+
+	return count + cullScalar(nodes, planes, i, end, visible + count);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma")))
+static void updateAvx2(SceneNodes *nodes, uint32_t start, uint32_t end, bool root) {
+	/* Updates 8 slots at a time with AVX2, parents are fetched with gathers */
+	uint32_t i, j;
+	for (i = start; i + 8 <= end; i += 8) {
+		Float8 local[12], world[12], bounds[3];
+
+		Float8 x = (Float8) _mm256_loadu_ps(nodes->rotation[0] + i), y = (Float8) _mm256_loadu_ps(nodes->rotation[1] + i);
+		Float8 z = (Float8) _mm256_loadu_ps(nodes->rotation[2] + i), w = (Float8) _mm256_loadu_ps(nodes->rotation[3] + i);
+		Float8 scale = (Float8) _mm256_loadu_ps(nodes->scale + i);
+
+		Float8 px = (Float8) _mm256_loadu_ps(nodes->position[0] + i);
+		Float8 py = (Float8) _mm256_loadu_ps(nodes->position[1] + i);
+		Float8 pz = (Float8) _mm256_loadu_ps(nodes->position[2] + i);
+
+		LOCAL_MATRIX(local, x, y, z, w, scale, px, py, pz);
+
+		if (root) {
+			memcpy(world, local, sizeof(world));
+		} else {
+			__m256i p = _mm256_loadu_si256((const __m256i *) (nodes->parent + i));
+			Float8 parent[12];
+
+			for (j = 0; j < 12; j++) parent[j] = (Float8) _mm256_i32gather_ps(nodes->world[j], p, sizeof(float));
+
+			COMPOSE(world, parent, local);
+			scale *= (Float8) _mm256_i32gather_ps(nodes->world_scale, p, sizeof(float));
+		}
+
+		Float8 cx = (Float8) _mm256_loadu_ps(nodes->centre[0] + i);
+		Float8 cy = (Float8) _mm256_loadu_ps(nodes->centre[1] + i);
+		Float8 cz = (Float8) _mm256_loadu_ps(nodes->centre[2] + i);
+
+		TRANSFORM(bounds, world, cx, cy, cz);
+
+		for (j = 0; j < 12; j++) _mm256_storeu_ps(nodes->world[j] + i, (__m256) world[j]);
+		for (j = 0; j < 3; j++) _mm256_storeu_ps(nodes->world_bounds[j] + i, (__m256) bounds[j]);
+
+		_mm256_storeu_ps(nodes->world_scale + i, (__m256) scale);
+		_mm256_storeu_ps(nodes->world_bounds[3] + i, (__m256) ((Float8) _mm256_loadu_ps(nodes->radius + i) * scale));
+	}
+
+	updateScalar(nodes, i, end, root);
+}
+
+__attribute__((target("avx2,fma")))
+static uint32_t cullAvx2(SceneNodes *nodes, const float planes[6][4], uint32_t start, uint32_t end, uint32_t *visible) {
+	/* Culls 8 slots at a time with AVX2, batches with nothing visible are
+	skipped after one movemask */
+	uint32_t count = 0, i, j;
+	for (i = start; i + 8 <= end; i += 8) {
+		Float8 x = (Float8) _mm256_loadu_ps(nodes->world_bounds[0] + i), y = (Float8) _mm256_loadu_ps(nodes->world_bounds[1] + i);
+		Float8 z = (Float8) _mm256_loadu_ps(nodes->world_bounds[2] + i), r = (Float8) _mm256_loadu_ps(nodes->world_bounds[3] + i);
+		Float8 zero = {};
+
+		Int8 inside = {-1, -1, -1, -1, -1, -1, -1, -1};
+		for (j = 0; j < 6; j++) inside &= PLANE_DISTANCE(planes[j], x, y, z, r) >= zero;
+
+		uint32_t mask = (uint32_t) _mm256_movemask_ps((__m256) inside);
+		while (mask) {
+			visible[count++] = nodes->handle[i + __builtin_ctz(mask)];
+			mask &= mask - 1;
+		}
+	}
+
+	return count + cullScalar(nodes, planes, i, end, visible + count);
+}
+#endif
+
+static void updateChunk(void *data, uint32_t index) {
+	/* Updates one chunk of a depth with the scene's kernels */
+	SceneJob *job = data;
+	SceneNodes *nodes = &job->scene->nodes;
+
+	uint32_t start = job->start + index * SCENE_CHUNK;
+	uint32_t end = (job->end - start < SCENE_CHUNK) ? job->end : start + SCENE_CHUNK;
+
+	switch (job->scene->simd) {
+#if defined(__x86_64__)
+		case SCENE_SIMD_AVX2:
+			updateAvx2(nodes, start, end, job->root);
+			break;
+#endif
+
+		case SCENE_SIMD_128:
+			update128(nodes, start, end, job->root);
+			break;
+
+		default:
+			updateScalar(nodes, start, end, job->root);
+			break;
+	}
+}
+
+static void cullChunk(void *data, uint32_t index) {
+	/* Culls one chunk with the scene's kernels, its visible handles are
+	written at the chunk's slots in scratch */
+	SceneJob *job = data;
+	Scene *scene = job->scene;
+
+	uint32_t start = index * SCENE_CHUNK;
+	uint32_t end = (job->end - start < SCENE_CHUNK) ? job->end : start + SCENE_CHUNK;
+	uint32_t *visible = scene->scratch.visible + start;
+
+	switch (scene->simd) {
+#if defined(__x86_64__)
+		case SCENE_SIMD_AVX2:
+			scene->scratch.counts[index] = cullAvx2(&scene->nodes, job->planes, start, end, visible);
+			break;
+#endif
+
+		case SCENE_SIMD_128:
+			scene->scratch.counts[index] = cull128(&scene->nodes, job->planes, start, end, visible);
+			break;
+
+		default:
+			scene->scratch.counts[index] = cullScalar(&scene->nodes, job->planes, start, end, visible);
+			break;
+	}
+}
+
+static uint32_t countChunks(uint32_t start, uint32_t end) {
+	return (end - start + SCENE_CHUNK - 1) / SCENE_CHUNK;
+}
+
+void UpdateScene(Scene *scene) {
+	/* Updates every world matrix and bounding sphere, one depth at a time so
+	parents are done before their children */
+	if (!scene->sorted) sortScene(scene);
+
+	uint32_t depth;
+	for (depth = 0; depth < scene->levels.count; depth++) {
+		SceneJob job = {
+			.scene = scene,
+			.start = scene->levels.first[depth],
+			.end = scene->levels.first[depth + 1],
+			.root = (depth == 0),
+		};
+
+		RunJobs(scene->jobs, updateChunk, &job, countChunks(job.start, job.end));
+	}
+}
+
+void GetFrustumPlanes(const float view_projection[16], float planes[6][4]) {
+	/* Extracts the world space planes of a column major view projection with
+	Vulkan's 0 to 1 depth. Normals point inwards and are unit length */
+	const float *m = view_projection;
+
+	/* Row r of m is m[r], m[4 + r], m[8 + r] and m[12 + r] */
+	uint32_t i, j;
+	for (j = 0; j < 4; j++) {
+		float x = m[4 * j], y = m[4 * j + 1], z = m[4 * j + 2], w = m[4 * j + 3];
+
+		planes[0][j] = w + x;
+		planes[1][j] = w - x;
+		planes[2][j] = w + y;
+		planes[3][j] = w - y;
+		planes[4][j] = z;
+		planes[5][j] = w - z;
+	}
+
+	for (i = 0; i < 6; i++) {
+		float length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+		for (j = 0; j < 4; j++) planes[i][j] /= length;
+	}
+}
+
+uint32_t CullScene(Scene *scene, const float planes[6][4], uint32_t *visible) {
+	/* Writes the handles of the nodes whose world bounds touch the frustum of
+	planes into visible, which has room for every node, and returns how many
+	there are. They're written in slot order, once per chunk, so visible can
+	be write combined memory */
+	SceneJob job = {
+		.scene = scene,
+		.end = scene->count,
+		.planes = planes,
+	};
+
+	uint32_t chunks = countChunks(0, scene->count);
+	RunJobs(scene->jobs, cullChunk, &job, chunks);
+
+	uint32_t count = 0, i;
+	for (i = 0; i < chunks; i++) {
+		memcpy(visible + count, scene->scratch.visible + i * SCENE_CHUNK, scene->scratch.counts[i] * sizeof(uint32_t));
+		count += scene->scratch.counts[i];
+	}
+
+	return count;
+}
+
+void CopySceneWorlds(Scene *scene, const uint32_t *nodes, uint32_t count, float (*worlds)[12]) {
+	/* Copies the world matrices of nodes, row major 3x4, in order into worlds
+	e.g. per instance data for the device */
+	uint32_t i, j;
+	for (i = 0; i < count; i++) {
+		uint32_t slot = scene->handles.slots[nodes[i]];
+
+		float world[12];
+		for (j = 0; j < 12; j++) world[j] = scene->nodes.world[j][slot];
+
+		memcpy(worlds[i], world, sizeof(world));
+	}
+}
@@ -0,0 +1,229 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "archive.h"
+#include "panic.h"
+#include "shaders.h"
+
+/* constants */
+
+static const uint32_t INITIAL_SHADER_SLOTS = 64;
+
+static const uint64_t HASH_OFFSET = 0xcbf29ce484222325ULL;
+static const uint64_t HASH_PRIME = 0x100000001b3ULL;
+
+/* code */
+
+static uint64_t hashCode(const uint32_t *code, size_t size) {
+	/* Returns a 64 bit FNV-1a style hash of the SPIR-V, taken a word at a time as
+	SPIR-V is always a whole number of words */
+	uint64_t hash = HASH_OFFSET ^ size;
+
+	size_t i;
+	for (i = 0; i < size / sizeof(uint32_t); i++) {
+		hash ^= code[i];
+		hash *= HASH_PRIME;
+		hash ^= hash >> 29;
+	}
+
+	return hash;
+}
+
+static uint32_t findSlot(ShaderCache *cache, uint64_t hash, const uint32_t *code, size_t size) {
+	/* Returns the slot holding the module of code, or the empty slot it would
+	go in. The code is compared as well, the hash only narrows the search */
+	uint32_t mask = cache->capacity - 1;
+	uint32_t slot = (uint32_t) hash & mask;
+
+	while (cache->slots[slot]) {
+		ShaderModule *module = cache->slots[slot];
+		bool same = module->hash == hash && module->size == size;
+
+		if (same && (module->code == code || memcmp(module->code, code, size) == 0)) break;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+static void resizeShaderCache(ShaderCache *cache, uint32_t capacity) {
+	/* Rehashes the modules into a table of capacity slots */
+	ShaderModule **slots = cache->slots;
+	uint32_t old_capacity = cache->capacity;
+
+	cache->slots = calloc(capacity, sizeof(ShaderModule *));
+	if (!cache->slots) Panic("resizeShaderCache: unable to allocate %u slots\n", capacity);
+
+	cache->capacity = capacity;
+
+	uint32_t i;
+	for (i = 0; i < old_capacity; i++) {
+		ShaderModule *module = slots[i];
+		if (module) cache->slots[findSlot(cache, module->hash, module->code, module->size)] = module;
+	}
+
+	free(slots);
+}
+
+ShaderCache CreateShaderCache(const DeviceDispatch *vk) {
+	/* Returns an empty ShaderCache for the device vk was loaded from */
+	ShaderCache cache = {
+		.vk = vk,
+	};
+
+	resizeShaderCache(&cache, INITIAL_SHADER_SLOTS);
+
+	return cache;
+}
+
+void DestroyShaderCache(ShaderCache *cache) {
+	/* Destroys every cached VkShaderModule, whether it's released or not */
+	uint32_t i;
+	for (i = 0; i < cache->capacity; i++) {
+		ShaderModule *module = cache->slots[i];
+		if (!module) continue;
+
+		cache->vk->DestroyShaderModule(cache->vk->device, module->module, NULL);
+		free(module->code);
+		free(module);
+	}
+
+	free(cache->slots);
+
+	*cache = (ShaderCache) {};
+}
+
+ShaderModule *AcquireShaderModule(ShaderCache *cache, const uint32_t *code, size_t size) {
+	/* Returns the ShaderModule for the SPIR-V, it is only created the first time
+	the code is seen and shared after that. code doesn't need to outlive the
+	call */
+	uint64_t hash = hashCode(code, size);
+	uint32_t slot = findSlot(cache, hash, code, size);
+
+	if (cache->slots[slot]) {
+		cache->slots[slot]->references += 1;
+		return cache->slots[slot];
+	}
+
+	VkShaderModuleCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = size,
+		.pCode = code,
+	};
+
+	ShaderModule *module = calloc(1, sizeof(ShaderModule));
+	if (module) module->code = malloc(size);
+	if (!module || !module->code) Panic("AcquireShaderModule: unable to allocate ShaderModule\n");
+
+	memcpy(module->code, code, size);
+
+	if (cache->vk->CreateShaderModule(cache->vk->device, &create_info, NULL, &module->module) != VK_SUCCESS)
+		Panic("AcquireShaderModule: unable to create VkShaderModule\n");
+
+	module->hash = hash;
+	module->size = size;
+	module->references = 1;
+
+	cache->slots[slot] = module;
+	cache->count += 1;
+
+	/* keep the load factor under 3/4 so probes stay short */
+	if (cache->count * 4 > cache->capacity * 3)
+		resizeShaderCache(cache, cache->capacity * 2);
+
+	return module;
+}
+
+ShaderModule *AcquireArchiveShader(ShaderCache *cache, Archive *archive, const char *name) {
+	/* Returns the ShaderModule for the SPIR-V blob called name in archive */
+	ArchiveBlob blob = FindArchiveBlob(archive, name);
+
+	if (!blob.data || !blob.size || blob.size % sizeof(uint32_t))
+		Panic("AcquireArchiveShader: no SPIR-V called '%s' in the archive\n", name);
+
+	return AcquireShaderModule(cache, blob.data, blob.size);
+}
+
+static void removeSlot(ShaderCache *cache, uint32_t slot) {
+	/* Empties slot, then shifts back the modules that probed past it */
+	uint32_t mask = cache->capacity - 1;
+	uint32_t next = (slot + 1) & mask;
+
+	cache->slots[slot] = NULL;
+
+	while (cache->slots[next]) {
+		ShaderModule *module = cache->slots[next];
+		uint32_t home = (uint32_t) module->hash & mask;
+
+		/* move module back if its home isn't cyclically within (slot, next] */
+		bool reachable = (slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next);
+		if (!reachable) {
+			cache->slots[slot] = module;
+			cache->slots[next] = NULL;
+			slot = next;
+		}
+
+		next = (next + 1) & mask;
+	}
+}
+
+void ReleaseShaderModule(ShaderCache *cache, ShaderModule *module) {
+	/* Drops a reference to module, destroying it once no one uses it. Pipelines
+	don't need their modules once they are created */
+	if (!module || --module->references) return;
+
+	removeSlot(cache, findSlot(cache, module->hash, module->code, module->size));
+	cache->count -= 1;
+
+	cache->vk->DestroyShaderModule(cache->vk->device, module->module, NULL);
+	free(module->code);
+	free(module);
+}
+
+ShaderVariant CreateShaderVariant(ShaderModule *module, VkShaderStageFlagBits stage, const ShaderConstant *constants, uint32_t count) {
+	/* Returns a ShaderVariant of module specialised with the constants */
+	if (count > MAX_SHADER_CONSTANTS)
+		Panic("CreateShaderVariant: %u constants is more than %u\n", count, MAX_SHADER_CONSTANTS);
+
+	ShaderVariant variant = {
+		.module = module,
+		.stage = stage,
+		.entry = "main",
+		.count = count,
+	};
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		variant.data[i] = constants[i].value;
+		variant.entries[i] = (VkSpecializationMapEntry) {
+			.constantID = constants[i].id,
+			.offset = i * sizeof(uint32_t),
+			.size = sizeof(uint32_t),
+		};
+	}
+
+	return variant;
+}
+
+VkPipelineShaderStageCreateInfo GetShaderStage(ShaderVariant *variant) {
+	/* Returns the stage info for pipeline creation. It points into variant, so
+	variant must not move until the pipeline has been created */
+	variant->specialization = (VkSpecializationInfo) {
+		.mapEntryCount = variant->count,
+		.pMapEntries = variant->entries,
+		.dataSize = variant->count * sizeof(uint32_t),
+		.pData = variant->data,
+	};
+
+	return (VkPipelineShaderStageCreateInfo) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = variant->stage,
+		.module = variant->module->module,
+		.pName = variant->entry,
+		.pSpecializationInfo = (variant->count) ? &variant->specialization : NULL,
+	};
+}
@@ -0,0 +1,99 @@
+/* Shared by shaders that bin or shade clustered lights, see lights.h. The
+view frustum is split into CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z
+slices that grow exponentially with depth. Everything is in view space, which
+looks down -z with y up, and depth is -z. Shaders include it with LIGHT_SET
+defined to the descriptor set of the lights */
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_CLUSTER_LIGHTS 256
+
+/* Only the binning kernel writes the clusters */
+#ifndef CLUSTER_ACCESS
+#define CLUSTER_ACCESS readonly
+#endif
+
+struct Light {
+	/* A point light has no direction and a cosine of -1, a spot light has
+	the cosine and sine of half its cone */
+	vec3 position;
+	float range;
+	vec3 colour;
+	float cosine;
+	vec3 direction;
+	float sine;
+};
+
+layout(std430, set = LIGHT_SET, binding = 0) readonly buffer Lights {
+	/* scale is the tangent of half the field of view in x and y, a view
+	position's slice is floor(log(depth) * slice_scale + slice_bias) */
+	vec2 scale;
+	float near;
+	float far;
+	vec2 extent;
+	float slice_scale;
+	float slice_bias;
+	uint light_count;
+	Light lights[];
+};
+
+layout(std430, set = LIGHT_SET, binding = 1) CLUSTER_ACCESS buffer Counts {
+	/* lights reaching each cluster, only the first MAX_CLUSTER_LIGHTS are
+	in its indices */
+	uint counts[];
+};
+
+layout(std430, set = LIGHT_SET, binding = 2) CLUSTER_ACCESS buffer Indices {
+	/* MAX_CLUSTER_LIGHTS per cluster */
+	uint indices[];
+};
+
+uint clusterSlice(float depth) {
+	return uint(clamp(floor(log(depth) * slice_scale + slice_bias), 0.0, CLUSTER_Z - 1.0));
+}
+
+uint clusterIndex(vec2 pixel, float depth) {
+	/* Returns the cluster of a pixel of the target at a view depth */
+	uvec2 tile = min(uvec2(pixel / extent * vec2(CLUSTER_X, CLUSTER_Y)), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+
+	return (clusterSlice(depth) * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+}
+
+vec3 viewRay(vec2 pixel) {
+	/* Returns the view space point at depth 1 seen through pixel */
+	vec2 ndc = pixel / extent * 2.0 - 1.0;
+
+	return vec3(ndc.x * scale.x, -ndc.y * scale.y, -1.0);
+}
+
+vec3 shadeLight(Light light, vec3 position, vec3 normal) {
+	/* Returns the diffuse light arriving at position, falling off smoothly to
+	0 at the light's range */
+	vec3 to_light = light.position - position;
+	float distance_squared = dot(to_light, to_light);
+	vec3 direction = to_light * inversesqrt(max(distance_squared, 1e-8));
+
+	float ratio = distance_squared / (light.range * light.range);
+	float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+	float attenuation = window * window / (distance_squared + 1.0);
+
+	float cone = dot(-direction, light.direction);
+	attenuation *= clamp((cone - light.cosine) / max(1.0 - light.cosine, 1e-4) * 4.0, 0.0, 1.0);
+
+	return light.colour * attenuation * max(dot(normal, direction), 0.0);
+}
+
+vec3 shadeClustered(vec2 pixel, vec3 position, vec3 normal) {
+	/* Returns the diffuse light at a view space position from the lights of
+	its cluster only */
+	uint cluster = clusterIndex(pixel, -position.z);
+	uint first = cluster * MAX_CLUSTER_LIGHTS;
+	uint count = min(counts[cluster], MAX_CLUSTER_LIGHTS);
+	vec3 light = vec3(0.0);
+
+	for (uint i = 0; i < count; i++)
+		light += shadeLight(lights[indices[first + i]], position, normal);
+
+	return light;
+}
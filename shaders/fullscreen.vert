@@ -0,0 +1,8 @@
+#version 450
+
+/* Covers the target with one triangle drawn as 3 vertices */
+
+void main() {
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	gl_Position = vec4(corner * 4.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,33 @@
+#version 450
+
+/* Shades an infinite floor with the clustered lights. The floor is found by
+intersecting each pixel's view ray with a plane, so the scene costs the same
+fragments at any light count */
+
+#define LIGHT_SET 0
+#include "clustered.glsl"
+
+layout(push_constant) uniform Constants {
+	/* plane is the view space normal and distance of the floor, albedo is its
+	colour with the ambient light in a */
+	vec4 plane;
+	vec4 albedo;
+};
+
+layout(location = 0) out vec4 colour;
+
+void main() {
+	vec3 ray = viewRay(gl_FragCoord.xy);
+	float facing = dot(plane.xyz, ray);
+
+	/* ray.z is -1 so the distance along it is the depth */
+	float depth = (facing < 0.0) ? -plane.w / facing : far;
+
+	if (depth <= near || depth >= far) {
+		colour = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
+	vec3 light = shadeClustered(gl_FragCoord.xy, ray * depth, plane.xyz);
+	colour = vec4(albedo.rgb * (albedo.a + light), 1.0);
+}
@@ -0,0 +1,82 @@
+/* Shared by the primitive kernels. Each workgroup handles a block of
+WORKGROUP_SIZE * ITEMS uint elements, both are specialisation constants set
+per device. Compiled with SUBGROUPS, workgroup scans use subgroup arithmetic,
+otherwise they go through shared memory */
+
+#ifdef SUBGROUPS
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+#define MAX_WORKGROUP_SIZE 256
+#define WORKGROUP_SIZE gl_WorkGroupSize.x
+
+layout(local_size_x_id = 1) in;
+layout(constant_id = 0) const uint ITEMS = 4;
+
+shared uvec4 partials[MAX_WORKGROUP_SIZE];
+shared uvec4 workgroup_total;
+
+uvec4 workgroupScan(uvec4 value, out uvec4 total) {
+	/* Returns the exclusive prefix sum of value over the workgroup's
+	invocations, total is the sum of every value. Every invocation must call
+	it */
+#ifdef SUBGROUPS
+	uvec4 inclusive = subgroupInclusiveAdd(value);
+	uvec4 sum = subgroupAdd(value);
+
+	if (subgroupElect()) partials[gl_SubgroupID] = sum;
+	barrier();
+
+	/* the first subgroup scans the subgroup sums, gl_SubgroupSize at a time */
+	if (gl_SubgroupID == 0) {
+		uvec4 carry = uvec4(0);
+
+		for (uint i = 0; i < gl_NumSubgroups; i += gl_SubgroupSize) {
+			uint index = i + gl_SubgroupInvocationID;
+			uvec4 partial = (index < gl_NumSubgroups) ? partials[index] : uvec4(0);
+			uvec4 scanned = subgroupExclusiveAdd(partial) + carry;
+
+			if (index < gl_NumSubgroups) partials[index] = scanned;
+			carry += subgroupAdd(partial);
+		}
+
+		if (subgroupElect()) workgroup_total = carry;
+	}
+
+	barrier();
+
+	total = workgroup_total;
+	uvec4 prefix = partials[gl_SubgroupID] + inclusive - value;
+	barrier();
+
+	return prefix;
+#else
+	uint id = gl_LocalInvocationID.x;
+
+	partials[id] = value;
+	barrier();
+
+	for (uint offset = 1; offset < WORKGROUP_SIZE; offset <<= 1) {
+		uvec4 add = (id >= offset) ? partials[id - offset] : uvec4(0);
+		barrier();
+
+		partials[id] += add;
+		barrier();
+	}
+
+	total = partials[WORKGROUP_SIZE - 1];
+	uvec4 prefix = partials[id] - value;
+	barrier();
+
+	return prefix;
+#endif
+}
+
+uint workgroupScan(uint value, out uint total) {
+	/* Returns the exclusive prefix sum of a single uint over the workgroup */
+	uvec4 sums;
+	uint prefix = workgroupScan(uvec4(value, 0, 0, 0), sums).x;
+
+	total = sums.x;
+	return prefix;
+}
@@ -0,0 +1,20 @@
+#version 450
+
+/* Samples the sprite's rectangle of its atlas page */
+
+layout(set = 0, binding = 0) uniform sampler2D page;
+
+layout(location = 0) in vec2 texcoord;
+layout(location = 1) flat in vec4 bounds;
+layout(location = 2) flat in vec4 tint;
+
+layout(location = 0) out vec4 colour;
+
+void main() {
+	/* Staying half a texel inside the rectangle keeps linear filtering from
+	reading the neighbouring images of the page */
+	vec2 inset = 0.5 / vec2(textureSize(page, 0));
+	vec2 st = clamp(texcoord, bounds.xy + inset, bounds.zw - inset);
+
+	colour = texture(page, st) * tint;
+}
@@ -0,0 +1,32 @@
+#version 450
+
+/* Expands every sprite instance into a quad drawn as a 4 vertex triangle
+strip. Positions are in pixels from the top left of the target */
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 size;
+layout(location = 2) in vec4 uv;
+layout(location = 3) in vec4 colour;
+layout(location = 4) in float rotation;
+
+layout(push_constant) uniform Constants {
+	/* 2 / the extent of the target */
+	vec2 scale;
+};
+
+layout(location = 0) out vec2 texcoord;
+layout(location = 1) flat out vec4 bounds;
+layout(location = 2) flat out vec4 tint;
+
+void main() {
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	vec2 offset = (corner - 0.5) * size;
+
+	float s = sin(rotation), c = cos(rotation);
+	vec2 pixel = position + vec2(c * offset.x - s * offset.y, s * offset.x + c * offset.y);
+
+	gl_Position = vec4(pixel * scale - 1.0, 0.0, 1.0);
+	texcoord = mix(uv.xy, uv.zw, corner);
+	bounds = uv;
+	tint = colour;
+}
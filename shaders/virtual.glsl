@@ -0,0 +1,75 @@
+/* Shared by shaders that sample a VirtualTexture, see virtual.h. Sampling
+also writes the page it wanted to the feedback, the pages a frame asks for are
+streamed in over the next frames. Until then the table clamps the level of
+detail to the finest resident page. Shaders include it with VIRTUAL_SET
+defined to the descriptor set of the texture */
+
+#define VIRTUAL_PAGE_SIZE 128
+#define MAX_VIRTUAL_REQUESTS 4096
+
+/* One pixel in VIRTUAL_FEEDBACK_RATE writes feedback, the pixels take turns
+so each writes every VIRTUAL_FEEDBACK_RATE frames */
+#define VIRTUAL_FEEDBACK_RATE 4u
+
+layout(set = VIRTUAL_SET, binding = 0) uniform sampler2D virtual_pages;
+layout(set = VIRTUAL_SET, binding = 1) uniform usampler2D virtual_table;
+
+layout(std430, set = VIRTUAL_SET, binding = 2) buffer VirtualFeedback {
+	/* The header is written each frame before the passes. atlas is the slots
+	across the atlas, 0 for a sparse image, and seen has a bit per page */
+	uint sparse;
+	uint pages;
+	uint levels;
+	uint atlas;
+	uint frame;
+	uint count;
+	uint requests[MAX_VIRTUAL_REQUESTS];
+	uint seen[];
+} virtual_feedback;
+
+uint virtualPage(uint level, uvec2 page) {
+	/* Returns the number of the page at level, the pages before it are a
+	geometric series of the levels before */
+	uint pages = virtual_feedback.pages, width = pages >> level;
+
+	return (4u * pages * pages - 4u * width * width) / 3u + page.y * width + page.x;
+}
+
+void requestVirtualPage(uint page) {
+	/* Appends page to the requests the first time it's seen this frame */
+	uint bit = 1u << (page & 31u);
+	if ((atomicOr(virtual_feedback.seen[page >> 5], bit) & bit) != 0u) return;
+
+	uint index = atomicAdd(virtual_feedback.count, 1u);
+	if (index < MAX_VIRTUAL_REQUESTS) virtual_feedback.requests[index] = page;
+}
+
+vec4 sampleVirtual(vec2 uv) {
+	/* Samples the texture at uv in [0, 1], at the level its derivatives ask
+	for or the finest resident one above it */
+	vec2 texel = uv * float(virtual_feedback.pages * VIRTUAL_PAGE_SIZE);
+	float lod = log2(max(length(dFdx(texel)), length(dFdy(texel))));
+	lod = clamp(lod, 0.0, float(virtual_feedback.levels - 1u));
+
+	uint level = uint(lod), width = virtual_feedback.pages >> level;
+	uvec2 page = min(uvec2(uv * float(width)), uvec2(width - 1u));
+
+	uvec2 pixel = uvec2(gl_FragCoord.xy);
+	if ((pixel.x + pixel.y * 2u + virtual_feedback.frame) % VIRTUAL_FEEDBACK_RATE == 0u)
+		requestVirtualPage(virtualPage(level, page));
+
+	/* The next level is resident whenever this one is, so trilinear filtering
+	only reads resident pages */
+	uvec4 entry = texelFetch(virtual_table, ivec2(page), int(level));
+
+	if (virtual_feedback.sparse != 0u)
+		return textureLod(virtual_pages, uv, max(lod, float(entry.z)));
+
+	/* The atlas has one level, so the page is filtered on its own level and
+	clamped half a texel inside its slot to keep the neighbours out */
+	vec2 within = fract(uv * float(virtual_feedback.pages >> entry.z)) * float(VIRTUAL_PAGE_SIZE);
+	within = clamp(within, vec2(0.5), vec2(float(VIRTUAL_PAGE_SIZE) - 0.5));
+
+	vec2 atlas = (vec2(entry.xy) * float(VIRTUAL_PAGE_SIZE) + within) / float(virtual_feedback.atlas * VIRTUAL_PAGE_SIZE);
+	return textureLod(virtual_pages, atlas, 0.0);
+}
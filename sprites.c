@@ -0,0 +1,622 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "atlas.h"
+#include "buffers.h"
+#include "deletion.h"
+#include "frames.h"
+#include "panic.h"
+#include "passes.h"
+#include "reload.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "sprites.h"
+#include "textures.h"
+
+/* constants */
+
+#define SPRITE_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
+/* A tracked page can be evicted and restored every frame, its retired sets
+wait for the frames in flight before they're freed */
+#define SPRITE_SETS ((FRAMES_IN_FLIGHT + 2) * MAX_SPRITE_PAGES)
+
+/* code */
+
+static void *growArray(void *data, uint32_t *capacity, size_t size) {
+	/* Doubles the capacity of an upload or batch array */
+	uint32_t grown = (*capacity) ? *capacity * 2 : 16;
+
+	void *resized = realloc(data, grown * size);
+	if (!resized) Panic("growArray: unable to grow to %u elements\n", grown);
+
+	*capacity = grown;
+	return resized;
+}
+
+static VkPipeline createPipeline(Sprites *sprites, VkShaderModule vertex, VkShaderModule fragment) {
+	/* Creates the pipeline that expands instances into alpha blended quads, or
+	returns VK_NULL_HANDLE. It only reads state that is fixed once the sprites
+	are created, so the shader reloader can call it on its own thread */
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+
+	VkPipelineShaderStageCreateInfo stages[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_VERTEX_BIT,
+			.module = vertex,
+			.pName = "main",
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.module = fragment,
+			.pName = "main",
+		},
+	};
+
+	VkVertexInputBindingDescription binding = {
+		.binding = 0,
+		.stride = sizeof(SpriteInstance),
+		.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+	};
+
+	VkVertexInputAttributeDescription attributes[] = {
+		{.location = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(SpriteInstance, position)},
+		{.location = 1, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(SpriteInstance, size)},
+		{.location = 2, .format = VK_FORMAT_R16G16B16A16_UNORM, .offset = offsetof(SpriteInstance, uv)},
+		{.location = 3, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(SpriteInstance, colour)},
+		{.location = 4, .format = VK_FORMAT_R32_SFLOAT, .offset = offsetof(SpriteInstance, rotation)},
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertex_input = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &binding,
+		.vertexAttributeDescriptionCount = sizeof(attributes) / sizeof(attributes[0]),
+		.pVertexAttributeDescriptions = attributes,
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+	};
+
+	VkPipelineViewportStateCreateInfo viewport = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1,
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterization = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = VK_CULL_MODE_NONE,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.lineWidth = 1.0f,
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisample = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+	};
+
+	VkPipelineColorBlendAttachmentState blend_attachment = {
+		.blendEnable = VK_TRUE,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
+
+	VkPipelineColorBlendStateCreateInfo blend = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &blend_attachment,
+	};
+
+	/* The viewport follows the target's extent so resizes don't need a new
+	pipeline */
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+	VkPipelineDynamicStateCreateInfo dynamic = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = 2,
+		.pDynamicStates = dynamic_states,
+	};
+
+	VkGraphicsPipelineCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = 2,
+		.pStages = stages,
+		.pVertexInputState = &vertex_input,
+		.pInputAssemblyState = &input_assembly,
+		.pViewportState = &viewport,
+		.pRasterizationState = &rasterization,
+		.pMultisampleState = &multisample,
+		.pColorBlendState = &blend,
+		.pDynamicState = &dynamic,
+		.layout = sprites->layout,
+	};
+
+	VkPipelineRenderingCreateInfoKHR rendering_info;
+	ApplyPipelinePass(&sprites->pass, &create_info, &rendering_info);
+
+	VkPipeline pipeline;
+	if (vk->CreateGraphicsPipelines(sprites->device.device, VK_NULL_HANDLE, 1, &create_info, NULL, &pipeline) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	return pipeline;
+}
+
+static VkPipeline reloadPipeline(void *data, const ShaderCode *shaders) {
+	/* Rebuilds the pipeline from reloaded SPIR-V, on the reloader's thread.
+	The ShaderCache isn't thread safe so the modules are made here */
+	Sprites *sprites = data;
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+
+	VkShaderModule modules[2] = {};
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	uint32_t i;
+	for (i = 0; i < 2; i++) {
+		VkShaderModuleCreateInfo create_info = {
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = shaders[i].size,
+			.pCode = shaders[i].code,
+		};
+
+		if (vk->CreateShaderModule(sprites->device.device, &create_info, NULL, &modules[i]) != VK_SUCCESS) break;
+	}
+
+	if (i == 2) pipeline = createPipeline(sprites, modules[0], modules[1]);
+
+	vk->DestroyShaderModule(sprites->device.device, modules[0], NULL);
+	vk->DestroyShaderModule(sprites->device.device, modules[1], NULL);
+
+	return pipeline;
+}
+
+Sprites CreateSprites(RendererDevice device, Passes *passes, RenderTarget *target, uint32_t capacity) {
+	/* Creates Sprites that draw up to capacity sprites a frame into targets
+	compatible with target */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	Sprites sprites = {
+		.device = device,
+		.atlas = CreateAtlas(SPRITE_PAGE_SIZE),
+		.capacity = capacity,
+	};
+
+	VkSamplerCreateInfo sampler_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	};
+
+	if (vk->CreateSampler(device.device, &sampler_info, NULL, &sprites.sampler) != VK_SUCCESS)
+		Panic("CreateSprites: unable to create VkSampler\n");
+
+	VkDescriptorSetLayoutBinding binding = {
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+	};
+
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindings = &binding,
+	};
+
+	if (vk->CreateDescriptorSetLayout(device.device, &set_info, NULL, &sprites.set_layout) != VK_SUCCESS)
+		Panic("CreateSprites: unable to create VkDescriptorSetLayout\n");
+
+	VkDescriptorPoolSize pool_size = {
+		.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = SPRITE_SETS,
+	};
+
+	VkDescriptorPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+		.maxSets = SPRITE_SETS,
+		.poolSizeCount = 1,
+		.pPoolSizes = &pool_size,
+	};
+
+	if (vk->CreateDescriptorPool(device.device, &pool_info, NULL, &sprites.descriptors) != VK_SUCCESS)
+		Panic("CreateSprites: unable to create VkDescriptorPool\n");
+
+	VkPushConstantRange range = {
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.offset = 0,
+		.size = 2 * sizeof(float),
+	};
+
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &sprites.set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &range,
+	};
+
+	if (vk->CreatePipelineLayout(device.device, &layout_info, NULL, &sprites.layout) != VK_SUCCESS)
+		Panic("CreateSprites: unable to create VkPipelineLayout\n");
+
+	ShaderCache *cache = device.shaders.cache;
+	Archive *archive = device.shaders.archive;
+
+	if (!archive) Panic("CreateSprites: sprites need the shader archive\n");
+
+	ShaderModule *vertex = AcquireArchiveShader(cache, archive, "sprite.vert.spv");
+	ShaderModule *fragment = AcquireArchiveShader(cache, archive, "sprite.frag.spv");
+
+	sprites.pass = GetPipelinePass(passes, target);
+	sprites.pipeline = createPipeline(&sprites, vertex->module, fragment->module);
+
+	if (!sprites.pipeline) Panic("CreateSprites: unable to create the sprite VkPipeline\n");
+
+	/* The pipeline doesn't need the modules once it's created */
+	ReleaseShaderModule(cache, fragment);
+	ReleaseShaderModule(cache, vertex);
+
+	/* Instances are written once by the CPU and read once by the GPU, so
+	uncached host memory is the right place for them */
+	VkDeviceSize size = (VkDeviceSize) capacity * FRAMES_IN_FLIGHT * sizeof(SpriteInstance);
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	sprites.instances = CreateBuffer(&device, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, properties);
+
+	BeginSprites(&sprites, 0);
+
+	return sprites;
+}
+
+void DestroySprites(Sprites *sprites) {
+	/* Destroys the sprites, no frame that drew them may be in flight */
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+	VkDevice device = sprites->device.device;
+
+	if (sprites->reloader) UnwatchPipeline(sprites->reloader, &sprites->pipeline);
+
+	/* Evicted pages were zeroed, their textures are already queued */
+	uint32_t i;
+	for (i = 0; i < sprites->pages.count; i++) {
+		if (sprites->residency) RemoveResident(sprites->residency, sprites->pages.residents[i]);
+
+		DestroyTexture(&sprites->device, &sprites->pages.textures[i]);
+		free(sprites->pages.texels[i]);
+	}
+
+	DestroyBuffer(&sprites->device, &sprites->instances);
+
+	vk->DestroyPipeline(device, sprites->pipeline, NULL);
+	vk->DestroyPipelineLayout(device, sprites->layout, NULL);
+	vk->DestroyDescriptorPool(device, sprites->descriptors, NULL);
+	vk->DestroyDescriptorSetLayout(device, sprites->set_layout, NULL);
+	vk->DestroySampler(device, sprites->sampler, NULL);
+
+	DestroyAtlas(&sprites->atlas);
+	free(sprites->uploads.data);
+	free(sprites->uploads.texels);
+	free(sprites->batches.data);
+
+	*sprites = (Sprites) {};
+}
+
+void WatchSprites(Sprites *sprites, ShaderReloader *reloader) {
+	/* Rebuilds the pipeline whenever the sprite shaders change. sprites must
+	not move until it's destroyed */
+	const char *shaders[] = {"sprite.vert.spv", "sprite.frag.spv"};
+
+	sprites->reloader = reloader;
+	WatchPipeline(reloader, &sprites->pipeline, shaders, 2, reloadPipeline, sprites);
+}
+
+void TrackSprites(Sprites *sprites, Residency *residency) {
+	/* Adds the atlas pages to residency, which may evict those that haven't
+	been drawn lately. It has to be called before any images are added */
+	if (sprites->pages.count) Panic("TrackSprites: the sprites already have pages\n");
+
+	sprites->residency = residency;
+}
+
+static VkDescriptorSet createPageSet(Sprites *sprites, uint32_t page) {
+	/* Allocates a descriptor set that samples the page's texture */
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+
+	VkDescriptorSetAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = sprites->descriptors,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &sprites->set_layout,
+	};
+
+	VkDescriptorSet set;
+	if (vk->AllocateDescriptorSets(sprites->device.device, &allocate_info, &set) != VK_SUCCESS)
+		Panic("createPageSet: unable to allocate VkDescriptorSet\n");
+
+	VkDescriptorImageInfo image_info = {
+		.sampler = sprites->sampler,
+		.imageView = sprites->pages.textures[page].view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	};
+
+	VkWriteDescriptorSet write = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = set,
+		.dstBinding = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = &image_info,
+	};
+
+	vk->UpdateDescriptorSets(sprites->device.device, 1, &write, 0, NULL);
+
+	return set;
+}
+
+static Texture createPageTexture(Sprites *sprites) {
+	/* Creates the texture of a page, its contents are undefined */
+	VkExtent2D extent = {SPRITE_PAGE_SIZE, SPRITE_PAGE_SIZE};
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	return CreateTexture(&sprites->device, extent, SPRITE_FORMAT, usage);
+}
+
+static void addPage(Sprites *sprites) {
+	/* Creates the texture of a new atlas page and the descriptor set that
+	samples it. Tracked pages are added to the Residency */
+	if (sprites->pages.count == MAX_SPRITE_PAGES)
+		Panic("addPage: more than %u sprite pages\n", MAX_SPRITE_PAGES);
+
+	uint32_t page = sprites->pages.count++;
+	Texture *texture = &sprites->pages.textures[page];
+
+	*texture = createPageTexture(sprites);
+	sprites->pages.sets[page] = createPageSet(sprites, page);
+
+	if (!sprites->residency) return;
+
+	sprites->pages.texels[page] = calloc((size_t) SPRITE_PAGE_SIZE * SPRITE_PAGE_SIZE, sizeof(uint32_t));
+	if (!sprites->pages.texels[page]) Panic("addPage: unable to allocate the texels of page %u\n", page);
+
+	sprites->pages.residents[page] = AddResident(sprites->residency, (ResidentInfo) {
+		.demote = DemoteTexture,
+		.data = texture,
+		.size = texture->size,
+		.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		.levels = 1,
+		.priority = SPRITE_PAGE_PRIORITY,
+	});
+}
+
+static void queueUpload(Sprites *sprites, uint32_t page, VkRect2D region, const uint32_t *texels, uint32_t stride) {
+	/* Queues a copy of region's texels, stride texels apart, into the page for
+	the next RecordSpriteUploads */
+	size_t row = (size_t) region.extent.width * sizeof(uint32_t);
+	size_t size = row * region.extent.height;
+
+	if (sprites->uploads.size + size > sprites->uploads.reserved) {
+		size_t reserved = (sprites->uploads.reserved) ? sprites->uploads.reserved : size;
+		while (reserved < sprites->uploads.size + size) reserved *= 2;
+
+		uint8_t *grown = realloc(sprites->uploads.texels, reserved);
+		if (!grown) Panic("queueUpload: unable to allocate %zu bytes of uploads\n", reserved);
+
+		sprites->uploads.texels = grown;
+		sprites->uploads.reserved = reserved;
+	}
+
+	if (sprites->uploads.count == sprites->uploads.capacity)
+		sprites->uploads.data = growArray(sprites->uploads.data, &sprites->uploads.capacity, sizeof(SpriteUpload));
+
+	sprites->uploads.data[sprites->uploads.count++] = (SpriteUpload) {
+		.page = page,
+		.region = region,
+		.offset = sprites->uploads.size,
+	};
+
+	uint32_t y;
+	for (y = 0; y < region.extent.height; y++)
+		memcpy(sprites->uploads.texels + sprites->uploads.size + y * row, texels + (size_t) y * stride, row);
+
+	sprites->uploads.size += size;
+}
+
+static void restorePage(Sprites *sprites, uint32_t page) {
+	/* Creates the texture of an evicted page again and queues the upload of
+	its texels. Frames in flight may still use its old set, so it's retired */
+	Texture *texture = &sprites->pages.textures[page];
+
+	if (sprites->retired.count == MAX_SPRITE_PAGES)
+		Panic("restorePage: more than %u pages restored without RecordSpriteUploads\n", MAX_SPRITE_PAGES);
+
+	sprites->retired.sets[sprites->retired.count++] = sprites->pages.sets[page];
+
+	*texture = createPageTexture(sprites);
+	sprites->pages.sets[page] = createPageSet(sprites, page);
+
+	RestoreResident(sprites->residency, sprites->pages.residents[page], 1, texture->size);
+
+	VkRect2D region = {.extent = {SPRITE_PAGE_SIZE, SPRITE_PAGE_SIZE}};
+	queueUpload(sprites, page, region, sprites->pages.texels[page], SPRITE_PAGE_SIZE);
+}
+
+static uint16_t toUnorm16(uint32_t texel) {
+	/* Returns texel / SPRITE_PAGE_SIZE as a rounded 16 bit unorm */
+	return (uint16_t) (((uint64_t) texel * UINT16_MAX + SPRITE_PAGE_SIZE / 2) / SPRITE_PAGE_SIZE);
+}
+
+SpriteImage AddSpriteImage(Sprites *sprites, uint32_t width, uint32_t height, const uint32_t *texels) {
+	/* Packs an RGBA8 image into the atlas and queues its upload for the next
+	RecordSpriteUploads. It can be drawn once that has been recorded */
+	AtlasRect rect;
+	if (!PackAtlas(&sprites->atlas, width, height, &rect))
+		Panic("AddSpriteImage: a %ux%u image doesn't fit a %u page\n", width, height, SPRITE_PAGE_SIZE);
+
+	while (sprites->pages.count <= rect.page) addPage(sprites);
+
+	VkRect2D region = {{rect.x, rect.y}, {rect.width, rect.height}};
+	uint32_t *page = sprites->pages.texels[rect.page];
+
+	if (page) {
+		uint32_t y;
+		for (y = 0; y < height; y++)
+			memcpy(page + (size_t) (rect.y + y) * SPRITE_PAGE_SIZE + rect.x, texels + (size_t) y * width, width * sizeof(uint32_t));
+	}
+
+	/* An evicted page gets the image with the rest of its texels once it's
+	restored */
+	if (sprites->pages.textures[rect.page].image) queueUpload(sprites, rect.page, region, texels, width);
+
+	return (SpriteImage) {
+		.page = rect.page,
+		.uv = {
+			toUnorm16(rect.x),
+			toUnorm16(rect.y),
+			toUnorm16(rect.x + rect.width),
+			toUnorm16(rect.y + rect.height),
+		},
+	};
+}
+
+void BeginSprites(Sprites *sprites, uint64_t frame) {
+	/* Starts the sprites of frame in its slice of the instance buffer, which
+	the GPU has finished reading once the frame's fence was waited on */
+	sprites->frame = frame;
+	sprites->slice = frame % FRAMES_IN_FLIGHT;
+	sprites->mapped = (SpriteInstance *) sprites->instances.mapped + (size_t) sprites->slice * sprites->capacity;
+	sprites->count = 0;
+	sprites->batches.count = 0;
+}
+
+void DrawSprite(Sprites *sprites, const SpriteImage *image, float x, float y, float width, float height, float rotation, uint32_t colour) {
+	/* Adds a sprite centred on x, y. Sprites are drawn in the order they're
+	added, a new batch starts whenever the page changes */
+	if (sprites->count == sprites->capacity)
+		Panic("DrawSprite: more than %u sprites in a frame\n", sprites->capacity);
+
+	SpriteBatch *batch = (sprites->batches.count) ? &sprites->batches.data[sprites->batches.count - 1] : NULL;
+
+	if (!batch || batch->page != image->page) {
+		if (sprites->batches.count == sprites->batches.capacity)
+			sprites->batches.data = growArray(sprites->batches.data, &sprites->batches.capacity, sizeof(SpriteBatch));
+
+		batch = &sprites->batches.data[sprites->batches.count++];
+		*batch = (SpriteBatch) {.page = image->page, .first = sprites->count};
+
+		/* A tracked page is kept from eviction while frames draw it */
+		if (sprites->residency && !TouchResident(sprites->residency, sprites->pages.residents[image->page], sprites->frame))
+			restorePage(sprites, image->page);
+	}
+
+	/* Written whole and in order, as the mapping is write combined */
+	sprites->mapped[sprites->count++] = (SpriteInstance) {
+		.position = {x, y},
+		.size = {width, height},
+		.uv = {image->uv[0], image->uv[1], image->uv[2], image->uv[3]},
+		.colour = colour,
+		.rotation = rotation,
+	};
+
+	batch->count++;
+}
+
+void RecordSpriteUploads(Sprites *sprites, VkCommandBuffer command_buffer, DeletionQueue *deletions, uint64_t value) {
+	/* Records the copies of the images added and the pages restored since the
+	last call, outside of a pass. Their staging buffer is deleted once the
+	queue reaches value, as are the sets of pages that were evicted. Tracked
+	sprites must call it every frame before RecordSprites */
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+
+	uint32_t i;
+	for (i = 0; i < sprites->retired.count; i++)
+		DeleteDescriptorSetLater(deletions, sprites->descriptors, sprites->retired.sets[i], value);
+
+	sprites->retired.count = 0;
+
+	if (!sprites->uploads.count) return;
+
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	Buffer staging = CreateBuffer(&sprites->device, sprites->uploads.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, properties);
+	memcpy(staging.mapped, sprites->uploads.texels, sprites->uploads.size);
+
+	uint32_t page;
+	for (page = 0; page < sprites->pages.count; page++) {
+		Texture *texture = &sprites->pages.textures[page];
+		bool transitioned = false;
+
+		/* Pages evicted since their images were added get them on restore */
+		if (!texture->image) continue;
+
+		for (i = 0; i < sprites->uploads.count; i++) {
+			SpriteUpload *upload = &sprites->uploads.data[i];
+			if (upload->page != page) continue;
+
+			if (!transitioned) {
+				TransitionTexture(vk, command_buffer, texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				transitioned = true;
+			}
+
+			CopyBufferToTexture(vk, command_buffer, staging.buffer, upload->offset, texture, upload->region);
+		}
+
+		if (transitioned)
+			TransitionTexture(vk, command_buffer, texture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	DeleteBufferLater(deletions, &staging, value);
+
+	sprites->uploads.count = 0;
+	sprites->uploads.size = 0;
+}
+
+void RecordSprites(Sprites *sprites, VkCommandBuffer command_buffer, VkExtent2D extent) {
+	/* Records the sprites of the frame into the current pass, one instanced
+	draw per batch */
+	const DeviceDispatch *vk = sprites->device.dispatch.device;
+
+	if (!sprites->count) return;
+
+	vk->CmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprites->pipeline);
+
+	VkViewport viewport = {
+		.width = (float) extent.width,
+		.height = (float) extent.height,
+		.maxDepth = 1.0f,
+	};
+
+	VkRect2D scissor = {.extent = extent};
+
+	vk->CmdSetViewport(command_buffer, 0, 1, &viewport);
+	vk->CmdSetScissor(command_buffer, 0, 1, &scissor);
+
+	float scale[2] = {2.0f / extent.width, 2.0f / extent.height};
+	vk->CmdPushConstants(command_buffer, sprites->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(scale), scale);
+
+	VkDeviceSize offset = (VkDeviceSize) sprites->slice * sprites->capacity * sizeof(SpriteInstance);
+	vk->CmdBindVertexBuffers(command_buffer, 0, 1, &sprites->instances.buffer, &offset);
+
+	uint32_t i;
+	for (i = 0; i < sprites->batches.count; i++) {
+		SpriteBatch *batch = &sprites->batches.data[i];
+
+		vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprites->layout, 0, 1, &sprites->pages.sets[batch->page], 0, NULL);
+		vk->CmdDraw(command_buffer, 4, batch->count, 0, batch->first);
+	}
+}
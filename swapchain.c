@@ -0,0 +1,175 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "panic.h"
+#include "renderer.h"
+#include "swapchain.h"
+
+/* code */
+
+static VkSurfaceFormatKHR chooseSurfaceFormat(RendererDevice *device, VkSurfaceKHR surface) {
+	/* Returns an 8 bit sRGB BGRA format if the surface has one, otherwise the
+	first format that it supports */
+	uint32_t count = 0;
+	device->dispatch.instance->GetPhysicalDeviceSurfaceFormatsKHR(device->physical_device, surface, &count, NULL);
+	if (!count) Panic("chooseSurfaceFormat: the surface has no formats\n");
+
+	VkSurfaceFormatKHR *formats = calloc(count, sizeof(VkSurfaceFormatKHR));
+	if (!formats) Panic("chooseSurfaceFormat: unable to allocate VkSurfaceFormatKHRs\n");
+
+	device->dispatch.instance->GetPhysicalDeviceSurfaceFormatsKHR(device->physical_device, surface, &count, formats);
+
+	VkSurfaceFormatKHR format = formats[0];
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		if (formats[i].format != VK_FORMAT_B8G8R8A8_SRGB) continue;
+		if (formats[i].colorSpace != VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) continue;
+
+		format = formats[i];
+		break;
+	}
+
+	free(formats);
+
+	return format;
+}
+
+static VkExtent2D chooseExtent(VkSurfaceCapabilitiesKHR *capabilities, VkExtent2D extent) {
+	/* Returns the surface's extent, or extent clamped to the surface limits
+	when the surface leaves it up to the swapchain */
+	if (capabilities->currentExtent.width != UINT32_MAX) return capabilities->currentExtent;
+
+	VkExtent2D min = capabilities->minImageExtent, max = capabilities->maxImageExtent;
+
+	extent.width = (extent.width < min.width) ? min.width : (extent.width > max.width) ? max.width : extent.width;
+	extent.height = (extent.height < min.height) ? min.height : (extent.height > max.height) ? max.height : extent.height;
+
+	return extent;
+}
+
+static uint32_t chooseImageCount(VkSurfaceCapabilitiesKHR *capabilities) {
+	/* Returns one more image than the minimum so acquiring rarely waits */
+	uint32_t count = capabilities->minImageCount + 1;
+
+	if (capabilities->maxImageCount && count > capabilities->maxImageCount)
+		count = capabilities->maxImageCount;
+
+	return (count > MAX_SWAPCHAIN_IMAGES) ? MAX_SWAPCHAIN_IMAGES : count;
+}
+
+static VkCompositeAlphaFlagBitsKHR chooseCompositeAlpha(VkSurfaceCapabilitiesKHR *capabilities) {
+	/* Returns opaque composition if supported, otherwise the first supported
+	mode */
+	VkCompositeAlphaFlagsKHR supported = capabilities->supportedCompositeAlpha;
+	if (supported & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR) return VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+	return (VkCompositeAlphaFlagBitsKHR) (supported & -supported);
+}
+
+static VkImageView createImageView(RendererDevice *device, VkImage image, VkFormat format) {
+	/* Creates a 2D colour VkImageView of image */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	VkImageViewCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = 1,
+			.layerCount = 1,
+		},
+	};
+
+	VkImageView view;
+	if (vk->CreateImageView(device->device, &create_info, NULL, &view) != VK_SUCCESS)
+		Panic("createImageView: unable to create VkImageView\n");
+
+	return view;
+}
+
+Swapchain CreateSwapchain(RendererDevice *device, VkSurfaceKHR surface, VkExtent2D extent, Swapchain *old) {
+	/* Creates a Swapchain for surface. extent is only used when the surface
+	doesn't dictate one, and old is retired but must still be destroyed by the
+	caller once the GPU has finished with it */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	VkSurfaceCapabilitiesKHR capabilities;
+	device->dispatch.instance->GetPhysicalDeviceSurfaceCapabilitiesKHR(device->physical_device, surface, &capabilities);
+
+	Swapchain swapchain = {
+		.format = chooseSurfaceFormat(device, surface),
+		.present_mode = VK_PRESENT_MODE_FIFO_KHR,
+		.extent = chooseExtent(&capabilities, extent),
+
+		/* Blits to the images are optional, e.g. for upscaling a frame */
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT),
+	};
+
+	if (!swapchain.extent.width || !swapchain.extent.height) return swapchain;
+
+	uint32_t families[] = {device->family.graphics, device->family.present};
+	bool concurrent = families[0] != families[1];
+
+	VkSwapchainCreateInfoKHR create_info = {
+		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+		.surface = surface,
+		.minImageCount = chooseImageCount(&capabilities),
+		.imageFormat = swapchain.format.format,
+		.imageColorSpace = swapchain.format.colorSpace,
+		.imageExtent = swapchain.extent,
+		.imageArrayLayers = 1,
+		.imageUsage = swapchain.usage,
+		.imageSharingMode = (concurrent) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = (concurrent) ? 2 : 0,
+		.pQueueFamilyIndices = families,
+		.preTransform = capabilities.currentTransform,
+		.compositeAlpha = chooseCompositeAlpha(&capabilities),
+		.presentMode = swapchain.present_mode,
+		.clipped = VK_TRUE,
+		.oldSwapchain = (old) ? old->swapchain : VK_NULL_HANDLE,
+	};
+
+	if (vk->CreateSwapchainKHR(device->device, &create_info, NULL, &swapchain.swapchain) != VK_SUCCESS)
+		Panic("CreateSwapchain: unable to create VkSwapchainKHR\n");
+
+	vk->GetSwapchainImagesKHR(device->device, swapchain.swapchain, &swapchain.count, NULL);
+	if (swapchain.count > MAX_SWAPCHAIN_IMAGES)
+		Panic("CreateSwapchain: %u images is more than %u\n", swapchain.count, MAX_SWAPCHAIN_IMAGES);
+
+	vk->GetSwapchainImagesKHR(device->device, swapchain.swapchain, &swapchain.count, swapchain.images);
+
+	VkSemaphoreCreateInfo semaphore_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+
+	uint32_t i;
+	for (i = 0; i < swapchain.count; i++) {
+		swapchain.views[i] = createImageView(device, swapchain.images[i], swapchain.format.format);
+
+		if (vk->CreateSemaphore(device->device, &semaphore_info, NULL, &swapchain.rendered[i]) != VK_SUCCESS)
+			Panic("CreateSwapchain: unable to create VkSemaphore\n");
+	}
+
+	return swapchain;
+}
+
+void DestroySwapchain(RendererDevice *device, Swapchain *swapchain) {
+	/* Destroys the swapchain, the GPU must have finished presenting from it */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	uint32_t i;
+	for (i = 0; i < swapchain->count; i++) {
+		vk->DestroyImageView(device->device, swapchain->views[i], NULL);
+		vk->DestroySemaphore(device->device, swapchain->rendered[i], NULL);
+	}
+
+	if (swapchain->swapchain) vk->DestroySwapchainKHR(device->device, swapchain->swapchain, NULL);
+
+	*swapchain = (Swapchain) {};
+}
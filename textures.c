@@ -0,0 +1,219 @@
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "deletion.h"
+#include "panic.h"
+#include "renderer.h"
+#include "textures.h"
+
+/* types */
+
+typedef struct {
+	/* TextureAccess is the stage and access that goes with a texture layout */
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+} TextureAccess;
+
+/* code */
+
+static TextureAccess getTextureAccess(VkImageLayout layout) {
+	/* Returns the stage and access that uses a texture in layout */
+	switch (layout) {
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return (TextureAccess) { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+
+		case VK_IMAGE_LAYOUT_GENERAL:
+			return (TextureAccess) {
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+			};
+
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return (TextureAccess) { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return (TextureAccess) { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT };
+
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return (TextureAccess) {
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+			};
+
+		default:
+			/* UNDEFINED has nothing to wait for */
+			return (TextureAccess) { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0 };
+	}
+}
+
+uint32_t GetTexelSize(VkFormat format) {
+	/* Returns the bytes per texel of an uncompressed colour format, or 0 for
+	formats it doesn't know */
+	switch (format) {
+		case VK_FORMAT_R8_UNORM:
+			return 1;
+
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_R8G8B8A8_UINT:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_R16G16_UINT:
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_R32_SFLOAT:
+			return 4;
+
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R32G32_UINT:
+		case VK_FORMAT_R32G32_SFLOAT:
+			return 8;
+
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+
+		default:
+			return 0;
+	}
+}
+
+Texture CreateTexture(RendererDevice *device, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage) {
+	/* Creates a device local Texture and a view of it, its contents are
+	undefined until something is copied or drawn into it */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	VkImageCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = format,
+		.extent = {extent.width, extent.height, 1},
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	Texture texture = {
+		.format = format,
+		.extent = extent,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	if (vk->CreateImage(device->device, &create_info, NULL, &texture.image) != VK_SUCCESS)
+		Panic("CreateTexture: unable to create %ux%u VkImage\n", extent.width, extent.height);
+
+	VkMemoryRequirements requirements;
+	vk->GetImageMemoryRequirements(device->device, texture.image, &requirements);
+
+	uint32_t type = FindMemoryType(device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (type == NO_MEMORY_TYPE)
+		Panic("CreateTexture: no device local memory type\n");
+
+	VkMemoryAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = type,
+	};
+
+	if (vk->AllocateMemory(device->device, &allocate_info, NULL, &texture.memory) != VK_SUCCESS)
+		Panic("CreateTexture: unable to allocate %llu bytes\n", (unsigned long long) requirements.size);
+
+	vk->BindImageMemory(device->device, texture.image, texture.memory, 0);
+	texture.size = requirements.size;
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = texture.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = 1,
+			.layerCount = 1,
+		},
+	};
+
+	if (vk->CreateImageView(device->device, &view_info, NULL, &texture.view) != VK_SUCCESS)
+		Panic("CreateTexture: unable to create VkImageView\n");
+
+	return texture;
+}
+
+void DestroyTexture(RendererDevice *device, Texture *texture) {
+	/* Destroys the Texture and frees its memory */
+	const DeviceDispatch *vk = device->dispatch.device;
+
+	vk->DestroyImageView(device->device, texture->view, NULL);
+	vk->DestroyImage(device->device, texture->image, NULL);
+	vk->FreeMemory(device->device, texture->memory, NULL);
+
+	*texture = (Texture) {};
+}
+
+void DeleteTextureLater(DeletionQueue *queue, Texture *texture, uint64_t value) {
+	/* Destroys the Texture once the queue's progress reaches value */
+	DeleteLater(queue, DELETE_IMAGE_VIEW, (uint64_t) texture->view, value);
+	DeleteLater(queue, DELETE_IMAGE, (uint64_t) texture->image, value);
+	DeleteLater(queue, DELETE_MEMORY, (uint64_t) texture->memory, value);
+
+	*texture = (Texture) {};
+}
+
+VkDeviceSize DemoteTexture(void *data, uint32_t levels, DeletionQueue *queue, uint64_t value) {
+	/* DemoteMethod of a Texture added to a Residency. It only has one level so
+	it's evicted or left alone, an evicted Texture is zeroed and its owner has
+	to create it again before it's used */
+	Texture *texture = data;
+
+	if (levels) return texture->size;
+
+	DeleteTextureLater(queue, texture, value);
+
+	return 0;
+}
+
+void TransitionTexture(const DeviceDispatch *vk, VkCommandBuffer command_buffer, Texture *texture, VkImageLayout layout) {
+	/* Records a barrier from the texture's layout to layout. Transitions to the
+	same layout still wait for earlier writes, e.g. between two copies */
+	TextureAccess src = getTextureAccess(texture->layout), dst = getTextureAccess(layout);
+
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = src.access,
+		.dstAccessMask = dst.access,
+		.oldLayout = texture->layout,
+		.newLayout = layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = texture->image,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = 1,
+			.layerCount = 1,
+		},
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, src.stage, dst.stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+	texture->layout = layout;
+}
+
+void CopyBufferToTexture(const DeviceDispatch *vk, VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, Texture *texture, VkRect2D region) {
+	/* Records a copy of tightly packed texels at offset into region of the
+	texture, which must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL */
+	VkBufferImageCopy copy = {
+		.bufferOffset = offset,
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.layerCount = 1,
+		},
+		.imageOffset = {region.offset.x, region.offset.y, 0},
+		.imageExtent = {region.extent.width, region.extent.height, 1},
+	};
+
+	vk->CmdCopyBufferToImage(command_buffer, buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+}
@@ -0,0 +1,191 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SODA_ZSTD
+#include <zstd.h>
+#endif
+
+#include "archive.h"
+#include "panic.h"
+
+/* pack writes the files given on the command line into an archive that
+OpenArchive can map. Blobs are named after the file's basename and start on a
+page of their own:
+
+	pack shaders.pack shaders/sprite.vert.spv shaders/sprite.frag.spv
+
+With -z, in a build made with ZSTD=1, blobs are compressed with zstd when
+that saves at least an eighth of their size:
+
+	pack -z assets.pack meshes/ship.mesh textures/ship.rgba
+*/
+
+/* constants */
+
+/* Archives are cooked once and read on every start, so compression is
+slow and thorough. zstd decompresses as fast whatever the level */
+#define PACK_LEVEL 19
+
+/* types */
+
+typedef struct {
+	/* Input is a file that's going to be packed */
+	const char *path;
+	ArchiveEntry entry;
+} Input;
+
+/* code */
+
+static const char *baseName(const char *path) {
+	/* Returns the part of path after the last '/' */
+	const char *slash = strrchr(path, '/');
+
+	return (slash) ? slash + 1 : path;
+}
+
+static int compareInputName(const void *a, const void *b) {
+	/* qsort comparator so the index can be binary searched */
+	return strncmp(((const Input *) a)->entry.name, ((const Input *) b)->entry.name, ARCHIVE_NAME_SIZE);
+}
+
+static uint64_t alignOffset(uint64_t offset) {
+	/* Rounds offset up to ARCHIVE_ALIGNMENT */
+	return (offset + ARCHIVE_ALIGNMENT - 1) & ~((uint64_t) ARCHIVE_ALIGNMENT - 1);
+}
+
+static void *readFile(const char *path, size_t *size) {
+	/* Returns the contents of the file at path */
+	FILE *file = fopen(path, "rb");
+	if (!file) Panic("pack: unable to open %s\n", path);
+
+	if (fseek(file, 0, SEEK_END) != 0) Panic("pack: unable to seek %s\n", path);
+
+	long length = ftell(file);
+	if (length < 0) Panic("pack: unable to size %s\n", path);
+	rewind(file);
+
+	void *data = malloc(length + 1);
+	if (!data) Panic("pack: unable to allocate %ld bytes for %s\n", length, path);
+
+	if (fread(data, 1, length, file) != (size_t) length) Panic("pack: unable to read %s\n", path);
+	fclose(file);
+
+	*size = length;
+	return data;
+}
+
+static void *compressBlob(void *data, ArchiveEntry *entry) {
+	/* Returns the bytes to store for the entry->size bytes at data, setting
+	entry's compression and stored size. data is returned when compressing
+	doesn't pay */
+	entry->compression = ARCHIVE_STORED;
+	entry->stored = entry->size;
+
+#ifdef SODA_ZSTD
+	size_t bound = ZSTD_compressBound(entry->size);
+
+	void *compressed = malloc(bound);
+	if (!compressed) Panic("pack: unable to allocate %zu bytes to compress '%s'\n", bound, entry->name);
+
+	size_t size = ZSTD_compress(compressed, bound, data, entry->size, PACK_LEVEL);
+	if (ZSTD_isError(size)) Panic("pack: unable to compress '%s': %s\n", entry->name, ZSTD_getErrorName(size));
+
+	/* Blobs that barely shrink are cheaper to read in place */
+	if (size > entry->size - entry->size / 8) {
+		free(compressed);
+		return data;
+	}
+
+	entry->compression = ARCHIVE_ZSTD;
+	entry->stored = size;
+
+	free(data);
+	return compressed;
+#else
+	Panic("pack: -z needs a build made with ZSTD=1\n");
+	return data;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+	bool compress = argc > 1 && strcmp(argv[1], "-z") == 0;
+	int first = (compress) ? 2 : 1;
+
+	if (argc < first + 2) {
+		fprintf(stderr, "usage: %s [-z] ARCHIVE FILE...\n", argv[0]);
+		return 1;
+	}
+
+	uint32_t count = argc - first - 1;
+	Input *inputs = calloc(count, sizeof(Input));
+	if (!inputs) Panic("pack: unable to allocate inputs\n");
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		Input *input = &inputs[i];
+		input->path = argv[first + 1 + i];
+
+		const char *name = baseName(input->path);
+		if (strlen(name) >= ARCHIVE_NAME_SIZE)
+			Panic("pack: '%s' is longer than %d characters\n", name, ARCHIVE_NAME_SIZE - 1);
+
+		strncpy(input->entry.name, name, ARCHIVE_NAME_SIZE);
+	}
+
+	qsort(inputs, count, sizeof(Input), compareInputName);
+
+	for (i = 1; i < count; i++) {
+		if (compareInputName(&inputs[i - 1], &inputs[i]) == 0)
+			Panic("pack: %s and %s are both called '%s'\n", inputs[i - 1].path, inputs[i].path, inputs[i].entry.name);
+	}
+
+	FILE *out = fopen(argv[first], "wb");
+	if (!out) Panic("pack: unable to create %s\n", argv[first]);
+
+	/* Stored sizes are only known once each blob is compressed, so the blobs
+	are written one at a time and the index after them */
+	uint64_t offset = alignOffset(sizeof(ArchiveHeader) + count * sizeof(ArchiveEntry));
+	uint64_t size = 0, stored = 0;
+
+	for (i = 0; i < count; i++) {
+		ArchiveEntry *entry = &inputs[i].entry;
+
+		size_t length;
+		void *data = readFile(inputs[i].path, &length);
+
+		entry->offset = offset;
+		entry->size = length;
+
+		if (compress) data = compressBlob(data, entry);
+		else entry->stored = entry->size;
+
+		if (fseek(out, offset, SEEK_SET) != 0) Panic("pack: unable to seek %s\n", argv[first]);
+		if (fwrite(data, 1, entry->stored, out) != entry->stored) Panic("pack: unable to write '%s'\n", entry->name);
+
+		free(data);
+
+		offset = alignOffset(offset + entry->stored);
+		size += entry->size;
+		stored += entry->stored;
+	}
+
+	ArchiveHeader header = {
+		.version = ARCHIVE_VERSION,
+		.count = count,
+	};
+	memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+
+	rewind(out);
+	fwrite(&header, sizeof(header), 1, out);
+	for (i = 0; i < count; i++)
+		fwrite(&inputs[i].entry, sizeof(ArchiveEntry), 1, out);
+
+	if (fclose(out) != 0) Panic("pack: unable to write %s\n", argv[first]);
+	free(inputs);
+
+	printf("%s: %u blobs, %llu bytes stored in %llu\n", argv[first], count, (unsigned long long) size, (unsigned long long) stored);
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "panic.h"
+#include "virtual.h"
+
+/* pages cuts a square image of raw sRGB RGBA8 texels into the page file of a
+VirtualTexture. The image is SIZE texels across, a power of 2 of at least a
+page, and is filtered down to a single page in linear space:
+
+	pages terrain.pages terrain.rgba 65536
+
+Each level is held in memory while the next is filtered from it */
+
+/* code */
+
+static float linear[256];
+
+static uint8_t toSrgb(float value) {
+	/* Returns the sRGB byte of a linear value */
+	float srgb = (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+	return (uint8_t) (srgb * 255.0f + 0.5f);
+}
+
+static uint8_t *readImage(const char *path, uint32_t size) {
+	/* Reads size * size texels from the file at path */
+	FILE *file = fopen(path, "rb");
+	if (!file) Panic("pages: unable to open %s\n", path);
+
+	size_t bytes = (size_t) size * size * 4;
+
+	uint8_t *texels = malloc(bytes);
+	if (!texels) Panic("pages: unable to allocate %zu bytes\n", bytes);
+
+	if (fread(texels, 1, bytes, file) != bytes) Panic("pages: %s has fewer than %ux%u texels\n", path, size, size);
+	fclose(file);
+
+	return texels;
+}
+
+static uint8_t *halveImage(const uint8_t *texels, uint32_t size) {
+	/* Returns the image size / 2 across, each texel the average of 2x2 of
+	texels. Colour is averaged in linear space and alpha as it is */
+	uint32_t half = size / 2;
+
+	uint8_t *halved = malloc((size_t) half * half * 4);
+	if (!halved) Panic("pages: unable to allocate a %ux%u level\n", half, half);
+
+	uint32_t x, y, channel;
+	for (y = 0; y < half; y++) {
+		for (x = 0; x < half; x++) {
+			const uint8_t *top = texels + ((size_t) (2 * y) * size + 2 * x) * 4;
+			const uint8_t *bottom = top + (size_t) size * 4;
+			uint8_t *out = halved + ((size_t) y * half + x) * 4;
+
+			for (channel = 0; channel < 3; channel++) {
+				float sum = linear[top[channel]] + linear[top[channel + 4]] + linear[bottom[channel]] + linear[bottom[channel + 4]];
+				out[channel] = toSrgb(sum / 4.0f);
+			}
+
+			out[3] = (top[3] + top[7] + bottom[3] + bottom[7] + 2) / 4;
+		}
+	}
+
+	return halved;
+}
+
+static void writeLevel(FILE *out, const uint8_t *texels, uint32_t size) {
+	/* Appends the pages of a level row by row */
+	uint32_t pages = size / VIRTUAL_PAGE_SIZE;
+	size_t row = VIRTUAL_PAGE_SIZE * 4;
+
+	uint32_t x, y, line;
+	for (y = 0; y < pages; y++) {
+		for (x = 0; x < pages; x++) {
+			for (line = 0; line < VIRTUAL_PAGE_SIZE; line++) {
+				size_t offset = ((size_t) (y * VIRTUAL_PAGE_SIZE + line) * size + (size_t) x * VIRTUAL_PAGE_SIZE) * 4;
+				if (fwrite(texels + offset, 1, row, out) != row) Panic("pages: unable to write a page\n");
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s PAGES IMAGE SIZE\n", argv[0]);
+		return 1;
+	}
+
+	uint32_t size = (uint32_t) strtoul(argv[3], NULL, 10);
+	if (size < VIRTUAL_PAGE_SIZE || (size & (size - 1)))
+		Panic("pages: %u isn't a power of 2 of at least %u\n", size, VIRTUAL_PAGE_SIZE);
+
+	PageFileHeader header = {
+		.version = PAGE_FILE_VERSION,
+		.pages = size / VIRTUAL_PAGE_SIZE,
+	};
+
+	memcpy(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic));
+	while (header.pages >> header.levels) header.levels++;
+
+	if (header.levels > MAX_VIRTUAL_LEVELS)
+		Panic("pages: %u levels is over the maximum of %u\n", header.levels, MAX_VIRTUAL_LEVELS);
+
+	uint32_t i;
+	for (i = 0; i < 256; i++) {
+		float value = i / 255.0f;
+		linear[i] = (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	FILE *out = fopen(argv[1], "wb");
+	if (!out) Panic("pages: unable to create %s\n", argv[1]);
+
+	fwrite(&header, sizeof(header), 1, out);
+	if (fseek(out, PAGE_FILE_ALIGNMENT, SEEK_SET) != 0) Panic("pages: unable to seek %s\n", argv[1]);
+
+	uint8_t *texels = readImage(argv[2], size);
+
+	uint32_t level;
+	for (level = 0; level < header.levels; level++, size /= 2) {
+		writeLevel(out, texels, size);
+
+		if (level + 1 == header.levels) break;
+
+		uint8_t *halved = halveImage(texels, size);
+		free(texels);
+		texels = halved;
+	}
+
+	free(texels);
+
+	if (fclose(out) != 0) Panic("pages: unable to write %s\n", argv[1]);
+
+	printf("%s: %u levels, %u pages across\n", argv[1], header.levels, header.pages);
+
+	return 0;
+}
@@ -0,0 +1,374 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "capture.h"
+#include "compute.h"
+#include "panic.h"
+#include "renderer.h"
+#include "shaders.h"
+
+/* replay re-executes a capture written with SODA_CAPTURE on a headless
+renderer as fast as it can, and reports how long it took:
+
+	SODA_CAPTURE=scene.capture ./soda
+	./replay scene.capture --loops 10
+*/
+
+/* types */
+
+typedef struct {
+	/* Capture is the capture file read into memory */
+	uint8_t *data;
+	size_t size;
+} Capture;
+
+typedef struct {
+	/* Replay holds the objects recreated from the capture, indexed by id */
+	RendererDevice device;
+	Compute compute;
+
+	uint32_t capacity;
+	Buffer *buffers;
+	ComputeKernel *kernels;
+
+	struct {
+		/* Namespace for the tokens of the last submit in the capture and in
+		this replay, captured is 0 until there has been one */
+		ComputeToken captured, replayed;
+	} submits;
+
+	struct {
+		/* Namespace for the totals of a loop */
+		uint64_t records, dispatches, submits, frames, uploaded;
+	} stats;
+} Replay;
+
+/* code */
+
+static Capture readCapture(const char *path) {
+	/* Reads the whole capture and checks its header */
+	FILE *file = fopen(path, "rb");
+	if (!file) Panic("replay: unable to open %s\n", path);
+
+	fseek(file, 0, SEEK_END);
+	Capture capture = {
+		.size = (size_t) ftell(file),
+	};
+	rewind(file);
+
+	capture.data = malloc(capture.size ? capture.size : 1);
+	if (!capture.data || fread(capture.data, 1, capture.size, file) != capture.size)
+		Panic("replay: unable to read %s\n", path);
+
+	fclose(file);
+
+	CaptureHeader header;
+	if (capture.size < sizeof(header)) Panic("replay: %s is too small\n", path);
+
+	memcpy(&header, capture.data, sizeof(header));
+	if (memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != CAPTURE_VERSION)
+		Panic("replay: %s isn't a version %u capture\n", path, CAPTURE_VERSION);
+
+	return capture;
+}
+
+static void reserveIds(Replay *replay, uint32_t id) {
+	/* Grows the object arrays so that id can be stored */
+	if (id < replay->capacity) return;
+
+	uint32_t capacity = (replay->capacity) ? replay->capacity : 64;
+	while (capacity <= id) capacity *= 2;
+
+	replay->buffers = realloc(replay->buffers, capacity * sizeof(Buffer));
+	replay->kernels = realloc(replay->kernels, capacity * sizeof(ComputeKernel));
+	if (!replay->buffers || !replay->kernels) Panic("replay: unable to allocate %u objects\n", capacity);
+
+	memset(replay->buffers + replay->capacity, 0, (capacity - replay->capacity) * sizeof(Buffer));
+	memset(replay->kernels + replay->capacity, 0, (capacity - replay->capacity) * sizeof(ComputeKernel));
+
+	replay->capacity = capacity;
+}
+
+static VkMemoryPropertyFlags replayProperties(Replay *replay, VkMemoryPropertyFlags properties) {
+	/* Returns properties if this device has them, otherwise the nearest it has.
+	Host visible buffers stay host visible so their contents can be written */
+	if (FindMemoryType(&replay->device, UINT32_MAX, properties) != NO_MEMORY_TYPE) return properties;
+
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	return 0;
+}
+
+static Buffer *getBuffer(Replay *replay, uint32_t id) {
+	/* Returns the live buffer with id */
+	if (id >= replay->capacity || !replay->buffers[id].buffer) Panic("replay: no buffer %u\n", id);
+
+	return &replay->buffers[id];
+}
+
+static ComputeKernel *getKernel(Replay *replay, uint32_t id) {
+	/* Returns the live kernel with id */
+	if (id >= replay->capacity || !replay->kernels[id].pipeline) Panic("replay: no kernel %u\n", id);
+
+	return &replay->kernels[id];
+}
+
+static void checkSize(uint32_t op, uint32_t size, uint64_t expected) {
+	/* Panics unless a record's size is the size its payload declares */
+	if (size != expected)
+		Panic("replay: record %u is %u bytes but declares %llu\n", op, size, (unsigned long long) expected);
+}
+
+static void replayKernel(Replay *replay, const uint8_t *payload, uint32_t size) {
+	/* Recreates a kernel, its code is copied out as records aren't aligned */
+	CaptureKernelCreateData data;
+	if (size < sizeof(data)) checkSize(CAPTURE_KERNEL_CREATE, size, sizeof(data));
+
+	memcpy(&data, payload, sizeof(data));
+
+	ShaderConstant constants[MAX_SHADER_CONSTANTS];
+	if (data.constants > MAX_SHADER_CONSTANTS) Panic("replay: kernel %u has too many constants\n", data.id);
+	if (data.buffers > MAX_KERNEL_BUFFERS) Panic("replay: kernel %u has too many buffers\n", data.id);
+
+	/* data.size is bounded first so the declared size can't wrap */
+	if (data.size > size) checkSize(CAPTURE_KERNEL_CREATE, size, data.size);
+	checkSize(CAPTURE_KERNEL_CREATE, size, sizeof(data) + data.constants * sizeof(ShaderConstant) + data.size);
+	if (!data.size || data.size % sizeof(uint32_t)) Panic("replay: kernel %u has %llu bytes of SPIR-V\n", data.id, (unsigned long long) data.size);
+
+	memcpy(constants, payload + sizeof(data), data.constants * sizeof(ShaderConstant));
+
+	uint32_t *code = malloc(data.size);
+	if (!code) Panic("replay: unable to allocate SPIR-V\n");
+
+	memcpy(code, payload + sizeof(data) + data.constants * sizeof(ShaderConstant), data.size);
+
+	reserveIds(replay, data.id);
+	replay->kernels[data.id] = CreateComputeKernel(&replay->compute, code, data.size, constants, data.constants, data.buffers, data.push_constants);
+
+	free(code);
+}
+
+static void replayDispatch(Replay *replay, const uint8_t *payload, uint32_t size) {
+	/* Records a dispatch with the replayed kernel and buffers */
+	CaptureDispatchData data;
+	if (size < sizeof(data)) checkSize(CAPTURE_DISPATCH, size, sizeof(data));
+
+	memcpy(&data, payload, sizeof(data));
+
+	ComputeKernel *kernel = getKernel(replay, data.kernel);
+	checkSize(CAPTURE_DISPATCH, size, sizeof(data) + kernel->buffers * sizeof(uint32_t) + kernel->push_constants);
+
+	uint32_t ids[MAX_KERNEL_BUFFERS];
+	memcpy(ids, payload + sizeof(data), kernel->buffers * sizeof(uint32_t));
+
+	VkBuffer buffers[MAX_KERNEL_BUFFERS];
+
+	uint32_t i;
+	for (i = 0; i < kernel->buffers; i++) buffers[i] = getBuffer(replay, ids[i])->buffer;
+
+	const void *push_constants = payload + sizeof(data) + kernel->buffers * sizeof(uint32_t);
+	Dispatch(&replay->compute, kernel, buffers, push_constants, data.x, data.y, data.z);
+
+	replay->stats.dispatches += 1;
+}
+
+static void replayWait(Replay *replay, ComputeToken token) {
+	/* Waits for the replayed batch that signals what token did in the capture.
+	Tokens go up by one a batch in both, so they're offset from the capture's
+	by the difference at the last submit. Waits for batches from before the
+	capture have nothing of the replay's to wait for */
+	if (!replay->submits.captured) return;
+
+	if (token > replay->submits.captured) Panic("replay: wait for token %llu before its submit\n", (unsigned long long) token);
+
+	ComputeToken before = replay->submits.captured - token;
+	if (before >= replay->submits.replayed) return;
+
+	WaitCompute(&replay->compute, replay->submits.replayed - before);
+}
+
+static void replayRecord(Replay *replay, uint32_t op, const uint8_t *payload, uint32_t size) {
+	/* Executes one record */
+	switch (op) {
+		case CAPTURE_BUFFER_CREATE: {
+			CaptureBufferCreateData data;
+			checkSize(op, size, sizeof(data));
+			memcpy(&data, payload, sizeof(data));
+
+			reserveIds(replay, data.id);
+			replay->buffers[data.id] = CreateBuffer(&replay->device, data.size, data.usage, replayProperties(replay, data.properties));
+			break;
+		}
+
+		case CAPTURE_BUFFER_DESTROY: {
+			CaptureDestroyData data;
+			checkSize(op, size, sizeof(data));
+			memcpy(&data, payload, sizeof(data));
+
+			DestroyBuffer(&replay->device, getBuffer(replay, data.id));
+			break;
+		}
+
+		case CAPTURE_BUFFER_WRITE: {
+			CaptureBufferWriteData data;
+			if (size < sizeof(data)) checkSize(op, size, sizeof(data));
+
+			memcpy(&data, payload, sizeof(data));
+			if (data.size > size) checkSize(op, size, data.size);
+			checkSize(op, size, sizeof(data) + data.size);
+
+			Buffer *buffer = getBuffer(replay, data.id);
+			if (!buffer->mapped || data.offset + data.size > buffer->size)
+				Panic("replay: can't write %llu bytes to buffer %u\n", (unsigned long long) data.size, data.id);
+
+			memcpy((uint8_t *) buffer->mapped + data.offset, payload + sizeof(data), data.size);
+			replay->stats.uploaded += data.size;
+			break;
+		}
+
+		case CAPTURE_KERNEL_CREATE:
+			replayKernel(replay, payload, size);
+			break;
+
+		case CAPTURE_KERNEL_DESTROY: {
+			CaptureDestroyData data;
+			checkSize(op, size, sizeof(data));
+			memcpy(&data, payload, sizeof(data));
+
+			DestroyComputeKernel(&replay->compute, getKernel(replay, data.id));
+			break;
+		}
+
+		case CAPTURE_DISPATCH:
+			replayDispatch(replay, payload, size);
+			break;
+
+		case CAPTURE_SUBMIT: {
+			CaptureSubmitData data;
+			checkSize(op, size, sizeof(data));
+			memcpy(&data, payload, sizeof(data));
+
+			replay->submits.captured = data.token;
+			replay->submits.replayed = SubmitCompute(&replay->compute);
+			replay->stats.submits += 1;
+			break;
+		}
+
+		case CAPTURE_WAIT: {
+			CaptureWaitData data;
+			checkSize(op, size, sizeof(data));
+			memcpy(&data, payload, sizeof(data));
+
+			replayWait(replay, data.token);
+			break;
+		}
+
+		case CAPTURE_FRAME:
+			checkSize(op, size, sizeof(CaptureFrameData));
+			replay->stats.frames += 1;
+			break;
+
+		default:
+			Panic("replay: unknown record %u\n", op);
+	}
+}
+
+static void replayCapture(Replay *replay, Capture *capture) {
+	/* Executes every record then waits for the GPU to finish */
+	size_t offset = sizeof(CaptureHeader);
+
+	while (offset + sizeof(CaptureRecord) <= capture->size) {
+		CaptureRecord record;
+		memcpy(&record, capture->data + offset, sizeof(record));
+		offset += sizeof(record);
+
+		if (offset + record.size > capture->size) Panic("replay: the capture is truncated\n");
+
+		replayRecord(replay, record.op, capture->data + offset, record.size);
+		replay->stats.records += 1;
+
+		offset += record.size;
+	}
+
+	SubmitCompute(&replay->compute);
+	WaitCompute(&replay->compute, replay->compute.submitted);
+}
+
+static void destroyObjects(Replay *replay) {
+	/* Destroys the objects the capture left alive, so the next loop starts
+	from the same state */
+	uint32_t i;
+	for (i = 0; i < replay->capacity; i++) {
+		if (replay->buffers[i].buffer) DestroyBuffer(&replay->device, &replay->buffers[i]);
+		if (replay->kernels[i].pipeline) DestroyComputeKernel(&replay->compute, &replay->kernels[i]);
+	}
+}
+
+static double seconds() {
+	/* Returns a monotonic time in seconds */
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 2 && !(argc == 4 && strcmp(argv[2], "--loops") == 0)) {
+		fprintf(stderr, "usage: %s CAPTURE [--loops N]\n", argv[0]);
+		return 1;
+	}
+
+	uint32_t loops = (argc == 4) ? (uint32_t) strtoul(argv[3], NULL, 10) : 1;
+	Capture capture = readCapture(argv[1]);
+
+	CreateHeadlessRenderer();
+
+	Replay replay = {
+		.device = GetRendererDevice(),
+	};
+
+	replay.compute = CreateCompute(replay.device);
+
+	double best = 0, total = 0;
+
+	uint32_t i;
+	for (i = 0; i < loops; i++) {
+		replay.submits = (typeof(replay.submits)) {};
+		replay.stats = (typeof(replay.stats)) {};
+
+		double start = seconds();
+		replayCapture(&replay, &capture);
+		double elapsed = seconds() - start;
+
+		destroyObjects(&replay);
+
+		total += elapsed;
+		if (!i || elapsed < best) best = elapsed;
+	}
+
+	printf("records: %llu, dispatches: %llu, submits: %llu, frames: %llu, uploaded: %.2f MB\n",
+		(unsigned long long) replay.stats.records, (unsigned long long) replay.stats.dispatches,
+		(unsigned long long) replay.stats.submits, (unsigned long long) replay.stats.frames,
+		replay.stats.uploaded / 1e6);
+
+	printf("loops: %u, best: %.3f ms, mean: %.3f ms", loops, best * 1e3, total / loops * 1e3);
+	if (replay.stats.frames) printf(", best frame: %.3f ms", best / replay.stats.frames * 1e3);
+	printf("\n");
+
+	DestroyCompute(&replay.compute);
+	DestroyRenderer();
+
+	free(replay.buffers);
+	free(replay.kernels);
+	free(capture.data);
+
+	return 0;
+}
@@ -0,0 +1,1114 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <SDL.h>
+#include <vulkan/vulkan.h>
+
+#include "buffers.h"
+#include "frames.h"
+#include "panic.h"
+#include "renderer.h"
+#include "virtual.h"
+
+/* constants */
+
+#define VIRTUAL_BINDINGS 3
+
+/* The feedback of a frame is read back from its count to its last request */
+#define FEEDBACK_OFFSET offsetof(VirtualFeedback, count)
+#define FEEDBACK_SIZE ((MAX_VIRTUAL_REQUESTS + 1) * sizeof(uint32_t))
+
+/* types */
+
+typedef struct {
+	/* PagePlace is where a page is in the texture */
+	uint32_t level, x, y;
+} PagePlace;
+
+/* code */
+
+static PagePlace getPagePlace(VirtualTexture *virtual, uint32_t page) {
+	/* Returns the level and position of page, pages are numbered level by level
+	then row by row */
+	uint32_t level = 0;
+	while (page >= virtual->first[level + 1]) level++;
+
+	uint32_t index = page - virtual->first[level], width = virtual->pages >> level;
+
+	return (PagePlace) {level, index % width, index / width};
+}
+
+static uint32_t getPage(VirtualTexture *virtual, PagePlace place) {
+	/* Returns the page at place */
+	return virtual->first[place.level] + place.y * (virtual->pages >> place.level) + place.x;
+}
+
+static uint32_t getParentPage(VirtualTexture *virtual, uint32_t page) {
+	/* Returns the page of the next level that covers page, or NO_VIRTUAL_SLOT
+	for the last level's single page */
+	PagePlace place = getPagePlace(virtual, page);
+	if (place.level + 1 == virtual->levels) return NO_VIRTUAL_SLOT;
+
+	return getPage(virtual, (PagePlace) {place.level + 1, place.x / 2, place.y / 2});
+}
+
+static void readPage(VirtualLoader *loader, VirtualLoad load) {
+	/* Reads a page from the page file into the load's buffer */
+	uint8_t *data = loader->memory + (size_t) load.buffer * VIRTUAL_PAGE_BYTES;
+	off_t offset = PAGE_FILE_ALIGNMENT + (off_t) load.page * VIRTUAL_PAGE_BYTES;
+
+	size_t read = 0;
+	while (read < VIRTUAL_PAGE_BYTES) {
+		ssize_t result = pread(loader->fd, data + read, VIRTUAL_PAGE_BYTES - read, offset + read);
+		if (result <= 0) Panic("readPage: unable to read page %u\n", load.page);
+
+		read += result;
+	}
+}
+
+static int virtualLoader(void *data) {
+	/* Reads the queued pages in order until the loader quits, every read is
+	done with the mutex unlocked */
+	VirtualLoader *loader = data;
+
+	SDL_LockMutex(loader->mutex);
+	while (true) {
+		while (!loader->quit && !loader->queue_count)
+			SDL_CondWait(loader->wake, loader->mutex);
+
+		if (loader->quit) break;
+
+		VirtualLoad load = loader->queue[loader->queue_head];
+		loader->queue_head = (loader->queue_head + 1) % VIRTUAL_LOADS;
+		loader->queue_count -= 1;
+		SDL_UnlockMutex(loader->mutex);
+
+		readPage(loader, load);
+
+		SDL_LockMutex(loader->mutex);
+		loader->done[(loader->done_head + loader->done_count) % VIRTUAL_LOADS] = load;
+		loader->done_count += 1;
+	}
+	SDL_UnlockMutex(loader->mutex);
+
+	return 0;
+}
+
+static void openPageFile(VirtualTexture *virtual, const char *path) {
+	/* Opens and validates the page file at path, and sets the size of the
+	texture from its header */
+	VirtualLoader *loader = virtual->loader;
+
+	loader->fd = open(path, O_RDONLY);
+	if (loader->fd < 0) Panic("CreateVirtualTexture: unable to open %s\n", path);
+
+	PageFileHeader header;
+	if (pread(loader->fd, &header, sizeof(header), 0) != sizeof(header))
+		Panic("CreateVirtualTexture: %s is too small to be a page file\n", path);
+
+	if (memcmp(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic)) != 0)
+		Panic("CreateVirtualTexture: %s is not a page file\n", path);
+
+	if (header.version != PAGE_FILE_VERSION)
+		Panic("CreateVirtualTexture: %s has version %u, expected %u\n", path, header.version, PAGE_FILE_VERSION);
+
+	if (!header.pages || !header.levels || (header.pages & (header.pages - 1)) || header.levels > MAX_VIRTUAL_LEVELS || header.pages >> (header.levels - 1) != 1)
+		Panic("CreateVirtualTexture: %s has %u levels of %u pages\n", path, header.levels, header.pages);
+
+	virtual->pages = header.pages;
+	virtual->levels = header.levels;
+
+	/* The levels are a quarter of the one before, so the pages before a level
+	are a geometric series */
+	uint32_t level;
+	for (level = 0; level <= virtual->levels; level++) {
+		uint32_t width = (level < virtual->levels) ? virtual->pages >> level : 0;
+		virtual->first[level] = (4 * virtual->pages * virtual->pages - 4 * width * width) / 3;
+	}
+
+	virtual->count = virtual->first[virtual->levels];
+
+	struct stat status;
+	if (fstat(loader->fd, &status) != 0) Panic("CreateVirtualTexture: unable to stat %s\n", path);
+
+	if ((uint64_t) status.st_size < PAGE_FILE_ALIGNMENT + (uint64_t) virtual->count * VIRTUAL_PAGE_BYTES)
+		Panic("CreateVirtualTexture: %s is truncated\n", path);
+}
+
+static void startLoader(VirtualTexture *virtual) {
+	/* Allocates the loader's buffers and starts its thread */
+	VirtualLoader *loader = virtual->loader;
+
+	loader->memory = malloc((size_t) VIRTUAL_LOADS * VIRTUAL_PAGE_BYTES);
+	if (!loader->memory) Panic("startLoader: unable to allocate the load buffers\n");
+
+	uint32_t i;
+	for (i = 0; i < VIRTUAL_LOADS; i++) loader->spare[i] = VIRTUAL_LOADS - 1 - i;
+	loader->spare_count = VIRTUAL_LOADS;
+
+	loader->mutex = SDL_CreateMutex();
+	loader->wake = SDL_CreateCond();
+
+	if (!loader->mutex || !loader->wake)
+		Panic("startLoader: unable to create synchronisation primitives: %s\n", SDL_GetError());
+
+	loader->thread = SDL_CreateThread(virtualLoader, "soda/virtual", loader);
+	if (!loader->thread) Panic("startLoader: unable to create thread: %s\n", SDL_GetError());
+}
+
+static VkImage createImage(VirtualTexture *virtual, uint32_t size, uint32_t levels, VkFormat format, VkImageCreateFlags flags) {
+	/* Creates a square image that's sampled and copied to */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkImageCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.flags = flags,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = format,
+		.extent = {size, size, 1},
+		.mipLevels = levels,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	VkImage image;
+	if (vk->CreateImage(virtual->device.device, &create_info, NULL, &image) != VK_SUCCESS)
+		Panic("createImage: unable to create %ux%u VkImage\n", size, size);
+
+	return image;
+}
+
+static VkDeviceMemory allocateMemory(VirtualTexture *virtual, VkMemoryRequirements requirements, VkDeviceSize size) {
+	/* Allocates size bytes of device local memory that meets requirements */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	uint32_t type = FindMemoryType(&virtual->device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (type == NO_MEMORY_TYPE)
+		Panic("allocateMemory: no device local memory type\n");
+
+	VkMemoryAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = size,
+		.memoryTypeIndex = type,
+	};
+
+	VkDeviceMemory memory;
+	if (vk->AllocateMemory(virtual->device.device, &allocate_info, NULL, &memory) != VK_SUCCESS)
+		Panic("allocateMemory: unable to allocate %llu bytes\n", (unsigned long long) size);
+
+	return memory;
+}
+
+static bool createSparseImage(VirtualTexture *virtual) {
+	/* Creates the partially resident image of the whole texture and the memory
+	of its slots. Returns false, leaving nothing behind, if the device's blocks
+	aren't a page or the levels need a mip tail or metadata */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+	VkDevice device = virtual->device.device;
+
+	VkImageCreateFlags flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+	VkImage image = createImage(virtual, virtual->pages * VIRTUAL_PAGE_SIZE, virtual->levels, VIRTUAL_FORMAT, flags);
+
+	VkMemoryRequirements requirements;
+	vk->GetImageMemoryRequirements(device, image, &requirements);
+
+	VkSparseImageMemoryRequirements sparse[4];
+	uint32_t count = 4;
+	vk->GetImageSparseMemoryRequirements(device, image, &count, sparse);
+
+	bool suitable = (count == 1 && requirements.alignment == VIRTUAL_PAGE_BYTES);
+
+	if (suitable) {
+		VkSparseImageFormatProperties *properties = &sparse[0].formatProperties;
+		VkExtent3D granularity = properties->imageGranularity;
+
+		suitable = properties->aspectMask == VK_IMAGE_ASPECT_COLOR_BIT
+			&& granularity.width == VIRTUAL_PAGE_SIZE && granularity.height == VIRTUAL_PAGE_SIZE
+			&& sparse[0].imageMipTailFirstLod >= virtual->levels;
+	}
+
+	if (!suitable) {
+		vk->DestroyImage(device, image, NULL);
+		return false;
+	}
+
+	virtual->images.image = image;
+	virtual->images.memory = allocateMemory(virtual, requirements, (VkDeviceSize) virtual->capacity * VIRTUAL_PAGE_BYTES);
+
+	return true;
+}
+
+static void createAtlas(VirtualTexture *virtual) {
+	/* Creates the atlas of slots the indirection fallback copies pages into */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	virtual->atlas = 1;
+	while (virtual->atlas * virtual->atlas < virtual->capacity) virtual->atlas++;
+
+	if (virtual->atlas > MAX_VIRTUAL_ATLAS)
+		Panic("createAtlas: %u slots don't fit in an atlas\n", virtual->capacity);
+
+	virtual->images.image = createImage(virtual, virtual->atlas * VIRTUAL_PAGE_SIZE, 1, VIRTUAL_FORMAT, 0);
+
+	VkMemoryRequirements requirements;
+	vk->GetImageMemoryRequirements(virtual->device.device, virtual->images.image, &requirements);
+
+	virtual->images.memory = allocateMemory(virtual, requirements, requirements.size);
+	vk->BindImageMemory(virtual->device.device, virtual->images.image, virtual->images.memory, 0);
+}
+
+static void createTable(VirtualTexture *virtual) {
+	/* Creates the table image and its CPU copy, every entry starts at the last
+	level's page in slot 0 */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	virtual->images.table = createImage(virtual, virtual->pages, virtual->levels, VK_FORMAT_R8G8B8A8_UINT, 0);
+
+	VkMemoryRequirements requirements;
+	vk->GetImageMemoryRequirements(virtual->device.device, virtual->images.table, &requirements);
+
+	virtual->images.table_memory = allocateMemory(virtual, requirements, requirements.size);
+	vk->BindImageMemory(virtual->device.device, virtual->images.table, virtual->images.table_memory, 0);
+
+	uint32_t level, i;
+	for (level = 0; level < virtual->levels; level++) {
+		uint32_t width = virtual->pages >> level;
+
+		virtual->table.entries[level] = malloc((size_t) width * width * sizeof(uint32_t));
+		if (!virtual->table.entries[level]) Panic("createTable: unable to allocate level %u\n", level);
+
+		for (i = 0; i < width * width; i++) virtual->table.entries[level][i] = VIRTUAL_TABLE_ENTRY(0, 0, virtual->levels - 1);
+
+		virtual->table.dirty[level] = (VirtualRect) {0, 0, width, width};
+	}
+}
+
+static VkImageView createView(VirtualTexture *virtual, VkImage image, VkFormat format, uint32_t levels) {
+	/* Creates a view of every level of image */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = levels,
+			.layerCount = 1,
+		},
+	};
+
+	VkImageView view;
+	if (vk->CreateImageView(virtual->device.device, &view_info, NULL, &view) != VK_SUCCESS)
+		Panic("createView: unable to create VkImageView\n");
+
+	return view;
+}
+
+static VkSampler createSampler(VirtualTexture *virtual, VkFilter filter, VkSamplerMipmapMode mipmap) {
+	/* Creates a sampler that clamps to the edge and reaches every level */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkSamplerCreateInfo sampler_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = filter,
+		.minFilter = filter,
+		.mipmapMode = mipmap,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.maxLod = VK_LOD_CLAMP_NONE,
+	};
+
+	VkSampler sampler;
+	if (vk->CreateSampler(virtual->device.device, &sampler_info, NULL, &sampler) != VK_SUCCESS)
+		Panic("createSampler: unable to create VkSampler\n");
+
+	return sampler;
+}
+
+static void createSet(VirtualTexture *virtual) {
+	/* Creates the set layout and descriptor set of the pages, the table and the
+	feedback buffer */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+	VkDevice device = virtual->device.device;
+
+	VkDescriptorType types[VIRTUAL_BINDINGS] = {
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	};
+
+	VkDescriptorSetLayoutBinding bindings[VIRTUAL_BINDINGS];
+
+	uint32_t i;
+	for (i = 0; i < VIRTUAL_BINDINGS; i++) {
+		bindings[i] = (VkDescriptorSetLayoutBinding) {
+			.binding = i,
+			.descriptorType = types[i],
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		};
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = VIRTUAL_BINDINGS,
+		.pBindings = bindings,
+	};
+
+	if (vk->CreateDescriptorSetLayout(device, &set_info, NULL, &virtual->set_layout) != VK_SUCCESS)
+		Panic("createSet: unable to create VkDescriptorSetLayout\n");
+
+	VkDescriptorPoolSize pool_sizes[] = {
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+	};
+
+	VkDescriptorPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = 1,
+		.poolSizeCount = 2,
+		.pPoolSizes = pool_sizes,
+	};
+
+	if (vk->CreateDescriptorPool(device, &pool_info, NULL, &virtual->descriptors) != VK_SUCCESS)
+		Panic("createSet: unable to create VkDescriptorPool\n");
+
+	VkDescriptorSetAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = virtual->descriptors,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &virtual->set_layout,
+	};
+
+	if (vk->AllocateDescriptorSets(device, &allocate_info, &virtual->set) != VK_SUCCESS)
+		Panic("createSet: unable to allocate VkDescriptorSet\n");
+
+	VkDescriptorImageInfo image_infos[] = {
+		{virtual->sampler, virtual->images.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+		{virtual->table_sampler, virtual->images.table_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+	};
+
+	VkDescriptorBufferInfo buffer_info = {.buffer = virtual->feedback.buffer, .range = VK_WHOLE_SIZE};
+
+	VkWriteDescriptorSet writes[VIRTUAL_BINDINGS];
+	for (i = 0; i < VIRTUAL_BINDINGS; i++) {
+		writes[i] = (VkWriteDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = virtual->set,
+			.dstBinding = i,
+			.descriptorCount = 1,
+			.descriptorType = types[i],
+			.pImageInfo = (i < 2) ? &image_infos[i] : NULL,
+			.pBufferInfo = (i < 2) ? NULL : &buffer_info,
+		};
+	}
+
+	vk->UpdateDescriptorSets(device, VIRTUAL_BINDINGS, writes, 0, NULL);
+}
+
+static void createBuffers(VirtualTexture *virtual) {
+	/* Creates the feedback buffer and the staging and readback of each frame in
+	flight. Readbacks are host cached where the device has it */
+	VkDeviceSize bitmap = (VkDeviceSize) (virtual->count + 31) / 32 * sizeof(uint32_t);
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	virtual->feedback = CreateBuffer(&virtual->device, sizeof(VirtualFeedback) + bitmap, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	/* A frame uploads its pages then whatever of the table changed, which is at
+	most an entry per page */
+	virtual->table_offset = (VkDeviceSize) VIRTUAL_UPLOADS * VIRTUAL_PAGE_BYTES;
+	VkDeviceSize staging = virtual->table_offset + (VkDeviceSize) virtual->count * sizeof(uint32_t);
+
+	VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	if (FindMemoryType(&virtual->device, UINT32_MAX, cached) == NO_MEMORY_TYPE) cached = coherent;
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		virtual->staging[i] = CreateBuffer(&virtual->device, staging, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, coherent);
+		virtual->readback[i] = CreateBuffer(&virtual->device, FEEDBACK_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT, cached);
+	}
+}
+
+static void createPages(VirtualTexture *virtual) {
+	/* Allocates the state of every page and slot, every slot starts free */
+	virtual->page.states = calloc(virtual->count, sizeof(uint8_t));
+	virtual->page.children = calloc(virtual->count, sizeof(uint8_t));
+	virtual->page.slots = malloc(virtual->count * sizeof(uint32_t));
+	virtual->page.bound = malloc(virtual->count * sizeof(uint32_t));
+
+	virtual->slot.slots = malloc(virtual->capacity * sizeof(VirtualSlot));
+	virtual->slot.free = malloc(virtual->capacity * sizeof(uint32_t));
+	virtual->slot.retired = malloc(virtual->capacity * sizeof(uint32_t));
+	virtual->slot.retired_frames = malloc(virtual->capacity * sizeof(uint64_t));
+
+	if (!virtual->page.states || !virtual->page.children || !virtual->page.slots || !virtual->page.bound)
+		Panic("createPages: unable to allocate %u pages\n", virtual->count);
+
+	if (!virtual->slot.slots || !virtual->slot.free || !virtual->slot.retired || !virtual->slot.retired_frames)
+		Panic("createPages: unable to allocate %u slots\n", virtual->capacity);
+
+	uint32_t i;
+	for (i = 0; i < virtual->count; i++) virtual->page.slots[i] = virtual->page.bound[i] = NO_VIRTUAL_SLOT;
+
+	for (i = 0; i < virtual->capacity; i++) {
+		virtual->slot.slots[i] = (VirtualSlot) {NO_VIRTUAL_SLOT, NO_VIRTUAL_SLOT, 0};
+		virtual->slot.free[i] = virtual->capacity - 1 - i;
+	}
+
+	virtual->slot.free_count = virtual->capacity;
+}
+
+static void bindPages(VirtualTexture *virtual, const VirtualLoad *loads, uint32_t count) {
+	/* Binds the slots of loads at their pages in the sparse image, signalling
+	the fence. The pages the slots were bound at before are unbound, their
+	frames have finished since the slots were retired */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkSparseImageMemoryBind binds[2 * VIRTUAL_UPLOADS];
+	uint32_t bind_count = 0;
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		uint32_t page = loads[i].page, slot = virtual->page.slots[page];
+		VirtualSlot *bound = &virtual->slot.slots[slot];
+
+		uint32_t old = bound->bound;
+		if (old != NO_VIRTUAL_SLOT && old != page && virtual->page.bound[old] == slot) {
+			PagePlace place = getPagePlace(virtual, old);
+
+			binds[bind_count++] = (VkSparseImageMemoryBind) {
+				.subresource = {VK_IMAGE_ASPECT_COLOR_BIT, place.level, 0},
+				.offset = {place.x * VIRTUAL_PAGE_SIZE, place.y * VIRTUAL_PAGE_SIZE, 0},
+				.extent = {VIRTUAL_PAGE_SIZE, VIRTUAL_PAGE_SIZE, 1},
+				.memory = VK_NULL_HANDLE,
+			};
+
+			virtual->page.bound[old] = NO_VIRTUAL_SLOT;
+		}
+
+		/* The page may still be bound at the slot it was evicted from */
+		if (virtual->page.bound[page] != NO_VIRTUAL_SLOT && virtual->page.bound[page] != slot)
+			virtual->slot.slots[virtual->page.bound[page]].bound = NO_VIRTUAL_SLOT;
+
+		PagePlace place = getPagePlace(virtual, page);
+
+		binds[bind_count++] = (VkSparseImageMemoryBind) {
+			.subresource = {VK_IMAGE_ASPECT_COLOR_BIT, place.level, 0},
+			.offset = {place.x * VIRTUAL_PAGE_SIZE, place.y * VIRTUAL_PAGE_SIZE, 0},
+			.extent = {VIRTUAL_PAGE_SIZE, VIRTUAL_PAGE_SIZE, 1},
+			.memory = virtual->images.memory,
+			.memoryOffset = (VkDeviceSize) slot * VIRTUAL_PAGE_BYTES,
+		};
+
+		bound->bound = page;
+		virtual->page.bound[page] = slot;
+	}
+
+	VkSparseImageMemoryBindInfo image_bind = {
+		.image = virtual->images.image,
+		.bindCount = bind_count,
+		.pBinds = binds,
+	};
+
+	VkBindSparseInfo bind_info = {
+		.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO,
+		.imageBindCount = 1,
+		.pImageBinds = &image_bind,
+	};
+
+	if (vk->QueueBindSparse(virtual->device.queue.graphics, 1, &bind_info, virtual->loads.fence) != VK_SUCCESS)
+		Panic("bindPages: unable to bind %u pages\n", count);
+}
+
+static uint32_t assignSlot(VirtualTexture *virtual, VirtualLoad load) {
+	/* Gives a loaded page a free slot, which the caller checked for */
+	uint32_t slot = virtual->slot.free[--virtual->slot.free_count];
+
+	virtual->slot.slots[slot].page = load.page;
+	virtual->slot.slots[slot].used = virtual->frame;
+	virtual->page.slots[load.page] = slot;
+	virtual->page.states[load.page] = VIRTUAL_LOADED;
+
+	uint32_t parent = getParentPage(virtual, load.page);
+	if (parent != NO_VIRTUAL_SLOT) virtual->page.children[parent] += 1;
+
+	return slot;
+}
+
+static void setTableRegion(VirtualTexture *virtual, PagePlace place, uint32_t entry) {
+	/* Sets the entries under the page at place, on its level and every finer
+	one, to entry */
+	uint32_t level = place.level + 1;
+	while (level-- > 0) {
+		uint32_t span = 1u << (place.level - level), width = virtual->pages >> level;
+		uint32_t x0 = place.x * span, y0 = place.y * span;
+
+		uint32_t x, y;
+		for (y = y0; y < y0 + span; y++) {
+			uint32_t *row = virtual->table.entries[level] + (size_t) y * width;
+			for (x = x0; x < x0 + span; x++) row[x] = entry;
+		}
+
+		VirtualRect *dirty = &virtual->table.dirty[level];
+
+		if (dirty->x0 >= dirty->x1) {
+			*dirty = (VirtualRect) {x0, y0, x0 + span, y0 + span};
+			continue;
+		}
+
+		if (x0 < dirty->x0) dirty->x0 = x0;
+		if (y0 < dirty->y0) dirty->y0 = y0;
+		if (x0 + span > dirty->x1) dirty->x1 = x0 + span;
+		if (y0 + span > dirty->y1) dirty->y1 = y0 + span;
+	}
+}
+
+static uint32_t getTableEntry(VirtualTexture *virtual, uint32_t page) {
+	/* Returns the table entry of a page that has a slot */
+	uint32_t slot = virtual->page.slots[page];
+	PagePlace place = getPagePlace(virtual, page);
+
+	if (virtual->sparse) return VIRTUAL_TABLE_ENTRY(0, 0, place.level);
+
+	return VIRTUAL_TABLE_ENTRY(slot % virtual->atlas, slot / virtual->atlas, place.level);
+}
+
+static void uploadLoad(VirtualTexture *virtual, VirtualLoad load) {
+	/* Copies a load into the frame's staging to be uploaded, makes its page
+	resident and gives its buffer back to the loader */
+	VirtualLoader *loader = virtual->loader;
+
+	uint8_t *staging = virtual->staging[virtual->slice].mapped;
+	memcpy(staging + (size_t) virtual->loads.upload_count * VIRTUAL_PAGE_BYTES,
+		loader->memory + (size_t) load.buffer * VIRTUAL_PAGE_BYTES, VIRTUAL_PAGE_BYTES);
+
+	virtual->loads.uploads[virtual->loads.upload_count++] = load;
+	loader->spare[loader->spare_count++] = load.buffer;
+
+	virtual->page.states[load.page] = VIRTUAL_RESIDENT;
+	setTableRegion(virtual, getPagePlace(virtual, load.page), getTableEntry(virtual, load.page));
+}
+
+static void takeLoads(VirtualTexture *virtual) {
+	/* Takes the pages the loader has read while there are free slots. Pages
+	whose parent was dropped are dropped too, as every page with a slot needs
+	its parent to have one. Sparse loads wait on a bind, only one batch of
+	binds is pending at a time */
+	VirtualLoader *loader = virtual->loader;
+
+	uint32_t limit = VIRTUAL_UPLOADS - virtual->loads.upload_count;
+	if (virtual->sparse) limit = (virtual->loads.binding_count) ? 0 : VIRTUAL_UPLOADS;
+
+	uint32_t taken = 0;
+
+	SDL_LockMutex(loader->mutex);
+	while (loader->done_count && taken < limit && virtual->slot.free_count) {
+		VirtualLoad load = loader->done[loader->done_head];
+		loader->done_head = (loader->done_head + 1) % VIRTUAL_LOADS;
+		loader->done_count -= 1;
+
+		uint32_t parent = getParentPage(virtual, load.page);
+		if (parent != NO_VIRTUAL_SLOT && virtual->page.slots[parent] == NO_VIRTUAL_SLOT) {
+			virtual->page.states[load.page] = VIRTUAL_ABSENT;
+			loader->spare[loader->spare_count++] = load.buffer;
+			continue;
+		}
+
+		assignSlot(virtual, load);
+		taken += 1;
+
+		if (virtual->sparse) virtual->loads.binding[virtual->loads.binding_count++] = load;
+		else uploadLoad(virtual, load);
+	}
+	SDL_UnlockMutex(loader->mutex);
+
+	if (virtual->sparse && virtual->loads.binding_count)
+		bindPages(virtual, virtual->loads.binding, virtual->loads.binding_count);
+}
+
+static void finishBinds(VirtualTexture *virtual) {
+	/* Uploads the loads whose binds have completed. Only the last level's page
+	waits here without a bind when there's no sparse image */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	if (!virtual->loads.binding_count) return;
+
+	if (virtual->sparse) {
+		if (vk->GetFenceStatus(virtual->device.device, virtual->loads.fence) != VK_SUCCESS) return;
+		vk->ResetFences(virtual->device.device, 1, &virtual->loads.fence);
+	}
+
+	uint32_t i;
+	for (i = 0; i < virtual->loads.binding_count; i++)
+		uploadLoad(virtual, virtual->loads.binding[i]);
+
+	virtual->loads.binding_count = 0;
+}
+
+static int compareDescending(const void *a, const void *b) {
+	/* qsort comparator that puts the coarser levels' higher pages first */
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x < y) - (x > y);
+}
+
+static void requestPages(VirtualTexture *virtual) {
+	/* Reads the feedback the frame's slice wrote FRAMES_IN_FLIGHT frames ago.
+	Requested pages with a slot are marked used, missing ones are queued after
+	their missing ancestors, coarsest first, while the loader has buffers */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+	VirtualLoader *loader = virtual->loader;
+
+	if (!virtual->written[virtual->slice]) return;
+	virtual->written[virtual->slice] = false;
+
+	Buffer *readback = &virtual->readback[virtual->slice];
+
+	if (!(readback->properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		VkMappedMemoryRange range = {
+			.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = readback->memory,
+			.size = VK_WHOLE_SIZE,
+		};
+
+		vk->InvalidateMappedMemoryRanges(virtual->device.device, 1, &range);
+	}
+
+	uint32_t *feedback = readback->mapped;
+	uint32_t count = (feedback[0] < MAX_VIRTUAL_REQUESTS) ? feedback[0] : MAX_VIRTUAL_REQUESTS;
+	uint32_t *requests = feedback + 1;
+
+	qsort(requests, count, sizeof(uint32_t), compareDescending);
+
+	uint32_t queued = 0;
+
+	SDL_LockMutex(loader->mutex);
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		uint32_t page = requests[i];
+		if (page >= virtual->count) continue;
+
+		uint32_t slot = virtual->page.slots[page];
+		if (slot != NO_VIRTUAL_SLOT) {
+			virtual->slot.slots[slot].used = virtual->frame;
+			continue;
+		}
+
+		uint32_t chain[MAX_VIRTUAL_LEVELS], length = 0;
+		while (page != NO_VIRTUAL_SLOT && virtual->page.states[page] == VIRTUAL_ABSENT) {
+			chain[length++] = page;
+			page = getParentPage(virtual, page);
+		}
+
+		while (length && loader->spare_count) {
+			VirtualLoad load = {chain[--length], loader->spare[--loader->spare_count]};
+
+			virtual->page.states[load.page] = VIRTUAL_QUEUED;
+			loader->queue[(loader->queue_head + loader->queue_count) % VIRTUAL_LOADS] = load;
+			loader->queue_count += 1;
+			queued += 1;
+		}
+	}
+
+	if (queued) SDL_CondSignal(loader->wake);
+	SDL_UnlockMutex(loader->mutex);
+}
+
+static bool evictSlot(VirtualTexture *virtual) {
+	/* Evicts the least recently used resident page that has no children with
+	slots and wasn't requested by the latest feedback. Its entries go back to
+	its parent's and the slot retires. Returns false if none can be evicted */
+	uint32_t victim = NO_VIRTUAL_SLOT;
+	uint64_t oldest = virtual->frame;
+
+	uint32_t i;
+	for (i = 0; i < virtual->capacity; i++) {
+		VirtualSlot *slot = &virtual->slot.slots[i];
+		uint32_t page = slot->page;
+
+		if (page == NO_VIRTUAL_SLOT || slot->used >= oldest) continue;
+		if (virtual->page.states[page] != VIRTUAL_RESIDENT || virtual->page.children[page]) continue;
+		if (page == virtual->count - 1) continue;
+
+		victim = i;
+		oldest = slot->used;
+	}
+
+	if (victim == NO_VIRTUAL_SLOT) return false;
+
+	uint32_t page = virtual->slot.slots[victim].page;
+	uint32_t parent = getParentPage(virtual, page);
+
+	virtual->page.states[page] = VIRTUAL_ABSENT;
+	virtual->page.slots[page] = NO_VIRTUAL_SLOT;
+	virtual->page.children[parent] -= 1;
+	virtual->slot.slots[victim].page = NO_VIRTUAL_SLOT;
+
+	setTableRegion(virtual, getPagePlace(virtual, page), getTableEntry(virtual, parent));
+
+	uint32_t index = (virtual->slot.retired_head + virtual->slot.retired_count) % virtual->capacity;
+	virtual->slot.retired[index] = victim;
+	virtual->slot.retired_frames[index] = virtual->frame;
+	virtual->slot.retired_count += 1;
+
+	return true;
+}
+
+static void retireSlots(VirtualTexture *virtual) {
+	/* Frees the slots evicted by frames that have finished */
+	while (virtual->slot.retired_count) {
+		uint32_t head = virtual->slot.retired_head;
+		if (virtual->slot.retired_frames[head] + FRAMES_IN_FLIGHT > virtual->frame) break;
+
+		virtual->slot.free[virtual->slot.free_count++] = virtual->slot.retired[head];
+		virtual->slot.retired_head = (head + 1) % virtual->capacity;
+		virtual->slot.retired_count -= 1;
+	}
+}
+
+VirtualTexture CreateVirtualTexture(RendererDevice device, const char *path, uint32_t capacity) {
+	/* Creates a VirtualTexture of the page file at path that keeps up to
+	capacity pages in memory. Sparse residency is used when the device has it
+	and its blocks are pages, otherwise the pages go in an atlas. The last
+	level's page is always resident */
+	const DeviceDispatch *vk = device.dispatch.device;
+
+	if (!device.supports.fragment_atomics)
+		Panic("CreateVirtualTexture: the device can't write feedback from fragment shaders\n");
+
+	VirtualTexture virtual = {
+		.device = device,
+		.images = {
+			.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.table_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+		},
+	};
+
+	virtual.loader = calloc(1, sizeof(VirtualLoader));
+	if (!virtual.loader) Panic("CreateVirtualTexture: unable to allocate VirtualLoader\n");
+
+	openPageFile(&virtual, path);
+
+	/* A texture that fits never evicts, otherwise a chain down from the last
+	level has to fit next to the reserve */
+	virtual.capacity = (capacity < virtual.count) ? capacity : virtual.count;
+	if (virtual.capacity < virtual.count && virtual.capacity < VIRTUAL_RESERVE + virtual.levels)
+		Panic("CreateVirtualTexture: %u slots is under the minimum of %u\n", capacity, VIRTUAL_RESERVE + virtual.levels);
+
+	virtual.sparse = device.supports.sparse_residency && createSparseImage(&virtual);
+	if (!virtual.sparse) createAtlas(&virtual);
+
+	createTable(&virtual);
+
+	virtual.images.view = createView(&virtual, virtual.images.image, VIRTUAL_FORMAT, virtual.sparse ? virtual.levels : 1);
+	virtual.images.table_view = createView(&virtual, virtual.images.table, VK_FORMAT_R8G8B8A8_UINT, virtual.levels);
+	virtual.sampler = createSampler(&virtual, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR);
+	virtual.table_sampler = createSampler(&virtual, VK_FILTER_NEAREST, VK_SAMPLER_MIPMAP_MODE_NEAREST);
+
+	createBuffers(&virtual);
+	createSet(&virtual);
+	createPages(&virtual);
+
+	VkFenceCreateInfo fence_info = {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+	if (vk->CreateFence(device.device, &fence_info, NULL, &virtual.loads.fence) != VK_SUCCESS)
+		Panic("CreateVirtualTexture: unable to create VkFence\n");
+
+	startLoader(&virtual);
+
+	/* The last level's page is read here, so every entry of the table has a
+	page from the first frame, and is uploaded by the first BeginVirtualTexture */
+	VirtualLoader *loader = virtual.loader;
+	VirtualLoad load = {virtual.count - 1, loader->spare[--loader->spare_count]};
+
+	readPage(loader, load);
+	assignSlot(&virtual, load);
+
+	virtual.loads.binding[virtual.loads.binding_count++] = load;
+	if (virtual.sparse) bindPages(&virtual, &load, 1);
+
+	return virtual;
+}
+
+void DestroyVirtualTexture(VirtualTexture *virtual) {
+	/* Stops the loader and destroys the texture, no frame that sampled it may
+	be in flight */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+	VkDevice device = virtual->device.device;
+	VirtualLoader *loader = virtual->loader;
+
+	SDL_LockMutex(loader->mutex);
+	loader->quit = true;
+	SDL_CondSignal(loader->wake);
+	SDL_UnlockMutex(loader->mutex);
+
+	SDL_WaitThread(loader->thread, NULL);
+	SDL_DestroyCond(loader->wake);
+	SDL_DestroyMutex(loader->mutex);
+	close(loader->fd);
+	free(loader->memory);
+	free(loader);
+
+	if (virtual->sparse && virtual->loads.binding_count)
+		vk->WaitForFences(device, 1, &virtual->loads.fence, VK_TRUE, UINT64_MAX);
+
+	vk->DestroyFence(device, virtual->loads.fence, NULL);
+
+	uint32_t i;
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		DestroyBuffer(&virtual->device, &virtual->staging[i]);
+		DestroyBuffer(&virtual->device, &virtual->readback[i]);
+	}
+
+	DestroyBuffer(&virtual->device, &virtual->feedback);
+
+	vk->DestroyDescriptorPool(device, virtual->descriptors, NULL);
+	vk->DestroyDescriptorSetLayout(device, virtual->set_layout, NULL);
+	vk->DestroySampler(device, virtual->sampler, NULL);
+	vk->DestroySampler(device, virtual->table_sampler, NULL);
+
+	vk->DestroyImageView(device, virtual->images.view, NULL);
+	vk->DestroyImageView(device, virtual->images.table_view, NULL);
+	vk->DestroyImage(device, virtual->images.image, NULL);
+	vk->DestroyImage(device, virtual->images.table, NULL);
+	vk->FreeMemory(device, virtual->images.memory, NULL);
+	vk->FreeMemory(device, virtual->images.table_memory, NULL);
+
+	for (i = 0; i < virtual->levels; i++) free(virtual->table.entries[i]);
+
+	free(virtual->page.states);
+	free(virtual->page.children);
+	free(virtual->page.slots);
+	free(virtual->page.bound);
+	free(virtual->slot.slots);
+	free(virtual->slot.free);
+	free(virtual->slot.retired);
+	free(virtual->slot.retired_frames);
+
+	*virtual = (VirtualTexture) {};
+}
+
+void BeginVirtualTexture(VirtualTexture *virtual, uint64_t frame) {
+	/* Starts frame, whose fence was waited on, so the feedback and staging of
+	its slice are free. Reads the feedback, queues the missing pages, takes the
+	pages that were loaded and evicts enough to keep VIRTUAL_RESERVE slots */
+	virtual->frame = frame;
+	virtual->slice = frame % FRAMES_IN_FLIGHT;
+	virtual->loads.upload_count = 0;
+
+	retireSlots(virtual);
+	requestPages(virtual);
+	finishBinds(virtual);
+	takeLoads(virtual);
+
+	if (virtual->capacity == virtual->count) return;
+
+	while (virtual->slot.free_count + virtual->slot.retired_count < VIRTUAL_RESERVE)
+		if (!evictSlot(virtual)) break;
+}
+
+static void recordImageBarrier(const DeviceDispatch *vk, VkCommandBuffer command_buffer, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout) {
+	/* Records a transition of every level of image between sampling and
+	copying */
+	bool to_transfer = (new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = to_transfer ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = to_transfer ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT,
+		.oldLayout = old_layout,
+		.newLayout = new_layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = VK_REMAINING_MIP_LEVELS,
+			.layerCount = 1,
+		},
+	};
+
+	VkPipelineStageFlags src = to_transfer ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkPipelineStageFlags dst = to_transfer ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	vk->CmdPipelineBarrier(command_buffer, src, dst, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void recordBarrier(const DeviceDispatch *vk, VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = src_access,
+		.dstAccessMask = dst_access,
+	};
+
+	vk->CmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+static void recordPageCopies(VirtualTexture *virtual, VkCommandBuffer command_buffer) {
+	/* Records the copies of the frame's uploads, into their pages of the sparse
+	image or their slots of the atlas */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkBufferImageCopy copies[VIRTUAL_UPLOADS];
+
+	uint32_t i;
+	for (i = 0; i < virtual->loads.upload_count; i++) {
+		uint32_t page = virtual->loads.uploads[i].page;
+		PagePlace place = getPagePlace(virtual, page);
+
+		if (!virtual->sparse) {
+			uint32_t slot = virtual->page.slots[page];
+			place = (PagePlace) {0, slot % virtual->atlas, slot / virtual->atlas};
+		}
+
+		copies[i] = (VkBufferImageCopy) {
+			.bufferOffset = (VkDeviceSize) i * VIRTUAL_PAGE_BYTES,
+			.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, place.level, 0, 1},
+			.imageOffset = {place.x * VIRTUAL_PAGE_SIZE, place.y * VIRTUAL_PAGE_SIZE, 0},
+			.imageExtent = {VIRTUAL_PAGE_SIZE, VIRTUAL_PAGE_SIZE, 1},
+		};
+	}
+
+	VkBuffer staging = virtual->staging[virtual->slice].buffer;
+	vk->CmdCopyBufferToImage(command_buffer, staging, virtual->images.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, i, copies);
+}
+
+static void recordTableCopies(VirtualTexture *virtual, VkCommandBuffer command_buffer) {
+	/* Packs the dirty part of each level of the table into staging and records
+	its copy */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	uint8_t *staging = virtual->staging[virtual->slice].mapped;
+	VkDeviceSize offset = virtual->table_offset;
+
+	VkBufferImageCopy copies[MAX_VIRTUAL_LEVELS];
+	uint32_t count = 0;
+
+	uint32_t level;
+	for (level = 0; level < virtual->levels; level++) {
+		VirtualRect *dirty = &virtual->table.dirty[level];
+		if (dirty->x0 >= dirty->x1) continue;
+
+		uint32_t width = virtual->pages >> level, span = dirty->x1 - dirty->x0;
+
+		uint32_t y;
+		for (y = dirty->y0; y < dirty->y1; y++) {
+			memcpy(staging + offset + (size_t) (y - dirty->y0) * span * sizeof(uint32_t),
+				virtual->table.entries[level] + (size_t) y * width + dirty->x0, span * sizeof(uint32_t));
+		}
+
+		copies[count++] = (VkBufferImageCopy) {
+			.bufferOffset = offset,
+			.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1},
+			.imageOffset = {dirty->x0, dirty->y0, 0},
+			.imageExtent = {span, dirty->y1 - dirty->y0, 1},
+		};
+
+		offset += (VkDeviceSize) span * (dirty->y1 - dirty->y0) * sizeof(uint32_t);
+		*dirty = (VirtualRect) {};
+	}
+
+	if (!count) return;
+
+	VkBuffer buffer = virtual->staging[virtual->slice].buffer;
+	vk->CmdCopyBufferToImage(command_buffer, buffer, virtual->images.table, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, count, copies);
+}
+
+static bool isTableDirty(VirtualTexture *virtual) {
+	/* Returns true if any level of the table has changed */
+	uint32_t level;
+	for (level = 0; level < virtual->levels; level++)
+		if (virtual->table.dirty[level].x0 < virtual->table.dirty[level].x1) return true;
+
+	return false;
+}
+
+void RecordVirtualTexture(VirtualTexture *virtual, VkCommandBuffer command_buffer) {
+	/* Records the frame's uploads and table changes, then clears the feedback.
+	It's recorded outside of a pass and before the passes that sample */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkPipelineStageFlags fragment = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	VkPipelineStageFlags transfer = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkImageLayout transfer_dst = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	VkImageLayout shader_read = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	/* Evicted slots are overwritten once the previous frames' fragments are
+	done with them */
+	if (virtual->loads.upload_count) {
+		recordImageBarrier(vk, command_buffer, virtual->images.image, virtual->images.layout, transfer_dst);
+		recordPageCopies(virtual, command_buffer);
+		recordImageBarrier(vk, command_buffer, virtual->images.image, transfer_dst, shader_read);
+
+		virtual->images.layout = shader_read;
+	}
+
+	if (isTableDirty(virtual)) {
+		recordImageBarrier(vk, command_buffer, virtual->images.table, virtual->images.table_layout, transfer_dst);
+		recordTableCopies(virtual, command_buffer);
+		recordImageBarrier(vk, command_buffer, virtual->images.table, transfer_dst, shader_read);
+
+		virtual->images.table_layout = shader_read;
+	}
+
+	/* The previous frame's fragments and feedback copy are done with the
+	buffer before it's cleared */
+	recordBarrier(vk, command_buffer, fragment | transfer, 0, transfer, 0);
+
+	uint32_t header[] = {virtual->sparse, virtual->pages, virtual->levels, virtual->atlas, (uint32_t) virtual->frame, 0};
+
+	uint32_t i;
+	for (i = 0; i < sizeof(header) / sizeof(header[0]); i++)
+		vk->CmdFillBuffer(command_buffer, virtual->feedback.buffer, i * sizeof(uint32_t), sizeof(uint32_t), header[i]);
+
+	vk->CmdFillBuffer(command_buffer, virtual->feedback.buffer, sizeof(VirtualFeedback), VK_WHOLE_SIZE, 0);
+
+	VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	recordBarrier(vk, command_buffer, transfer, VK_ACCESS_TRANSFER_WRITE_BIT, fragment, access);
+}
+
+void RecordVirtualFeedback(VirtualTexture *virtual, VkCommandBuffer command_buffer) {
+	/* Records the copy of the frame's feedback to its readback, outside of a
+	pass and after the passes that sample. It's read when the slice comes round
+	again */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	VkPipelineStageFlags fragment = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	VkPipelineStageFlags transfer = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	recordBarrier(vk, command_buffer, fragment, VK_ACCESS_SHADER_WRITE_BIT, transfer, VK_ACCESS_TRANSFER_READ_BIT);
+
+	VkBufferCopy region = {
+		.srcOffset = FEEDBACK_OFFSET,
+		.size = FEEDBACK_SIZE,
+	};
+
+	vk->CmdCopyBuffer(command_buffer, virtual->feedback.buffer, virtual->readback[virtual->slice].buffer, 1, &region);
+	recordBarrier(vk, command_buffer, transfer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+	virtual->written[virtual->slice] = true;
+}
+
+void BindVirtualTexture(VirtualTexture *virtual, VkCommandBuffer command_buffer, VkPipelineLayout layout, uint32_t set) {
+	/* Binds the pages, table and feedback at set of a graphics pipeline layout
+	made with virtual->set_layout */
+	const DeviceDispatch *vk = virtual->device.dispatch.device;
+
+	vk->CmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &virtual->set, 0, NULL);
+}